@@ -201,15 +201,21 @@ SOURCES += \
     streaming/input/reltouch.cpp \
     streaming/session.cpp \
     streaming/audio/audio.cpp \
+    streaming/audio/audiopacketqueue.cpp \
+    streaming/audio/audioringbuffer.cpp \
+    streaming/audio/jitterbuffer.cpp \
+    streaming/audio/polyphaseresampler.cpp \
     streaming/audio/renderers/sdlaud.cpp \
     gui/computermodel.cpp \
     gui/appmodel.cpp \
     streaming/streamutils.cpp \
+    streaming/decoderprobecache.cpp \
     backend/autoupdatechecker.cpp \
     path.cpp \
     settings/mappingmanager.cpp \
     gui/sdlgamepadkeynavigation.cpp \
     streaming/video/overlaymanager.cpp \
+    streaming/video/glyphatlas.cpp \
     backend/systemproperties.cpp \
     wm.cpp
 
@@ -236,17 +242,25 @@ HEADERS += \
     settings/streamingpreferences.h \
     streaming/input/input.h \
     streaming/session.h \
+    streaming/audio/audiopacketqueue.h \
+    streaming/audio/audioringbuffer.h \
+    streaming/audio/jitterbuffer.h \
+    streaming/audio/polyphaseresampler.h \
     streaming/audio/renderers/renderer.h \
     streaming/audio/renderers/sdl.h \
     gui/computermodel.h \
     gui/appmodel.h \
     streaming/video/decoder.h \
+    streaming/video/latencyhistogram.h \
     streaming/streamutils.h \
+    streaming/decoderprobecache.h \
+    streaming/spscringpositions.h \
     backend/autoupdatechecker.h \
     path.h \
     settings/mappingmanager.h \
     gui/sdlgamepadkeynavigation.h \
     streaming/video/overlaymanager.h \
+    streaming/video/glyphatlas.h \
     backend/systemproperties.h
 
 # Platform-specific renderers and decoders
@@ -256,18 +270,29 @@ ffmpeg {
     DEFINES += HAVE_FFMPEG
     SOURCES += \
         streaming/video/ffmpeg.cpp \
+        streaming/video/framepool.cpp \
+        streaming/video/sliceworkerpool.cpp \
         streaming/video/ffmpeg-renderers/genhwaccel.cpp \
         streaming/video/ffmpeg-renderers/sdlvid.cpp \
         streaming/video/ffmpeg-renderers/swframemapper.cpp \
-        streaming/video/ffmpeg-renderers/pacer/pacer.cpp
+        streaming/video/ffmpeg-renderers/swframeuploader.cpp \
+        streaming/video/ffmpeg-renderers/pacer/pacer.cpp \
+        streaming/video/ffmpeg-renderers/pacer/framedroppolicy.cpp \
+        streaming/video/ffmpeg-renderers/pacer/softwarevsyncsource.cpp
 
     HEADERS += \
         streaming/video/ffmpeg.h \
+        streaming/video/framepool.h \
+        streaming/video/sliceworkerpool.h \
         streaming/video/ffmpeg-renderers/renderer.h \
         streaming/video/ffmpeg-renderers/genhwaccel.h \
         streaming/video/ffmpeg-renderers/sdlvid.h \
         streaming/video/ffmpeg-renderers/swframemapper.h \
-        streaming/video/ffmpeg-renderers/pacer/pacer.h
+        streaming/video/ffmpeg-renderers/swframeuploader.h \
+        streaming/video/ffmpeg-renderers/pacer/framering.h \
+        streaming/video/ffmpeg-renderers/pacer/pacer.h \
+        streaming/video/ffmpeg-renderers/pacer/framedroppolicy.h \
+        streaming/video/ffmpeg-renderers/pacer/softwarevsyncsource.h
 }
 libva {
     message(VAAPI renderer selected)
@@ -325,8 +350,12 @@ libdrm {
     message(DRM renderer selected)
 
     DEFINES += HAVE_DRM
-    SOURCES += streaming/video/ffmpeg-renderers/drm.cpp
-    HEADERS += streaming/video/ffmpeg-renderers/drm.h
+    SOURCES += \
+        streaming/video/ffmpeg-renderers/drm.cpp \
+        streaming/video/ffmpeg-renderers/pacer/drmvsyncsource.cpp
+    HEADERS += \
+        streaming/video/ffmpeg-renderers/drm.h \
+        streaming/video/ffmpeg-renderers/pacer/drmvsyncsource.h
 
     linux {
         message(Master hooks enabled)
@@ -6,6 +6,7 @@
 
 #include "streaming/session.h"
 #include "streaming/streamutils.h"
+#include "streaming/decoderprobecache.h"
 
 #ifdef Q_OS_WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -70,13 +71,27 @@ SystemProperties::SystemProperties()
 
     // Populate data that requires talking to SDL. We do it all in one shot
     // and cache the results to speed up future queries on this data.
+    m_RevalidationThread = nullptr;
+    m_NeedsDecoderInfoRevalidation = false;
     querySdlVideoInfo();
 
+    if (m_NeedsDecoderInfoRevalidation) {
+        startDecoderInfoRevalidation();
+    }
+
     Q_ASSERT(!monitorRefreshRates.isEmpty());
     Q_ASSERT(!monitorNativeResolutions.isEmpty());
     Q_ASSERT(!monitorSafeAreaResolutions.isEmpty());
 }
 
+SystemProperties::~SystemProperties()
+{
+    if (m_RevalidationThread != nullptr) {
+        m_RevalidationThread->wait();
+        delete m_RevalidationThread;
+    }
+}
+
 QRect SystemProperties::getNativeResolution(int displayIndex)
 {
     // Returns default constructed QRect if out of bounds
@@ -124,6 +139,26 @@ void SystemProperties::querySdlVideoInfo()
     }
 }
 
+static SDL_Window* createTestWindow()
+{
+    SDL_Window* testWindow = SDL_CreateWindow("", 0, 0, 1280, 720,
+                                              SDL_WINDOW_HIDDEN | StreamUtils::getPlatformWindowFlags());
+    if (!testWindow) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Failed to create test window with platform flags: %s",
+                    SDL_GetError());
+
+        testWindow = SDL_CreateWindow("", 0, 0, 1280, 720, SDL_WINDOW_HIDDEN);
+        if (!testWindow) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Failed to create window for hardware decode test: %s",
+                         SDL_GetError());
+        }
+    }
+
+    return testWindow;
+}
+
 void SystemProperties::querySdlVideoInfoInternal()
 {
     hasHardwareAcceleration = false;
@@ -139,21 +174,29 @@ void SystemProperties::querySdlVideoInfoInternal()
     // We call the internal variant because we're already in a safe thread context.
     refreshDisplaysInternal();
 
-    SDL_Window* testWindow = SDL_CreateWindow("", 0, 0, 1280, 720,
-                                              SDL_WINDOW_HIDDEN | StreamUtils::getPlatformWindowFlags());
-    if (!testWindow) {
-        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
-                    "Failed to create test window with platform flags: %s",
-                    SDL_GetError());
+    // Use the decoder info from a previous launch if it's still valid for this system.
+    // If it hasn't been checked in a while, we'll probe again in the background to
+    // make sure nothing has changed.
+    QMutexLocker probeLocker(DecoderProbeCache::getProbeLock());
+    DecoderProbeCache::DECODER_INFO cachedInfo;
+    if (DecoderProbeCache::getDecoderInfo(cachedInfo)) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Using cached decoder info");
+
+        hasHardwareAcceleration = cachedInfo.isHardwareAccelerated;
+        rendererAlwaysFullScreen = cachedInfo.isFullScreenOnly;
+        supportsHdr = cachedInfo.isHdrSupported;
+        maximumResolution = cachedInfo.maxResolution;
+        m_NeedsDecoderInfoRevalidation = DecoderProbeCache::isDecoderInfoRevalidationDue();
+
+        SDL_QuitSubSystem(SDL_INIT_VIDEO);
+        return;
+    }
 
-        testWindow = SDL_CreateWindow("", 0, 0, 1280, 720, SDL_WINDOW_HIDDEN);
-        if (!testWindow) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "Failed to create window for hardware decode test: %s",
-                         SDL_GetError());
-            SDL_QuitSubSystem(SDL_INIT_VIDEO);
-            return;
-        }
+    SDL_Window* testWindow = createTestWindow();
+    if (!testWindow) {
+        SDL_QuitSubSystem(SDL_INIT_VIDEO);
+        return;
     }
 
     Session::getDecoderInfo(testWindow, hasHardwareAcceleration, rendererAlwaysFullScreen, supportsHdr, maximumResolution);
@@ -163,6 +206,79 @@ void SystemProperties::querySdlVideoInfoInternal()
     SDL_QuitSubSystem(SDL_INIT_VIDEO);
 }
 
+class RevalidateDecoderInfoThread : public QThread
+{
+public:
+    RevalidateDecoderInfoThread(SystemProperties* me) :
+        QThread(nullptr),
+        m_Me(me) {}
+
+    void run() override
+    {
+        m_Me->revalidateDecoderInfoInternal();
+    }
+
+    SystemProperties* m_Me;
+};
+
+void SystemProperties::startDecoderInfoRevalidation()
+{
+#ifdef Q_OS_DARWIN
+    // Cocoa only allows us to create windows on the main thread, so we can't
+    // probe in the background. We do it now while we're still starting up,
+    // like querySdlVideoInfo(), rather than freezing the UI later.
+    revalidateDecoderInfoInternal();
+#else
+    // Probe on a separate thread, so the UI stays responsive while we create
+    // the test window, renderer, and decoder. This thread updates the cache
+    // itself under the probe lock. Sessions and refreshDisplays() wait for it.
+    m_RevalidationThread = new RevalidateDecoderInfoThread(this);
+    m_RevalidationThread->start();
+#endif
+}
+
+void SystemProperties::revalidateDecoderInfoInternal()
+{
+    QMutexLocker probeLocker(DecoderProbeCache::getProbeLock());
+
+    if (SDL_InitSubSystem(SDL_INIT_VIDEO) != 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_InitSubSystem(SDL_INIT_VIDEO) failed: %s",
+                     SDL_GetError());
+        return;
+    }
+
+    SDL_Window* testWindow = createTestWindow();
+    if (testWindow) {
+        DecoderProbeCache::DECODER_INFO info = {};
+
+        // This also updates the cached decoder info
+        Session::getDecoderInfo(testWindow, info.isHardwareAccelerated, info.isFullScreenOnly,
+                                info.isHdrSupported, info.maxResolution);
+
+        SDL_DestroyWindow(testWindow);
+
+        if (info.isHardwareAccelerated != hasHardwareAcceleration ||
+                info.isFullScreenOnly != rendererAlwaysFullScreen ||
+                info.isHdrSupported != supportsHdr ||
+                info.maxResolution != maximumResolution) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Cached decoder info was out of date. Changes will apply after restarting.");
+
+            // Results for individual stream configurations are likely stale too
+            DecoderProbeCache::invalidate();
+            if (info.isHardwareAccelerated) {
+                DecoderProbeCache::putDecoderInfo(info);
+            }
+        }
+        else {
+            DecoderProbeCache::markDecoderInfoRevalidated();
+        }
+    }
+
+    SDL_QuitSubSystem(SDL_INIT_VIDEO);
+}
+
 class RefreshDisplaysThread : public QThread
 {
 public:
@@ -180,6 +296,11 @@ public:
 
 void SystemProperties::refreshDisplays()
 {
+    // Don't initialize SDL while background revalidation is using it
+    if (m_RevalidationThread != nullptr) {
+        m_RevalidationThread->wait();
+    }
+
     if (WMUtils::isRunningX11() || WMUtils::isRunningWayland()) {
         // Use a separate thread to temporarily initialize SDL
         // video to avoid stomping on Qt's X11 and OGL state.
@@ -2,6 +2,7 @@
 
 #include <QObject>
 #include <QRect>
+#include <QThread>
 
 class SystemProperties : public QObject
 {
@@ -9,9 +10,11 @@ class SystemProperties : public QObject
 
     friend class QuerySdlVideoThread;
     friend class RefreshDisplaysThread;
+    friend class RevalidateDecoderInfoThread;
 
 public:
     SystemProperties();
+    ~SystemProperties() override;
 
     Q_PROPERTY(bool hasHardwareAcceleration MEMBER hasHardwareAcceleration CONSTANT)
     Q_PROPERTY(bool rendererAlwaysFullScreen MEMBER rendererAlwaysFullScreen CONSTANT)
@@ -40,6 +43,8 @@ private:
     void querySdlVideoInfo();
     void querySdlVideoInfoInternal();
     void refreshDisplaysInternal();
+    void startDecoderInfoRevalidation();
+    void revalidateDecoderInfoInternal();
 
     bool hasHardwareAcceleration;
     bool rendererAlwaysFullScreen;
@@ -58,5 +63,7 @@ private:
     QString versionString;
     bool supportsHdr;
     bool usesMaterial3Theme;
+    QThread* m_RevalidationThread;
+    bool m_NeedsDecoderInfoRevalidation;
 };
 
@@ -321,6 +321,11 @@ StreamCommandLineParser::StreamCommandLineParser()
         {"fullscreen", StreamingPreferences::CSK_FULLSCREEN},
         {"always",     StreamingPreferences::CSK_ALWAYS},
     };
+    m_FrameDropPolicyMap = {
+        {"balanced",       StreamingPreferences::FDP_BALANCED},
+        {"lowest-latency", StreamingPreferences::FDP_LOWEST_LATENCY},
+        {"smoothest",      StreamingPreferences::FDP_SMOOTHEST},
+    };
 }
 
 StreamCommandLineParser::~StreamCommandLineParser()
@@ -360,6 +365,7 @@ void StreamCommandLineParser::parse(const QStringList &args, StreamingPreference
     parser.addToggleOption("game-optimization", "game optimizations");
     parser.addToggleOption("audio-on-host", "audio on host PC");
     parser.addToggleOption("frame-pacing", "frame pacing");
+    parser.addChoiceOption("frame-drop-policy", "frame drop policy", m_FrameDropPolicyMap.keys());
     parser.addToggleOption("mute-on-focus-loss", "mute audio when Moonlight window loses focus");
     parser.addToggleOption("background-gamepad", "background gamepad input");
     parser.addToggleOption("reverse-scroll-direction", "inverted scroll direction");
@@ -467,6 +473,11 @@ void StreamCommandLineParser::parse(const QStringList &args, StreamingPreference
     // Resolve --frame-pacing and --no-frame-pacing options
     preferences->framePacing = parser.getToggleOptionValue("frame-pacing", preferences->framePacing);
 
+    // Resolve --frame-drop-policy option
+    if (parser.isSet("frame-drop-policy")) {
+        preferences->frameDropPolicy = mapValue(m_FrameDropPolicyMap, parser.getChoiceOptionValue("frame-drop-policy"));
+    }
+
     // Resolve --mute-on-focus-loss and --no-mute-on-focus-loss options
     preferences->muteOnFocusLoss = parser.getToggleOptionValue("mute-on-focus-loss", preferences->muteOnFocusLoss);
 
@@ -845,6 +845,58 @@ Flickable {
                     ToolTip.visible: hovered
                     ToolTip.text: qsTr("Frame pacing reduces micro-stutter by delaying frames that come in too early")
                 }
+
+                Label {
+                    width: parent.width
+                    id: frameDropPolicyTitle
+                    text: qsTr("Frame drop policy")
+                    font.pointSize: 12
+                    wrapMode: Text.Wrap
+                }
+
+                AutoResizingComboBox {
+                    // ignore setting the index at first, and actually set it when the component is loaded
+                    Component.onCompleted: {
+                        var saved_fdp = StreamingPreferences.frameDropPolicy
+                        currentIndex = 0
+                        for (var i = 0; i < frameDropPolicyListModel.count; i++) {
+                            var el_fdp = frameDropPolicyListModel.get(i).val;
+                            if (saved_fdp === el_fdp) {
+                                currentIndex = i
+                                break
+                            }
+                        }
+                        activated(currentIndex)
+                    }
+
+                    id: frameDropPolicyComboBox
+                    hoverEnabled: true
+                    textRole: "text"
+                    model: ListModel {
+                        id: frameDropPolicyListModel
+                        ListElement {
+                            text: qsTr("Balanced (Recommended)")
+                            val: StreamingPreferences.FDP_BALANCED
+                        }
+                        ListElement {
+                            text: qsTr("Lowest latency")
+                            val: StreamingPreferences.FDP_LOWEST_LATENCY
+                        }
+                        ListElement {
+                            text: qsTr("Smoothest video")
+                            val: StreamingPreferences.FDP_SMOOTHEST
+                        }
+                    }
+                    // ::onActivated must be used, as it only listens for when the index is changed by a human
+                    onActivated: {
+                        StreamingPreferences.frameDropPolicy = frameDropPolicyListModel.get(currentIndex).val
+                    }
+
+                    ToolTip.delay: 1000
+                    ToolTip.timeout: 5000
+                    ToolTip.visible: hovered
+                    ToolTip.text: qsTr("Lowest latency always shows the newest frame and drops any that queue up. Smoothest video shows every frame it can, even if they queue up behind the display.")
+                }
             }
         }
 
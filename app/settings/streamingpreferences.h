@@ -108,6 +108,14 @@ public:
     };
     Q_ENUM(CaptureSysKeysMode);
 
+    enum FrameDropPolicy
+    {
+        FDP_BALANCED,
+        FDP_LOWEST_LATENCY,
+        FDP_SMOOTHEST,
+    };
+    Q_ENUM(FrameDropPolicy);
+
     Q_PROPERTY(int width MEMBER width NOTIFY displayModeChanged)
     Q_PROPERTY(int height MEMBER height NOTIFY displayModeChanged)
     Q_PROPERTY(int fps MEMBER fps NOTIFY displayModeChanged)
@@ -123,6 +131,7 @@ public:
     Q_PROPERTY(bool absoluteMouseMode MEMBER absoluteMouseMode NOTIFY absoluteMouseModeChanged)
     Q_PROPERTY(bool absoluteTouchMode MEMBER absoluteTouchMode NOTIFY absoluteTouchModeChanged)
     Q_PROPERTY(bool framePacing MEMBER framePacing NOTIFY framePacingChanged)
+    Q_PROPERTY(FrameDropPolicy frameDropPolicy MEMBER frameDropPolicy NOTIFY frameDropPolicyChanged)
     Q_PROPERTY(bool connectionWarnings MEMBER connectionWarnings NOTIFY connectionWarningsChanged)
     Q_PROPERTY(bool configurationWarnings MEMBER configurationWarnings NOTIFY configurationWarningsChanged)
     Q_PROPERTY(bool richPresence MEMBER richPresence NOTIFY richPresenceChanged)
@@ -189,6 +198,7 @@ public:
     UIDisplayMode uiDisplayMode;
     Language language;
     CaptureSysKeysMode captureSysKeysMode;
+    FrameDropPolicy frameDropPolicy;
 
 signals:
     void displayModeChanged();
@@ -212,6 +222,7 @@ signals:
     void uiDisplayModeChanged();
     void windowModeChanged();
     void framePacingChanged();
+    void frameDropPolicyChanged();
     void connectionWarningsChanged();
     void configurationWarningsChanged();
     void richPresenceChanged();
@@ -10,9 +10,16 @@
 #endif
 
 #include "renderers/sdl.h"
+#include "streaming/streamutils.h"
 
 #include <Limelight.h>
 
+// Concealing more than this would just add latency for the jitter buffer
+// to work off, and PLC fades to silence over longer gaps anyway.
+#define MAX_CONCEALED_AUDIO_PACKETS 4
+
+#define AUDIO_REINIT_INTERVAL_MS 1000
+
 #define TRY_INIT_RENDERER(renderer, opusConfig)        \
 {                                                      \
     IAudioRenderer* __renderer = new renderer();       \
@@ -64,36 +71,37 @@ IAudioRenderer* Session::createAudioRenderer(const POPUS_MULTISTREAM_CONFIGURATI
     return nullptr;
 }
 
-bool Session::initializeAudioRenderer()
+bool Session::initializeAudioRenderer(IAudioRenderer*& renderer, OpusMSDecoder*& decoder,
+                                      OPUS_MULTISTREAM_CONFIGURATION& activeConfig)
 {
     int error;
 
     SDL_assert(m_OriginalAudioConfig.channelCount > 0);
-    SDL_assert(m_AudioRenderer == nullptr);
-    SDL_assert(m_OpusDecoder == nullptr);
+    SDL_assert(renderer == nullptr);
+    SDL_assert(decoder == nullptr);
 
-    m_AudioRenderer = createAudioRenderer(&m_OriginalAudioConfig);
+    renderer = createAudioRenderer(&m_OriginalAudioConfig);
 
     // We may be unable to create an audio renderer right now
-    if (m_AudioRenderer == nullptr) {
+    if (renderer == nullptr) {
         return false;
     }
 
     // Allow the chosen renderer to remap Opus channels as needed to ensure proper output
-    m_ActiveAudioConfig = m_OriginalAudioConfig;
-    m_AudioRenderer->remapChannels(&m_ActiveAudioConfig);
+    activeConfig = m_OriginalAudioConfig;
+    renderer->remapChannels(&activeConfig);
 
     // Create the Opus decoder with the renderer's preferred channel mapping
-    m_OpusDecoder =
-        opus_multistream_decoder_create(m_ActiveAudioConfig.sampleRate,
-                                        m_ActiveAudioConfig.channelCount,
-                                        m_ActiveAudioConfig.streams,
-                                        m_ActiveAudioConfig.coupledStreams,
-                                        m_ActiveAudioConfig.mapping,
+    decoder =
+        opus_multistream_decoder_create(activeConfig.sampleRate,
+                                        activeConfig.channelCount,
+                                        activeConfig.streams,
+                                        activeConfig.coupledStreams,
+                                        activeConfig.mapping,
                                         &error);
-    if (m_OpusDecoder == nullptr) {
-        delete m_AudioRenderer;
-        m_AudioRenderer = nullptr;
+    if (decoder == nullptr) {
+        delete renderer;
+        renderer = nullptr;
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                      "Failed to create decoder: %d",
                      error);
@@ -102,7 +110,7 @@ bool Session::initializeAudioRenderer()
 
     SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                 "Audio stream has %d channels",
-                m_ActiveAudioConfig.channelCount);
+                activeConfig.channelCount);
     return true;
 }
 
@@ -151,12 +159,74 @@ int Session::arInit(int /* audioConfiguration */,
                     void* /* arContext */, int /* arFlags */)
 {
     SDL_memcpy(&s_ActiveSession->m_OriginalAudioConfig, opusConfig, sizeof(*opusConfig));
-    s_ActiveSession->initializeAudioRenderer();
+
+    SDL_zero(s_ActiveSession->m_ActiveWndAudioStats);
+    SDL_zero(s_ActiveSession->m_LastWndAudioStats);
+    SDL_zero(s_ActiveSession->m_GlobalAudioStats);
+    SDL_zero(s_ActiveSession->m_LastJitterStats);
+    SDL_AtomicLock(&s_ActiveSession->m_OverlayAudioStatsLock);
+    SDL_zero(s_ActiveSession->m_OverlayAudioStats);
+    SDL_AtomicUnlock(&s_ActiveSession->m_OverlayAudioStatsLock);
+
+    // If this fails, the decode thread will keep trying in the background
+    s_ActiveSession->initializeAudioRenderer(s_ActiveSession->m_AudioRenderer,
+                                             s_ActiveSession->m_OpusDecoder,
+                                             s_ActiveSession->m_ActiveAudioConfig);
+    s_ActiveSession->m_NextAudioReinitTime = SDL_GetTicks() + AUDIO_REINIT_INTERVAL_MS;
+
+    s_ActiveSession->m_AudioPacketQueue.reset();
+    SDL_AtomicSet(&s_ActiveSession->m_AudioDecodeThreadStopping, 0);
+    s_ActiveSession->m_AudioPacketSemaphore = SDL_CreateSemaphore(0);
+    if (s_ActiveSession->m_AudioPacketSemaphore != nullptr) {
+        s_ActiveSession->m_AudioDecodeThread = SDL_CreateThread(Session::audioDecodeThreadProc,
+                                                                "AudioDecode",
+                                                                s_ActiveSession);
+    }
+    if (s_ActiveSession->m_AudioDecodeThread == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create audio decode thread: %s",
+                     SDL_GetError());
+        arCleanup();
+        return -1;
+    }
+
     return 0;
 }
 
 void Session::arCleanup()
 {
+    // Stop the decode thread first, since it uses everything below
+    if (s_ActiveSession->m_AudioDecodeThread != nullptr) {
+        SDL_AtomicSet(&s_ActiveSession->m_AudioDecodeThreadStopping, 1);
+        SDL_SemPost(s_ActiveSession->m_AudioPacketSemaphore);
+        SDL_WaitThread(s_ActiveSession->m_AudioDecodeThread, nullptr);
+        s_ActiveSession->m_AudioDecodeThread = nullptr;
+    }
+
+    if (s_ActiveSession->m_AudioPacketSemaphore != nullptr) {
+        SDL_DestroySemaphore(s_ActiveSession->m_AudioPacketSemaphore);
+        s_ActiveSession->m_AudioPacketSemaphore = nullptr;
+    }
+
+    // Wait for any reinitialization in progress, then throw away its result
+    if (s_ActiveSession->m_AudioReinitThread != nullptr) {
+        SDL_WaitThread(s_ActiveSession->m_AudioReinitThread, nullptr);
+        s_ActiveSession->m_AudioReinitThread = nullptr;
+
+        delete s_ActiveSession->m_PendingAudioRenderer;
+        s_ActiveSession->m_PendingAudioRenderer = nullptr;
+
+        opus_multistream_decoder_destroy(s_ActiveSession->m_PendingOpusDecoder);
+        s_ActiveSession->m_PendingOpusDecoder = nullptr;
+    }
+
+    // Include whatever is left of the last window
+    if (s_ActiveSession->m_ActiveWndAudioStats.measurementStartTimestamp != 0) {
+        s_ActiveSession->addAudioStats(s_ActiveSession->m_ActiveWndAudioStats,
+                                       s_ActiveSession->m_GlobalAudioStats);
+        s_ActiveSession->logAudioStats(s_ActiveSession->m_GlobalAudioStats, "Global audio stats");
+    }
+
     delete s_ActiveSession->m_AudioRenderer;
     s_ActiveSession->m_AudioRenderer = nullptr;
 
@@ -164,109 +234,432 @@ void Session::arCleanup()
     s_ActiveSession->m_OpusDecoder = nullptr;
 }
 
-void Session::arDecodeAndPlaySample(char* sampleData, int sampleLength)
+bool Session::decodeAndSubmitAudio(const unsigned char* sampleData, int sampleLength, bool concealment)
 {
     int samplesDecoded;
+    int sampleSize = m_AudioRenderer->getAudioBufferSampleSize();
+    int frameSize = sampleSize * m_ActiveAudioConfig.channelCount;
+    int desiredBufferSize = frameSize * m_ActiveAudioConfig.samplesPerFrame;
+    void* buffer = m_AudioRenderer->getAudioBuffer(&desiredBufferSize);
+    if (buffer == nullptr) {
+        return true;
+    }
 
-#ifndef STEAM_LINK
-    // Set this thread to high priority to reduce the chance of missing
-    // our sample delivery time. On Steam Link, this causes starvation
-    // of other threads due to severely restricted CPU time available,
-    // so we will skip it on that platform.
-    if (s_ActiveSession->m_AudioSampleCount == 0) {
-        if (SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH) < 0) {
-            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
-                        "Unable to set audio thread to high priority: %s",
-                        SDL_GetError());
+    // Opus must be asked for exactly the duration of a lost packet when
+    // concealing it, rather than however much our buffer can hold.
+    int maxFrames = concealment ? m_ActiveAudioConfig.samplesPerFrame : desiredBufferSize / frameSize;
+
+    uint64_t decodeStartTimeUs = StreamUtils::getMonotonicTimeUs();
+    if (m_AudioRenderer->getAudioBufferFormat() == IAudioRenderer::AudioFormat::Float32NE) {
+        samplesDecoded = opus_multistream_decode_float(m_OpusDecoder,
+                                                       sampleData,
+                                                       sampleLength,
+                                                       (float*)buffer,
+                                                       maxFrames,
+                                                       (concealment && sampleData != nullptr) ? 1 : 0);
+    }
+    else {
+        samplesDecoded = opus_multistream_decode(m_OpusDecoder,
+                                                 sampleData,
+                                                 sampleLength,
+                                                 (short*)buffer,
+                                                 maxFrames,
+                                                 (concealment && sampleData != nullptr) ? 1 : 0);
+    }
+
+    uint64_t decodeTimeUs = StreamUtils::getMonotonicTimeUs() - decodeStartTimeUs;
+    m_ActiveWndAudioStats.totalDecodeTimeUs += decodeTimeUs;
+    m_ActiveWndAudioStats.decodeLatency.record(decodeTimeUs);
+
+    // Update desiredSize with the number of bytes actually populated by the decoding operation
+    if (samplesDecoded > 0) {
+        SDL_assert(desiredBufferSize >= frameSize * samplesDecoded);
+        desiredBufferSize = frameSize * samplesDecoded;
+
+        if (!concealment) {
+            m_ActiveWndAudioStats.decodedPackets++;
         }
     }
-#endif
+    else {
+        desiredBufferSize = 0;
+    }
 
-    // See if we need to drop this sample
-    if (s_ActiveSession->m_DropAudioEndTime != 0) {
-        if (SDL_TICKS_PASSED(SDL_GetTicks(), s_ActiveSession->m_DropAudioEndTime)) {
-            // Avoid calling SDL_GetTicks() now
-            s_ActiveSession->m_DropAudioEndTime = 0;
+    return m_AudioRenderer->submitAudio(desiredBufferSize);
+}
 
-            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
-                        "Audio drop window has ended");
+bool Session::concealLostAudio(const unsigned char* nextSampleData, int nextSampleLength)
+{
+    // Only SILK and hybrid packets can carry in-band FEC for the previous
+    // packet. Opus falls back to PLC for CELT-only packets, so we don't
+    // bother passing them in and count those as PLC instead.
+    bool nextHasFec = nextSampleLength > 0 && (nextSampleData[0] >> 3) < 16;
+
+    while (m_AudioLostPackets > 0) {
+        bool useFec = nextHasFec && m_AudioLostPackets == 1;
+
+        // Earlier losses can only be extrapolated with PLC, but the last one
+        // can be rebuilt from the redundant data in the packet after it.
+        if (!decodeAndSubmitAudio(useFec ? nextSampleData : nullptr,
+                                  useFec ? nextSampleLength : 0,
+                                  true)) {
+            m_AudioLostPackets = 0;
+            return false;
+        }
+
+        if (useFec) {
+            m_ActiveWndAudioStats.fecPackets++;
         }
         else {
-            // We're still in the drop window
-            return;
+            m_ActiveWndAudioStats.plcPackets++;
         }
+        m_AudioLostPackets--;
     }
 
-    s_ActiveSession->m_AudioSampleCount++;
+    return true;
+}
 
-    // If audio is muted, don't decode or play the audio
-    if (s_ActiveSession->m_AudioMuted) {
-        return;
+void Session::arDecodeAndPlaySample(char* sampleData, int sampleLength)
+{
+    // Decoding and playback happen on our audio decode thread, so nothing
+    // there (like recreating the audio device) can hold up packet intake.
+    // If that thread has fallen far enough behind to fill the queue, the
+    // packet is dropped and counted in the audio stats.
+    if (s_ActiveSession->m_AudioPacketQueue.push(sampleData, sampleLength)) {
+        SDL_SemPost(s_ActiveSession->m_AudioPacketSemaphore);
     }
+}
 
-    if (s_ActiveSession->m_AudioRenderer != nullptr) {
-        int sampleSize = s_ActiveSession->m_AudioRenderer->getAudioBufferSampleSize();
-        int frameSize = sampleSize * s_ActiveSession->m_ActiveAudioConfig.channelCount;
-        int desiredBufferSize = frameSize * s_ActiveSession->m_ActiveAudioConfig.samplesPerFrame;
-        void* buffer = s_ActiveSession->m_AudioRenderer->getAudioBuffer(&desiredBufferSize);
-        if (buffer == nullptr) {
+int Session::audioDecodeThreadProc(void* context)
+{
+    Session* me = reinterpret_cast<Session*>(context);
+
+#ifndef STEAM_LINK
+    // Run at the same priority as the audio device threads to reduce
+    // the chance of missing our sample delivery time. On Steam Link,
+    // this causes starvation of other threads due to severely restricted
+    // CPU time available, so we will skip it on that platform.
+    if (SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL) < 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Unable to set audio decode thread to time critical priority: %s",
+                    SDL_GetError());
+    }
+#endif
+
+    // Each packet in the queue has posted the semaphore once
+    for (;;) {
+        SDL_SemWait(me->m_AudioPacketSemaphore);
+        if (SDL_AtomicGet(&me->m_AudioDecodeThreadStopping)) {
+            break;
+        }
+
+        const unsigned char* sampleData;
+        int sampleLength;
+        if (me->m_AudioPacketQueue.front(&sampleData, &sampleLength)) {
+            me->decodeAudioPacket(sampleData, sampleLength);
+            me->m_AudioPacketQueue.pop();
+        }
+    }
+
+    return 0;
+}
+
+int Session::audioReinitThreadProc(void* context)
+{
+    Session* me = reinterpret_cast<Session*>(context);
+    Uint32 audioReinitStartTime = SDL_GetTicks();
+
+    if (me->initializeAudioRenderer(me->m_PendingAudioRenderer,
+                                    me->m_PendingOpusDecoder,
+                                    me->m_PendingAudioConfig)) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Audio reinitialization took %d ms",
+                    SDL_GetTicks() - audioReinitStartTime);
+    }
+
+    SDL_AtomicSet(&me->m_AudioReinitComplete, 1);
+    return 0;
+}
+
+void Session::reinitializeAudioRendererAsync()
+{
+    SDL_assert(m_AudioRenderer == nullptr);
+
+    if (m_AudioReinitThread != nullptr) {
+        if (!SDL_AtomicGet(&m_AudioReinitComplete)) {
+            // Still working on it. Until it's done, packets are dropped
+            // as they arrive, so we can't fall behind real-time playback.
             return;
         }
 
-        if (s_ActiveSession->m_AudioRenderer->getAudioBufferFormat() == IAudioRenderer::AudioFormat::Float32NE) {
-            samplesDecoded = opus_multistream_decode_float(s_ActiveSession->m_OpusDecoder,
-                                                           (unsigned char*)sampleData,
-                                                           sampleLength,
-                                                           (float*)buffer,
-                                                           desiredBufferSize / frameSize,
-                                                           0);
+        SDL_WaitThread(m_AudioReinitThread, nullptr);
+        m_AudioReinitThread = nullptr;
+
+        if (m_PendingAudioRenderer != nullptr) {
+            m_AudioRenderer = m_PendingAudioRenderer;
+            m_OpusDecoder = m_PendingOpusDecoder;
+            m_ActiveAudioConfig = m_PendingAudioConfig;
+            m_PendingAudioRenderer = nullptr;
+            m_PendingOpusDecoder = nullptr;
+
+            // The new renderer's counters start from zero
+            SDL_zero(m_LastJitterStats);
         }
         else {
-            samplesDecoded = opus_multistream_decode(s_ActiveSession->m_OpusDecoder,
-                                                     (unsigned char*)sampleData,
-                                                     sampleLength,
-                                                     (short*)buffer,
-                                                     desiredBufferSize / frameSize,
-                                                     0);
+            // Only try to recreate the audio renderer every second to
+            // avoid thrashing if the audio device is unavailable.
+            m_NextAudioReinitTime = SDL_GetTicks() + AUDIO_REINIT_INTERVAL_MS;
         }
+    }
+    else if (SDL_TICKS_PASSED(SDL_GetTicks(), m_NextAudioReinitTime)) {
+        SDL_AtomicSet(&m_AudioReinitComplete, 0);
+        m_AudioReinitThread = SDL_CreateThread(Session::audioReinitThreadProc, "AudioReinit", this);
+        if (m_AudioReinitThread == nullptr) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Unable to create audio reinitialization thread: %s",
+                        SDL_GetError());
+            m_NextAudioReinitTime = SDL_GetTicks() + AUDIO_REINIT_INTERVAL_MS;
+        }
+    }
+}
+
+void Session::decodeAudioPacket(const unsigned char* sampleData, int sampleLength)
+{
+    updateAudioStats();
+
+    if (sampleData != nullptr) {
+        m_ActiveWndAudioStats.receivedPackets++;
+    }
+    else {
+        m_ActiveWndAudioStats.lostPackets++;
+    }
 
-        // Update desiredSize with the number of bytes actually populated by the decoding operation
-        if (samplesDecoded > 0) {
-            SDL_assert(desiredBufferSize >= frameSize * samplesDecoded);
-            desiredBufferSize = frameSize * samplesDecoded;
+    if (m_AudioRenderer == nullptr) {
+        reinitializeAudioRendererAsync();
+    }
+
+    // If audio is muted, don't decode or play the audio
+    if (m_AudioMuted) {
+        m_AudioLostPackets = 0;
+        return;
+    }
+
+    if (m_AudioRenderer == nullptr) {
+        // There's nothing to conceal the loss for
+        m_AudioLostPackets = 0;
+        if (sampleData != nullptr) {
+            m_ActiveWndAudioStats.droppedPackets++;
         }
-        else {
-            desiredBufferSize = 0;
+    }
+    else if (sampleData == nullptr) {
+        // The connection tells us about lost packets by passing no data. We hold
+        // off on concealing them until the next packet arrives, since it may
+        // contain FEC data that lets us recover the lost audio.
+        if (m_AudioLostPackets < MAX_CONCEALED_AUDIO_PACKETS) {
+            m_AudioLostPackets++;
         }
+    }
+    else if (!concealLostAudio(sampleData, sampleLength) ||
+             !decodeAndSubmitAudio(sampleData, sampleLength, false)) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Reinitializing audio renderer after failure");
 
-        if (!s_ActiveSession->m_AudioRenderer->submitAudio(desiredBufferSize)) {
-            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
-                        "Reinitializing audio renderer after failure");
+        opus_multistream_decoder_destroy(m_OpusDecoder);
+        m_OpusDecoder = nullptr;
+
+        delete m_AudioRenderer;
+        m_AudioRenderer = nullptr;
+
+        // Start recreating it right away, since a new default device
+        // may already be waiting for us if the old one was removed.
+        m_NextAudioReinitTime = SDL_GetTicks();
+        reinitializeAudioRendererAsync();
+    }
+}
+
+void Session::updateAudioStats()
+{
+    Uint32 now = SDL_GetTicks();
+
+    if (m_ActiveWndAudioStats.measurementStartTimestamp == 0) {
+        m_ActiveWndAudioStats.measurementStartTimestamp = now;
+        return;
+    }
+
+    // Flip stats windows roughly every second, like the video stats
+    if (!SDL_TICKS_PASSED(now, m_ActiveWndAudioStats.measurementStartTimestamp + 1000)) {
+        return;
+    }
+
+    // Packets that didn't fit in our queue never made it to this thread
+    int queueDroppedPackets = m_AudioPacketQueue.takeDroppedPackets();
+    m_ActiveWndAudioStats.receivedPackets += queueDroppedPackets;
+    m_ActiveWndAudioStats.queueDroppedPackets += queueDroppedPackets;
+
+    // Sample the renderer's queue and turn its running counters into
+    // per-window counts. They're smoothed already, so once per window is enough.
+    float queuedLatencyMs;
+    AUDIO_JITTER_STATS jitterStats;
+    if (m_AudioRenderer != nullptr && m_AudioRenderer->getJitterStats(&jitterStats)) {
+        m_ActiveWndAudioStats.underruns += jitterStats.underruns - m_LastJitterStats.underruns;
+        m_ActiveWndAudioStats.overflowDroppedPackets += jitterStats.overflowDrops - m_LastJitterStats.overflowDrops;
+        m_ActiveWndAudioStats.totalQueueLatencyMs += jitterStats.queueLatencyMs;
+        m_ActiveWndAudioStats.totalTargetLatencyMs += jitterStats.targetLatencyMs;
+        m_ActiveWndAudioStats.queueLatencySamples++;
+        m_LastJitterStats = jitterStats;
+
+        // This already includes audio waiting to be decoded
+        queuedLatencyMs = jitterStats.queueLatencyMs;
+    }
+    else {
+        queuedLatencyMs = LiGetPendingAudioDuration();
+    }
+
+    uint32_t rtt, rttVariance;
+    if (LiGetEstimatedRttInfo(&rtt, &rttVariance)) {
+        queuedLatencyMs += rtt / 2.0f;
+    }
+    m_ActiveWndAudioStats.totalEstimatedLatencyMs += queuedLatencyMs;
+    m_ActiveWndAudioStats.latencySamples++;
 
-            opus_multistream_decoder_destroy(s_ActiveSession->m_OpusDecoder);
-            s_ActiveSession->m_OpusDecoder = nullptr;
+    if (getOverlayManager().isOverlayEnabled(Overlay::OverlayDebug)) {
+        AUDIO_STATS lastTwoWndStats = {};
+        addAudioStats(m_LastWndAudioStats, lastTwoWndStats);
+        addAudioStats(m_ActiveWndAudioStats, lastTwoWndStats);
 
-            delete s_ActiveSession->m_AudioRenderer;
-            s_ActiveSession->m_AudioRenderer = nullptr;
+        SDL_AtomicLock(&m_OverlayAudioStatsLock);
+        m_OverlayAudioStats = lastTwoWndStats;
+        SDL_AtomicUnlock(&m_OverlayAudioStatsLock);
+    }
+
+    // Accumulate these values into the global stats
+    addAudioStats(m_ActiveWndAudioStats, m_GlobalAudioStats);
+
+    // Move this window into the last window slot and clear it for next window
+    m_LastWndAudioStats = m_ActiveWndAudioStats;
+    SDL_zero(m_ActiveWndAudioStats);
+    m_ActiveWndAudioStats.measurementStartTimestamp = now;
+}
+
+void Session::addAudioStats(AUDIO_STATS& src, AUDIO_STATS& dst)
+{
+    dst.receivedPackets += src.receivedPackets;
+    dst.lostPackets += src.lostPackets;
+    dst.decodedPackets += src.decodedPackets;
+    dst.plcPackets += src.plcPackets;
+    dst.fecPackets += src.fecPackets;
+    dst.droppedPackets += src.droppedPackets;
+    dst.queueDroppedPackets += src.queueDroppedPackets;
+    dst.overflowDroppedPackets += src.overflowDroppedPackets;
+    dst.underruns += src.underruns;
+    dst.totalDecodeTimeUs += src.totalDecodeTimeUs;
+    dst.latencySamples += src.latencySamples;
+    dst.queueLatencySamples += src.queueLatencySamples;
+    dst.totalQueueLatencyMs += src.totalQueueLatencyMs;
+    dst.totalTargetLatencyMs += src.totalTargetLatencyMs;
+    dst.totalEstimatedLatencyMs += src.totalEstimatedLatencyMs;
+
+    dst.decodeLatency.add(src.decodeLatency);
+
+    // Initialize the measurement start point if this is the first audio stat window
+    if (!dst.measurementStartTimestamp) {
+        dst.measurementStartTimestamp = src.measurementStartTimestamp;
+    }
+}
+
+void Session::stringifyAudioStats(AUDIO_STATS& stats, char* output, int length)
+{
+    int offset = 0;
+    int ret;
+
+    // Start with an empty string
+    output[offset] = 0;
+
+    if (stats.receivedPackets == 0 && stats.lostPackets == 0) {
+        return;
+    }
+
+    ret = snprintf(&output[offset],
+                   length - offset,
+                   "Audio packets lost by your network connection: %.2f%%\n"
+                   "Lost audio packets concealed/recovered by FEC: %u/%u\n"
+                   "Audio packets dropped (playback unavailable/decode queue full/jitter buffer full): %u/%u/%u\n",
+                   (float)stats.lostPackets / (stats.receivedPackets + stats.lostPackets) * 100,
+                   stats.plcPackets,
+                   stats.fecPackets,
+                   stats.droppedPackets,
+                   stats.queueDroppedPackets,
+                   stats.overflowDroppedPackets);
+    if (ret < 0 || ret >= length - offset) {
+        SDL_assert(false);
+        return;
+    }
+
+    offset += ret;
+
+    if (stats.decodeLatency.count != 0) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Average audio decoding time: %.2f ms (p99: %.2f ms)\n",
+                       (double)stats.totalDecodeTimeUs / 1000.0 / stats.decodeLatency.count,
+                       stats.decodeLatency.getPercentile(99) / 1000.0f);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
         }
+
+        offset += ret;
     }
 
-    // Only try to recreate the audio renderer every 200 samples (1 second)
-    // to avoid thrashing if the audio device is unavailable. It is
-    // safe to reinitialize here because we can't be torn down while
-    // the audio decoder/playback thread is still alive.
-    if (s_ActiveSession->m_AudioRenderer == nullptr && (s_ActiveSession->m_AudioSampleCount % 200) == 0) {
-        // Since we're doing this inline and audio initialization takes time, we need
-        // to drop samples to account for the time we've spent blocking audio rendering
-        // so we return to real-time playback and don't accumulate latency.
-        Uint32 audioReinitStartTime = SDL_GetTicks();
-        if (s_ActiveSession->initializeAudioRenderer()) {
-            Uint32 audioReinitStopTime = SDL_GetTicks();
-
-            s_ActiveSession->m_DropAudioEndTime = audioReinitStopTime + (audioReinitStopTime - audioReinitStartTime);
-            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
-                        "Audio reinitialization took %d ms - starting drop window",
-                        audioReinitStopTime - audioReinitStartTime);
+    if (stats.queueLatencySamples != 0) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Average audio queue latency: %.1f ms (target: %.1f ms, %u underruns)\n",
+                       stats.totalQueueLatencyMs / stats.queueLatencySamples,
+                       stats.totalTargetLatencyMs / stats.queueLatencySamples,
+                       stats.underruns);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
         }
+
+        offset += ret;
+    }
+
+    if (stats.latencySamples != 0) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Estimated audio latency: %.1f ms\n",
+                       stats.totalEstimatedLatencyMs / stats.latencySamples);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+    }
+}
+
+void Session::stringifyOverlayAudioStats(char* output, int length)
+{
+    AUDIO_STATS stats;
+
+    SDL_AtomicLock(&m_OverlayAudioStatsLock);
+    stats = m_OverlayAudioStats;
+    SDL_AtomicUnlock(&m_OverlayAudioStatsLock);
+
+    stringifyAudioStats(stats, output, length);
+}
+
+void Session::logAudioStats(AUDIO_STATS& stats, const char* title)
+{
+    if (stats.receivedPackets != 0 || stats.lostPackets != 0) {
+        char audioStatsStr[1024];
+        stringifyAudioStats(stats, audioStatsStr, sizeof(audioStatsStr));
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "%s", title);
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "----------------------------------------------------------\n%s",
+                    audioStatsStr);
     }
 }
@@ -0,0 +1,72 @@
+#include "audiopacketqueue.h"
+
+AudioPacketQueue::AudioPacketQueue()
+{
+    reset();
+}
+
+void AudioPacketQueue::reset()
+{
+    m_Positions.reset();
+    SDL_AtomicSet(&m_DroppedPackets, 0);
+}
+
+bool AudioPacketQueue::push(const char* sampleData, int sampleLength)
+{
+    uint32_t queuedPackets;
+    uint32_t pushCount = m_Positions.beginWrite(&queuedPackets);
+
+    if (queuedPackets >= k_Capacity) {
+        SDL_AtomicIncRef(&m_DroppedPackets);
+        return false;
+    }
+
+    if (sampleLength > AUDIO_PACKET_MAX_SIZE) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Dropping oversized audio packet: %d bytes",
+                    sampleLength);
+        SDL_AtomicIncRef(&m_DroppedPackets);
+        return false;
+    }
+
+    PAUDIO_PACKET packet = &m_Packets[pushCount % k_Capacity];
+    packet->lost = sampleData == nullptr;
+    packet->length = packet->lost ? 0 : sampleLength;
+    if (!packet->lost) {
+        memcpy(packet->data, sampleData, sampleLength);
+    }
+
+    // This is a release store, so the consumer can't
+    // see the new count before the packet itself.
+    m_Positions.endWrite(pushCount + 1);
+    return true;
+}
+
+bool AudioPacketQueue::front(const unsigned char** sampleData, int* sampleLength)
+{
+    uint32_t queuedPackets;
+    uint32_t popCount = m_Positions.beginRead(&queuedPackets);
+
+    if (queuedPackets == 0) {
+        return false;
+    }
+
+    PAUDIO_PACKET packet = &m_Packets[popCount % k_Capacity];
+    *sampleData = packet->lost ? nullptr : packet->data;
+    *sampleLength = packet->length;
+    return true;
+}
+
+void AudioPacketQueue::pop()
+{
+    uint32_t queuedPackets;
+    uint32_t popCount = m_Positions.beginRead(&queuedPackets);
+
+    SDL_assert(queuedPackets != 0);
+    m_Positions.endRead(popCount + 1);
+}
+
+int AudioPacketQueue::takeDroppedPackets()
+{
+    return SDL_AtomicSet(&m_DroppedPackets, 0);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "SDL_compat.h"
+#include "streaming/spscringpositions.h"
+
+// Large enough for any Opus packet the host will send us
+#define AUDIO_PACKET_MAX_SIZE 2048
+
+// A bounded lock-free queue of Opus packets for exactly one producer thread
+// and one consumer thread. Packets are copied into fixed slots, so neither
+// side ever allocates or waits on the other.
+class AudioPacketQueue
+{
+public:
+    AudioPacketQueue();
+
+    // Only safe while neither thread is using the queue
+    void reset();
+
+    // Producer only. A null sampleData marks a lost packet. Returns false
+    // and counts the packet as dropped if the queue is full.
+    bool push(const char* sampleData, int sampleLength);
+
+    // Consumer only. Returns the oldest packet, which remains valid until
+    // pop() is called. sampleData will be null for a lost packet.
+    bool front(const unsigned char** sampleData, int* sampleLength);
+
+    // Consumer only
+    void pop();
+
+    // Returns the number of packets dropped since the last call
+    int takeDroppedPackets();
+
+private:
+    static constexpr int k_Capacity = 32;
+
+    typedef struct _AUDIO_PACKET {
+        bool lost;
+        int length;
+        unsigned char data[AUDIO_PACKET_MAX_SIZE];
+    } AUDIO_PACKET, *PAUDIO_PACKET;
+
+    AUDIO_PACKET m_Packets[k_Capacity];
+    SpscRingPositions m_Positions;
+
+    SDL_atomic_t m_DroppedPackets;
+};
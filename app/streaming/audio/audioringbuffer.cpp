@@ -0,0 +1,78 @@
+#include "audioringbuffer.h"
+
+AudioRingBuffer::AudioRingBuffer() :
+    m_Buffer(nullptr),
+    m_Channels(0),
+    m_CapacityFrames(0)
+{
+}
+
+AudioRingBuffer::~AudioRingBuffer()
+{
+    SDL_free(m_Buffer);
+}
+
+bool AudioRingBuffer::initialize(int channels, int minCapacityFrames)
+{
+    SDL_assert(m_Buffer == nullptr);
+
+    m_CapacityFrames = 1;
+    while (m_CapacityFrames < minCapacityFrames) {
+        m_CapacityFrames <<= 1;
+    }
+
+    m_Channels = channels;
+    m_Buffer = (float*)SDL_calloc(m_CapacityFrames * channels, sizeof(float));
+    return m_Buffer != nullptr;
+}
+
+int AudioRingBuffer::getCapacityFrames()
+{
+    return m_CapacityFrames;
+}
+
+int AudioRingBuffer::getReadableFrames()
+{
+    return (int)m_Positions.count();
+}
+
+void AudioRingBuffer::copyFrames(float* dst, const float* src, int frameCount)
+{
+    memcpy(dst, src, frameCount * m_Channels * sizeof(float));
+}
+
+int AudioRingBuffer::write(const float* frames, int frameCount)
+{
+    uint32_t usedFrames;
+    uint32_t writeCount = m_Positions.beginWrite(&usedFrames);
+
+    frameCount = SDL_min(frameCount, m_CapacityFrames - (int)usedFrames);
+
+    // Copy up to the end of the buffer, then wrap around to the start
+    int offset = (int)(writeCount & (m_CapacityFrames - 1));
+    int firstFrames = SDL_min(frameCount, m_CapacityFrames - offset);
+    copyFrames(m_Buffer + offset * m_Channels, frames, firstFrames);
+    copyFrames(m_Buffer, frames + firstFrames * m_Channels, frameCount - firstFrames);
+
+    // This is a release store, so the consumer can't see the new
+    // count before it can see the frames we just copied in.
+    m_Positions.endWrite(writeCount + frameCount);
+    return frameCount;
+}
+
+int AudioRingBuffer::read(float* frames, int frameCount)
+{
+    uint32_t availableFrames;
+    uint32_t readCount = m_Positions.beginRead(&availableFrames);
+
+    frameCount = SDL_min(frameCount, (int)availableFrames);
+
+    int offset = (int)(readCount & (m_CapacityFrames - 1));
+    int firstFrames = SDL_min(frameCount, m_CapacityFrames - offset);
+    copyFrames(frames, m_Buffer + offset * m_Channels, firstFrames);
+    copyFrames(frames + firstFrames * m_Channels, m_Buffer, frameCount - firstFrames);
+
+    // Likewise, the producer can't reuse this space until we're done reading it
+    m_Positions.endRead(readCount + frameCount);
+    return frameCount;
+}
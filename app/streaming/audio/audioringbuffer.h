@@ -0,0 +1,38 @@
+#pragma once
+
+#include "SDL_compat.h"
+#include "streaming/spscringpositions.h"
+
+// A lock-free ring of interleaved float audio frames for exactly one
+// producer thread and one consumer thread, so an audio callback can pull
+// samples without ever waiting on the thread that decodes them.
+class AudioRingBuffer
+{
+public:
+    AudioRingBuffer();
+
+    ~AudioRingBuffer();
+
+    // Capacity is rounded up to a power of two
+    bool initialize(int channels, int minCapacityFrames);
+
+    int getCapacityFrames();
+
+    // Safe to call from either thread, though the result is only
+    // a lower bound for the side that isn't changing it.
+    int getReadableFrames();
+
+    // Producer only. Returns the number of frames written.
+    int write(const float* frames, int frameCount);
+
+    // Consumer only. Returns the number of frames read.
+    int read(float* frames, int frameCount);
+
+private:
+    void copyFrames(float* dst, const float* src, int frameCount);
+
+    float* m_Buffer;
+    int m_Channels;
+    int m_CapacityFrames;
+    SpscRingPositions m_Positions;
+};
@@ -0,0 +1,171 @@
+#include "jitterbuffer.h"
+
+#include <Limelight.h>
+
+// Never target more latency than this, no matter how bad the jitter is
+#define MAX_TARGET_LATENCY_MS 100.0
+
+// How much headroom to keep above the measured network jitter
+#define JITTER_HEADROOM_FACTOR 3.0
+
+// Packets are dropped if the queue gets this far above the target, since
+// rate correction would take too long to bring the latency back down.
+#define MAX_EXCESS_LATENCY_MS 60.0
+
+// Per-packet smoothing of the measured latency and the target
+#define LATENCY_SMOOTHING_FACTOR 0.02
+#define TARGET_SMOOTHING_FACTOR 0.005
+
+// Rate correction per ms of latency error, which settles in a few seconds
+#define PROPORTIONAL_GAIN 0.0002
+
+// Accumulated rate correction per ms of error on each packet. This is what
+// ends up matching the drift between the host and device clocks.
+#define INTEGRAL_GAIN 0.0000001
+
+// Limits of the playback rate correction. Half a percent is well below the
+// pitch change that anyone can hear.
+#define MAX_DRIFT_CORRECTION 0.002
+#define MAX_RATE_CORRECTION 0.005
+
+AudioJitterBuffer::AudioJitterBuffer() :
+    m_SampleRate(0),
+    m_SamplesPerFrame(0),
+    m_PacketDurationMs(0),
+    m_DevicePeriodMs(0),
+    m_LastPacketTime(0),
+    m_NetworkJitterMs(0),
+    m_TargetLatencyMs(0),
+    m_SmoothedLatencyMs(0),
+    m_DriftCorrection(0)
+{
+    SDL_AtomicSet(&m_TargetFrames, 0);
+    SDL_AtomicSet(&m_Underruns, 0);
+    SDL_AtomicSet(&m_OverflowDrops, 0);
+    SDL_zero(m_Stats);
+}
+
+void AudioJitterBuffer::initialize(int sampleRate, int channels, int samplesPerFrame, int devicePeriodFrames)
+{
+    m_SampleRate = sampleRate;
+    m_SamplesPerFrame = samplesPerFrame;
+    m_PacketDurationMs = samplesPerFrame * 1000.0 / sampleRate;
+    m_DevicePeriodMs = devicePeriodFrames * 1000.0 / sampleRate;
+
+    // Start out assuming a perfect network
+    m_TargetLatencyMs = m_DevicePeriodMs / 2 + m_PacketDurationMs * 2;
+    m_SmoothedLatencyMs = m_TargetLatencyMs;
+    SDL_AtomicSet(&m_TargetFrames, (int)(m_TargetLatencyMs * sampleRate / 1000));
+
+    m_Resampler.initialize(channels, samplesPerFrame);
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Audio jitter buffer initial target latency: %.1f ms",
+                m_TargetLatencyMs);
+}
+
+int AudioJitterBuffer::getMaxOutputFrames()
+{
+    return m_Resampler.getMaxOutputFrames(m_SamplesPerFrame);
+}
+
+int AudioJitterBuffer::getTargetFrames()
+{
+    return SDL_AtomicGet(&m_TargetFrames);
+}
+
+void AudioJitterBuffer::updateNetworkJitter()
+{
+    uint64_t now = SDL_GetPerformanceCounter();
+
+    if (m_LastPacketTime != 0) {
+        // Estimate jitter as the mean deviation of packet interarrival
+        // times from the packet duration, like RTP (RFC 3550) does.
+        double interarrivalMs = (now - m_LastPacketTime) * 1000.0 / SDL_GetPerformanceFrequency();
+        double deviationMs = qAbs(interarrivalMs - m_PacketDurationMs);
+        m_NetworkJitterMs += (deviationMs - m_NetworkJitterMs) / 16;
+    }
+
+    m_LastPacketTime = now;
+}
+
+int AudioJitterBuffer::process(const float* input, int inputFrames, int queuedFrames, float* output)
+{
+    updateNetworkJitter();
+
+    // Audio waiting to be decoded adds latency just like our device queue does
+    double latencyMs = queuedFrames * 1000.0 / m_SampleRate + LiGetPendingAudioDuration();
+
+    // Keep enough audio queued to ride out the jitter we're seeing, on top of
+    // the half of a device period that is queued on average between callbacks.
+    double desiredTargetMs = m_DevicePeriodMs / 2 +
+                             SDL_max(m_PacketDurationMs * 2, m_NetworkJitterMs * JITTER_HEADROOM_FACTOR);
+    desiredTargetMs = SDL_min(desiredTargetMs, MAX_TARGET_LATENCY_MS);
+    m_TargetLatencyMs += (desiredTargetMs - m_TargetLatencyMs) * TARGET_SMOOTHING_FACTOR;
+    SDL_AtomicSet(&m_TargetFrames, (int)(m_TargetLatencyMs * m_SampleRate / 1000));
+
+    int outputFrames;
+    if (latencyMs > m_TargetLatencyMs + MAX_EXCESS_LATENCY_MS) {
+        SDL_AtomicIncRef(&m_OverflowDrops);
+        outputFrames = 0;
+    }
+    else {
+        m_SmoothedLatencyMs += (latencyMs - m_SmoothedLatencyMs) * LATENCY_SMOOTHING_FACTOR;
+
+        // Play slightly faster when we're above the target and slower when we're below it
+        double errorMs = m_SmoothedLatencyMs - m_TargetLatencyMs;
+        m_DriftCorrection = qBound(-MAX_DRIFT_CORRECTION,
+                                   m_DriftCorrection + errorMs * INTEGRAL_GAIN,
+                                   MAX_DRIFT_CORRECTION);
+        double rateCorrection = qBound(-MAX_RATE_CORRECTION,
+                                       errorMs * PROPORTIONAL_GAIN + m_DriftCorrection,
+                                       MAX_RATE_CORRECTION);
+
+        outputFrames = m_Resampler.process(input, inputFrames, output, 1.0 + rateCorrection);
+    }
+
+    m_StatsLock.lock();
+    m_Stats.queueLatencyMs = (float)m_SmoothedLatencyMs;
+    m_Stats.targetLatencyMs = (float)m_TargetLatencyMs;
+    m_Stats.networkJitterMs = (float)m_NetworkJitterMs;
+    m_Stats.driftPpm = (float)(m_DriftCorrection * 1000000);
+    m_StatsLock.unlock();
+
+    return outputFrames;
+}
+
+void AudioJitterBuffer::notifyUnderrun()
+{
+    SDL_AtomicIncRef(&m_Underruns);
+}
+
+void AudioJitterBuffer::getStats(PAUDIO_JITTER_STATS stats)
+{
+    m_StatsLock.lock();
+    *stats = m_Stats;
+    m_StatsLock.unlock();
+
+    stats->underruns = SDL_AtomicGet(&m_Underruns);
+    stats->overflowDrops = SDL_AtomicGet(&m_OverflowDrops);
+}
+
+void AudioJitterBuffer::logStats()
+{
+    AUDIO_JITTER_STATS stats;
+
+    // Don't bother for renderers that never played anything, like test instances
+    if (m_LastPacketTime == 0) {
+        return;
+    }
+
+    getStats(&stats);
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Audio jitter buffer: %.1f ms latency (%.1f ms target), %.1f ms network jitter, %.0f ppm drift, %u underruns, %u overflow drops",
+                stats.queueLatencyMs,
+                stats.targetLatencyMs,
+                stats.networkJitterMs,
+                stats.driftPpm,
+                stats.underruns,
+                stats.overflowDrops);
+}
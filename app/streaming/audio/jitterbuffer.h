@@ -0,0 +1,71 @@
+#pragma once
+
+#include "polyphaseresampler.h"
+#include "SDL_compat.h"
+
+#include <QMutex>
+
+typedef struct _AUDIO_JITTER_STATS {
+    uint32_t underruns;
+    uint32_t overflowDrops;
+    float queueLatencyMs;
+    float targetLatencyMs;
+    float networkJitterMs;
+    float driftPpm;
+} AUDIO_JITTER_STATS, *PAUDIO_JITTER_STATS;
+
+// Holds the audio queue of a renderer at a target latency without dropping
+// or inserting whole packets. The queue depth is measured on every packet,
+// and a small playback rate correction steers it towards the target, which
+// absorbs clock drift between the host and our audio device. The target
+// itself follows the jitter in packet arrival times.
+class AudioJitterBuffer
+{
+public:
+    AudioJitterBuffer();
+
+    void initialize(int sampleRate, int channels, int samplesPerFrame, int devicePeriodFrames);
+
+    // Returns the most frames process() can write for a packet
+    int getMaxOutputFrames();
+
+    // Returns the current target latency in frames. This may be called from
+    // the audio thread, such as to decide how much to prebuffer after an underrun.
+    int getTargetFrames();
+
+    // Takes a decoded packet and the number of frames that are queued ahead
+    // of it, and writes the rate corrected packet to output. Returns the number
+    // of frames written, which is 0 if the packet should be dropped.
+    int process(const float* input, int inputFrames, int queuedFrames, float* output);
+
+    // The queue depth alone can't tell us when playback ran dry between
+    // packets, so renderers report underruns as their audio thread sees them.
+    void notifyUnderrun();
+
+    void getStats(PAUDIO_JITTER_STATS stats);
+
+    void logStats();
+
+private:
+    void updateNetworkJitter();
+
+    PolyphaseResampler m_Resampler;
+    int m_SampleRate;
+    int m_SamplesPerFrame;
+    double m_PacketDurationMs;
+    double m_DevicePeriodMs;
+
+    uint64_t m_LastPacketTime;
+    double m_NetworkJitterMs;
+    double m_TargetLatencyMs;
+    double m_SmoothedLatencyMs;
+    double m_DriftCorrection;
+
+    SDL_atomic_t m_TargetFrames;
+    SDL_atomic_t m_Underruns;
+    SDL_atomic_t m_OverflowDrops;
+
+    // Protects the floating point stats that are read by other threads
+    QMutex m_StatsLock;
+    AUDIO_JITTER_STATS m_Stats;
+};
@@ -0,0 +1,182 @@
+#include "polyphaseresampler.h"
+
+#include <QtGlobal>
+#include <QtMath>
+
+#include "SDL_compat.h"
+
+#if defined(Q_PROCESSOR_X86_64) || (defined(Q_PROCESSOR_X86) && (defined(__SSE__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)))
+#include <xmmintrin.h>
+#define HAVE_SSE_DOT_PRODUCT
+#elif defined(Q_PROCESSOR_ARM_64)
+#include <arm_neon.h>
+#define HAVE_NEON_DOT_PRODUCT
+#endif
+
+// Filter length in input frames. This is also the delay we add.
+#define FILTER_TAPS 16
+
+// Number of filter phases per input frame. Filters between two phases
+// are linearly interpolated.
+#define FILTER_PHASES 64
+
+// Cutoff as a fraction of Nyquist. This keeps everything below about
+// 21.6 KHz at 48 KHz untouched while still suppressing imaging.
+#define FILTER_CUTOFF 0.9
+
+namespace {
+
+struct FilterBank {
+    // One extra phase so we can always interpolate towards phase + 1
+    alignas(16) float coefficients[FILTER_PHASES + 1][FILTER_TAPS];
+
+    FilterBank()
+    {
+        for (int phase = 0; phase <= FILTER_PHASES; phase++) {
+            double fraction = (double)phase / FILTER_PHASES;
+            double sum = 0;
+
+            for (int tap = 0; tap < FILTER_TAPS; tap++) {
+                // Distance of this tap from the output position, which lies
+                // between the two middle taps of the filter.
+                double x = tap - (FILTER_TAPS / 2 - 1) - fraction;
+
+                double sinc = x == 0 ? 1.0 : qSin(M_PI * FILTER_CUTOFF * x) / (M_PI * FILTER_CUTOFF * x);
+
+                // Blackman window across the whole filter
+                double n = (x + FILTER_TAPS / 2) / FILTER_TAPS;
+                double window = 0.42 - 0.5 * qCos(2 * M_PI * n) + 0.08 * qCos(4 * M_PI * n);
+
+                coefficients[phase][tap] = (float)(sinc * window);
+                sum += coefficients[phase][tap];
+            }
+
+            // Normalize each phase to unity gain, so we don't introduce any
+            // amplitude modulation as the phase changes.
+            for (int tap = 0; tap < FILTER_TAPS; tap++) {
+                coefficients[phase][tap] = (float)(coefficients[phase][tap] / sum);
+            }
+        }
+    }
+};
+
+const FilterBank k_FilterBank;
+
+inline float dotProduct(const float* samples, const float* filter)
+{
+#if defined(HAVE_SSE_DOT_PRODUCT)
+    __m128 sum = _mm_mul_ps(_mm_loadu_ps(samples), _mm_load_ps(filter));
+    for (int i = 4; i < FILTER_TAPS; i += 4) {
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(samples + i), _mm_load_ps(filter + i)));
+    }
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+#elif defined(HAVE_NEON_DOT_PRODUCT)
+    float32x4_t sum = vmulq_f32(vld1q_f32(samples), vld1q_f32(filter));
+    for (int i = 4; i < FILTER_TAPS; i += 4) {
+        sum = vmlaq_f32(sum, vld1q_f32(samples + i), vld1q_f32(filter + i));
+    }
+    return vaddvq_f32(sum);
+#else
+    float sum = 0;
+    for (int i = 0; i < FILTER_TAPS; i++) {
+        sum += samples[i] * filter[i];
+    }
+    return sum;
+#endif
+}
+
+}
+
+PolyphaseResampler::PolyphaseResampler() :
+    m_Channels(0),
+    m_MaxInputFrames(0),
+    m_HistoryStride(0),
+    m_HistoryFrames(0),
+    m_Position(0)
+{
+
+}
+
+void PolyphaseResampler::initialize(int channels, int maxInputFrames)
+{
+    m_Channels = channels;
+    m_MaxInputFrames = maxInputFrames;
+
+    // Each channel needs room for the filter's worth of history plus the new input
+    m_HistoryStride = FILTER_TAPS + maxInputFrames;
+    m_History.resize(m_HistoryStride * channels);
+    m_Filter.resize(FILTER_TAPS + 4);
+
+    reset();
+}
+
+void PolyphaseResampler::reset()
+{
+    // Start with silence in the history, centered so the first output
+    // frame lines up with the first input frame.
+    m_History.fill(0);
+    m_HistoryFrames = FILTER_TAPS / 2 - 1;
+    m_Position = 0;
+}
+
+int PolyphaseResampler::getMaxOutputFrames(int inputFrames)
+{
+    // We never step by less than 0.9 frames, which is far beyond any drift
+    // correction we'd apply, and may have one frame left from the last call.
+    return (int)(inputFrames / 0.9) + 2;
+}
+
+int PolyphaseResampler::process(const float* input, int inputFrames, float* output, double step)
+{
+    SDL_assert(inputFrames <= m_MaxInputFrames);
+    SDL_assert(step >= 0.9 && step <= 1.1);
+
+    // Deinterleave the input onto the end of the history for each channel,
+    // so each dot product reads contiguous samples.
+    for (int c = 0; c < m_Channels; c++) {
+        float* history = m_History.data() + c * m_HistoryStride + m_HistoryFrames;
+        for (int i = 0; i < inputFrames; i++) {
+            history[i] = input[i * m_Channels + c];
+        }
+    }
+    m_HistoryFrames += inputFrames;
+
+    // The aligned copy of the interpolated filter for dotProduct()
+    float* filter = (float*)(((uintptr_t)m_Filter.data() + 15) & ~(uintptr_t)15);
+
+    int outputFrames = 0;
+    while ((int)m_Position + FILTER_TAPS <= m_HistoryFrames) {
+        int start = (int)m_Position;
+        double phase = (m_Position - start) * FILTER_PHASES;
+        int phaseIndex = (int)phase;
+        float phaseFraction = (float)(phase - phaseIndex);
+
+        // Interpolate between the two nearest phases. Doing this once per
+        // output frame rather than per channel keeps multichannel cheap.
+        const float* filterA = k_FilterBank.coefficients[phaseIndex];
+        const float* filterB = k_FilterBank.coefficients[phaseIndex + 1];
+        for (int tap = 0; tap < FILTER_TAPS; tap++) {
+            filter[tap] = filterA[tap] + (filterB[tap] - filterA[tap]) * phaseFraction;
+        }
+
+        for (int c = 0; c < m_Channels; c++) {
+            output[outputFrames * m_Channels + c] = dotProduct(m_History.constData() + c * m_HistoryStride + start, filter);
+        }
+
+        outputFrames++;
+        m_Position += step;
+    }
+
+    // Keep the input that future output frames still need
+    int consumedFrames = SDL_min((int)m_Position, m_HistoryFrames);
+    for (int c = 0; c < m_Channels; c++) {
+        float* history = m_History.data() + c * m_HistoryStride;
+        memmove(history, history + consumedFrames, (m_HistoryFrames - consumedFrames) * sizeof(float));
+    }
+    m_HistoryFrames -= consumedFrames;
+    m_Position -= consumedFrames;
+
+    return outputFrames;
+}
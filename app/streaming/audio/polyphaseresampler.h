@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QVector>
+
+// Resamples interleaved float audio by a ratio very close to 1.0 using a
+// windowed sinc polyphase filter. This is meant for nudging the playback
+// rate by fractions of a percent to track clock drift, not for converting
+// between sample rates, so the filter is short and the ratio can change
+// on every call without any discontinuity in the output.
+class PolyphaseResampler
+{
+public:
+    PolyphaseResampler();
+
+    void initialize(int channels, int maxInputFrames);
+
+    void reset();
+
+    // Returns the most frames process() can produce from inputFrames
+    int getMaxOutputFrames(int inputFrames);
+
+    // Consumes all input frames and returns the number of output frames.
+    // Each output frame advances the input position by step frames, so
+    // steps above 1.0 shorten the audio and steps below 1.0 stretch it.
+    int process(const float* input, int inputFrames, float* output, double step);
+
+private:
+    int m_Channels;
+    int m_MaxInputFrames;
+
+    // Planar input history, including the tail of the previous call
+    QVector<float> m_History;
+    int m_HistoryStride;
+    int m_HistoryFrames;
+
+    // Position of the next output frame relative to the start of m_History
+    double m_Position;
+
+    // Interpolated filter for the current output frame
+    QVector<float> m_Filter;
+};
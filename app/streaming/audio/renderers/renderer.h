@@ -1,8 +1,34 @@
 #pragma once
 
+#include "../jitterbuffer.h"
+#include "streaming/video/latencyhistogram.h"
+
 #include <Limelight.h>
 #include <QtGlobal>
 
+typedef struct _AUDIO_STATS {
+    uint32_t receivedPackets;
+    uint32_t lostPackets; // Reported missing by the connection
+    uint32_t decodedPackets;
+    uint32_t plcPackets;
+    uint32_t fecPackets;
+    uint32_t droppedPackets; // Without a working renderer
+    uint32_t queueDroppedPackets; // Before reaching the decode thread
+    uint32_t overflowDroppedPackets; // By the renderer's jitter buffer
+    uint32_t underruns;
+    uint64_t totalDecodeTimeUs;
+
+    // Sampled once per window, since they're already smoothed by the renderer
+    uint32_t latencySamples;
+    uint32_t queueLatencySamples; // Only for renderers with jitter stats
+    float totalQueueLatencyMs;
+    float totalTargetLatencyMs;
+    float totalEstimatedLatencyMs; // Half the RTT plus everything queued after it
+    uint32_t measurementStartTimestamp;
+
+    LatencyHistogram decodeLatency; // opus_multistream_decode()
+} AUDIO_STATS, *PAUDIO_STATS;
+
 class IAudioRenderer
 {
 public:
@@ -17,6 +43,11 @@ public:
 
     virtual int getCapabilities() = 0;
 
+    // Return false if this renderer doesn't use an AudioJitterBuffer
+    virtual bool getJitterStats(PAUDIO_JITTER_STATS) {
+        return false;
+    }
+
     virtual void remapChannels(POPUS_MULTISTREAM_CONFIGURATION) {
         // Use default channel mapping:
         // 0 - Front Left
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "renderer.h"
+#include "../audioringbuffer.h"
 #include "SDL_compat.h"
 
 class SdlAudioRenderer : public IAudioRenderer
@@ -20,8 +21,21 @@ public:
 
     virtual AudioFormat getAudioBufferFormat();
 
+    virtual bool getJitterStats(PAUDIO_JITTER_STATS stats);
+
 private:
+    static void SDLCALL audioCallback(void* userdata, Uint8* stream, int len);
+
     SDL_AudioDeviceID m_AudioDevice;
     void* m_AudioBuffer;
+    void* m_ResampledBuffer;
     int m_FrameSize;
+    int m_SampleFrameSize;
+    AudioJitterBuffer m_JitterBuffer;
+
+    // Decoded audio waiting for SDL's audio thread to pull it
+    AudioRingBuffer m_RingBuffer;
+
+    // Only touched by the audio callback
+    bool m_Prebuffering;
 };
@@ -4,7 +4,9 @@
 
 SdlAudioRenderer::SdlAudioRenderer()
     : m_AudioDevice(0),
-      m_AudioBuffer(nullptr)
+      m_AudioBuffer(nullptr),
+      m_ResampledBuffer(nullptr),
+      m_Prebuffering(true)
 {
     SDL_assert(!SDL_WasInit(SDL_INIT_AUDIO));
 
@@ -24,6 +26,8 @@ bool SdlAudioRenderer::prepareForPlayback(const OPUS_MULTISTREAM_CONFIGURATION*
     want.freq = opusConfig->sampleRate;
     want.format = AUDIO_F32SYS;
     want.channels = opusConfig->channelCount;
+    want.callback = SdlAudioRenderer::audioCallback;
+    want.userdata = this;
 
     // On PulseAudio systems, setting a value too small can cause underruns for other
     // applications sharing this output device. We impose a floor of 480 samples (10 ms)
@@ -39,9 +43,8 @@ bool SdlAudioRenderer::prepareForPlayback(const OPUS_MULTISTREAM_CONFIGURATION*
     want.samples = SDL_max(480, opusConfig->samplesPerFrame);
 #endif
 
-    m_FrameSize = opusConfig->samplesPerFrame *
-                  opusConfig->channelCount *
-                  getAudioBufferSampleSize();
+    m_SampleFrameSize = opusConfig->channelCount * getAudioBufferSampleSize();
+    m_FrameSize = opusConfig->samplesPerFrame * m_SampleFrameSize;
 
     m_AudioDevice = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
     if (m_AudioDevice == 0) {
@@ -51,8 +54,16 @@ bool SdlAudioRenderer::prepareForPlayback(const OPUS_MULTISTREAM_CONFIGURATION*
         return false;
     }
 
+    // SDL's audio thread pulls a device buffer from our ring at a time
+    m_JitterBuffer.initialize(have.freq, have.channels, opusConfig->samplesPerFrame, have.samples);
+
     m_AudioBuffer = SDL_malloc(m_FrameSize);
-    if (m_AudioBuffer == nullptr) {
+    m_ResampledBuffer = SDL_malloc(m_JitterBuffer.getMaxOutputFrames() * m_SampleFrameSize);
+
+    // The jitter buffer drops packets well before we'd queue 250 ms of audio,
+    // so the ring only fills up if the device stops pulling from it.
+    if (m_AudioBuffer == nullptr || m_ResampledBuffer == nullptr ||
+            !m_RingBuffer.initialize(have.channels, have.freq / 4 + have.samples)) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                      "Failed to allocate audio buffer");
         return false;
@@ -72,24 +83,59 @@ bool SdlAudioRenderer::prepareForPlayback(const OPUS_MULTISTREAM_CONFIGURATION*
                 "SDL audio driver: %s",
                 SDL_GetCurrentAudioDriver());
 
-    // Start playback
+    // Start playback. The callback will play silence until
+    // we've buffered up to our target latency.
     SDL_PauseAudioDevice(m_AudioDevice, 0);
 
     return true;
 }
 
+void SDLCALL SdlAudioRenderer::audioCallback(void* userdata, Uint8* stream, int len)
+{
+    SdlAudioRenderer* me = reinterpret_cast<SdlAudioRenderer*>(userdata);
+    int frames = len / me->m_SampleFrameSize;
+    int framesRead = 0;
+
+    // After running dry, wait until we have our target latency buffered again
+    // rather than playing each packet as it arrives and underrunning again.
+    if (me->m_Prebuffering &&
+            me->m_RingBuffer.getReadableFrames() >= SDL_min(me->m_JitterBuffer.getTargetFrames(),
+                                                            me->m_RingBuffer.getCapacityFrames())) {
+        me->m_Prebuffering = false;
+    }
+
+    if (!me->m_Prebuffering) {
+        framesRead = me->m_RingBuffer.read((float*)stream, frames);
+        if (framesRead < frames) {
+            me->m_JitterBuffer.notifyUnderrun();
+            me->m_Prebuffering = true;
+        }
+    }
+
+    // Fill whatever we couldn't provide with silence
+    SDL_memset(stream + framesRead * me->m_SampleFrameSize,
+               0,
+               len - framesRead * me->m_SampleFrameSize);
+}
+
 SdlAudioRenderer::~SdlAudioRenderer()
 {
     if (m_AudioDevice != 0) {
         // Stop playback
         SDL_PauseAudioDevice(m_AudioDevice, 1);
         SDL_CloseAudioDevice(m_AudioDevice);
+
+        m_JitterBuffer.logStats();
     }
 
     if (m_AudioBuffer != nullptr) {
         SDL_free(m_AudioBuffer);
     }
 
+    if (m_ResampledBuffer != nullptr) {
+        SDL_free(m_ResampledBuffer);
+    }
+
     SDL_QuitSubSystem(SDL_INIT_AUDIO);
     SDL_assert(!SDL_WasInit(SDL_INIT_AUDIO));
 }
@@ -106,34 +152,28 @@ bool SdlAudioRenderer::submitAudio(int bytesWritten)
         return true;
     }
 
-    // Don't queue if there's already more than 30 ms of audio data waiting
-    // in Moonlight's audio queue.
-    if (LiGetPendingAudioDuration() > 30) {
-        return true;
+    // Our device may enter a permanent error status upon removal, so we need
+    // to recreate the audio device to pick up the new default audio device.
+    if (SDL_GetAudioDeviceStatus(m_AudioDevice) == SDL_AUDIO_STOPPED) {
+        return false;
     }
 
-    // Provide backpressure on the queue to ensure too many frames don't build up
-    // in SDL's audio queue, but don't wait forever to avoid a deadlock if the
-    // audio device fails.
-    for (int i = 0; i < 100; i++) {
-        // Our device may enter a permanent error status upon removal, so we need
-        // to recreate the audio device to pick up the new default audio device.
-        if (SDL_GetAudioDeviceStatus(m_AudioDevice) == SDL_AUDIO_STOPPED) {
-            return false;
-        }
-
-        // Only queue more samples where there are 10 frames or less in SDL's queue
-        if (SDL_GetQueuedAudioSize(m_AudioDevice) / m_FrameSize <= 10) {
-            break;
-        }
-
-        SDL_Delay(1);
+    // Let the jitter buffer adjust the playback rate to keep our ring at the
+    // target latency. It will drop the packet instead if the ring has grown far
+    // beyond the target, such as when the device stops consuming audio.
+    int frames = m_JitterBuffer.process((float*)m_AudioBuffer,
+                                        bytesWritten / m_SampleFrameSize,
+                                        m_RingBuffer.getReadableFrames(),
+                                        (float*)m_ResampledBuffer);
+    if (frames == 0) {
+        return true;
     }
 
-    if (SDL_QueueAudio(m_AudioDevice, m_AudioBuffer, bytesWritten) < 0) {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                     "Failed to queue audio sample: %s",
-                     SDL_GetError());
+    // This never blocks on the audio thread. If the ring is somehow full,
+    // whatever doesn't fit is dropped like an overflowing queue would be.
+    if (m_RingBuffer.write((float*)m_ResampledBuffer, frames) < frames) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Audio ring buffer overflow");
     }
 
     return true;
@@ -149,3 +189,9 @@ IAudioRenderer::AudioFormat SdlAudioRenderer::getAudioBufferFormat()
 {
     return AudioFormat::Float32NE;
 }
+
+bool SdlAudioRenderer::getJitterStats(PAUDIO_JITTER_STATS stats)
+{
+    m_JitterBuffer.getStats(stats);
+    return true;
+}
@@ -0,0 +1,393 @@
+#include "decoderprobecache.h"
+
+#include "SDL_compat.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QSysInfo>
+
+#ifdef HAVE_FFMPEG
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+}
+#endif
+
+#ifdef Q_OS_WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+#define SER_DECODERPROBECACHE "decoderprobecache"
+#define SER_IDENTITY "identity"
+#define SER_PROBETIME "probetime"
+#define SER_REVALIDATIONTIME "revalidationtime"
+#define SER_INFO "info"
+#define SER_HWACCEL "hwaccel"
+#define SER_FULLSCREENONLY "fullscreenonly"
+#define SER_HDR "hdr"
+#define SER_MAXRES "maxres"
+#define SER_AVAILABILITY "availability"
+#define SER_PROPERTIES "properties"
+#define SER_CAPABILITIES "caps"
+#define SER_COLORSPACE "colorspace"
+#define SER_COLORRANGE "colorrange"
+#define SER_ALWAYSFULLSCREEN "alwaysfullscreen"
+
+// Re-probe at least this often to pick up changes that aren't reflected in
+// the system identity, like user-mode driver updates on Linux.
+#define CACHE_MAX_AGE_SECS (7 * 24 * 60 * 60)
+
+// Cached decoder info is used right away at launch. We only spend the time to
+// probe it again in the background if it hasn't been confirmed in this long.
+#define DECODER_INFO_REVALIDATION_AGE_SECS (24 * 60 * 60)
+
+// Environment variables that can change which decoder or renderer we pick
+static const char* const k_IdentityEnvironmentVariables[] = {
+    "DECODER_CAPS",
+    "H264_DECODER_HINT",
+    "HEVC_DECODER_HINT",
+    "AV1_DECODER_HINT",
+    "PREFER_VULKAN",
+    "DXVA2_ENABLED",
+    "DXVA2_DISABLE_DECODER_BLACKLIST",
+    "DXVA2_QUIRK_FLAGS",
+    "D3D11VA_ENABLED",
+    "FORCE_VAAPI",
+    "VAAPI_FORCE_DIRECT",
+    "VAAPI_FORCE_INDIRECT",
+    "LIBVA_DRIVER_NAME",
+    "LIBVA_DRIVERS_PATH",
+    "VDPAU_DRIVER_PATH",
+    "VDPAU_XWAYLAND",
+    "DRM_FORCE_DIRECT",
+    "DRM_FORCE_EGL",
+    "PLVK_ALLOW_INTEL",
+    "PLVK_ALLOW_SOFTWARE",
+    "VT_FORCE_INDIRECT",
+    "VT_FORCE_METAL",
+    "MMAL_DISABLE_SUPPORT_CHECK",
+    "RPI_ALLOW_EGL_RENDER",
+    "RPI_ALLOW_EGL_4K",
+    "RPI_ALLOW_COPYBACK_RENDER",
+    "GENHWACCEL_CAPS",
+    "SOFTWARE_DECODE_SLICES",
+    "SDL_VIDEODRIVER",
+    "SDL_RENDER_DRIVER",
+};
+
+static QMutex s_ProbeLock;
+
+bool DecoderProbeCache::getDecoderInfo(DECODER_INFO& info)
+{
+    QSettings settings;
+
+    if (!openCache(settings, false)) {
+        return false;
+    }
+
+    settings.beginGroup(SER_INFO);
+    if (!settings.contains(SER_HWACCEL)) {
+        return false;
+    }
+
+    info.isHardwareAccelerated = settings.value(SER_HWACCEL).toBool();
+    info.isFullScreenOnly = settings.value(SER_FULLSCREENONLY).toBool();
+    info.isHdrSupported = settings.value(SER_HDR).toBool();
+    info.maxResolution = settings.value(SER_MAXRES).toSize();
+    return true;
+}
+
+void DecoderProbeCache::putDecoderInfo(const DECODER_INFO& info)
+{
+    QSettings settings;
+
+    if (!openCache(settings, true)) {
+        return;
+    }
+
+    settings.beginGroup(SER_INFO);
+    settings.setValue(SER_HWACCEL, info.isHardwareAccelerated);
+    settings.setValue(SER_FULLSCREENONLY, info.isFullScreenOnly);
+    settings.setValue(SER_HDR, info.isHdrSupported);
+    settings.setValue(SER_MAXRES, info.maxResolution);
+}
+
+bool DecoderProbeCache::getDecoderAvailability(int vds, int videoFormat, int width, int height, int frameRate,
+                                               int& availability)
+{
+    QSettings settings;
+
+    if (!openCache(settings, false)) {
+        return false;
+    }
+
+    settings.beginGroup(SER_AVAILABILITY);
+
+    QString key = getProbeKey(vds, videoFormat, width, height, frameRate);
+    if (!settings.contains(key)) {
+        return false;
+    }
+
+    availability = settings.value(key).toInt();
+    return true;
+}
+
+void DecoderProbeCache::putDecoderAvailability(int vds, int videoFormat, int width, int height, int frameRate,
+                                               int availability)
+{
+    QSettings settings;
+
+    if (!openCache(settings, true)) {
+        return;
+    }
+
+    settings.beginGroup(SER_AVAILABILITY);
+    settings.setValue(getProbeKey(vds, videoFormat, width, height, frameRate), availability);
+}
+
+bool DecoderProbeCache::getDecoderProperties(int vds, int videoFormat, int width, int height, int frameRate,
+                                             DECODER_PROPERTIES& properties)
+{
+    QSettings settings;
+
+    if (!openCache(settings, false)) {
+        return false;
+    }
+
+    settings.beginGroup(SER_PROPERTIES);
+    settings.beginGroup(getProbeKey(vds, videoFormat, width, height, frameRate));
+    if (!settings.contains(SER_CAPABILITIES)) {
+        return false;
+    }
+
+    properties.capabilities = settings.value(SER_CAPABILITIES).toInt();
+    properties.colorSpace = settings.value(SER_COLORSPACE).toInt();
+    properties.colorRange = settings.value(SER_COLORRANGE).toInt();
+    properties.isAlwaysFullScreen = settings.value(SER_ALWAYSFULLSCREEN).toBool();
+    return true;
+}
+
+void DecoderProbeCache::putDecoderProperties(int vds, int videoFormat, int width, int height, int frameRate,
+                                             const DECODER_PROPERTIES& properties)
+{
+    QSettings settings;
+
+    if (!openCache(settings, true)) {
+        return;
+    }
+
+    settings.beginGroup(SER_PROPERTIES);
+    settings.beginGroup(getProbeKey(vds, videoFormat, width, height, frameRate));
+    settings.setValue(SER_CAPABILITIES, properties.capabilities);
+    settings.setValue(SER_COLORSPACE, properties.colorSpace);
+    settings.setValue(SER_COLORRANGE, properties.colorRange);
+    settings.setValue(SER_ALWAYSFULLSCREEN, properties.isAlwaysFullScreen);
+}
+
+bool DecoderProbeCache::isDecoderInfoRevalidationDue()
+{
+    QSettings settings;
+
+    if (!openCache(settings, false)) {
+        return true;
+    }
+
+    qint64 now = QDateTime::currentSecsSinceEpoch();
+    qint64 lastCheckTime = qMax(settings.value(SER_PROBETIME, 0).toLongLong(),
+                                settings.value(SER_REVALIDATIONTIME, 0).toLongLong());
+
+    return now < lastCheckTime || now - lastCheckTime >= DECODER_INFO_REVALIDATION_AGE_SECS;
+}
+
+void DecoderProbeCache::markDecoderInfoRevalidated()
+{
+    QSettings settings;
+
+    // This doesn't extend the cache's lifetime past CACHE_MAX_AGE_SECS, since
+    // we've only confirmed the decoder info and not the other results.
+    if (!openCache(settings, false)) {
+        return;
+    }
+
+    settings.setValue(SER_REVALIDATIONTIME, QDateTime::currentSecsSinceEpoch());
+}
+
+void DecoderProbeCache::invalidate()
+{
+    QSettings settings;
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Invalidating decoder probe cache");
+    settings.remove(SER_DECODERPROBECACHE);
+}
+
+QMutex* DecoderProbeCache::getProbeLock()
+{
+    return &s_ProbeLock;
+}
+
+bool DecoderProbeCache::openCache(QSettings& settings, bool forWrite)
+{
+    bool ok;
+
+    if (qEnvironmentVariableIntValue("DECODER_PROBE_CACHE", &ok) == 0 && ok) {
+        return false;
+    }
+
+    QString identity = getSystemIdentity();
+    qint64 now = QDateTime::currentSecsSinceEpoch();
+
+    settings.beginGroup(SER_DECODERPROBECACHE);
+
+    qint64 probeTime = settings.value(SER_PROBETIME, 0).toLongLong();
+    if (settings.value(SER_IDENTITY).toString() == identity &&
+            now >= probeTime && now - probeTime < CACHE_MAX_AGE_SECS) {
+        return true;
+    }
+
+    if (!forWrite) {
+        if (settings.contains(SER_IDENTITY)) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Decoder probe cache is out of date");
+        }
+        return false;
+    }
+
+    // Start a new cache for the current system
+    settings.remove("");
+    settings.setValue(SER_IDENTITY, identity);
+    settings.setValue(SER_PROBETIME, now);
+    return true;
+}
+
+QString DecoderProbeCache::getProbeKey(int vds, int videoFormat, int width, int height, int frameRate)
+{
+    return QString("%1-%2-%3x%4x%5").arg(vds).arg(videoFormat, 0, 16).arg(width).arg(height).arg(frameRate);
+}
+
+#ifdef Q_OS_LINUX
+static QString readFirstLine(const QString& path)
+{
+    QFile file(path);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QString();
+    }
+
+    return QString::fromUtf8(file.readLine()).trimmed();
+}
+#endif
+
+void DecoderProbeCache::appendGpuIdentity(QStringList& identity)
+{
+#if defined(Q_OS_WIN32)
+    DISPLAY_DEVICEW device;
+
+    device.cb = sizeof(device);
+    for (DWORD i = 0; EnumDisplayDevicesW(nullptr, i, &device, 0); i++, device.cb = sizeof(device)) {
+        if (!(device.StateFlags & DISPLAY_DEVICE_ACTIVE)) {
+            continue;
+        }
+
+        QString gpu = QString::fromWCharArray(device.DeviceString) + " " + QString::fromWCharArray(device.DeviceID);
+
+        // DeviceKey points at the adapter's registry key, which has the driver version
+        QString deviceKey = QString::fromWCharArray(device.DeviceKey);
+        QString machinePrefix = "\\Registry\\Machine\\";
+        if (deviceKey.startsWith(machinePrefix, Qt::CaseInsensitive)) {
+            std::wstring subKey = deviceKey.mid(machinePrefix.length()).toStdWString();
+            WCHAR driverVersion[64];
+            DWORD driverVersionSize = sizeof(driverVersion);
+
+            if (RegGetValueW(HKEY_LOCAL_MACHINE, subKey.c_str(), L"DriverVersion", RRF_RT_REG_SZ,
+                             nullptr, driverVersion, &driverVersionSize) == ERROR_SUCCESS) {
+                gpu += " " + QString::fromWCharArray(driverVersion);
+            }
+        }
+
+        identity.append(gpu);
+    }
+#elif defined(Q_OS_LINUX)
+    // Identify each DRM device by its PCI IDs, kernel driver, and driver version if available.
+    // User-mode drivers like Mesa don't report their versions here, so we depend on revalidation
+    // and cache expiration to catch those updates.
+    QDir drmDir("/sys/class/drm");
+    for (const QString& card : drmDir.entryList(QStringList("card*"), QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot)) {
+        // Skip connectors like card0-HDMI-A-1
+        if (card.contains('-')) {
+            continue;
+        }
+
+        QString devicePath = drmDir.filePath(card + "/device");
+        QString driver = QFileInfo(QFileInfo(devicePath + "/driver").symLinkTarget()).fileName();
+
+        identity.append(QString("%1: %2:%3 %4 %5").arg(card,
+                                                      readFirstLine(devicePath + "/vendor"),
+                                                      readFirstLine(devicePath + "/device"),
+                                                      driver,
+                                                      readFirstLine("/sys/module/" + driver + "/version")));
+    }
+
+    // The NVIDIA proprietary driver doesn't report a module version in sysfs
+    QString nvidiaVersion = readFirstLine("/proc/driver/nvidia/version");
+    if (!nvidiaVersion.isEmpty()) {
+        identity.append(nvidiaVersion);
+    }
+#else
+    // On other platforms, GPU drivers are updated along with the OS
+    Q_UNUSED(identity);
+#endif
+}
+
+QString DecoderProbeCache::getSystemIdentity()
+{
+    QStringList identity;
+
+    identity.append(VERSION_STR);
+    identity.append(QSysInfo::kernelType() + " " + QSysInfo::kernelVersion());
+    identity.append(QSysInfo::productType() + " " + QSysInfo::productVersion());
+
+    {
+        SDL_version sdlVersion;
+        const char* videoDriver = SDL_GetCurrentVideoDriver();
+
+        SDL_GetVersion(&sdlVersion);
+        identity.append(QString("SDL %1.%2.%3 (%4)")
+                            .arg(sdlVersion.major)
+                            .arg(sdlVersion.minor)
+                            .arg(sdlVersion.patch)
+                            .arg(videoDriver != nullptr ? videoDriver : "none"));
+    }
+
+#ifdef HAVE_FFMPEG
+    identity.append(QString("FFmpeg %1 (avcodec %2)").arg(av_version_info()).arg(avcodec_version()));
+#endif
+
+    for (int i = 0; i < SDL_GetNumVideoDisplays(); i++) {
+        SDL_DisplayMode mode;
+
+        if (SDL_GetDesktopDisplayMode(i, &mode) == 0) {
+            identity.append(QString("Display %1: %2x%3x%4 (%5)")
+                                .arg(i)
+                                .arg(mode.w)
+                                .arg(mode.h)
+                                .arg(mode.refresh_rate)
+                                .arg(SDL_GetPixelFormatName(mode.format)));
+        }
+    }
+
+    appendGpuIdentity(identity);
+
+    for (const char* name : k_IdentityEnvironmentVariables) {
+        if (qEnvironmentVariableIsSet(name)) {
+            identity.append(QString("%1=%2").arg(name, QString::fromLocal8Bit(qgetenv(name))));
+        }
+    }
+
+    return QCryptographicHash::hash(identity.join('\n').toUtf8(), QCryptographicHash::Sha256).toHex();
+}
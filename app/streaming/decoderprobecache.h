@@ -0,0 +1,92 @@
+#pragma once
+
+#include <QMutex>
+#include <QSettings>
+#include <QSize>
+#include <QString>
+
+// Persists the results of test-only decoder probes across launches, so we
+// don't need to create and tear down decoders and renderers every time we
+// start. Cached results are only valid for the GPU, driver, FFmpeg build,
+// and display configuration that they were probed on, and they expire after
+// a while to catch changes that we can't see in the system identity.
+// Only results that found a hardware decoder are worth caching. Failing to
+// find one may be transient, so those probes always run again.
+// Callers must hold getProbeLock() from checking a cached result until
+// they're done using it, so it can't be invalidated in the meantime.
+class DecoderProbeCache
+{
+public:
+    typedef struct _DECODER_INFO {
+        bool isHardwareAccelerated;
+        bool isFullScreenOnly;
+        bool isHdrSupported;
+        QSize maxResolution;
+    } DECODER_INFO;
+
+    typedef struct _DECODER_PROPERTIES {
+        int capabilities;
+        int colorSpace;
+        int colorRange;
+        bool isAlwaysFullScreen;
+    } DECODER_PROPERTIES;
+
+    // Results of Session::getDecoderInfo()
+    static
+    bool getDecoderInfo(DECODER_INFO& info);
+
+    static
+    void putDecoderInfo(const DECODER_INFO& info);
+
+    // Results of Session::getDecoderAvailability()
+    static
+    bool getDecoderAvailability(int vds, int videoFormat, int width, int height, int frameRate,
+                                int& availability);
+
+    static
+    void putDecoderAvailability(int vds, int videoFormat, int width, int height, int frameRate,
+                                int availability);
+
+    // Results of Session::populateDecoderProperties()
+    static
+    bool getDecoderProperties(int vds, int videoFormat, int width, int height, int frameRate,
+                              DECODER_PROPERTIES& properties);
+
+    static
+    void putDecoderProperties(int vds, int videoFormat, int width, int height, int frameRate,
+                              const DECODER_PROPERTIES& properties);
+
+    // Returns true if the cached decoder info hasn't been probed or confirmed
+    // recently enough to skip probing it again in the background
+    static
+    bool isDecoderInfoRevalidationDue();
+
+    // Records that a background probe confirmed the cached decoder info
+    static
+    void markDecoderInfoRevalidated();
+
+    // Discards all cached results. This is done when the decoder can't be
+    // recreated, and when the stream moves to another display or loses its
+    // render device.
+    static
+    void invalidate();
+
+    // Held by background revalidation for its whole probe, so session
+    // initialization can wait for it before using SDL. Sessions hold it
+    // while they check the cache and use or replace what they found.
+    static
+    QMutex* getProbeLock();
+
+private:
+    static
+    bool openCache(QSettings& settings, bool forWrite);
+
+    static
+    QString getProbeKey(int vds, int videoFormat, int width, int height, int frameRate);
+
+    static
+    QString getSystemIdentity();
+
+    static
+    void appendGpuIdentity(QStringList& identity);
+};
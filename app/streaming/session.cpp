@@ -1,6 +1,7 @@
 #include "session.h"
 #include "settings/streamingpreferences.h"
 #include "streaming/streamutils.h"
+#include "streaming/decoderprobecache.h"
 #include "backend/richpresencemanager.h"
 
 #include <Limelight.h>
@@ -307,6 +308,8 @@ bool Session::chooseDecoder(StreamingPreferences::VideoDecoderSelection vds,
     params.window = window;
     params.enableVsync = enableVsync;
     params.enableFramePacing = enableFramePacing;
+    params.frameDropPolicy = (!testOnly && s_ActiveSession != nullptr) ?
+                s_ActiveSession->m_Preferences->frameDropPolicy : StreamingPreferences::FDP_BALANCED;
     params.testOnly = testOnly;
     params.vds = vds;
 
@@ -401,6 +404,25 @@ int Session::drSubmitDecodeUnit(PDECODE_UNIT du)
 void Session::getDecoderInfo(SDL_Window* window,
                              bool& isHardwareAccelerated, bool& isFullScreenOnly,
                              bool& isHdrSupported, QSize& maxResolution)
+{
+    // Failing to find a hardware decoder can be transient, like while the GPU
+    // is busy or its driver is being updated or reset. We always probe again
+    // in that case rather than leaving the user on software decoding.
+    if (probeDecoderInfo(window, isHardwareAccelerated, isFullScreenOnly, isHdrSupported, maxResolution) &&
+            isHardwareAccelerated) {
+        DecoderProbeCache::DECODER_INFO info;
+
+        info.isHardwareAccelerated = isHardwareAccelerated;
+        info.isFullScreenOnly = isFullScreenOnly;
+        info.isHdrSupported = isHdrSupported;
+        info.maxResolution = maxResolution;
+        DecoderProbeCache::putDecoderInfo(info);
+    }
+}
+
+bool Session::probeDecoderInfo(SDL_Window* window,
+                               bool& isHardwareAccelerated, bool& isFullScreenOnly,
+                               bool& isHdrSupported, QSize& maxResolution)
 {
     IVideoDecoder* decoder;
 
@@ -418,7 +440,7 @@ void Session::getDecoderInfo(SDL_Window* window,
         maxResolution = decoder->getDecoderMaxResolution();
         delete decoder;
 
-        return;
+        return true;
     }
 
     // Try an AV1 Main10 decoder next to see if we have HDR support
@@ -459,7 +481,7 @@ void Session::getDecoderInfo(SDL_Window* window,
         maxResolution = decoder->getDecoderMaxResolution();
         delete decoder;
 
-        return;
+        return true;
     }
 
 
@@ -472,7 +494,7 @@ void Session::getDecoderInfo(SDL_Window* window,
         maxResolution = decoder->getDecoderMaxResolution();
         delete decoder;
 
-        return;
+        return true;
     }
 #endif
 
@@ -486,11 +508,12 @@ void Session::getDecoderInfo(SDL_Window* window,
         maxResolution = decoder->getDecoderMaxResolution();
         delete decoder;
 
-        return;
+        return true;
     }
 
     SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                  "Failed to find ANY working H.264 or HEVC decoder!");
+    return false;
 }
 
 Session::DecoderAvailability
@@ -499,33 +522,81 @@ Session::getDecoderAvailability(SDL_Window* window,
                                 int videoFormat, int width, int height, int frameRate)
 {
     IVideoDecoder* decoder;
+    int cachedAvailability;
 
-    if (!chooseDecoder(vds, window, videoFormat, width, height, frameRate, false, false, true, decoder)) {
-        return DecoderAvailability::None;
+    // Hold the lock until we're done with the result, so the cache can't be
+    // invalidated between our check and using what it returned
+    QMutexLocker probeLocker(DecoderProbeCache::getProbeLock());
+    if (DecoderProbeCache::getDecoderAvailability(vds, videoFormat, width, height, frameRate, cachedAvailability)) {
+        return (DecoderAvailability)cachedAvailability;
     }
 
-    bool hw = decoder->isHardwareAccelerated();
-
-    delete decoder;
+    DecoderAvailability availability;
+    if (chooseDecoder(vds, window, videoFormat, width, height, frameRate, false, false, true, decoder)) {
+        availability = decoder->isHardwareAccelerated() ? DecoderAvailability::Hardware : DecoderAvailability::Software;
+        delete decoder;
+    }
+    else {
+        availability = DecoderAvailability::None;
+    }
 
-    return hw ? DecoderAvailability::Hardware : DecoderAvailability::Software;
+    // Only cache hardware decoders for the same reasons as getDecoderInfo()
+    if (availability == DecoderAvailability::Hardware) {
+        DecoderProbeCache::putDecoderAvailability(vds, videoFormat, width, height, frameRate, (int)availability);
+    }
+    return availability;
 }
 
 bool Session::populateDecoderProperties(SDL_Window* window)
 {
-    IVideoDecoder* decoder;
+    DecoderProbeCache::DECODER_PROPERTIES properties;
+
+    // Hold the lock until we've applied the properties, like getDecoderAvailability()
+    QMutexLocker probeLocker(DecoderProbeCache::getProbeLock());
+    bool cached = DecoderProbeCache::getDecoderProperties(m_Preferences->videoDecoderSelection,
+                                                          m_SupportedVideoFormats.first(),
+                                                          m_StreamConfig.width,
+                                                          m_StreamConfig.height,
+                                                          m_StreamConfig.fps,
+                                                          properties);
+
+    if (cached) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Using cached decoder properties");
+    }
+    else {
+        IVideoDecoder* decoder;
+
+        if (!chooseDecoder(m_Preferences->videoDecoderSelection,
+                           window,
+                           m_SupportedVideoFormats.first(),
+                           m_StreamConfig.width,
+                           m_StreamConfig.height,
+                           m_StreamConfig.fps,
+                           false, false, true, decoder)) {
+            return false;
+        }
 
-    if (!chooseDecoder(m_Preferences->videoDecoderSelection,
-                       window,
-                       m_SupportedVideoFormats.first(),
-                       m_StreamConfig.width,
-                       m_StreamConfig.height,
-                       m_StreamConfig.fps,
-                       false, false, true, decoder)) {
-        return false;
+        properties.capabilities = decoder->getDecoderCapabilities();
+        properties.colorSpace = decoder->getDecoderColorspace();
+        properties.colorRange = decoder->getDecoderColorRange();
+        properties.isAlwaysFullScreen = decoder->isAlwaysFullScreen();
+
+        // Software decoders measure the CPU to choose their capabilities,
+        // so only the results from hardware decoders can be reused.
+        if (decoder->isHardwareAccelerated()) {
+            DecoderProbeCache::putDecoderProperties(m_Preferences->videoDecoderSelection,
+                                                    m_SupportedVideoFormats.first(),
+                                                    m_StreamConfig.width,
+                                                    m_StreamConfig.height,
+                                                    m_StreamConfig.fps,
+                                                    properties);
+        }
+
+        delete decoder;
     }
 
-    m_VideoCallbacks.capabilities = decoder->getDecoderCapabilities();
+    m_VideoCallbacks.capabilities = properties.capabilities;
     if (m_VideoCallbacks.capabilities & CAPABILITY_PULL_RENDERER) {
         // It is an error to pass a push callback when in pull mode
         m_VideoCallbacks.submitDecodeUnit = nullptr;
@@ -544,7 +615,7 @@ bool Session::populateDecoderProperties(SDL_Window* window)
                         m_StreamConfig.colorSpace);
         }
         else {
-            m_StreamConfig.colorSpace = decoder->getDecoderColorspace();
+            m_StreamConfig.colorSpace = properties.colorSpace;
         }
 
         m_StreamConfig.colorRange = qEnvironmentVariableIntValue("COLOR_RANGE_OVERRIDE", &ok);
@@ -554,16 +625,14 @@ bool Session::populateDecoderProperties(SDL_Window* window)
                         m_StreamConfig.colorRange);
         }
         else {
-            m_StreamConfig.colorRange = decoder->getDecoderColorRange();
+            m_StreamConfig.colorRange = properties.colorRange;
         }
     }
 
-    if (decoder->isAlwaysFullScreen()) {
+    if (properties.isAlwaysFullScreen) {
         m_IsFullScreen = true;
     }
 
-    delete decoder;
-
     return true;
 }
 
@@ -590,13 +659,32 @@ Session::Session(NvComputer* computer, NvApp& app, StreamingPreferences *prefere
       m_CancelRetry(false),
       m_OpusDecoder(nullptr),
       m_AudioRenderer(nullptr),
-      m_AudioSampleCount(0),
-      m_DropAudioEndTime(0)
+      m_AudioLostPackets(0),
+      m_AudioPacketSemaphore(nullptr),
+      m_AudioDecodeThread(nullptr),
+      m_AudioReinitThread(nullptr),
+      m_NextAudioReinitTime(0),
+      m_PendingAudioRenderer(nullptr),
+      m_PendingOpusDecoder(nullptr),
+      m_OverlayAudioStatsLock(0)
 {
+    SDL_AtomicSet(&m_AudioDecodeThreadStopping, 0);
+    SDL_AtomicSet(&m_AudioReinitComplete, 0);
+    SDL_zero(m_ActiveWndAudioStats);
+    SDL_zero(m_LastWndAudioStats);
+    SDL_zero(m_GlobalAudioStats);
+    SDL_zero(m_LastJitterStats);
+    SDL_zero(m_OverlayAudioStats);
 }
 
 bool Session::initialize()
 {
+    {
+        // Wait for any background decoder probing to finish before we use SDL.
+        // After this, we only take the probe lock to read or write the cache.
+        QMutexLocker probeLocker(DecoderProbeCache::getProbeLock());
+    }
+
 #ifdef Q_OS_DARWIN
     if (qEnvironmentVariableIntValue("I_WANT_BUGGY_FULLSCREEN") == 0) {
         // If we have a notch and the user specified one of the two native display modes
@@ -2202,6 +2290,10 @@ void Session::execInternal()
                     if (newDisplayIndex != currentDisplayIndex) {
                         currentDisplayIndex = newDisplayIndex;
                         updateOptimalWindowDisplayMode();
+
+                        // The new display may be driven by a different GPU
+                        QMutexLocker probeLocker(DecoderProbeCache::getProbeLock());
+                        DecoderProbeCache::invalidate();
                     }
 
                     break;
@@ -2240,6 +2332,15 @@ void Session::execInternal()
             if (currentDisplayIndex != SDL_GetWindowDisplayIndex(m_Window)) {
                 currentDisplayIndex = SDL_GetWindowDisplayIndex(m_Window);
                 updateOptimalWindowDisplayMode();
+
+                // The new display may be driven by a different GPU
+                QMutexLocker probeLocker(DecoderProbeCache::getProbeLock());
+                DecoderProbeCache::invalidate();
+            }
+            else if (event.type == SDL_RENDER_DEVICE_RESET) {
+                // The GPU or its driver may have changed underneath us
+                QMutexLocker probeLocker(DecoderProbeCache::getProbeLock());
+                DecoderProbeCache::invalidate();
             }
 
             // Now that the old decoder is dead, flush any events it may
@@ -2273,6 +2374,13 @@ void Session::execInternal()
                     SDL_AtomicUnlock(&m_DecoderLock);
                     SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                                  "Failed to recreate decoder after reset");
+
+                    // Our cached probe results may have led us to choose a decoder
+                    // that no longer works, so don't trust them next time.
+                    {
+                        QMutexLocker probeLocker(DecoderProbeCache::getProbeLock());
+                        DecoderProbeCache::invalidate();
+                    }
                     emit displayLaunchError(tr("Unable to initialize video decoder. Please check your streaming settings and try again."));
                     goto DispatchDeferredCleanup;
                 }
@@ -9,6 +9,7 @@
 #include "input/input.h"
 #include "video/decoder.h"
 #include "audio/renderers/renderer.h"
+#include "audio/audiopacketqueue.h"
 #include "video/overlaymanager.h"
 
 class SupportedVideoFormatList : public QList<int>
@@ -122,6 +123,9 @@ public:
         return m_OverlayManager;
     }
 
+    // Writes the audio stats for the last two windows, for the overlay
+    void stringifyOverlayAudioStats(char* output, int length);
+
     void flushWindowEvents();
 
     void setShouldExitAfterQuit();
@@ -171,7 +175,24 @@ private:
 
     IAudioRenderer* createAudioRenderer(const POPUS_MULTISTREAM_CONFIGURATION opusConfig);
 
-    bool initializeAudioRenderer();
+    bool initializeAudioRenderer(IAudioRenderer*& renderer, OpusMSDecoder*& decoder,
+                                 OPUS_MULTISTREAM_CONFIGURATION& activeConfig);
+
+    void reinitializeAudioRendererAsync();
+
+    void decodeAudioPacket(const unsigned char* sampleData, int sampleLength);
+
+    bool decodeAndSubmitAudio(const unsigned char* sampleData, int sampleLength, bool concealment);
+
+    bool concealLostAudio(const unsigned char* nextSampleData, int nextSampleLength);
+
+    void updateAudioStats();
+
+    void addAudioStats(AUDIO_STATS& src, AUDIO_STATS& dst);
+
+    void stringifyAudioStats(AUDIO_STATS& stats, char* output, int length);
+
+    void logAudioStats(AUDIO_STATS& stats, const char* title);
 
     bool testAudio(int audioConfiguration);
 
@@ -192,6 +213,11 @@ private:
         Hardware
     };
 
+    static
+    bool probeDecoderInfo(SDL_Window* window,
+                          bool& isHardwareAccelerated, bool& isFullScreenOnly,
+                          bool& isHdrSupported, QSize& maxResolution);
+
     static
     DecoderAvailability getDecoderAvailability(SDL_Window* window,
                                                StreamingPreferences::VideoDecoderSelection vds,
@@ -248,6 +274,12 @@ private:
     static
     void arDecodeAndPlaySample(char* sampleData, int sampleLength);
 
+    static
+    int audioDecodeThreadProc(void* context);
+
+    static
+    int audioReinitThreadProc(void* context);
+
     static
     int drSetup(int videoFormat, int width, int height, int frameRate, void*, int);
 
@@ -298,8 +330,32 @@ private:
     IAudioRenderer* m_AudioRenderer;
     OPUS_MULTISTREAM_CONFIGURATION m_ActiveAudioConfig;
     OPUS_MULTISTREAM_CONFIGURATION m_OriginalAudioConfig;
-    int m_AudioSampleCount;
-    Uint32 m_DropAudioEndTime;
+    int m_AudioLostPackets;
+
+    // Packets are decoded and played on their own thread
+    AudioPacketQueue m_AudioPacketQueue;
+    SDL_sem* m_AudioPacketSemaphore;
+    SDL_Thread* m_AudioDecodeThread;
+    SDL_atomic_t m_AudioDecodeThreadStopping;
+
+    // The renderer is recreated on another thread while
+    // the decode thread keeps draining the packet queue.
+    SDL_Thread* m_AudioReinitThread;
+    SDL_atomic_t m_AudioReinitComplete;
+    Uint32 m_NextAudioReinitTime;
+    IAudioRenderer* m_PendingAudioRenderer;
+    OpusMSDecoder* m_PendingOpusDecoder;
+    OPUS_MULTISTREAM_CONFIGURATION m_PendingAudioConfig;
+
+    // These are only touched by the audio thread
+    AUDIO_STATS m_ActiveWndAudioStats;
+    AUDIO_STATS m_LastWndAudioStats;
+    AUDIO_STATS m_GlobalAudioStats;
+    AUDIO_JITTER_STATS m_LastJitterStats;
+
+    // The last two windows, for the overlay to pick up
+    SDL_SpinLock m_OverlayAudioStatsLock;
+    AUDIO_STATS m_OverlayAudioStats;
 
     Overlay::OverlayManager m_OverlayManager;
 
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Read and write positions of a bounded ring shared by exactly one producer
+// thread and one consumer thread. The positions count every element ever
+// written and read, so they are free to wrap around and only the difference
+// between them matters. Rings indexing slots with (position % capacity) must
+// use a power of two capacity for that to stay correct across the wrap.
+//
+// The producer fills its slots before calling endWrite(), and the consumer
+// empties its slots before calling endRead(). Those are release stores, and
+// each side loads the other's position with acquire, so the consumer never
+// sees a slot before its contents and the producer never reuses a slot
+// before the consumer is done with it.
+class SpscRingPositions
+{
+public:
+    SpscRingPositions()
+    {
+        reset();
+    }
+
+    // Only safe while neither thread is using the ring
+    void reset()
+    {
+        m_WritePos.store(0, std::memory_order_relaxed);
+        m_ReadPos.store(0, std::memory_order_relaxed);
+    }
+
+    // Safe to call from either thread, though the result is only a
+    // lower or upper bound for the side that isn't changing it.
+    uint32_t count()
+    {
+        // Load the read position first so a concurrent read
+        // can never make the result appear negative.
+        uint32_t readPos = m_ReadPos.load(std::memory_order_acquire);
+        uint32_t writePos = m_WritePos.load(std::memory_order_acquire);
+        return writePos - readPos;
+    }
+
+    // Producer only. Returns the next position to write and stores
+    // the number of elements currently in the ring in *used.
+    uint32_t beginWrite(uint32_t* used)
+    {
+        uint32_t writePos = m_WritePos.load(std::memory_order_relaxed);
+        *used = writePos - m_ReadPos.load(std::memory_order_acquire);
+        return writePos;
+    }
+
+    // Producer only. Publishes every slot before newWritePos.
+    void endWrite(uint32_t newWritePos)
+    {
+        m_WritePos.store(newWritePos, std::memory_order_release);
+    }
+
+    // Consumer only. Returns the next position to read and stores
+    // the number of elements available to read in *available.
+    uint32_t beginRead(uint32_t* available)
+    {
+        uint32_t readPos = m_ReadPos.load(std::memory_order_acquire);
+        *available = m_WritePos.load(std::memory_order_acquire) - readPos;
+        return readPos;
+    }
+
+    // Consumer only. Releases every slot before newReadPos to the producer.
+    void endRead(uint32_t newReadPos)
+    {
+        m_ReadPos.store(newReadPos, std::memory_order_release);
+    }
+
+    // For rings where the producer may also consume, such as to evict the
+    // oldest element when full. Releases the slot at readPos if nobody else
+    // did first, and returns false if somebody did.
+    bool tryEndRead(uint32_t readPos)
+    {
+        return m_ReadPos.compare_exchange_strong(readPos, readPos + 1,
+                                                 std::memory_order_acq_rel,
+                                                 std::memory_order_acquire);
+    }
+
+private:
+    std::atomic<uint32_t> m_WritePos;
+    std::atomic<uint32_t> m_ReadPos;
+};
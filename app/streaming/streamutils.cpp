@@ -157,6 +157,16 @@ int StreamUtils::getDisplayRefreshRate(SDL_Window* window)
     return mode.refresh_rate;
 }
 
+uint64_t StreamUtils::getMonotonicTimeUs()
+{
+    static Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 counter = SDL_GetPerformanceCounter();
+
+    // Split the conversion to avoid overflowing 64 bits with
+    // high frequency counters on long-running sessions.
+    return (counter / frequency) * 1000000 + ((counter % frequency) * 1000000) / frequency;
+}
+
 bool StreamUtils::hasFastAes()
 {
 #ifndef __has_builtin
@@ -23,6 +23,9 @@ public:
     static
     int getDisplayRefreshRate(SDL_Window* window);
 
+    static
+    uint64_t getMonotonicTimeUs();
+
     static
     bool hasFastAes();
 
@@ -3,10 +3,12 @@
 #include <Limelight.h>
 #include "SDL_compat.h"
 #include "settings/streamingpreferences.h"
+#include "latencyhistogram.h"
 
 #define SDL_CODE_FRAME_READY 0
 
 #define MAX_SLICES 4
+#define MAX_ADAPTIVE_SLICES 16
 
 typedef struct _VIDEO_STATS {
     uint32_t receivedFrames;
@@ -14,22 +16,37 @@ typedef struct _VIDEO_STATS {
     uint32_t renderedFrames;
     uint32_t totalFrames;
     uint32_t networkDroppedFrames;
-    uint32_t pacerDroppedFrames;
+    uint32_t pacerDroppedFrames; // Total of the per-reason counters below
+    uint32_t pacingQueueDroppedFrames;
+    uint32_t latchDroppedFrames;
+    uint32_t renderQueueDroppedFrames;
+    uint32_t overflowDroppedFrames;
+    uint32_t vrrPresentedFrames; // Including repeats, only counted in VRR mode
+    uint32_t vrrRepeatedFrames;
+    uint32_t framePoolMissedFrames; // Decoded frames that needed a new AVFrame
     uint16_t minHostProcessingLatency;
     uint16_t maxHostProcessingLatency;
     uint32_t totalHostProcessingLatency;
     uint32_t framesWithHostProcessingLatency;
-    uint32_t totalReassemblyTime;
-    uint32_t totalDecodeTime;
-    uint32_t totalPacerTime;
-    uint32_t totalRenderTime;
+    uint64_t totalReassemblyTimeUs;
+    uint64_t totalDecodeTimeUs;
+    uint64_t totalPacerTimeUs;
+    uint64_t totalRenderTimeUs;
     uint32_t lastRtt;
     uint32_t lastRttVariance;
     float totalFps;
     float receivedFps;
     float decodedFps;
     float renderedFps;
+    float vrrRefreshRate;
     uint32_t measurementStartTimestamp;
+
+    // Per-stage latency distributions
+    LatencyHistogram reassemblyLatency; // Receive -> reassembly complete
+    LatencyHistogram submitLatency;     // avcodec_send_packet()
+    LatencyHistogram decodeLatency;     // Reassembly complete -> avcodec_receive_frame()
+    LatencyHistogram pacerLatency;      // Pacer enqueue -> render start
+    LatencyHistogram renderLatency;     // Render start -> present
 } VIDEO_STATS, *PVIDEO_STATS;
 
 typedef struct _DECODER_PARAMETERS {
@@ -42,6 +59,7 @@ typedef struct _DECODER_PARAMETERS {
     int frameRate;
     bool enableVsync;
     bool enableFramePacing;
+    StreamingPreferences::FrameDropPolicy frameDropPolicy;
     bool testOnly;
 } DECODER_PARAMETERS, *PDECODER_PARAMETERS;
 
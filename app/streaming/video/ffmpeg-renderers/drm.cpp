@@ -148,6 +148,7 @@ DrmRenderer::DrmRenderer(AVHWDeviceType hwDeviceType, IFFmpegRenderer *backendRe
       m_ConnectorId(0),
       m_EncoderId(0),
       m_CrtcId(0),
+      m_CrtcIndex(-1),
       m_PlaneId(0),
       m_CurrentFbId(0),
       m_LastFullRange(false),
@@ -159,9 +160,14 @@ DrmRenderer::DrmRenderer(AVHWDeviceType hwDeviceType, IFFmpegRenderer *backendRe
       m_ColorspaceProp(nullptr),
       m_Version(nullptr),
       m_HdrOutputMetadataBlobId(0),
+      m_VrrCapable(false),
+      m_VrrEnabled(false),
+      m_VrrEnabledPropId(0),
+      m_VrrMinRefreshRate(0),
       m_OutputRect{},
       m_SwFrameMapper(this),
-      m_CurrentSwFrameIdx(0)
+      m_CurrentSwFrameIdx(0),
+      m_DumbBufferFrame(av_frame_alloc())
 #ifdef HAVE_EGL
     , m_EglImageFactory(this)
 #endif
@@ -174,6 +180,11 @@ DrmRenderer::~DrmRenderer()
     // Ensure we're out of HDR mode
     setHdrMode(false);
 
+    // Put the CRTC back into fixed refresh mode if we changed it
+    if (m_VrrEnabled) {
+        drmModeObjectSetProperty(m_DrmFd, m_CrtcId, DRM_MODE_OBJECT_CRTC, m_VrrEnabledPropId, 0);
+    }
+
     for (int i = 0; i < k_SwFrameCount; i++) {
         if (m_SwFrame[i].primeFd) {
             close(m_SwFrame[i].primeFd);
@@ -190,6 +201,8 @@ DrmRenderer::~DrmRenderer()
         }
     }
 
+    av_frame_free(&m_DumbBufferFrame);
+
     if (m_CurrentFbId != 0) {
         drmModeRmFB(m_DrmFd, m_CurrentFbId);
     }
@@ -672,6 +685,19 @@ bool DrmRenderer::initialize(PDECODER_PARAMETERS params)
                     else if (!strcmp(prop->name, "Colorspace")) {
                         m_ColorspaceProp = prop;
                     }
+                    else if (!strcmp(prop->name, "vrr_capable")) {
+                        m_VrrCapable = props->prop_values[j] != 0;
+                        drmModeFreeProperty(prop);
+                    }
+                    else if (!strcmp(prop->name, "EDID") && props->prop_values[j] != 0) {
+                        drmModePropertyBlobPtr edid = drmModeGetPropertyBlob(m_DrmFd, (uint32_t)props->prop_values[j]);
+                        if (edid != nullptr) {
+                            m_VrrMinRefreshRate = getEdidMinRefreshRate((const uint8_t*)edid->data, edid->length);
+                            drmModeFreePropertyBlob(edid);
+                        }
+
+                        drmModeFreeProperty(prop);
+                    }
                     else if (!strcmp(prop->name, "max bpc") && (m_VideoFormat & VIDEO_FORMAT_MASK_10BIT)) {
                         if (drmModeObjectSetProperty(m_DrmFd, m_ConnectorId, DRM_MODE_OBJECT_CONNECTOR, prop->prop_id, 16) == 0) {
                             SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
@@ -705,8 +731,28 @@ bool DrmRenderer::initialize(PDECODER_PARAMETERS params)
         }
     }
 
+    // Populate CRTC properties
+    {
+        drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(m_DrmFd, m_CrtcId, DRM_MODE_OBJECT_CRTC);
+        if (props != nullptr) {
+            for (uint32_t j = 0; j < props->count_props; j++) {
+                drmModePropertyPtr prop = drmModeGetProperty(m_DrmFd, props->props[j]);
+                if (prop != nullptr) {
+                    if (!strcmp(prop->name, "VRR_ENABLED")) {
+                        m_VrrEnabledPropId = prop->prop_id;
+                    }
+
+                    drmModeFreeProperty(prop);
+                }
+            }
+
+            drmModeFreeObjectProperties(props);
+        }
+    }
+
     // If we got this far, we can do direct rendering via the DRM FD.
     m_SupportsDirectRendering = true;
+    m_CrtcIndex = crtcIndex;
 
     return true;
 }
@@ -884,38 +930,35 @@ void DrmRenderer::setHdrMode(bool enabled)
     }
 }
 
+void DrmRenderer::ffNoopFree(void*, uint8_t*)
+{
+    // Nothing
+}
+
 bool DrmRenderer::mapSoftwareFrame(AVFrame *frame, AVDRMFrameDescriptor *mappedFrame)
 {
-    bool ret = false;
-    bool freeFrame;
     auto drmFrame = &m_SwFrame[m_CurrentSwFrameIdx];
 
     SDL_assert(frame->format != AV_PIX_FMT_DRM_PRIME);
     SDL_assert(!m_DrmPrimeBackend);
 
     // If this is a non-DRM hwframe that cannot be exported to DRM format, we must
-    // use the SwFrameMapper to map it to a swframe before we can copy it to dumb buffers.
-    if (frame->hw_frames_ctx != nullptr) {
-        frame = m_SwFrameMapper.getSwFrameFromHwFrame(frame);
-        if (frame == nullptr) {
-            return false;
-        }
-
-        freeFrame = true;
-    }
-    else {
-        freeFrame = false;
+    // use the SwFrameMapper to read it back into our dumb buffers. Otherwise, this
+    // is just the format of the swframe.
+    AVPixelFormat swFormat = m_SwFrameMapper.getSwPixelFormat(frame);
+    if (swFormat == AV_PIX_FMT_NONE) {
+        return false;
     }
 
-    const AVPixFmtDescriptor* formatDesc = av_pix_fmt_desc_get((AVPixelFormat) frame->format);
-    int planes = av_pix_fmt_count_planes((AVPixelFormat) frame->format);
+    const AVPixFmtDescriptor* formatDesc = av_pix_fmt_desc_get(swFormat);
+    int planes = av_pix_fmt_count_planes(swFormat);
 
-    auto drmFormatTuple = k_AvToDrmFormatMap.find((AVPixelFormat) frame->format);
+    auto drmFormatTuple = k_AvToDrmFormatMap.find(swFormat);
     if (drmFormatTuple == k_AvToDrmFormatMap.end()) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                      "Unable to map frame with unsupported format: %d",
-                     frame->format);
-        goto Exit;
+                     swFormat);
+        return false;
     }
 
     // Create a new dumb buffer if needed
@@ -940,7 +983,7 @@ bool DrmRenderer::mapSoftwareFrame(AVFrame *frame, AVDRMFrameDescriptor *mappedF
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "DRM_IOCTL_MODE_CREATE_DUMB failed: %d",
                          errno);
-            goto Exit;
+            return false;
         }
 
         drmFrame->handle = createBuf.handle;
@@ -958,7 +1001,7 @@ bool DrmRenderer::mapSoftwareFrame(AVFrame *frame, AVDRMFrameDescriptor *mappedF
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "DRM_IOCTL_MODE_MAP_DUMB failed: %d",
                          errno);
-            goto Exit;
+            return false;
         }
 
         // Raspberry Pi on kernel 6.1 defaults to an aarch64 kernel with a 32-bit userspace (and off_t).
@@ -974,7 +1017,7 @@ bool DrmRenderer::mapSoftwareFrame(AVFrame *frame, AVDRMFrameDescriptor *mappedF
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "mmap() failed for dumb buffer: %d",
                          errno);
-            goto Exit;
+            return false;
         }
     }
 
@@ -985,7 +1028,7 @@ bool DrmRenderer::mapSoftwareFrame(AVFrame *frame, AVDRMFrameDescriptor *mappedF
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "drmPrimeHandleToFD() failed: %d",
                          errno);
-            goto Exit;
+            return false;
         }
     }
 
@@ -1005,73 +1048,72 @@ bool DrmRenderer::mapSoftwareFrame(AVFrame *frame, AVDRMFrameDescriptor *mappedF
         auto &layer = mappedFrame->layers[0];
         layer.format = drmFormatTuple->second;
 
-        // Prepare to write to the dumb buffer from the CPU
-        struct dma_buf_sync sync;
-        sync.flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_WRITE;
-        drmIoctl(drmFrame->primeFd, DMA_BUF_IOCTL_SYNC, &sync);
+        // Wrap the dumb buffer in a frame for the SwFrameMapper to copy into
+        m_DumbBufferFrame->format = swFormat;
+        m_DumbBufferFrame->width = frame->width;
+        m_DumbBufferFrame->height = frame->height;
 
         int lastPlaneSize = 0;
-        for (int i = 0; i < 4; i++) {
-            if (frame->data[i] != nullptr) {
-                auto &plane = layer.planes[layer.nb_planes];
-
-                plane.object_index = 0;
-                plane.offset = i == 0 ? 0 : (layer.planes[layer.nb_planes - 1].offset + lastPlaneSize);
-
-                int planeHeight;
-                if (i == 0) {
-                    // Y plane is not subsampled
-                    planeHeight = frame->height;
-                    plane.pitch = drmFrame->pitch;
-                }
-                else {
-                    planeHeight = AV_CEIL_RSHIFT(frame->height, formatDesc->log2_chroma_h);
+        for (int i = 0; i < planes; i++) {
+            auto &plane = layer.planes[layer.nb_planes];
 
-                    // First argument to AV_CEIL_RSHIFT() *must* be signed for correct behavior!
-                    plane.pitch = AV_CEIL_RSHIFT((ptrdiff_t)drmFrame->pitch, formatDesc->log2_chroma_w);
+            plane.object_index = 0;
+            plane.offset = i == 0 ? 0 : (layer.planes[layer.nb_planes - 1].offset + lastPlaneSize);
 
-                    // If UV planes are interleaved, double the pitch to count both U+V together
-                    if (planes == 2) {
-                        plane.pitch <<= 1;
-                    }
-                }
+            int planeHeight;
+            if (i == 0) {
+                // Y plane is not subsampled
+                planeHeight = frame->height;
+                plane.pitch = drmFrame->pitch;
+            }
+            else {
+                planeHeight = AV_CEIL_RSHIFT(frame->height, formatDesc->log2_chroma_h);
 
-                // Copy the plane data into the dumb buffer
-                if (frame->linesize[i] == (int)plane.pitch) {
-                    // We can do a single memcpy() if the pitch is compatible
-                    memcpy(drmFrame->mapping + plane.offset,
-                           frame->data[i],
-                           frame->linesize[i] * planeHeight);
-                }
-                else {
-                    // The pitch is incompatible, so we must copy line-by-line
-                    for (int j = 0; j < planeHeight; j++) {
-                        memcpy(drmFrame->mapping + (j * plane.pitch) + plane.offset,
-                               frame->data[i] + (j * frame->linesize[i]),
-                               qMin(frame->linesize[i], (int)plane.pitch));
-                    }
+                // First argument to AV_CEIL_RSHIFT() *must* be signed for correct behavior!
+                plane.pitch = AV_CEIL_RSHIFT((ptrdiff_t)drmFrame->pitch, formatDesc->log2_chroma_w);
+
+                // If UV planes are interleaved, double the pitch to count both U+V together
+                if (planes == 2) {
+                    plane.pitch <<= 1;
                 }
+            }
 
-                layer.nb_planes++;
+            m_DumbBufferFrame->data[i] = drmFrame->mapping + plane.offset;
+            m_DumbBufferFrame->linesize[i] = (int)plane.pitch;
 
-                lastPlaneSize = plane.pitch * planeHeight;
-            }
+            layer.nb_planes++;
+
+            lastPlaneSize = plane.pitch * planeHeight;
         }
 
+        // Some FFmpeg APIs require the destination frame to be refcounted
+        m_DumbBufferFrame->buf[0] = av_buffer_create(drmFrame->mapping, drmFrame->size, ffNoopFree, nullptr, 0);
+        if (m_DumbBufferFrame->buf[0] == nullptr) {
+            return false;
+        }
+
+        // Prepare to write to the dumb buffer from the CPU
+        struct dma_buf_sync sync;
+        sync.flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_WRITE;
+        drmIoctl(drmFrame->primeFd, DMA_BUF_IOCTL_SYNC, &sync);
+
+        // Copy the frame data into the dumb buffer. Frames that would otherwise need
+        // to be read back into a swframe first are read back directly into it.
+        bool copied = m_SwFrameMapper.copyFrame(frame, m_DumbBufferFrame);
+
         // End the CPU write to the dumb buffer
         sync.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_WRITE;
         drmIoctl(drmFrame->primeFd, DMA_BUF_IOCTL_SYNC, &sync);
-    }
 
-    ret = true;
-    m_CurrentSwFrameIdx = (m_CurrentSwFrameIdx + 1) % k_SwFrameCount;
+        av_buffer_unref(&m_DumbBufferFrame->buf[0]);
 
-Exit:
-    if (freeFrame) {
-        av_frame_free(&frame);
+        if (!copied) {
+            return false;
+        }
     }
 
-    return ret;
+    m_CurrentSwFrameIdx = (m_CurrentSwFrameIdx + 1) % k_SwFrameCount;
+    return true;
 }
 
 bool DrmRenderer::addFbForFrame(AVFrame *frame, uint32_t* newFbId, bool testMode)
@@ -1344,6 +1386,76 @@ void DrmRenderer::renderFrame(AVFrame* frame)
     drmModeRmFB(m_DrmFd, lastFbId);
 }
 
+bool DrmRenderer::getDrmVblankTarget(int* drmFd, int* crtcIndex)
+{
+    // We can only wait for V-blanks on the CRTC we're scanning out to
+    if (!m_SupportsDirectRendering || m_CrtcIndex < 0) {
+        return false;
+    }
+
+    *drmFd = m_DrmFd;
+    *crtcIndex = m_CrtcIndex;
+    return true;
+}
+
+bool DrmRenderer::enableVrr(int* minRefreshRate)
+{
+    // The connector must support VRR and the CRTC must let us turn it on
+    if (!m_SupportsDirectRendering || !m_VrrCapable || m_VrrEnabledPropId == 0) {
+        return false;
+    }
+
+    if (!m_VrrEnabled) {
+        int err = drmModeObjectSetProperty(m_DrmFd, m_CrtcId, DRM_MODE_OBJECT_CRTC, m_VrrEnabledPropId, 1);
+        if (err < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "drmModeObjectSetProperty(VRR_ENABLED) failed: %d",
+                         errno);
+            return false;
+        }
+
+        m_VrrEnabled = true;
+    }
+
+    if (m_VrrMinRefreshRate > 0) {
+        *minRefreshRate = m_VrrMinRefreshRate;
+    }
+    else {
+        // The EDID didn't tell us, so assume the most common lower bound
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Unable to find VRR range in EDID. Assuming 48 Hz minimum.");
+        *minRefreshRate = 48;
+    }
+
+    return true;
+}
+
+// Returns the minimum vertical rate from the EDID display range limits descriptor or 0 if not present
+int DrmRenderer::getEdidMinRefreshRate(const uint8_t* edid, size_t length)
+{
+    if (length < 128) {
+        return 0;
+    }
+
+    // The base block has four 18-byte descriptors starting at offset 54
+    for (size_t offset = 54; offset + 18 <= 126; offset += 18) {
+        const uint8_t* descriptor = &edid[offset];
+
+        // Display descriptors have a zero pixel clock
+        if (descriptor[0] != 0 || descriptor[1] != 0 || descriptor[2] != 0) {
+            continue;
+        }
+
+        // 0xFD is the display range limits tag
+        if (descriptor[3] == 0xFD) {
+            // EDID 1.4 allows an offset of 255 Hz to be added to the rates
+            return descriptor[5] + ((descriptor[4] & 0x01) ? 255 : 0);
+        }
+    }
+
+    return 0;
+}
+
 bool DrmRenderer::needsTestFrame()
 {
     return true;
@@ -1478,4 +1590,8 @@ void DrmRenderer::freeEGLImages(EGLDisplay dpy, EGLImage images[EGL_MAX_PLANES])
     m_EglImageFactory.freeEGLImages(dpy, images);
 }
 
+void DrmRenderer::flushEGLImages(EGLDisplay dpy) {
+    m_EglImageFactory.flushEGLImages(dpy);
+}
+
 #endif
@@ -64,21 +64,26 @@ public:
     virtual bool isDirectRenderingSupported() override;
     virtual int getDecoderColorspace() override;
     virtual void setHdrMode(bool enabled) override;
+    virtual bool getDrmVblankTarget(int* drmFd, int* crtcIndex) override;
+    virtual bool enableVrr(int* minRefreshRate) override;
 #ifdef HAVE_EGL
     virtual bool canExportEGL() override;
     virtual AVPixelFormat getEGLImagePixelFormat() override;
     virtual bool initializeEGL(EGLDisplay dpy, const EGLExtensions &ext) override;
     virtual ssize_t exportEGLImages(AVFrame *frame, EGLDisplay dpy, EGLImage images[EGL_MAX_PLANES]) override;
     virtual void freeEGLImages(EGLDisplay dpy, EGLImage[EGL_MAX_PLANES]) override;
+    virtual void flushEGLImages(EGLDisplay dpy) override;
 #endif
 
 private:
     bool getPropertyByName(drmModeObjectPropertiesPtr props, const char* name, uint64_t *value);
     const char* getDrmColorEncodingValue(AVFrame* frame);
     const char* getDrmColorRangeValue(AVFrame* frame);
+    static void ffNoopFree(void *opaque, uint8_t *data);
     bool mapSoftwareFrame(AVFrame* frame, AVDRMFrameDescriptor* mappedFrame);
     bool addFbForFrame(AVFrame* frame, uint32_t* newFbId, bool testMode);
     static bool drmFormatMatchesVideoFormat(uint32_t drmFormat, int videoFormat);
+    static int getEdidMinRefreshRate(const uint8_t* edid, size_t length);
 
     IFFmpegRenderer* m_BackendRenderer;
     SDL_Window* m_Window;
@@ -93,6 +98,7 @@ private:
     uint32_t m_ConnectorId;
     uint32_t m_EncoderId;
     uint32_t m_CrtcId;
+    int m_CrtcIndex;
     uint32_t m_PlaneId;
     uint32_t m_CurrentFbId;
     bool m_LastFullRange;
@@ -104,6 +110,10 @@ private:
     drmModePropertyPtr m_ColorspaceProp;
     drmVersionPtr m_Version;
     uint32_t m_HdrOutputMetadataBlobId;
+    bool m_VrrCapable;
+    bool m_VrrEnabled;
+    uint32_t m_VrrEnabledPropId;
+    int m_VrrMinRefreshRate;
     SDL_Rect m_OutputRect;
     std::set<uint32_t> m_SupportedPlaneFormats;
 
@@ -117,6 +127,7 @@ private:
         uint8_t* mapping;
         int primeFd;
     } m_SwFrame[k_SwFrameCount];
+    AVFrame* m_DumbBufferFrame;
 
 #ifdef HAVE_EGL
     EglImageFactory m_EglImageFactory;
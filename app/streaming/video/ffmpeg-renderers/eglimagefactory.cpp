@@ -1,6 +1,6 @@
 #include "eglimagefactory.h"
 
-#include <vector>
+#include <sys/stat.h>
 
 // Don't take a dependency on libdrm just for these constants
 #ifndef DRM_FORMAT_MOD_INVALID
@@ -27,10 +27,23 @@ EglImageFactory::EglImageFactory(IFFmpegRenderer* renderer) :
     m_eglCreateImageKHR(nullptr),
     m_eglDestroyImageKHR(nullptr),
     m_eglQueryDmaBufFormatsEXT(nullptr),
-    m_eglQueryDmaBufModifiersEXT(nullptr)
+    m_eglQueryDmaBufModifiersEXT(nullptr),
+    m_CacheDisplay(EGL_NO_DISPLAY),
+    m_CacheFramesContext(nullptr),
+    m_CacheWidth(0),
+    m_CacheHeight(0),
+    m_CacheUseCount(0),
+    m_CacheHits(0),
+    m_CacheMisses(0)
 {
 }
 
+EglImageFactory::~EglImageFactory()
+{
+    // The EGL renderer must flush our EGLImages while its display is still valid
+    SDL_assert(m_ImageCache.empty());
+}
+
 bool EglImageFactory::initializeEGL(EGLDisplay,
                                     const EGLExtensions &ext)
 {
@@ -68,6 +81,8 @@ ssize_t EglImageFactory::exportDRMImages(AVFrame* frame, AVDRMFrameDescriptor* d
 {
     memset(images, 0, sizeof(EGLImage) * EGL_MAX_PLANES);
 
+    invalidateCacheForFrame(frame, dpy);
+
     // DRM requires composed layers rather than separate layers per plane
     SDL_assert(drmFrame->nb_layers == 1);
 
@@ -208,31 +223,9 @@ ssize_t EglImageFactory::exportDRMImages(AVFrame* frame, AVDRMFrameDescriptor* d
     SDL_assert(attribIndex <= MAX_ATTRIB_COUNT);
 
     // Our EGLImages are non-planar, so we only populate the first entry
-    if (m_eglCreateImage) {
-        images[0] = m_eglCreateImage(dpy, EGL_NO_CONTEXT,
-                                     EGL_LINUX_DMA_BUF_EXT,
-                                     nullptr, attribs);
-        if (!images[0]) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "eglCreateImage() Failed: %d", eglGetError());
-            return -1;
-        }
-    }
-    else {
-        // Cast the EGLAttrib array elements to EGLint for the KHR extension
-        EGLint intAttribs[MAX_ATTRIB_COUNT];
-        for (int i = 0; i < MAX_ATTRIB_COUNT; i++) {
-            intAttribs[i] = (EGLint)attribs[i];
-        }
-
-        images[0] = m_eglCreateImageKHR(dpy, EGL_NO_CONTEXT,
-                                        EGL_LINUX_DMA_BUF_EXT,
-                                        nullptr, intAttribs);
-        if (!images[0]) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "eglCreateImageKHR() Failed: %d", eglGetError());
-            return -1;
-        }
+    images[0] = getOrCreateImage(dpy, attribs, attribIndex);
+    if (!images[0]) {
+        return -1;
     }
 
     return 1;
@@ -250,6 +243,8 @@ ssize_t EglImageFactory::exportVAImages(AVFrame *frame, VADRMPRIMESurfaceDescrip
 
     SDL_assert(vaFrame->num_layers <= EGL_MAX_PLANES);
 
+    invalidateCacheForFrame(frame, dpy);
+
     for (size_t i = 0; i < vaFrame->num_layers; ++i) {
         const auto &layer = vaFrame->layers[i];
 
@@ -391,31 +386,9 @@ ssize_t EglImageFactory::exportVAImages(AVFrame *frame, VADRMPRIMESurfaceDescrip
         attribs[attribIndex++] = EGL_NONE;
         SDL_assert(attribIndex <= EGL_ATTRIB_COUNT);
 
-        if (m_eglCreateImage) {
-            images[i] = m_eglCreateImage(dpy, EGL_NO_CONTEXT,
-                                         EGL_LINUX_DMA_BUF_EXT,
-                                         nullptr, attribs);
-            if (!images[i]) {
-                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                             "eglCreateImage() Failed: %d", eglGetError());
-                goto fail;
-            }
-        }
-        else {
-            // Cast the EGLAttrib array elements to EGLint for the KHR extension
-            EGLint intAttribs[EGL_ATTRIB_COUNT];
-            for (int i = 0; i < attribIndex; i++) {
-                intAttribs[i] = (EGLint)attribs[i];
-            }
-
-            images[i] = m_eglCreateImageKHR(dpy, EGL_NO_CONTEXT,
-                                            EGL_LINUX_DMA_BUF_EXT,
-                                            nullptr, intAttribs);
-            if (!images[i]) {
-                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                             "eglCreateImageKHR() Failed: %d", eglGetError());
-                goto fail;
-            }
+        images[i] = getOrCreateImage(dpy, attribs, attribIndex);
+        if (!images[i]) {
+            goto fail;
         }
 
         ++count;
@@ -513,14 +486,226 @@ bool EglImageFactory::supportsImportingModifier(EGLDisplay dpy, EGLint format, E
 
 void EglImageFactory::freeEGLImages(EGLDisplay dpy, EGLImage images[EGL_MAX_PLANES]) {
     for (size_t i = 0; i < EGL_MAX_PLANES; ++i) {
-        if (images[i] != nullptr) {
-            if (m_eglDestroyImage) {
-                m_eglDestroyImage(dpy, images[i]);
-            }
-            else {
-                m_eglDestroyImageKHR(dpy, images[i]);
+        if (images[i] == nullptr) {
+            continue;
+        }
+
+        size_t j;
+        for (j = 0; j < m_ImageCache.size(); j++) {
+            if (m_ImageCache[j].image == images[i] && m_ImageCache[j].display == dpy) {
+                break;
             }
         }
+
+        if (j < m_ImageCache.size()) {
+            releaseCachedImage(j);
+        }
+        else {
+            // This image didn't make it into the cache
+            destroyImage(dpy, images[i]);
+        }
     }
     memset(images, 0, sizeof(EGLImage) * EGL_MAX_PLANES);
 }
+
+void EglImageFactory::flushEGLImages(EGLDisplay dpy)
+{
+    if (m_CacheHits != 0 || m_CacheMisses != 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "EGLImage cache: %u hits, %u misses",
+                    m_CacheHits,
+                    m_CacheMisses);
+    }
+
+    for (const CachedImage& cachedImage : m_ImageCache) {
+        if (cachedImage.refCount != 0) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Destroying EGLImage that is still in use");
+        }
+
+        SDL_assert(cachedImage.display == dpy);
+        destroyImage(cachedImage.display, cachedImage.image);
+    }
+
+    m_ImageCache.clear();
+    m_CacheDisplay = EGL_NO_DISPLAY;
+    m_CacheFramesContext = nullptr;
+    m_CacheHits = m_CacheMisses = 0;
+}
+
+// Identifies the buffers behind an import by their DMA-BUF inodes rather
+// than the FDs, which are different each time a surface is exported. All
+// other attributes (layout, modifiers and color metadata) must match too.
+bool EglImageFactory::getImageCacheKey(const EGLAttrib* attribs, int attribCount, std::vector<EGLAttrib>& key)
+{
+    key.assign(attribs, attribs + attribCount);
+
+    for (int i = 0; i + 1 < attribCount; i += 2) {
+        switch (attribs[i]) {
+        case EGL_DMA_BUF_PLANE0_FD_EXT:
+        case EGL_DMA_BUF_PLANE1_FD_EXT:
+        case EGL_DMA_BUF_PLANE2_FD_EXT:
+        case EGL_DMA_BUF_PLANE3_FD_EXT:
+        {
+            struct stat st;
+            if (fstat((int)attribs[i + 1], &st) < 0) {
+                return false;
+            }
+
+            // EGLAttrib may be 32-bit, so store the inode in two parts
+            key[i + 1] = (EGLAttrib)(st.st_ino & 0xFFFFFFFF);
+            key.push_back((EGLAttrib)((uint64_t)st.st_ino >> 32));
+            key.push_back((EGLAttrib)st.st_dev);
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    return true;
+}
+
+// A new surface pool or display means none of our cached images can be hit
+// again, so let go of them rather than keeping the old buffers alive.
+void EglImageFactory::invalidateCacheForFrame(AVFrame* frame, EGLDisplay dpy)
+{
+    void* framesContext = frame->hw_frames_ctx != nullptr ? frame->hw_frames_ctx->data : nullptr;
+    if (dpy == m_CacheDisplay && framesContext == m_CacheFramesContext &&
+            frame->width == m_CacheWidth && frame->height == m_CacheHeight) {
+        return;
+    }
+
+    if (!m_ImageCache.empty()) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Invalidating %d cached EGLImages after decoder surface change",
+                    (int)m_ImageCache.size());
+    }
+
+    for (size_t i = 0; i < m_ImageCache.size();) {
+        if (m_ImageCache[i].refCount == 0) {
+            destroyImage(m_ImageCache[i].display, m_ImageCache[i].image);
+            m_ImageCache.erase(m_ImageCache.begin() + i);
+        }
+        else {
+            // Destroy this one when the last user frees it
+            m_ImageCache[i].key.clear();
+            i++;
+        }
+    }
+
+    m_CacheDisplay = dpy;
+    m_CacheFramesContext = framesContext;
+    m_CacheWidth = frame->width;
+    m_CacheHeight = frame->height;
+}
+
+void EglImageFactory::releaseCachedImage(size_t index)
+{
+    CachedImage& cachedImage = m_ImageCache[index];
+
+    SDL_assert(cachedImage.refCount > 0);
+    cachedImage.refCount--;
+
+    if (cachedImage.refCount == 0 && cachedImage.key.empty()) {
+        destroyImage(cachedImage.display, cachedImage.image);
+        m_ImageCache.erase(m_ImageCache.begin() + index);
+    }
+}
+
+EGLImage EglImageFactory::getOrCreateImage(EGLDisplay dpy, const EGLAttrib* attribs, int attribCount)
+{
+    std::vector<EGLAttrib> key;
+    if (!getImageCacheKey(attribs, attribCount, key)) {
+        // We can't tell which buffers these are, so don't cache it
+        return createImage(dpy, attribs, attribCount);
+    }
+
+    for (CachedImage& cachedImage : m_ImageCache) {
+        if (cachedImage.key == key && cachedImage.display == dpy) {
+            cachedImage.refCount++;
+            cachedImage.lastUsed = ++m_CacheUseCount;
+            m_CacheHits++;
+            return cachedImage.image;
+        }
+    }
+
+    EGLImage image = createImage(dpy, attribs, attribCount);
+    if (!image) {
+        return nullptr;
+    }
+
+    m_CacheMisses++;
+
+    // Make room by evicting the least recently used image that's not in use
+    if (m_ImageCache.size() >= EGL_IMAGE_CACHE_SIZE) {
+        size_t lruIndex = m_ImageCache.size();
+        for (size_t i = 0; i < m_ImageCache.size(); i++) {
+            if (m_ImageCache[i].refCount == 0 &&
+                    (lruIndex == m_ImageCache.size() || m_ImageCache[i].lastUsed < m_ImageCache[lruIndex].lastUsed)) {
+                lruIndex = i;
+            }
+        }
+
+        if (lruIndex == m_ImageCache.size()) {
+            // Everything is in use, so this one will be destroyed when freed
+            return image;
+        }
+
+        destroyImage(m_ImageCache[lruIndex].display, m_ImageCache[lruIndex].image);
+        m_ImageCache.erase(m_ImageCache.begin() + lruIndex);
+    }
+
+    CachedImage cachedImage;
+    cachedImage.key = std::move(key);
+    cachedImage.display = dpy;
+    cachedImage.image = image;
+    cachedImage.refCount = 1;
+    cachedImage.lastUsed = ++m_CacheUseCount;
+    m_ImageCache.push_back(std::move(cachedImage));
+
+    return image;
+}
+
+EGLImage EglImageFactory::createImage(EGLDisplay dpy, const EGLAttrib* attribs, int attribCount)
+{
+    EGLImage image;
+
+    if (m_eglCreateImage) {
+        image = m_eglCreateImage(dpy, EGL_NO_CONTEXT,
+                                 EGL_LINUX_DMA_BUF_EXT,
+                                 nullptr, attribs);
+        if (!image) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "eglCreateImage() Failed: %d", eglGetError());
+        }
+    }
+    else {
+        // Cast the EGLAttrib array elements to EGLint for the KHR extension
+        std::vector<EGLint> intAttribs(attribCount);
+        for (int i = 0; i < attribCount; i++) {
+            intAttribs[i] = (EGLint)attribs[i];
+        }
+
+        image = m_eglCreateImageKHR(dpy, EGL_NO_CONTEXT,
+                                    EGL_LINUX_DMA_BUF_EXT,
+                                    nullptr, intAttribs.data());
+        if (!image) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "eglCreateImageKHR() Failed: %d", eglGetError());
+        }
+    }
+
+    return image;
+}
+
+void EglImageFactory::destroyImage(EGLDisplay dpy, EGLImage image)
+{
+    if (m_eglDestroyImage) {
+        m_eglDestroyImage(dpy, image);
+    }
+    else {
+        m_eglDestroyImageKHR(dpy, image);
+    }
+}
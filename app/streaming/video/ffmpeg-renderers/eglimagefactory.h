@@ -2,14 +2,22 @@
 
 #include "renderer.h"
 
+#include <vector>
+
 #ifdef HAVE_LIBVA
 #include <va/va_drmcommon.h>
 #endif
 
+// Hardware decoders cycle through a small pool of surfaces, so we keep the
+// EGLImages for recently used DMA-BUFs around rather than importing them
+// again for every frame.
+#define EGL_IMAGE_CACHE_SIZE 64
+
 class EglImageFactory
 {
 public:
     EglImageFactory(IFFmpegRenderer* renderer);
+    ~EglImageFactory();
     bool initializeEGL(EGLDisplay, const EGLExtensions &ext);
 
 #ifdef HAVE_DRM
@@ -25,7 +33,26 @@ public:
 
     void freeEGLImages(EGLDisplay dpy, EGLImage images[EGL_MAX_PLANES]);
 
+    void flushEGLImages(EGLDisplay dpy);
+
 private:
+    // Images with an empty key were invalidated while still in use,
+    // so they are destroyed as soon as the last user frees them.
+    struct CachedImage {
+        std::vector<EGLAttrib> key;
+        EGLDisplay display;
+        EGLImage image;
+        int refCount;
+        uint64_t lastUsed;
+    };
+
+    static bool getImageCacheKey(const EGLAttrib* attribs, int attribCount, std::vector<EGLAttrib>& key);
+    void invalidateCacheForFrame(AVFrame* frame, EGLDisplay dpy);
+    void releaseCachedImage(size_t index);
+    EGLImage getOrCreateImage(EGLDisplay dpy, const EGLAttrib* attribs, int attribCount);
+    EGLImage createImage(EGLDisplay dpy, const EGLAttrib* attribs, int attribCount);
+    void destroyImage(EGLDisplay dpy, EGLImage image);
+
     IFFmpegRenderer* m_Renderer;
     bool m_EGLExtDmaBuf;
     PFNEGLCREATEIMAGEPROC m_eglCreateImage;
@@ -34,4 +61,14 @@ private:
     PFNEGLDESTROYIMAGEKHRPROC m_eglDestroyImageKHR;
     PFNEGLQUERYDMABUFFORMATSEXTPROC m_eglQueryDmaBufFormatsEXT;
     PFNEGLQUERYDMABUFMODIFIERSEXTPROC m_eglQueryDmaBufModifiersEXT;
+
+    // Only used on the render thread
+    std::vector<CachedImage> m_ImageCache;
+    EGLDisplay m_CacheDisplay;
+    void* m_CacheFramesContext;
+    int m_CacheWidth;
+    int m_CacheHeight;
+    uint64_t m_CacheUseCount;
+    uint32_t m_CacheHits;
+    uint32_t m_CacheMisses;
 };
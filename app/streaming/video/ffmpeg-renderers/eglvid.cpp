@@ -60,8 +60,9 @@ EGLRenderer::EGLRenderer(IFFmpegRenderer *backendRenderer)
         IFFmpegRenderer(RendererType::EGL),
         m_EGLImagePixelFormat(AV_PIX_FMT_NONE),
         m_EGLDisplay(EGL_NO_DISPLAY),
-        m_Textures{0},
         m_OverlayTextures{0},
+        m_OverlayTextureWidths{0},
+        m_OverlayTextureHeights{0},
         m_OverlayVbos{0},
         m_OverlayHasValidData{},
         m_ShaderProgram(0),
@@ -71,8 +72,9 @@ EGLRenderer::EGLRenderer(IFFmpegRenderer *backendRenderer)
         m_Backend(backendRenderer),
         m_VAO(0),
         m_BlockingSwapBuffers(false),
-        m_LastRenderSync(EGL_NO_SYNC),
-        m_LastFrame(av_frame_alloc()),
+        m_FramesInFlight{},
+        m_MaxFramesInFlight(1),
+        m_NextFrameInFlight(0),
         m_glEGLImageTargetTexture2DOES(nullptr),
         m_glGenVertexArraysOES(nullptr),
         m_glBindVertexArrayOES(nullptr),
@@ -89,6 +91,11 @@ EGLRenderer::EGLRenderer(IFFmpegRenderer *backendRenderer)
     SDL_assert(backendRenderer);
     SDL_assert(backendRenderer->canExportEGL());
 
+    for (int i = 0; i < EGL_MAX_FRAMES_IN_FLIGHT; i++) {
+        m_FramesInFlight[i].frame = av_frame_alloc();
+        m_FramesInFlight[i].renderSync = EGL_NO_SYNC;
+    }
+
     // Save these global parameters so we can restore them in our destructor
     SDL_GL_GetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, &m_OldContextProfileMask);
     SDL_GL_GetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, &m_OldContextMajorVersion);
@@ -100,10 +107,15 @@ EGLRenderer::~EGLRenderer()
     if (m_Context) {
         // Reattach the GL context to the main thread for destruction
         SDL_GL_MakeCurrent(m_Window, m_Context);
-        if (m_LastRenderSync != EGL_NO_SYNC) {
-            SDL_assert(m_eglDestroySync != nullptr);
-            m_eglDestroySync(m_EGLDisplay, m_LastRenderSync);
+        for (int i = 0; i < EGL_MAX_FRAMES_IN_FLIGHT; i++) {
+            retireFrameInFlight(&m_FramesInFlight[i]);
+            for (int j = 0; j < EGL_MAX_PLANES; j++) {
+                if (m_FramesInFlight[i].textures[j] != 0) {
+                    glDeleteTextures(1, &m_FramesInFlight[i].textures[j]);
+                }
+            }
         }
+        m_Backend->flushEGLImages(m_EGLDisplay);
         if (m_ShaderProgram) {
             glDeleteProgram(m_ShaderProgram);
         }
@@ -114,11 +126,6 @@ EGLRenderer::~EGLRenderer()
             SDL_assert(m_glDeleteVertexArraysOES != nullptr);
             m_glDeleteVertexArraysOES(1, &m_VAO);
         }
-        for (int i = 0; i < EGL_MAX_PLANES; i++) {
-            if (m_Textures[i] != 0) {
-                glDeleteTextures(1, &m_Textures[i]);
-            }
-        }
         for (int i = 0; i < Overlay::OverlayMax; i++) {
             if (m_OverlayTextures[i] != 0) {
                 glDeleteTextures(1, &m_OverlayTextures[i]);
@@ -134,7 +141,9 @@ EGLRenderer::~EGLRenderer()
         SDL_DestroyRenderer(m_DummyRenderer);
     }
 
-    av_frame_free(&m_LastFrame);
+    for (int i = 0; i < EGL_MAX_FRAMES_IN_FLIGHT; i++) {
+        av_frame_free(&m_FramesInFlight[i].frame);
+    }
 
     // Reset the global properties back to what they were before
     SDL_SetHint(SDL_HINT_OPENGL_ES_DRIVER, "0");
@@ -191,38 +200,55 @@ void EGLRenderer::renderOverlay(Overlay::OverlayType type, int viewportWidth, in
     }
 
     // Upload a new overlay texture if needed
-    SDL_Surface* newSurface = Session::get()->getOverlayManager().getUpdatedOverlaySurface(type);
+    SDL_Rect dirtyRect;
+    SDL_Surface* newSurface = Session::get()->getOverlayManager().getUpdatedOverlaySurface(type, &dirtyRect);
     if (newSurface != nullptr) {
         SDL_assert(!SDL_MUSTLOCK(newSurface));
         SDL_assert(newSurface->format->format == SDL_PIXELFORMAT_ARGB8888);
 
         glBindTexture(GL_TEXTURE_2D, m_OverlayTextures[type]);
 
-        void* packedPixelData = nullptr;
-        if (m_GlesMajorVersion >= 3 || m_HasExtUnpackSubimage) {
+        bool canUnpackAnyPitch = m_GlesMajorVersion >= 3 || m_HasExtUnpackSubimage;
+        if (canUnpackAnyPitch) {
             // If we are GLES 3.0+ or have GL_EXT_unpack_subimage, GL can handle any pitch
             SDL_assert(newSurface->pitch % newSurface->format->BytesPerPixel == 0);
             glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, newSurface->pitch / newSurface->format->BytesPerPixel);
         }
-        else if (newSurface->pitch != newSurface->w * newSurface->format->BytesPerPixel) {
-            // If we can't use GL_UNPACK_ROW_LENGTH and the surface isn't tightly packed,
-            // we must allocate a tightly packed buffer and copy our pixels there.
-            packedPixelData = malloc(newSurface->w * newSurface->h * newSurface->format->BytesPerPixel);
-            if (!packedPixelData) {
-                SDL_FreeSurface(newSurface);
-                return;
-            }
 
-            SDL_ConvertPixels(newSurface->w, newSurface->h,
-                              newSurface->format->format, newSurface->pixels, newSurface->pitch,
-                              newSurface->format->format, packedPixelData, newSurface->w * newSurface->format->BytesPerPixel);
+        if (newSurface->w == m_OverlayTextureWidths[type] && newSurface->h == m_OverlayTextureHeights[type] &&
+                (canUnpackAnyPitch || newSurface->pitch == newSurface->w * newSurface->format->BytesPerPixel)) {
+            // The texture already has everything outside the dirty rect, so we
+            // only need to upload the rows that changed (if there are any).
+            if (!SDL_RectEmpty(&dirtyRect)) {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, dirtyRect.y, newSurface->w, dirtyRect.h, GL_RGBA, GL_UNSIGNED_BYTE,
+                                (uint8_t*)newSurface->pixels + dirtyRect.y * newSurface->pitch);
+            }
         }
+        else {
+            void* packedPixelData = nullptr;
+            if (!canUnpackAnyPitch && newSurface->pitch != newSurface->w * newSurface->format->BytesPerPixel) {
+                // If we can't use GL_UNPACK_ROW_LENGTH and the surface isn't tightly packed,
+                // we must allocate a tightly packed buffer and copy our pixels there.
+                packedPixelData = malloc(newSurface->w * newSurface->h * newSurface->format->BytesPerPixel);
+                if (!packedPixelData) {
+                    SDL_FreeSurface(newSurface);
+                    return;
+                }
+
+                SDL_ConvertPixels(newSurface->w, newSurface->h,
+                                  newSurface->format->format, newSurface->pixels, newSurface->pitch,
+                                  newSurface->format->format, packedPixelData, newSurface->w * newSurface->format->BytesPerPixel);
+            }
+
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, newSurface->w, newSurface->h, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                         packedPixelData ? packedPixelData : newSurface->pixels);
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, newSurface->w, newSurface->h, 0, GL_RGBA, GL_UNSIGNED_BYTE,
-                     packedPixelData ? packedPixelData : newSurface->pixels);
+            if (packedPixelData) {
+                free(packedPixelData);
+            }
 
-        if (packedPixelData) {
-            free(packedPixelData);
+            m_OverlayTextureWidths[type] = newSurface->w;
+            m_OverlayTextureHeights[type] = newSurface->h;
         }
 
         SDL_FRect overlayRect;
@@ -578,6 +604,21 @@ bool EGLRenderer::initialize(PDECODER_PARAMETERS params)
         m_eglClientWaitSync = nullptr;
     }
 
+    // Without fences, we can't tell when the GPU is done with a frame, so we
+    // must finish each one before starting the next. With them, we default to
+    // preparing the next frame while the GPU is still working on the last one.
+    // EGL_FRAMES_IN_FLIGHT can be set to 1 for the lowest latency or up to
+    // EGL_MAX_FRAMES_IN_FLIGHT for more overlap on slow GPUs.
+    if (m_eglClientWaitSync != nullptr) {
+        bool ok;
+        m_MaxFramesInFlight = qEnvironmentVariableIntValue("EGL_FRAMES_IN_FLIGHT", &ok);
+        if (!ok) {
+            m_MaxFramesInFlight = 2;
+        }
+        m_MaxFramesInFlight = SDL_max(1, SDL_min(m_MaxFramesInFlight, EGL_MAX_FRAMES_IN_FLIGHT));
+    }
+    EGL_LOG(Info, "Frames in flight: %d", m_MaxFramesInFlight);
+
     // SDL always uses swap interval 0 under the hood on Wayland systems,
     // because the compositor guarantees tear-free rendering. In this
     // situation, swap interval > 0 behaves as a frame pacing option
@@ -610,13 +651,17 @@ bool EGLRenderer::initialize(PDECODER_PARAMETERS params)
         SDL_GL_SetSwapInterval(0);
     }
 
-    glGenTextures(EGL_MAX_PLANES, m_Textures);
-    for (size_t i = 0; i < EGL_MAX_PLANES; ++i) {
-        glBindTexture(GL_TEXTURE_EXTERNAL_OES, m_Textures[i]);
-        glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Each frame in flight gets its own textures, so we never retarget
+    // a texture that the GPU may still be sampling from.
+    for (int i = 0; i < m_MaxFramesInFlight; i++) {
+        glGenTextures(EGL_MAX_PLANES, m_FramesInFlight[i].textures);
+        for (size_t j = 0; j < EGL_MAX_PLANES; ++j) {
+            glBindTexture(GL_TEXTURE_EXTERNAL_OES, m_FramesInFlight[i].textures[j]);
+            glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
     }
 
     glGenBuffers(Overlay::OverlayMax, m_OverlayVbos);
@@ -772,13 +817,16 @@ void EGLRenderer::waitToRender()
     // See comment in renderFrame() for more details.
     SDL_GL_MakeCurrent(m_Window, m_Context);
 
-    // Wait for the previous buffer swap to finish before picking the next frame to render.
-    // This way we'll get the latest available frame and render it without blocking.
+    // Wait for the oldest buffer swap in flight to finish before picking the next frame
+    // to render. This way we'll get the latest available frame and render it without
+    // blocking. With one frame in flight, this waits for the previous buffer swap.
     if (m_BlockingSwapBuffers) {
         // Try to use eglClientWaitSync() if the driver supports it
-        if (m_LastRenderSync != EGL_NO_SYNC) {
-            SDL_assert(m_eglClientWaitSync != nullptr);
-            m_eglClientWaitSync(m_EGLDisplay, m_LastRenderSync, EGL_SYNC_FLUSH_COMMANDS_BIT, EGL_FOREVER);
+        if (m_eglClientWaitSync != nullptr) {
+            EGLSync renderSync = m_FramesInFlight[m_NextFrameInFlight].renderSync;
+            if (renderSync != EGL_NO_SYNC) {
+                m_eglClientWaitSync(m_EGLDisplay, renderSync, EGL_SYNC_FLUSH_COMMANDS_BIT, EGL_FOREVER);
+            }
         }
         else {
             // Use glFinish() if fences aren't available
@@ -787,6 +835,40 @@ void EGLRenderer::waitToRender()
     }
 }
 
+EGLSync EGLRenderer::createRenderSync()
+{
+    if (m_eglCreateSync != nullptr) {
+        return m_eglCreateSync(m_EGLDisplay, EGL_SYNC_FENCE, nullptr);
+    }
+    else if (m_eglCreateSyncKHR != nullptr) {
+        return m_eglCreateSyncKHR(m_EGLDisplay, EGL_SYNC_FENCE, nullptr);
+    }
+    else {
+        return EGL_NO_SYNC;
+    }
+}
+
+// Waits for the GPU to finish with a frame in flight and frees its resources.
+// The textures are kept for the next frame that uses this slot.
+void EGLRenderer::retireFrameInFlight(PEGL_FRAME_IN_FLIGHT frameInFlight)
+{
+    if (frameInFlight->renderSync != EGL_NO_SYNC) {
+        SDL_assert(m_eglClientWaitSync != nullptr);
+        m_eglClientWaitSync(m_EGLDisplay, frameInFlight->renderSync, EGL_SYNC_FLUSH_COMMANDS_BIT, EGL_FOREVER);
+        m_eglDestroySync(m_EGLDisplay, frameInFlight->renderSync);
+        frameInFlight->renderSync = EGL_NO_SYNC;
+    }
+
+    m_Backend->freeEGLImages(m_EGLDisplay, frameInFlight->images);
+
+    // Free the DMA-BUF backing the frame now that it is definitely no longer
+    // being used anymore. While the PRIME FD stays around until EGL is done
+    // with it, the memory backing it may be reused by FFmpeg before the GPU
+    // has read it. This is particularly noticeable on the RK3288-based
+    // TinkerBoard when V-Sync is disabled.
+    av_frame_unref(frameInFlight->frame);
+}
+
 void EGLRenderer::prepareToRender()
 {
     SDL_GL_MakeCurrent(m_Window, m_Context);
@@ -801,8 +883,6 @@ void EGLRenderer::prepareToRender()
 
 void EGLRenderer::renderFrame(AVFrame* frame)
 {
-    EGLImage imgs[EGL_MAX_PLANES];
-
     // Attach our GL context to the render thread
     // NB: It should already be current, unless the SDL render event watcher
     // performs a rendering operation (like a viewport update on resize) on
@@ -834,13 +914,19 @@ void EGLRenderer::renderFrame(AVFrame* frame)
         }
     }
 
-    ssize_t plane_count = m_Backend->exportEGLImages(frame, m_EGLDisplay, imgs);
+    // Reuse the slot of the oldest frame in flight. This normally doesn't block
+    // because we already waited for it in waitToRender() or the GPU finished it
+    // while we rendered the frames after it.
+    PEGL_FRAME_IN_FLIGHT frameInFlight = &m_FramesInFlight[m_NextFrameInFlight];
+    retireFrameInFlight(frameInFlight);
+
+    ssize_t plane_count = m_Backend->exportEGLImages(frame, m_EGLDisplay, frameInFlight->images);
     if (plane_count < 0)
         return;
     for (ssize_t i = 0; i < plane_count; ++i) {
         glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_EXTERNAL_OES, m_Textures[i]);
-        m_glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, imgs[i]);
+        glBindTexture(GL_TEXTURE_EXTERNAL_OES, frameInFlight->textures[i]);
+        m_glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, frameInFlight->images[i]);
     }
 
     glClear(GL_COLOR_BUFFER_BIT);
@@ -889,36 +975,18 @@ void EGLRenderer::renderFrame(AVFrame* frame)
         // our eglClientWaitSync() or glFinish() call in waitToRender() will not
         // return before the new buffer is actually ready for rendering.
         glClear(GL_COLOR_BUFFER_BIT);
-
-        // If we this EGL implementation supports fences, use those to delay
-        // rendering the next frame until this one is completed. If not, we'll
-        // have to just use glFinish().
-        if (m_eglClientWaitSync != nullptr) {
-            // Delete the sync object from last render
-            if (m_LastRenderSync != EGL_NO_SYNC) {
-                m_eglDestroySync(m_EGLDisplay, m_LastRenderSync);
-            }
-
-            // Create a new sync object that will be signalled when the buffer swap is completed
-            if (m_eglCreateSync != nullptr) {
-                m_LastRenderSync = m_eglCreateSync(m_EGLDisplay, EGL_SYNC_FENCE, nullptr);
-            }
-            else {
-                SDL_assert(m_eglCreateSyncKHR != nullptr);
-                m_LastRenderSync = m_eglCreateSyncKHR(m_EGLDisplay, EGL_SYNC_FENCE, nullptr);
-            }
-        }
     }
 
-    m_Backend->freeEGLImages(m_EGLDisplay, imgs);
+    // If this EGL implementation supports fences, use those to tell when the
+    // GPU is done with this frame. If not, we only have one frame in flight
+    // and rely on glFinish() in waitToRender() or the next buffer swap.
+    frameInFlight->renderSync = createRenderSync();
+
+    // Keep our own reference to the frame until it's retired. The caller may
+    // hold onto the frame and render it again.
+    av_frame_ref(frameInFlight->frame, frame);
 
-    // Free the DMA-BUF backing the last frame now that it is definitely
-    // no longer being used anymore. While the PRIME FD stays around until
-    // EGL is done with it, the memory backing it may be reused by FFmpeg
-    // before the GPU has read it. This is particularly noticeable on the
-    // RK3288-based TinkerBoard when V-Sync is disabled.
-    av_frame_unref(m_LastFrame);
-    av_frame_move_ref(m_LastFrame, frame);
+    m_NextFrameInFlight = (m_NextFrameInFlight + 1) % m_MaxFramesInFlight;
 }
 
 bool EGLRenderer::testRenderFrame(AVFrame* frame)
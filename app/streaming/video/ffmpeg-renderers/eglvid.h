@@ -6,6 +6,18 @@
 #include <SDL_egl.h>
 #include <SDL_opengles2.h>
 
+// We keep the resources for each frame until the GPU is done with it. This
+// lets us start on the next frame while the GPU is still drawing or scanning
+// out the previous ones.
+#define EGL_MAX_FRAMES_IN_FLIGHT 3
+
+typedef struct _EGL_FRAME_IN_FLIGHT {
+    AVFrame* frame;
+    EGLImage images[EGL_MAX_PLANES];
+    unsigned textures[EGL_MAX_PLANES];
+    EGLSync renderSync;
+} EGL_FRAME_IN_FLIGHT, *PEGL_FRAME_IN_FLIGHT;
+
 class EGLRenderer : public IFFmpegRenderer {
 public:
     EGLRenderer(IFFmpegRenderer *backendRenderer);
@@ -31,11 +43,14 @@ private:
     const float *getColorOffsets(const AVFrame* frame);
     const float *getColorMatrix(const AVFrame* frame);
     static int loadAndBuildShader(int shaderType, const char *filename);
+    EGLSync createRenderSync();
+    void retireFrameInFlight(PEGL_FRAME_IN_FLIGHT frameInFlight);
 
     AVPixelFormat m_EGLImagePixelFormat;
     void *m_EGLDisplay;
-    unsigned m_Textures[EGL_MAX_PLANES];
     unsigned m_OverlayTextures[Overlay::OverlayMax];
+    int m_OverlayTextureWidths[Overlay::OverlayMax];
+    int m_OverlayTextureHeights[Overlay::OverlayMax];
     unsigned m_OverlayVbos[Overlay::OverlayMax];
     SDL_atomic_t m_OverlayHasValidData[Overlay::OverlayMax];
     unsigned m_ShaderProgram;
@@ -45,8 +60,9 @@ private:
     IFFmpegRenderer *m_Backend;
     unsigned int m_VAO;
     bool m_BlockingSwapBuffers;
-    EGLSync m_LastRenderSync;
-    AVFrame* m_LastFrame;
+    EGL_FRAME_IN_FLIGHT m_FramesInFlight[EGL_MAX_FRAMES_IN_FLIGHT];
+    int m_MaxFramesInFlight;
+    int m_NextFrameInFlight;
     PFNGLEGLIMAGETARGETTEXTURE2DOESPROC m_glEGLImageTargetTexture2DOES;
     PFNGLGENVERTEXARRAYSOESPROC m_glGenVertexArraysOES;
     PFNGLBINDVERTEXARRAYOESPROC m_glBindVertexArrayOES;
@@ -0,0 +1,145 @@
+#include "drmvsyncsource.h"
+#include "streaming/streamutils.h"
+
+#include <xf86drm.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+
+DrmVsyncSource::DrmVsyncSource(int drmFd, int crtcIndex) :
+    m_DrmFd(drmFd),
+    m_CrtcIndex(crtcIndex),
+    m_MonotonicTimestamps(false),
+    m_PeriodUs(0),
+    m_LastVblankTimeUs(0),
+    m_LastVblankSequence(0),
+    m_LoggedVblankFailure(false)
+{
+
+}
+
+DrmVsyncSource::~DrmVsyncSource()
+{
+    // The DRM FD is owned by the renderer
+}
+
+bool DrmVsyncSource::initialize(SDL_Window*, int displayFps)
+{
+    m_PeriodUs = 1000000.0 / displayFps;
+
+    uint64_t value;
+    m_MonotonicTimestamps = drmGetCap(m_DrmFd, DRM_CAP_TIMESTAMP_MONOTONIC, &value) == 0 && value != 0;
+
+    // Query the current V-blank to make sure V-blank interrupts
+    // are working on this CRTC before we start waiting on them.
+    if (!waitForVblank(0, &m_LastVblankTimeUs, &m_LastVblankSequence)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "drmWaitVBlank() failed: %d",
+                     errno);
+        return false;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using DRM V-blank events on CRTC index %d",
+                m_CrtcIndex);
+    return true;
+}
+
+bool DrmVsyncSource::isAsync()
+{
+    // We wait on V-blanks in the Pacer's V-sync thread
+    return false;
+}
+
+void DrmVsyncSource::waitForVsync()
+{
+    uint64_t vblankTimeUs;
+    unsigned int sequence;
+
+    if (!waitForVblank(1, &vblankTimeUs, &sequence)) {
+        if (!m_LoggedVblankFailure) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "drmWaitVBlank() failed: %d",
+                        errno);
+            m_LoggedVblankFailure = true;
+        }
+
+        // V-blanks stop while the display is off, so don't spin
+        SDL_Delay((Uint32)(m_PeriodUs / 1000));
+        m_LastVblankTimeUs = StreamUtils::getMonotonicTimeUs();
+        return;
+    }
+
+    // The display mode's refresh rate is rounded to the nearest Hz, so refine
+    // our period using the timestamps of consecutive V-blanks. Ignore anything
+    // far off in case a timestamp was bogus. This is a 1/16 weighted moving
+    // average, so we keep the period in floating point to let errors smaller
+    // than 16 us still move it rather than truncating them away.
+    if (sequence == m_LastVblankSequence + 1 && vblankTimeUs > m_LastVblankTimeUs) {
+        int intervalUs = (int)SDL_min(vblankTimeUs - m_LastVblankTimeUs, (uint64_t)INT_MAX);
+        if (intervalUs > m_PeriodUs * 3 / 4 && intervalUs < m_PeriodUs * 5 / 4) {
+            m_PeriodUs += (intervalUs - m_PeriodUs) / 16;
+        }
+    }
+
+    m_LastVblankTimeUs = vblankTimeUs;
+    m_LastVblankSequence = sequence;
+}
+
+int DrmVsyncSource::getTimeUntilNextVsyncUs(int)
+{
+    // Time the Pacer's latch deadline from when the V-blank actually happened,
+    // not from when the V-sync thread got around to running again.
+    uint64_t periodUs = (uint64_t)llround(m_PeriodUs);
+    uint64_t nextVblankTimeUs = m_LastVblankTimeUs + periodUs;
+    uint64_t nowUs = StreamUtils::getMonotonicTimeUs();
+    if (nextVblankTimeUs <= nowUs) {
+        return 0;
+    }
+
+    return (int)SDL_min(nextVblankTimeUs - nowUs, periodUs);
+}
+
+bool DrmVsyncSource::waitForVblank(unsigned int relativeSequence, uint64_t* vblankTimeUs, unsigned int* sequence)
+{
+    drmVBlank vbl;
+    int type = DRM_VBLANK_RELATIVE;
+
+    // Select the CRTC by its index in the DRM resources
+    if (m_CrtcIndex > 1) {
+        type |= (m_CrtcIndex << DRM_VBLANK_HIGH_CRTC_SHIFT) & DRM_VBLANK_HIGH_CRTC_MASK;
+    }
+    else if (m_CrtcIndex == 1) {
+        type |= DRM_VBLANK_SECONDARY;
+    }
+
+    SDL_zero(vbl);
+    vbl.request.type = (drmVBlankSeqType)type;
+    vbl.request.sequence = relativeSequence;
+    if (drmWaitVBlank(m_DrmFd, &vbl) < 0) {
+        return false;
+    }
+
+    uint64_t nowUs = StreamUtils::getMonotonicTimeUs();
+    *sequence = vbl.reply.sequence;
+
+    if (m_MonotonicTimestamps) {
+        // DRM timestamps use CLOCK_MONOTONIC, which isn't necessarily the clock
+        // behind our monotonic time, so translate them by how old they are.
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        int64_t ageUs = ((int64_t)ts.tv_sec - vbl.reply.tval_sec) * 1000000 +
+                        (ts.tv_nsec / 1000 - vbl.reply.tval_usec);
+        ageUs = SDL_max(ageUs, 0);
+        *vblankTimeUs = nowUs - SDL_min((uint64_t)ageUs, nowUs);
+    }
+    else {
+        // We just woke up from the V-blank, so this is close enough
+        *vblankTimeUs = nowUs;
+    }
+
+    return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "pacer.h"
+
+// Synchronous V-sync source that waits for V-blanks on the CRTC that the
+// DRM renderer scans out to. It shares the renderer's DRM FD and doesn't
+// read any DRM events, so it can't steal page flip events from SDL.
+class DrmVsyncSource : public IVsyncSource
+{
+public:
+    DrmVsyncSource(int drmFd, int crtcIndex);
+
+    virtual ~DrmVsyncSource();
+
+    virtual bool initialize(SDL_Window* window, int displayFps) override;
+
+    virtual bool isAsync() override;
+
+    virtual void waitForVsync() override;
+
+    virtual int getTimeUntilNextVsyncUs(int vsyncPeriodUs) override;
+
+private:
+    bool waitForVblank(unsigned int relativeSequence, uint64_t* vblankTimeUs, unsigned int* sequence);
+
+    int m_DrmFd;
+    int m_CrtcIndex;
+    bool m_MonotonicTimestamps;
+    // Fractional so small corrections from the V-blank filter aren't lost
+    double m_PeriodUs;
+    uint64_t m_LastVblankTimeUs;
+    unsigned int m_LastVblankSequence;
+    bool m_LoggedVblankFailure;
+};
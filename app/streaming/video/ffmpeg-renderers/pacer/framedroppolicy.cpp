@@ -0,0 +1,176 @@
+#include "framedroppolicy.h"
+#include "../renderer.h"
+
+#include <QQueue>
+
+// Drops frames down to a strict target only if a queue stays above it for
+// a whole history window. Any dip to the strict target within the window
+// lets the queue stay at the lenient target instead, so short bursts of
+// frames are absorbed rather than dropped.
+class QueueHistoryFrameDropPolicy : public IFrameDropPolicy
+{
+public:
+    virtual int getPacingFrameDropTarget(int queueLength) override
+    {
+        // If we can't get more frames per second than we can display,
+        // there's never more than one frame worth keeping.
+        if (m_MaxVideoFps < m_DisplayFps) {
+            return 1;
+        }
+
+        // Keep a rolling window of pacing queue history at the V-sync rate
+        return getFrameDropTarget(m_PacingQueueHistory, m_DisplayFps, queueLength,
+                                  m_StrictPacingTarget, m_LenientPacingTarget);
+    }
+
+    virtual int getRenderFrameDropTarget(int queueLength) override
+    {
+        // Renderers that don't buffer any frames but don't support waitToRender() need us to buffer
+        // an extra frame to ensure they don't starve while waiting to present.
+        if (m_RendererAttributes & RENDERER_ATTRIBUTE_NO_BUFFERING) {
+            return SDL_max(m_StrictRenderTarget, 1);
+        }
+
+        // Keep a rolling window of render queue history at the stream frame rate
+        return getFrameDropTarget(m_RenderQueueHistory, m_MaxVideoFps, queueLength,
+                                  m_StrictRenderTarget, m_LenientRenderTarget);
+    }
+
+    virtual bool shouldLatchNewestFrame() override
+    {
+        return m_LatchNewestFrame;
+    }
+
+protected:
+    QueueHistoryFrameDropPolicy(int maxVideoFps, int displayFps, int rendererAttributes,
+                                int strictPacingTarget, int lenientPacingTarget,
+                                int strictRenderTarget, int lenientRenderTarget,
+                                int historyMs, bool latchNewestFrame) :
+        m_MaxVideoFps(maxVideoFps),
+        m_DisplayFps(displayFps),
+        m_RendererAttributes(rendererAttributes),
+        m_StrictPacingTarget(strictPacingTarget),
+        m_LenientPacingTarget(lenientPacingTarget),
+        m_StrictRenderTarget(strictRenderTarget),
+        m_LenientRenderTarget(lenientRenderTarget),
+        m_HistoryMs(historyMs),
+        m_LatchNewestFrame(latchNewestFrame)
+    {
+
+    }
+
+private:
+    // This only depends on the queue history and the targets, not on any clock
+    // or thread state, so the same sequence of queue lengths always produces
+    // the same drop decisions.
+    int getFrameDropTarget(QQueue<int>& history, int historyRate, int queueLength,
+                           int strictTarget, int lenientTarget)
+    {
+        int frameDropTarget = strictTarget;
+
+        for (int queueHistoryEntry : history) {
+            if (queueHistoryEntry <= strictTarget) {
+                // Be lenient as long as the queue length
+                // resolves before the end of frame history
+                frameDropTarget = lenientTarget;
+                break;
+            }
+        }
+
+        if (history.count() >= SDL_max(historyRate * m_HistoryMs / 1000, 1)) {
+            history.dequeue();
+        }
+
+        history.enqueue(queueLength);
+
+        return frameDropTarget;
+    }
+
+    int m_MaxVideoFps;
+    int m_DisplayFps;
+    int m_RendererAttributes;
+    int m_StrictPacingTarget;
+    int m_LenientPacingTarget;
+    int m_StrictRenderTarget;
+    int m_LenientRenderTarget;
+    int m_HistoryMs;
+    bool m_LatchNewestFrame;
+
+    // Only touched by the V-sync and render threads respectively
+    QQueue<int> m_PacingQueueHistory;
+    QQueue<int> m_RenderQueueHistory;
+};
+
+// Shows frames in order and tolerates bursts for half a second before
+// catching up to a single queued frame. Latching the newest frame would
+// drop every burst right away and make the lenient targets meaningless.
+class BalancedFrameDropPolicy : public QueueHistoryFrameDropPolicy
+{
+public:
+    BalancedFrameDropPolicy(int maxVideoFps, int displayFps, int rendererAttributes) :
+        QueueHistoryFrameDropPolicy(maxVideoFps, displayFps, rendererAttributes,
+                                    1, 3, 0, 2, 500, false)
+    {
+
+    }
+};
+
+// Keeps up to a full queue through bursts for two seconds and shows every
+// frame in order, so stutter is minimized at the cost of standing latency.
+class SmoothestFrameDropPolicy : public QueueHistoryFrameDropPolicy
+{
+public:
+    SmoothestFrameDropPolicy(int maxVideoFps, int displayFps, int rendererAttributes) :
+        QueueHistoryFrameDropPolicy(maxVideoFps, displayFps, rendererAttributes,
+                                    2, 3, 1, 2, 2000, false)
+    {
+
+    }
+};
+
+// Never lets frames queue up behind the display. Any frame that isn't the
+// newest one by the time we can show it is dropped immediately.
+class LowestLatencyFrameDropPolicy : public IFrameDropPolicy
+{
+public:
+    LowestLatencyFrameDropPolicy(int rendererAttributes) :
+        m_RendererAttributes(rendererAttributes)
+    {
+
+    }
+
+    virtual int getPacingFrameDropTarget(int) override
+    {
+        return 1;
+    }
+
+    virtual int getRenderFrameDropTarget(int) override
+    {
+        // Renderers without buffering still need one frame waiting to present
+        return (m_RendererAttributes & RENDERER_ATTRIBUTE_NO_BUFFERING) ? 1 : 0;
+    }
+
+    virtual bool shouldLatchNewestFrame() override
+    {
+        return true;
+    }
+
+private:
+    int m_RendererAttributes;
+};
+
+IFrameDropPolicy* IFrameDropPolicy::create(StreamingPreferences::FrameDropPolicy policy,
+                                           int maxVideoFps, int displayFps, int rendererAttributes)
+{
+    switch (policy) {
+    case StreamingPreferences::FDP_LOWEST_LATENCY:
+        return new LowestLatencyFrameDropPolicy(rendererAttributes);
+
+    case StreamingPreferences::FDP_SMOOTHEST:
+        return new SmoothestFrameDropPolicy(maxVideoFps, displayFps, rendererAttributes);
+
+    default:
+        SDL_assert(policy == StreamingPreferences::FDP_BALANCED);
+        return new BalancedFrameDropPolicy(maxVideoFps, displayFps, rendererAttributes);
+    }
+}
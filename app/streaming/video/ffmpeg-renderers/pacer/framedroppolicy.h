@@ -0,0 +1,27 @@
+#pragma once
+
+#include "settings/streamingpreferences.h"
+
+// Decides how many frames the Pacer may keep queued before it drops the
+// oldest ones, trading latency against smoothness. The pacing and render
+// queue targets are requested on different threads, so implementations
+// must keep separate state for each queue.
+class IFrameDropPolicy
+{
+public:
+    virtual ~IFrameDropPolicy() {}
+
+    // Called on the V-sync thread before each V-sync with the pacing queue length
+    virtual int getPacingFrameDropTarget(int queueLength) = 0;
+
+    // Called on the render thread after each frame with the render queue length
+    virtual int getRenderFrameDropTarget(int queueLength) = 0;
+
+    // Whether the V-sync thread should wait until its deadline and show the
+    // newest frame that arrived, dropping any older ones.
+    virtual bool shouldLatchNewestFrame() = 0;
+
+    static
+    IFrameDropPolicy* create(StreamingPreferences::FrameDropPolicy policy,
+                             int maxVideoFps, int displayFps, int rendererAttributes);
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "SDL_compat.h"
+#include "streaming/spscringpositions.h"
+
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <atomic>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Bounded lock-free ring of AVFrames with a single producer and a single
+// consumer thread. The producer is also allowed to evict the oldest frame
+// when the ring is full, so dequeues claim their slot using a CAS on the
+// head index rather than a plain store.
+//
+// The enqueue and dequeue paths never take a lock. A consumer that needs
+// to block parks on a condition variable, and the producer only takes the
+// park lock to wake it if a consumer is actually parked.
+template <int Capacity>
+class FrameRing
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "FrameRing capacity must be a power of two");
+
+public:
+    FrameRing()
+        : m_ParkedConsumers(0),
+          m_Interrupted(false)
+    {
+        for (int i = 0; i < Capacity; i++) {
+            m_Slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~FrameRing()
+    {
+        // The owner must drain the ring before destroying it
+        SDL_assert(isEmpty());
+    }
+
+    int capacity()
+    {
+        return Capacity;
+    }
+
+    int count()
+    {
+        return (int)m_Positions.count();
+    }
+
+    bool isEmpty()
+    {
+        return count() == 0;
+    }
+
+    // Producer only. Returns false if the ring is full.
+    bool enqueue(AVFrame* frame)
+    {
+        uint32_t used;
+        uint32_t tail = m_Positions.beginWrite(&used);
+        if (used == (uint32_t)Capacity) {
+            return false;
+        }
+
+        m_Slots[tail & (Capacity - 1)].store(frame, std::memory_order_relaxed);
+
+        // Publish the frame. The release store alone doesn't keep the load of
+        // m_ParkedConsumers below from moving ahead of it, so we need a full
+        // fence to pair with the one in waitForFrame(). Either the consumer
+        // sees the new tail or we see it parked.
+        m_Positions.endWrite(tail + 1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (m_ParkedConsumers.load(std::memory_order_relaxed) != 0) {
+            m_ParkLock.lock();
+            m_NotEmpty.wakeAll();
+            m_ParkLock.unlock();
+        }
+
+        return true;
+    }
+
+    // Consumer, or producer evicting the oldest frame. Returns nullptr if empty.
+    AVFrame* dequeue()
+    {
+        for (;;) {
+            uint32_t available;
+            uint32_t head = m_Positions.beginRead(&available);
+            if (available == 0) {
+                return nullptr;
+            }
+
+            // The producer can't reuse this slot until the head moves past
+            // it, so the frame we read here is valid if our CAS succeeds.
+            AVFrame* frame = m_Slots[head & (Capacity - 1)].load(std::memory_order_relaxed);
+            if (m_Positions.tryEndRead(head)) {
+                return frame;
+            }
+        }
+    }
+
+    // Consumer only. Blocks until a frame is available, the timeout expires,
+    // or interrupt() is called. A negative timeout waits forever. Returns true
+    // if a frame is available.
+    bool waitForFrame(int timeoutMs)
+    {
+        if (!isEmpty()) {
+            return true;
+        }
+
+        m_ParkLock.lock();
+
+        // This pairs with the fence in enqueue(). Either we see
+        // the new tail below or the producer sees us parked.
+        m_ParkedConsumers.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (isEmpty() && !isInterrupted()) {
+            if (timeoutMs < 0) {
+                m_NotEmpty.wait(&m_ParkLock);
+            }
+            else {
+                m_NotEmpty.wait(&m_ParkLock, timeoutMs);
+            }
+        }
+
+        m_ParkedConsumers.fetch_sub(1, std::memory_order_relaxed);
+        m_ParkLock.unlock();
+
+        return !isEmpty();
+    }
+
+    // Returns true once interrupt() has been called
+    bool isInterrupted()
+    {
+        return m_Interrupted.load(std::memory_order_acquire);
+    }
+
+    // Wakes any parked consumer and causes all future waits to return
+    // immediately. This is used to stop consumer threads.
+    void interrupt()
+    {
+        m_ParkLock.lock();
+        m_Interrupted.store(true, std::memory_order_release);
+        m_NotEmpty.wakeAll();
+        m_ParkLock.unlock();
+    }
+
+private:
+    std::atomic<AVFrame*> m_Slots[Capacity];
+    SpscRingPositions m_Positions;
+    std::atomic<int> m_ParkedConsumers;
+    std::atomic<bool> m_Interrupted;
+    QMutex m_ParkLock;
+    QWaitCondition m_NotEmpty;
+};
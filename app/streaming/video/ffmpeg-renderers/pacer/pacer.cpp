@@ -12,33 +12,77 @@
 #include "waylandvsyncsource.h"
 #endif
 
-#include <SDL_syswm.h>
+#ifdef HAVE_DRM
+#include "drmvsyncsource.h"
+#endif
 
-// Limit the number of queued frames to prevent excessive memory consumption
-// if the V-Sync source or renderer is blocked for a while. It's important
-// that the sum of all queued frames between both pacing and rendering queues
-// must not exceed the number buffer pool size to avoid running the decoder
-// out of available decoding surfaces.
-#define MAX_QUEUED_FRAMES 4
+#include "softwarevsyncsource.h"
+
+#include <SDL_syswm.h>
 
 // We may be woken up slightly late so don't go all the way
 // up to the next V-sync since we may accidentally step into
-// the next V-sync period. It also takes some amount of time
-// to do the render itself, so we can't render right before
-// V-sync happens.
-#define TIMER_SLACK_MS 3
+// the next V-sync period. This is added to the learned time
+// that the renderer needs to get a frame on screen.
+#define RENDER_DEADLINE_MARGIN_US 1000
+
+// Until we learn otherwise, assume the renderer needs 2 ms
+// (a 3 ms deadline slack including the margin).
+#define INITIAL_RENDER_COST_US 2000
+
+// Renders that complete within this long of the target V-sync
+// may have been blocked waiting for it, so we can't tell how
+// long they actually needed.
+#define VSYNC_WAIT_TOLERANCE_US 1000
+
+// When we miss a V-sync, add at least this much time on top of
+// what we had to get that frame rendered.
+#define MISSED_VSYNC_BACKOFF_US 2000
+
+class SystemPacerClock : public IPacerClock
+{
+public:
+    virtual uint64_t getTimeUs() override
+    {
+        return StreamUtils::getMonotonicTimeUs();
+    }
 
-Pacer::Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats) :
+    virtual void delay(int ms) override
+    {
+        SDL_Delay(ms);
+    }
+
+    virtual bool waitForFrame(FrameRing<MAX_QUEUED_FRAMES>& queue, int timeoutMs) override
+    {
+        return queue.waitForFrame(timeoutMs);
+    }
+};
+
+static SystemPacerClock s_SystemClock;
+
+Pacer::Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats, FramePool* framePool,
+             IPacerClock* clock) :
     m_RenderThread(nullptr),
     m_VsyncThread(nullptr),
     m_Stopping(false),
+    m_Clock(clock != nullptr ? clock : &s_SystemClock),
     m_VsyncSource(nullptr),
+    m_DropPolicy(nullptr),
     m_VsyncRenderer(renderer),
     m_MaxVideoFps(0),
     m_DisplayFps(0),
-    m_VideoStats(videoStats)
+    m_VideoStats(videoStats),
+    m_FramePool(framePool),
+    m_FrameTimingPool(av_buffer_pool_init(sizeof(FRAME_TIMING), nullptr)),
+    m_LatchNewestFrame(true),
+    m_VrrMinRefreshRate(0),
+    m_VrrRepeatFrames(false),
+    m_VrrLastFrame(nullptr),
+    m_VrrLastPresentUs(0),
+    m_VrrLastNewFrameUs(0),
+    m_VrrFrameIntervalUs(0)
 {
-
+    SDL_AtomicSet(&m_RenderCostUs, INITIAL_RENDER_COST_US);
 }
 
 Pacer::~Pacer()
@@ -47,18 +91,16 @@ Pacer::~Pacer()
 
     // Stop the V-sync thread
     if (m_VsyncThread != nullptr) {
-        m_PacingQueueNotEmpty.wakeAll();
+        m_PacingQueue.interrupt();
+        m_VsyncLock.lock();
         m_VsyncSignalled.wakeAll();
+        m_VsyncLock.unlock();
         SDL_WaitThread(m_VsyncThread, nullptr);
     }
 
-    // Stop V-sync callbacks
-    delete m_VsyncSource;
-    m_VsyncSource = nullptr;
-
     // Stop the render thread
     if (m_RenderThread != nullptr) {
-        m_RenderQueueNotEmpty.wakeAll();
+        m_RenderQueue.interrupt();
         SDL_WaitThread(m_RenderThread, nullptr);
     }
     else {
@@ -67,15 +109,41 @@ Pacer::~Pacer()
         m_VsyncRenderer->cleanupRenderContext();
     }
 
+    // Stop V-sync callbacks. This must wait until the render
+    // thread is gone, since it reports presents to the source.
+    delete m_VsyncSource;
+    m_VsyncSource = nullptr;
+
+    // Both threads that consult the drop policy are gone now
+    delete m_DropPolicy;
+    m_DropPolicy = nullptr;
+
     // Delete any remaining unconsumed frames
-    while (!m_RenderQueue.isEmpty()) {
-        AVFrame* frame = m_RenderQueue.dequeue();
-        av_frame_free(&frame);
+    if (m_VrrLastFrame != nullptr) {
+        m_FramePool->release(m_VrrLastFrame);
+        m_VrrLastFrame = nullptr;
+    }
+
+    AVFrame* frame;
+    while ((frame = m_RenderQueue.dequeue()) != nullptr) {
+        m_FramePool->release(frame);
     }
-    while (!m_PacingQueue.isEmpty()) {
-        AVFrame* frame = m_PacingQueue.dequeue();
-        av_frame_free(&frame);
+    while ((frame = m_PacingQueue.dequeue()) != nullptr) {
+        m_FramePool->release(frame);
     }
+
+    // Timing buffers still attached to frames elsewhere stay valid
+    // until those frames are released
+    av_buffer_pool_uninit(&m_FrameTimingPool);
+}
+
+Pacer::FRAME_TIMING* Pacer::getFrameTiming(AVFrame* frame)
+{
+    if (frame->opaque_ref == nullptr) {
+        return nullptr;
+    }
+
+    return (FRAME_TIMING*)frame->opaque_ref->data;
 }
 
 void Pacer::renderOnMainThread()
@@ -85,17 +153,10 @@ void Pacer::renderOnMainThread()
         return;
     }
 
-    m_FrameQueueLock.lock();
-
-    if (!m_RenderQueue.isEmpty()) {
-        AVFrame* frame = m_RenderQueue.dequeue();
-        m_FrameQueueLock.unlock();
-
+    AVFrame* frame = m_RenderQueue.dequeue();
+    if (frame != nullptr) {
         renderFrame(frame);
     }
-    else {
-        m_FrameQueueLock.unlock();
-    }
 }
 
 int Pacer::vsyncThread(void *context)
@@ -112,9 +173,9 @@ int Pacer::vsyncThread(void *context)
     while (!me->m_Stopping) {
         if (async) {
             // Wait for the VSync source to invoke signalVsync() or 100ms to elapse
-            me->m_FrameQueueLock.lock();
-            me->m_VsyncSignalled.wait(&me->m_FrameQueueLock, 100);
-            me->m_FrameQueueLock.unlock();
+            me->m_VsyncLock.lock();
+            me->m_VsyncSignalled.wait(&me->m_VsyncLock, 100);
+            me->m_VsyncLock.unlock();
         }
         else {
             // Let the VSync source wait in the context of our thread
@@ -125,7 +186,7 @@ int Pacer::vsyncThread(void *context)
             break;
         }
 
-        me->handleVsync(1000 / me->m_DisplayFps);
+        me->handleVsync(me->m_VsyncSource->getTimeUntilNextVsyncUs(1000000 / me->m_DisplayFps));
     }
 
     return 0;
@@ -145,25 +206,31 @@ int Pacer::renderThread(void* context)
         // Wait for the renderer to be ready for the next frame
         me->m_VsyncRenderer->waitToRender();
 
-        // Acquire the frame queue lock to protect the queue and
-        // the not empty condition
-        me->m_FrameQueueLock.lock();
-
-        // Wait for a frame to be ready to render
-        while (!me->m_Stopping && me->m_RenderQueue.isEmpty()) {
-            me->m_RenderQueueNotEmpty.wait(&me->m_FrameQueueLock);
+        // Wait for a frame to be ready to render. In VRR mode, we repeat the
+        // last frame if the next one doesn't arrive in time.
+        if (me->m_VrrRepeatFrames) {
+            if (!me->m_Clock->waitForFrame(me->m_RenderQueue, me->getVrrRepeatTimeoutMs())) {
+                if (!me->m_Stopping) {
+                    me->repeatVrrFrame();
+                }
+                continue;
+            }
+        }
+        else {
+            while (!me->m_Stopping && !me->m_Clock->waitForFrame(me->m_RenderQueue, -1));
         }
 
         if (me->m_Stopping) {
             // Exit this thread
-            me->m_FrameQueueLock.unlock();
             break;
         }
 
+        // The producer may have evicted this frame if the
+        // queue overflowed while we were waiting.
         AVFrame* frame = me->m_RenderQueue.dequeue();
-        me->m_FrameQueueLock.unlock();
-
-        me->renderFrame(frame);
+        if (frame != nullptr) {
+            me->renderFrame(frame);
+        }
     }
 
     // Notify the renderer that it is being destroyed soon
@@ -173,17 +240,13 @@ int Pacer::renderThread(void* context)
     return 0;
 }
 
-void Pacer::enqueueFrameForRenderingAndUnlock(AVFrame *frame)
+void Pacer::enqueueFrameForRendering(AVFrame *frame)
 {
+    // This will wake the render thread if it's waiting for a frame
     dropFrameForEnqueue(m_RenderQueue);
     m_RenderQueue.enqueue(frame);
 
-    m_FrameQueueLock.unlock();
-
-    if (m_RenderThread != nullptr) {
-        m_RenderQueueNotEmpty.wakeOne();
-    }
-    else {
+    if (m_RenderThread == nullptr) {
         SDL_Event event;
 
         // For main thread rendering, we'll push an event to trigger a callback
@@ -193,76 +256,191 @@ void Pacer::enqueueFrameForRenderingAndUnlock(AVFrame *frame)
     }
 }
 
-// Called in an arbitrary thread by the IVsyncSource on V-sync
-// or an event synchronized with V-sync
-void Pacer::handleVsync(int timeUntilNextVsyncMillis)
+// Called on the V-sync thread (or by the owner of an external
+// V-sync source) on V-sync or an event synchronized with V-sync
+void Pacer::handleVsync(int timeUntilNextVsyncUs)
 {
     // Make sure initialize() has been called
     SDL_assert(m_MaxVideoFps != 0);
 
-    m_FrameQueueLock.lock();
-
-    // If the queue length history entries are large, be strict
-    // about dropping excess frames.
-    int frameDropTarget = 1;
-
-    // If we may get more frames per second than we can display, use
-    // frame history to drop frames only if consistently above the
-    // one queued frame mark.
-    if (m_MaxVideoFps >= m_DisplayFps) {
-        for (int queueHistoryEntry : m_PacingQueueHistory) {
-            if (queueHistoryEntry <= 1) {
-                // Be lenient as long as the queue length
-                // resolves before the end of frame history
-                frameDropTarget = 3;
-                break;
-            }
+    // Latch a frame as late as we can while still leaving the renderer
+    // enough time to get it on screen by the next V-sync.
+    uint64_t vsyncTimeUs = m_Clock->getTimeUs() + timeUntilNextVsyncUs;
+    uint64_t deadlineUs = vsyncTimeUs - SDL_min(getRenderSlackUs(), timeUntilNextVsyncUs);
+
+    // Catch up if we're several frames ahead
+    dropExcessFrames(m_PacingQueue,
+                     m_DropPolicy->getPacingFrameDropTarget(m_PacingQueue.count()),
+                     &m_VideoStats->pacingQueueDroppedFrames);
+
+    // Wait for a frame to arrive or the deadline to expire. If we're latching
+    // the newest frame, keep waiting until the deadline in case another frame
+    // arrives in the meantime.
+    while (!m_Stopping) {
+        uint64_t nowUs = m_Clock->getTimeUs();
+        if (nowUs >= deadlineUs) {
+            break;
         }
 
-        // Keep a rolling 500 ms window of pacing queue history
-        if (m_PacingQueueHistory.count() == m_DisplayFps / 2) {
-            m_PacingQueueHistory.dequeue();
+        // Don't risk oversleeping past the deadline
+        int remainingMs = (int)((deadlineUs - nowUs) / 1000);
+        if (remainingMs == 0) {
+            break;
         }
 
-        m_PacingQueueHistory.enqueue(m_PacingQueue.count());
+        if (m_PacingQueue.isEmpty()) {
+            m_Clock->waitForFrame(m_PacingQueue, remainingMs);
+        }
+        else if (m_LatchNewestFrame) {
+            m_Clock->delay(remainingMs);
+        }
+        else {
+            break;
+        }
     }
 
-    // Catch up if we're several frames ahead
-    while (m_PacingQueue.count() > frameDropTarget) {
-        AVFrame* frame = m_PacingQueue.dequeue();
+    if (m_Stopping) {
+        return;
+    }
 
-        // Drop the lock while we call av_frame_free()
-        m_FrameQueueLock.unlock();
-        m_VideoStats->pacerDroppedFrames++;
-        av_frame_free(&frame);
-        m_FrameQueueLock.lock();
+    // Any older frames would just be displayed late, so drop them
+    if (m_LatchNewestFrame) {
+        dropExcessFrames(m_PacingQueue, 1, &m_VideoStats->latchDroppedFrames);
     }
 
-    if (m_PacingQueue.isEmpty()) {
-        // Wait for a frame to arrive or our V-sync timeout to expire
-        if (!m_PacingQueueNotEmpty.wait(&m_FrameQueueLock, SDL_max(timeUntilNextVsyncMillis, TIMER_SLACK_MS) - TIMER_SLACK_MS)) {
-            // Wait timed out - unlock and bail
-            m_FrameQueueLock.unlock();
-            return;
+    // Place the first frame on the render queue
+    AVFrame* frame = m_PacingQueue.dequeue();
+    if (frame != nullptr) {
+        FRAME_TIMING* timing = getFrameTiming(frame);
+        if (timing != nullptr) {
+            timing->vsyncTimeUs = vsyncTimeUs;
         }
+        enqueueFrameForRendering(frame);
+    }
+}
+
+int Pacer::getRenderSlackUs()
+{
+    int slackUs = SDL_AtomicGet(&m_RenderCostUs) + RENDER_DEADLINE_MARGIN_US;
+
+    // If the renderer needs more than a whole frame, latch right away
+    return SDL_min(slackUs, 1000000 / m_DisplayFps);
+}
 
-        if (m_Stopping) {
-            m_FrameQueueLock.unlock();
-            return;
+// Called on the render thread for frames latched for a specific V-sync
+void Pacer::updateRenderCost(uint64_t renderStartUs, uint64_t renderEndUs, uint64_t vsyncTimeUs)
+{
+    int costUs = SDL_AtomicGet(&m_RenderCostUs);
+    int renderTimeUs = (int)(renderEndUs - renderStartUs);
+
+    if (renderEndUs + VSYNC_WAIT_TOLERANCE_US < vsyncTimeUs) {
+        // We finished early, so this is how long the render really took.
+        // Cover slower frames immediately but only back off gradually.
+        if (renderTimeUs > costUs) {
+            costUs = renderTimeUs;
         }
+        else {
+            costUs -= (costUs - renderTimeUs) / 16;
+        }
+    }
+    else if (renderEndUs > vsyncTimeUs + VSYNC_WAIT_TOLERANCE_US) {
+        // We missed the V-sync, so we need at least the time we had plus
+        // however long we overran it. If the renderer blocked until the
+        // following V-sync, the overrun is meaningless, so cap it.
+        int availableUs = (int)(vsyncTimeUs - SDL_min(vsyncTimeUs, renderStartUs));
+        costUs = SDL_max(costUs, SDL_min(renderTimeUs, availableUs + MISSED_VSYNC_BACKOFF_US));
+    }
+    else {
+        // We finished right at V-sync. This is either a close call or the
+        // renderer waited for V-sync, so keep the current estimate.
+        return;
     }
 
-    // Place the first frame on the render queue
-    enqueueFrameForRenderingAndUnlock(m_PacingQueue.dequeue());
+    SDL_AtomicSet(&m_RenderCostUs, SDL_min(costUs, 1000000 / m_DisplayFps));
 }
 
-bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
+void Pacer::initializeFrameDropPolicy(int maxVideoFps, int displayFps,
+                                      StreamingPreferences::FrameDropPolicy frameDropPolicy)
 {
     m_MaxVideoFps = maxVideoFps;
-    m_DisplayFps = StreamUtils::getDisplayRefreshRate(window);
+    m_DisplayFps = displayFps;
     m_RendererAttributes = m_VsyncRenderer->getRendererAttributes();
+    m_DropPolicy = IFrameDropPolicy::create(frameDropPolicy, m_MaxVideoFps, m_DisplayFps, m_RendererAttributes);
+
+    // Latching the newest frame minimizes latency at the cost of dropping
+    // frames that arrive in bursts. The drop policy decides by default,
+    // but this can be overridden with the PACER_LATCH_NEWEST environment
+    // variable.
+    bool ok;
+    m_LatchNewestFrame = qEnvironmentVariableIntValue("PACER_LATCH_NEWEST", &ok) != 0;
+    if (!ok) {
+        m_LatchNewestFrame = m_DropPolicy->shouldLatchNewestFrame();
+    }
+}
 
-    if (enablePacing) {
+void Pacer::startThreads()
+{
+    if (m_VsyncSource != nullptr) {
+        m_VsyncThread = SDL_CreateThread(Pacer::vsyncThread, "PacerVsync", this);
+    }
+
+    if (m_VsyncRenderer->isRenderThreadSupported()) {
+        m_RenderThread = SDL_CreateThread(Pacer::renderThread, "PacerRender", this);
+    }
+}
+
+bool Pacer::initialize(IVsyncSource* vsyncSource, int displayFps, int maxVideoFps,
+                       StreamingPreferences::FrameDropPolicy frameDropPolicy)
+{
+    initializeFrameDropPolicy(maxVideoFps, displayFps, frameDropPolicy);
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Frame pacing: target %d Hz with %d FPS stream (externally driven)",
+                m_DisplayFps, m_MaxVideoFps);
+
+    if (!vsyncSource->initialize(nullptr, m_DisplayFps)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "External V-sync source failed to initialize");
+        delete vsyncSource;
+        return false;
+    }
+
+    m_VsyncSource = vsyncSource;
+    return true;
+}
+
+bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing,
+                       StreamingPreferences::FrameDropPolicy frameDropPolicy)
+{
+    initializeFrameDropPolicy(maxVideoFps, StreamUtils::getDisplayRefreshRate(window), frameDropPolicy);
+
+    // VRR displays can show each frame as soon as it's ready, so there's no
+    // V-sync to pace against. VRR_MIN_REFRESH_RATE can be set to the lowest
+    // refresh rate of a VRR display that we can't detect, or 0 to disable it.
+    // VRR presentation is a frame pacing mode, so we leave the display alone
+    // if the user turned pacing off.
+    bool ok;
+    int vrrMinRefreshRate = qEnvironmentVariableIntValue("VRR_MIN_REFRESH_RATE", &ok);
+    if (enablePacing && (!ok || vrrMinRefreshRate > 0)) {
+        if (!m_VsyncRenderer->enableVrr(&m_VrrMinRefreshRate)) {
+            m_VrrMinRefreshRate = 0;
+        }
+        if (ok) {
+            m_VrrMinRefreshRate = vrrMinRefreshRate;
+        }
+    }
+
+    if (m_VrrMinRefreshRate > 0) {
+        // We can only repeat frames for low framerate compensation on our render thread
+        m_VrrRepeatFrames = m_VsyncRenderer->isRenderThreadSupported();
+        m_VrrFrameIntervalUs = 1000000 / m_MaxVideoFps;
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Variable refresh rate: %d-%d Hz with %d FPS stream (frame repeating %s)",
+                    m_VrrMinRefreshRate, m_DisplayFps, m_MaxVideoFps,
+                    m_VrrRepeatFrames ? "enabled" : "disabled");
+    }
+    else if (enablePacing) {
         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                     "Frame pacing: target %d Hz with %d FPS stream",
                     m_DisplayFps, m_MaxVideoFps);
@@ -270,10 +448,12 @@ bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
         SDL_SysWMinfo info;
         SDL_VERSION(&info.version);
         if (!SDL_GetWindowWMInfo(window, &info)) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "SDL_GetWindowWMInfo() failed: %s",
-                         SDL_GetError());
-            return false;
+            // Video drivers like offscreen don't provide any window info,
+            // but we can still pace them with the software V-sync source.
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "SDL_GetWindowWMInfo() failed: %s",
+                        SDL_GetError());
+            info.subsystem = SDL_SYSWM_UNKNOWN;
         }
 
         switch (info.subsystem) {
@@ -293,6 +473,27 @@ bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
             break;
     #endif
 
+        case SDL_SYSWM_KMSDRM:
+    #ifdef HAVE_DRM
+            {
+                // If the renderer scans out directly to a DRM plane,
+                // we can wait for real V-blanks on its CRTC.
+                int drmFd, crtcIndex;
+                if (m_VsyncRenderer->getDrmVblankTarget(&drmFd, &crtcIndex)) {
+                    m_VsyncSource = new DrmVsyncSource(drmFd, crtcIndex);
+                    break;
+                }
+            }
+    #endif
+            // Fall through
+
+        case SDL_SYSWM_X11:
+        case SDL_SYSWM_UNKNOWN:
+            // These have no V-sync events that we can use, so predict
+            // V-sync from the refresh rate and present timestamps.
+            m_VsyncSource = new SoftwareVsyncSource();
+            break;
+
         default:
             // Platforms without a VsyncSource will just render frames
             // immediately like they used to.
@@ -314,85 +515,147 @@ bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
                     m_DisplayFps, m_MaxVideoFps);
     }
 
-    if (m_VsyncSource != nullptr) {
-        m_VsyncThread = SDL_CreateThread(Pacer::vsyncThread, "PacerVsync", this);
-    }
-
-    if (m_VsyncRenderer->isRenderThreadSupported()) {
-        m_RenderThread = SDL_CreateThread(Pacer::renderThread, "PacerRender", this);
-    }
-
+    startThreads();
     return true;
 }
 
 void Pacer::signalVsync()
 {
+    m_VsyncLock.lock();
     m_VsyncSignalled.wakeOne();
+    m_VsyncLock.unlock();
 }
 
 void Pacer::renderFrame(AVFrame* frame)
 {
     // Count time spent in Pacer's queues
-    Uint32 beforeRender = SDL_GetTicks();
-    m_VideoStats->totalPacerTime += beforeRender - frame->pkt_dts;
+    FRAME_TIMING* timing = getFrameTiming(frame);
+    uint64_t beforeRender = m_Clock->getTimeUs();
+    if (timing != nullptr) {
+        m_VideoStats->totalPacerTimeUs += beforeRender - timing->submitTimeUs;
+        m_VideoStats->pacerLatency.record(beforeRender - timing->submitTimeUs);
+    }
 
     // Render it
     m_VsyncRenderer->renderFrame(frame);
-    Uint32 afterRender = SDL_GetTicks();
+    uint64_t afterRender = m_Clock->getTimeUs();
+
+    if (m_VrrMinRefreshRate > 0) {
+        // Learn the stream's real frame interval for frame repeating. Gaps long
+        // enough to have needed several repeats are the host pausing, not a
+        // lower frame rate, so don't let them skew it.
+        if (m_VrrLastNewFrameUs != 0 && afterRender - m_VrrLastNewFrameUs < 4000000ULL / m_VrrMinRefreshRate) {
+            int intervalUs = (int)(afterRender - m_VrrLastNewFrameUs);
+            m_VrrFrameIntervalUs += (intervalUs - m_VrrFrameIntervalUs) / 8;
+        }
 
-    m_VideoStats->totalRenderTime += afterRender - beforeRender;
-    m_VideoStats->renderedFrames++;
-    av_frame_free(&frame);
+        m_VrrLastNewFrameUs = afterRender;
+        m_VrrLastPresentUs = afterRender;
+        m_VideoStats->vrrPresentedFrames++;
+    }
 
-    // Drop frames if we have too many queued up for a while
-    m_FrameQueueLock.lock();
+    // Learn how long the renderer needs to hit the V-sync that we latched this frame for
+    if (timing != nullptr && timing->vsyncTimeUs != 0) {
+        updateRenderCost(beforeRender, afterRender, timing->vsyncTimeUs);
+        m_VsyncSource->notifyFramePresented(afterRender);
+    }
 
-    int frameDropTarget;
+    m_VideoStats->totalRenderTimeUs += afterRender - beforeRender;
+    m_VideoStats->renderLatency.record(afterRender - beforeRender);
+    m_VideoStats->renderedFrames++;
 
-    if (m_RendererAttributes & RENDERER_ATTRIBUTE_NO_BUFFERING) {
-        // Renderers that don't buffer any frames but don't support waitToRender() need us to buffer
-        // an extra frame to ensure they don't starve while waiting to present.
-        frameDropTarget = 1;
+    if (m_VrrRepeatFrames) {
+        // Hold onto this frame until the next one in case we need to repeat it
+        if (m_VrrLastFrame != nullptr) {
+            m_FramePool->release(m_VrrLastFrame);
+        }
+        m_VrrLastFrame = frame;
     }
     else {
-        frameDropTarget = 0;
-        for (int queueHistoryEntry : m_RenderQueueHistory) {
-            if (queueHistoryEntry == 0) {
-                // Be lenient as long as the queue length
-                // resolves before the end of frame history
-                frameDropTarget = 2;
-                break;
-            }
-        }
+        m_FramePool->release(frame);
+    }
 
-        // Keep a rolling 500 ms window of render queue history
-        if (m_RenderQueueHistory.count() == m_MaxVideoFps / 2) {
-            m_RenderQueueHistory.dequeue();
-        }
+    // Drop frames if we have too many queued up for a while. With VRR, we
+    // want to show the newest frame as soon as possible, so there's no point
+    // keeping more than one around.
+    int frameDropTarget = m_VrrMinRefreshRate > 0 ?
+                1 : m_DropPolicy->getRenderFrameDropTarget(m_RenderQueue.count());
+    dropExcessFrames(m_RenderQueue, frameDropTarget, &m_VideoStats->renderQueueDroppedFrames);
+}
 
-        m_RenderQueueHistory.enqueue(m_RenderQueue.count());
+// Called on the render thread in VRR mode to find out how long it can wait
+// for the next frame before it must repeat the last one
+int Pacer::getVrrRepeatTimeoutMs()
+{
+    if (m_VrrLastFrame == nullptr) {
+        return -1;
     }
 
-    // Catch up if we're several frames ahead
-    while (m_RenderQueue.count() > frameDropTarget) {
-        AVFrame* frame = m_RenderQueue.dequeue();
+    // Like LFC in display drivers, show each frame an integer number of times
+    // with even spacing, rather than repeating it right at the display's limit
+    // and bunching the next frame up behind the repeat.
+    // We wait in whole milliseconds, rounded up so that we never repeat a
+    // frame early, so keep that much headroom under the display's limit.
+    int maxIntervalUs = SDL_max(1000000 / m_VrrMinRefreshRate - 1000, 1000);
+    int repeatIntervalUs = maxIntervalUs;
+    if (m_VrrFrameIntervalUs > maxIntervalUs) {
+        int presentsPerFrame = (m_VrrFrameIntervalUs + maxIntervalUs - 1) / maxIntervalUs;
+        repeatIntervalUs = m_VrrFrameIntervalUs / presentsPerFrame;
+    }
 
-        // Drop the lock while we call av_frame_free()
-        m_FrameQueueLock.unlock();
-        m_VideoStats->pacerDroppedFrames++;
-        av_frame_free(&frame);
-        m_FrameQueueLock.lock();
+    uint64_t repeatTimeUs = m_VrrLastPresentUs + repeatIntervalUs;
+    uint64_t nowUs = m_Clock->getTimeUs();
+    if (repeatTimeUs <= nowUs) {
+        return 0;
+    }
+
+    return (int)((repeatTimeUs - nowUs + 999) / 1000);
+}
+
+// Called on the render thread in VRR mode when the next frame is late
+void Pacer::repeatVrrFrame()
+{
+    // We may be woken up spuriously before we've rendered anything
+    if (m_VrrLastFrame == nullptr) {
+        return;
     }
 
-    m_FrameQueueLock.unlock();
+    m_VsyncRenderer->renderFrame(m_VrrLastFrame);
+    m_VrrLastPresentUs = m_Clock->getTimeUs();
+
+    m_VideoStats->vrrPresentedFrames++;
+    m_VideoStats->vrrRepeatedFrames++;
 }
 
-void Pacer::dropFrameForEnqueue(QQueue<AVFrame*>& queue)
+void Pacer::dropExcessFrames(FrameRing<MAX_QUEUED_FRAMES>& queue, int frameDropTarget, uint32_t* dropCounter)
 {
-    SDL_assert(queue.size() <= MAX_QUEUED_FRAMES);
-    if (queue.size() == MAX_QUEUED_FRAMES) {
+    // Only the consumer calls this, so the queue can't shrink underneath us
+    // except by producer eviction, which the nullptr check handles.
+    while (queue.count() > frameDropTarget) {
         AVFrame* frame = queue.dequeue();
-        av_frame_free(&frame);
+        if (frame == nullptr) {
+            break;
+        }
+
+        (*dropCounter)++;
+        m_VideoStats->pacerDroppedFrames++;
+        m_FramePool->release(frame);
+    }
+}
+
+void Pacer::dropFrameForEnqueue(FrameRing<MAX_QUEUED_FRAMES>& queue)
+{
+    // Only the producer calls this, so the queue can only shrink
+    // concurrently with us. If the consumer beats us to the oldest
+    // frame, we don't need to evict anything.
+    SDL_assert(queue.count() <= MAX_QUEUED_FRAMES);
+    if (queue.count() == MAX_QUEUED_FRAMES) {
+        AVFrame* frame = queue.dequeue();
+        if (frame != nullptr) {
+            m_VideoStats->overflowDroppedFrames++;
+            m_VideoStats->pacerDroppedFrames++;
+            m_FramePool->release(frame);
+        }
     }
 }
 
@@ -401,15 +664,25 @@ void Pacer::submitFrame(AVFrame* frame)
     // Make sure initialize() has been called
     SDL_assert(m_MaxVideoFps != 0);
 
-    // Queue the frame and possibly wake up the render thread
-    m_FrameQueueLock.lock();
+    // Frames from the decoder don't have an opaque_ref of their own. If the
+    // pool can't give us a buffer, the frame just isn't counted in the stats.
+    av_buffer_unref(&frame->opaque_ref);
+    if (m_FrameTimingPool != nullptr) {
+        frame->opaque_ref = av_buffer_pool_get(m_FrameTimingPool);
+    }
+
+    FRAME_TIMING* timing = getFrameTiming(frame);
+    if (timing != nullptr) {
+        timing->submitTimeUs = m_Clock->getTimeUs();
+        timing->vsyncTimeUs = 0;
+    }
+
+    // Queue the frame and possibly wake up the V-sync or render thread
     if (m_VsyncSource != nullptr) {
         dropFrameForEnqueue(m_PacingQueue);
         m_PacingQueue.enqueue(frame);
-        m_FrameQueueLock.unlock();
-        m_PacingQueueNotEmpty.wakeOne();
     }
     else {
-        enqueueFrameForRenderingAndUnlock(frame);
+        enqueueFrameForRendering(frame);
     }
 }
@@ -1,12 +1,21 @@
 #pragma once
 
 #include "../../decoder.h"
+#include "../../framepool.h"
 #include "../renderer.h"
+#include "framering.h"
+#include "framedroppolicy.h"
 
-#include <QQueue>
 #include <QMutex>
 #include <QWaitCondition>
 
+// Limit the number of queued frames to prevent excessive memory consumption
+// if the V-Sync source or renderer is blocked for a while. It's important
+// that the sum of all queued frames between both pacing and rendering queues
+// must not exceed the number buffer pool size to avoid running the decoder
+// out of available decoding surfaces.
+#define MAX_QUEUED_FRAMES 4
+
 class IVsyncSource {
 public:
     virtual ~IVsyncSource() {}
@@ -20,52 +29,140 @@ public:
         // Synchronous sources must implement waitForVsync()!
         SDL_assert(false);
     }
+
+    // Called on the V-sync thread after each V-sync. Sources that know when
+    // the V-sync actually happened can account for our wakeup latency.
+    virtual int getTimeUntilNextVsyncUs(int vsyncPeriodUs) {
+        return vsyncPeriodUs;
+    }
+
+    // Called on the render thread with the time that each frame latched
+    // for V-sync finished presenting.
+    virtual void notifyFramePresented(uint64_t) {}
+};
+
+// Time source for the Pacer's scheduling decisions. The default one uses the
+// real monotonic clock, while a simulation can step virtual time instead.
+class IPacerClock {
+public:
+    virtual ~IPacerClock() {}
+
+    virtual uint64_t getTimeUs() = 0;
+
+    // Sleeps like SDL_Delay()
+    virtual void delay(int ms) = 0;
+
+    // Waits like FrameRing::waitForFrame()
+    virtual bool waitForFrame(FrameRing<MAX_QUEUED_FRAMES>& queue, int timeoutMs) = 0;
 };
 
 class Pacer
 {
 public:
-    Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats);
+    // The clock is optional and must outlive the Pacer
+    Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats, FramePool* framePool,
+          IPacerClock* clock = nullptr);
 
     ~Pacer();
 
     void submitFrame(AVFrame* frame);
 
-    bool initialize(SDL_Window* window, int maxVideoFps, bool enablePacing);
+    bool initialize(SDL_Window* window, int maxVideoFps, bool enablePacing,
+                    StreamingPreferences::FrameDropPolicy frameDropPolicy);
+
+    // Paces to the given V-sync source without a window or any threads of
+    // our own, so the Pacer can be stepped through a simulation. The caller
+    // must call handleVsync() at each V-sync and renderOnMainThread() to
+    // render the latched frames. The Pacer takes ownership of the source,
+    // even if initialization fails.
+    bool initialize(IVsyncSource* vsyncSource, int displayFps, int maxVideoFps,
+                    StreamingPreferences::FrameDropPolicy frameDropPolicy);
 
     void signalVsync();
 
     void renderOnMainThread();
 
+    // Latches a frame for the next V-sync. This is called on our V-sync thread
+    // unless the Pacer was initialized with an external V-sync source.
+    void handleVsync(int timeUntilNextVsyncUs);
+
 private:
     static int vsyncThread(void* context);
 
     static int renderThread(void* context);
 
-    void handleVsync(int timeUntilNextVsyncMillis);
+    void initializeFrameDropPolicy(int maxVideoFps, int displayFps,
+                                   StreamingPreferences::FrameDropPolicy frameDropPolicy);
+
+    void startThreads();
+
+    int getRenderSlackUs();
 
-    void enqueueFrameForRenderingAndUnlock(AVFrame* frame);
+    void updateRenderCost(uint64_t renderStartUs, uint64_t renderEndUs, uint64_t vsyncTimeUs);
+
+    void enqueueFrameForRendering(AVFrame* frame);
 
     void renderFrame(AVFrame* frame);
 
-    void dropFrameForEnqueue(QQueue<AVFrame*>& queue);
+    int getVrrRepeatTimeoutMs();
+
+    void repeatVrrFrame();
+
+    void dropFrameForEnqueue(FrameRing<MAX_QUEUED_FRAMES>& queue);
+
+    void dropExcessFrames(FrameRing<MAX_QUEUED_FRAMES>& queue, int frameDropTarget, uint32_t* dropCounter);
+
+    // Our own timing for each frame. It's attached to the frame as its
+    // opaque_ref, since the other AVFrame fields belong to FFmpeg and the
+    // renderers.
+    typedef struct _FRAME_TIMING {
+        // When the frame was submitted to us
+        uint64_t submitTimeUs;
+
+        // The V-sync that the frame was latched for, or 0 if it wasn't
+        uint64_t vsyncTimeUs;
+    } FRAME_TIMING;
+
+    static FRAME_TIMING* getFrameTiming(AVFrame* frame);
 
-    QQueue<AVFrame*> m_RenderQueue;
-    QQueue<AVFrame*> m_PacingQueue;
-    QQueue<int> m_PacingQueueHistory;
-    QQueue<int> m_RenderQueueHistory;
-    QMutex m_FrameQueueLock;
-    QWaitCondition m_RenderQueueNotEmpty;
-    QWaitCondition m_PacingQueueNotEmpty;
+    // The pacing queue is produced by the decoder thread and consumed by the
+    // V-sync thread. The render queue is produced by the V-sync thread (or the
+    // decoder thread without a V-sync source) and consumed by the render thread.
+    FrameRing<MAX_QUEUED_FRAMES> m_RenderQueue;
+    FrameRing<MAX_QUEUED_FRAMES> m_PacingQueue;
+    QMutex m_VsyncLock;
     QWaitCondition m_VsyncSignalled;
     SDL_Thread* m_RenderThread;
     SDL_Thread* m_VsyncThread;
     bool m_Stopping;
+    IPacerClock* m_Clock;
 
     IVsyncSource* m_VsyncSource;
+    IFrameDropPolicy* m_DropPolicy;
     IFFmpegRenderer* m_VsyncRenderer;
     int m_MaxVideoFps;
     int m_DisplayFps;
     PVIDEO_STATS m_VideoStats;
+    FramePool* m_FramePool;
+    AVBufferPool* m_FrameTimingPool;
     int m_RendererAttributes;
+    bool m_LatchNewestFrame;
+
+    // Lowest refresh rate of the display in VRR mode or 0 if we're pacing
+    // to a fixed refresh rate. If we have a render thread, it repeats the
+    // last frame to keep the display above this rate. Holding that frame
+    // doesn't exceed our frame budget since the pacing queue is unused in
+    // VRR mode. The frame and timing state is only touched by the render
+    // thread.
+    int m_VrrMinRefreshRate;
+    bool m_VrrRepeatFrames;
+    AVFrame* m_VrrLastFrame;
+    uint64_t m_VrrLastPresentUs;
+    uint64_t m_VrrLastNewFrameUs;
+    int m_VrrFrameIntervalUs;
+
+    // Learned time the renderer needs from latching a frame until it's
+    // ready for V-sync. Written by the render thread and read by the
+    // V-sync thread.
+    SDL_atomic_t m_RenderCostUs;
 };
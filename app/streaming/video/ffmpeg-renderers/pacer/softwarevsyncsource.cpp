@@ -0,0 +1,156 @@
+#include "softwarevsyncsource.h"
+#include "streaming/streamutils.h"
+
+#include <cmath>
+
+#ifdef Q_OS_UNIX
+#include <time.h>
+#endif
+
+// The loop corrects the predicted V-sync phase by 1/16th and the period by
+// 1/1024th of each phase error, so a single late present can't move it much.
+#define PHASE_CORRECTION_DIVISOR 16
+#define PERIOD_CORRECTION_DIVISOR 1024
+
+// The steady offset between presents and our V-sync ticks is tracked over
+// roughly the last 64 frames.
+#define PRESENT_OFFSET_DIVISOR 64
+
+// Phase errors are clamped to 1/8th of a frame, so a descheduled render
+// thread looks like a small error rather than a phase jump.
+#define MAX_PHASE_ERROR_FRACTION 8
+
+// The refresh rate from SDL is rounded to the nearest Hz, so the real period
+// is well within 1% of it. Drifting further means we're chasing noise.
+#define MAX_PERIOD_DEVIATION_FRACTION 100
+
+SoftwareVsyncSource::SoftwareVsyncSource() :
+    m_NominalPeriodUs(0),
+    m_PeriodUs(0),
+    m_NextVsyncUs(0),
+    m_PresentOffsetUs(0),
+    m_HasPresentOffset(false)
+{
+
+}
+
+SoftwareVsyncSource::~SoftwareVsyncSource()
+{
+    if (m_NominalPeriodUs != 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Software V-sync period: %.1f us (nominal %.1f us)",
+                    m_PeriodUs, m_NominalPeriodUs);
+    }
+}
+
+bool SoftwareVsyncSource::initialize(SDL_Window*, int displayFps)
+{
+    if (displayFps <= 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Invalid display refresh rate for software V-sync: %d",
+                     displayFps);
+        return false;
+    }
+
+    m_NominalPeriodUs = 1000000.0 / displayFps;
+    m_PeriodUs = m_NominalPeriodUs;
+    m_NextVsyncUs = StreamUtils::getMonotonicTimeUs() + m_PeriodUs;
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using software V-sync source at %d Hz",
+                displayFps);
+    return true;
+}
+
+bool SoftwareVsyncSource::isAsync()
+{
+    // We wait on a timer in the Pacer's V-sync thread
+    return false;
+}
+
+void SoftwareVsyncSource::waitForVsync()
+{
+    uint64_t targetTimeUs;
+
+    m_Lock.lock();
+    {
+        double nowUs = StreamUtils::getMonotonicTimeUs();
+
+        // Skip any V-syncs we slept through or already signalled. The loop
+        // may also have moved the prediction while we were waiting.
+        if (m_NextVsyncUs <= nowUs) {
+            m_NextVsyncUs += (std::floor((nowUs - m_NextVsyncUs) / m_PeriodUs) + 1) * m_PeriodUs;
+        }
+
+        targetTimeUs = (uint64_t)m_NextVsyncUs;
+    }
+    m_Lock.unlock();
+
+    sleepUntil(targetTimeUs);
+}
+
+// Called on the render thread after each frame latched for V-sync is presented
+void SoftwareVsyncSource::notifyFramePresented(uint64_t presentTimeUs)
+{
+    QMutexLocker locker(&m_Lock);
+
+    // We don't know whether the renderer waited for V-sync or just presented
+    // as soon as it could. If it didn't wait, presents land at a constant
+    // offset from our own ticks, so locking onto that offset would just chase
+    // our own tail. Instead, we lock onto changes in the offset. Those come
+    // from the display's real refresh cadence drifting against our period
+    // when the renderer waits for V-sync, and average out to nothing when it
+    // doesn't.
+    double offsetUs = wrapPhase(presentTimeUs - m_NextVsyncUs, m_PeriodUs);
+    if (!m_HasPresentOffset) {
+        m_PresentOffsetUs = offsetUs;
+        m_HasPresentOffset = true;
+        return;
+    }
+
+    double maxErrorUs = m_PeriodUs / MAX_PHASE_ERROR_FRACTION;
+    double errorUs = wrapPhase(offsetUs - m_PresentOffsetUs, m_PeriodUs);
+    errorUs = SDL_max(-maxErrorUs, SDL_min(errorUs, maxErrorUs));
+
+    m_PresentOffsetUs = wrapPhase(m_PresentOffsetUs + errorUs / PRESENT_OFFSET_DIVISOR, m_PeriodUs);
+
+    // Proportional phase correction and integral period correction. The period
+    // also leaks back towards nominal, so noise can't walk it away over time.
+    m_NextVsyncUs += errorUs / PHASE_CORRECTION_DIVISOR;
+    m_PeriodUs += errorUs / PERIOD_CORRECTION_DIVISOR;
+    m_PeriodUs += (m_NominalPeriodUs - m_PeriodUs) / PERIOD_CORRECTION_DIVISOR;
+
+    double maxDeviationUs = m_NominalPeriodUs / MAX_PERIOD_DEVIATION_FRACTION;
+    m_PeriodUs = SDL_max(m_NominalPeriodUs - maxDeviationUs, SDL_min(m_PeriodUs, m_NominalPeriodUs + maxDeviationUs));
+}
+
+// Wraps a phase difference into [-period/2, period/2)
+double SoftwareVsyncSource::wrapPhase(double phaseUs, double periodUs)
+{
+    return phaseUs - std::floor(phaseUs / periodUs + 0.5) * periodUs;
+}
+
+void SoftwareVsyncSource::sleepUntil(uint64_t targetTimeUs)
+{
+    for (;;) {
+        uint64_t nowUs = StreamUtils::getMonotonicTimeUs();
+        if (nowUs >= targetTimeUs) {
+            break;
+        }
+
+        uint64_t remainingUs = targetTimeUs - nowUs;
+
+#ifdef Q_OS_UNIX
+        // nanosleep() is backed by high-resolution timers, so it will
+        // only overshoot by the kernel's timer slack.
+        struct timespec ts;
+        ts.tv_sec = (time_t)(remainingUs / 1000000);
+        ts.tv_nsec = (long)((remainingUs % 1000000) * 1000);
+        nanosleep(&ts, nullptr);
+#else
+        // SDL_Delay() only has millisecond granularity, so sleep until
+        // the last millisecond and yield for the remainder.
+        SDL_Delay(remainingUs > 2000 ? (Uint32)(remainingUs / 1000) - 1 : 0);
+#endif
+    }
+}
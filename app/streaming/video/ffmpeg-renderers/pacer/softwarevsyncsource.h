@@ -0,0 +1,41 @@
+#pragma once
+
+#include "pacer.h"
+
+#include <QMutex>
+
+// Synchronous V-sync source for platforms that don't give us V-sync events.
+// It ticks at the display refresh rate using a high-resolution timer and
+// uses present timestamps from the Pacer to lock onto the display's actual
+// refresh cadence, since the refresh rate reported by SDL is only accurate
+// to the nearest Hz. It doesn't need anything from the window system, so
+// it works the same for offscreen windows.
+class SoftwareVsyncSource : public IVsyncSource
+{
+public:
+    SoftwareVsyncSource();
+
+    virtual ~SoftwareVsyncSource();
+
+    virtual bool initialize(SDL_Window* window, int displayFps) override;
+
+    virtual bool isAsync() override;
+
+    virtual void waitForVsync() override;
+
+    virtual void notifyFramePresented(uint64_t presentTimeUs) override;
+
+private:
+    static double wrapPhase(double phaseUs, double periodUs);
+
+    static void sleepUntil(uint64_t targetTimeUs);
+
+    // Protects the loop state below, which is updated by the render
+    // thread and read by the V-sync thread.
+    QMutex m_Lock;
+    double m_NominalPeriodUs;
+    double m_PeriodUs;
+    double m_NextVsyncUs;
+    double m_PresentOffsetUs;
+    bool m_HasPresentOffset;
+};
@@ -251,6 +251,14 @@ public:
         return true;
     }
 
+    // Called by the Pacer to switch the display into variable refresh rate
+    // mode if the renderer can. If it succeeds, frames will be presented as
+    // soon as they're ready, so the renderer must not wait for V-sync.
+    virtual bool enableVrr(int*) {
+        // VRR detection is not supported by default
+        return false;
+    }
+
     virtual AVPixelFormat getPreferredPixelFormat(int videoFormat) {
         if (videoFormat & VIDEO_FORMAT_MASK_10BIT) {
             return (videoFormat & VIDEO_FORMAT_MASK_YUV444) ?
@@ -351,8 +359,11 @@ public:
         return -1;
     }
 
-    // Free the resources allocated during the last `exportEGLImages` call
+    // Free the resources allocated by an `exportEGLImages` call
     virtual void freeEGLImages(EGLDisplay, EGLImage[EGL_MAX_PLANES]) {}
+
+    // Free any EGLImages kept for reuse by later `exportEGLImages` calls
+    virtual void flushEGLImages(EGLDisplay) {}
 #endif
 
 #ifdef HAVE_DRM
@@ -366,6 +377,12 @@ public:
     }
 
     virtual void unmapDrmPrimeFrame(AVDRMFrameDescriptor*) {}
+
+    // Renderers that scan out directly to a DRM CRTC can share it with
+    // the Pacer, so it can wait for that CRTC's V-blanks.
+    virtual bool getDrmVblankTarget(int*, int*) {
+        return false;
+    }
 #endif
 
 protected:
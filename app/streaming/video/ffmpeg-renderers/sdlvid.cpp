@@ -19,8 +19,11 @@ SdlRenderer::SdlRenderer()
       m_Texture(nullptr),
       m_ColorSpace(-1),
       m_NeedsYuvToRgbConversion(false),
+      m_UseSwFrameUploader(false),
       m_SwsContext(nullptr),
       m_RgbFrame(av_frame_alloc()),
+      m_CpuUploadTime(0),
+      m_CpuUploadFrames(0),
       m_SwFrameMapper(this)
 {
     SDL_zero(m_OverlayTextures);
@@ -32,6 +35,16 @@ SdlRenderer::SdlRenderer()
 
 SdlRenderer::~SdlRenderer()
 {
+    if (m_CpuUploadFrames != 0) {
+        // This makes it easy to compare our conversion against swscale
+        // on a given machine by toggling SDL_FORCE_SWSCALE.
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Average CPU frame upload time: %.2f ms (%u frames, %s)",
+                    (double)m_CpuUploadTime * 1000.0 / SDL_GetPerformanceFrequency() / m_CpuUploadFrames,
+                    m_CpuUploadFrames,
+                    (m_NeedsYuvToRgbConversion && !m_UseSwFrameUploader) ? "swscale" : "SwFrameUploader");
+    }
+
 #ifdef HAVE_CUDA
     if (m_CudaGLHelper != nullptr) {
         delete m_CudaGLHelper;
@@ -266,6 +279,12 @@ void SdlRenderer::ffNoopFree(void*, uint8_t*)
     // Nothing
 }
 
+void SdlRenderer::addCpuUploadTime(uint64_t startTime)
+{
+    m_CpuUploadTime += SDL_GetPerformanceCounter() - startTime;
+    m_CpuUploadFrames++;
+}
+
 void SdlRenderer::renderFrame(AVFrame* frame)
 {
     int err;
@@ -320,6 +339,7 @@ ReadbackRetry:
 
         // Remember to keep this in sync with SdlRenderer::isPixelFormatSupported()!
         m_NeedsYuvToRgbConversion = false;
+        m_UseSwFrameUploader = false;
         switch (frame->format)
         {
         case AV_PIX_FMT_YUV420P:
@@ -343,6 +363,12 @@ ReadbackRetry:
         }
 
         if (m_NeedsYuvToRgbConversion) {
+            // Use our own conversion for formats it supports unless asked not to
+            m_UseSwFrameUploader = !qEnvironmentVariableIntValue("SDL_FORCE_SWSCALE") &&
+                                   m_SwFrameUploader.initializeXrgbConversion(frame, colorspace, isFrameFullRange(frame));
+        }
+
+        if (m_NeedsYuvToRgbConversion && !m_UseSwFrameUploader) {
             m_RgbFrame->width = frame->width;
             m_RgbFrame->height = frame->height;
             m_RgbFrame->format = AV_PIX_FMT_BGR0;
@@ -398,7 +424,7 @@ ReadbackRetry:
             }
 #endif
         }
-        else {
+        else if (!m_NeedsYuvToRgbConversion) {
             // SDL will perform YUV conversion on the GPU
             switch (colorspace)
             {
@@ -481,8 +507,9 @@ ReadbackRetry:
                                 frame->linesize[1]) != 0)
 #endif
         {
-            char* pixels;
+            uint8_t* pixels;
             int texturePitch;
+            uint64_t startTime = SDL_GetPerformanceCounter();
 
             err = SDL_LockTexture(m_Texture, nullptr, (void**)&pixels, &texturePitch);
             if (err < 0) {
@@ -492,46 +519,39 @@ ReadbackRetry:
                 goto Exit;
             }
 
-            // If the planar pitches match, we can use a single memcpy() to transfer
-            // the data. If not, we'll need to do separate memcpy() calls for each
-            // line to ensure the pitch doesn't get screwed up.
-
-            if (frame->linesize[0] == texturePitch) {
-                memcpy(pixels,
-                       frame->data[0],
-                       frame->linesize[0] * frame->height);
-            }
-            else {
-                int pitch = SDL_min(frame->linesize[0], texturePitch);
-                for (int i = 0; i < frame->height; i++) {
-                    memcpy(pixels + (texturePitch * i),
-                           frame->data[0] + (frame->linesize[0] * i),
-                           pitch);
-                }
-            }
-
-            if (frame->linesize[1] == texturePitch) {
-                memcpy(pixels + (texturePitch * frame->height),
-                       frame->data[1],
-                       frame->linesize[1] * frame->height / 2);
-            }
-            else {
-                int pitch = SDL_min(frame->linesize[1], texturePitch);
-                for (int i = 0; i < frame->height / 2; i++) {
-                    memcpy(pixels + (texturePitch * (frame->height + i)),
-                           frame->data[1] + (frame->linesize[1] * i),
-                           pitch);
-                }
-            }
+            // Copy both planes in parallel, fixing up the pitch as we go
+            m_SwFrameUploader.copyNv12(frame, pixels, texturePitch);
 
             SDL_UnlockTexture(m_Texture);
+            addCpuUploadTime(startTime);
         }
     }
+    else if (m_UseSwFrameUploader) {
+        // We have a pixel format that SDL doesn't natively support, but we can
+        // convert it to RGB ourselves directly into the locked texture buffer.
+        uint8_t* pixels;
+        int texturePitch;
+        uint64_t startTime = SDL_GetPerformanceCounter();
+
+        err = SDL_LockTexture(m_Texture, nullptr, (void**)&pixels, &texturePitch);
+        if (err < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "SDL_LockTexture() failed: %s",
+                         SDL_GetError());
+            goto Exit;
+        }
+
+        m_SwFrameUploader.convertToXrgb(frame, pixels, texturePitch);
+
+        SDL_UnlockTexture(m_Texture);
+        addCpuUploadTime(startTime);
+    }
     else {
         // We have a pixel format that SDL doesn't natively support, so we must use
         // swscale to convert the YUV frame into an RGB frame to upload to the GPU.
         uint8_t* pixels;
         int texturePitch;
+        uint64_t startTime = SDL_GetPerformanceCounter();
 
         err = SDL_LockTexture(m_Texture, nullptr, (void**)&pixels, &texturePitch);
         if (err < 0) {
@@ -557,6 +577,7 @@ ReadbackRetry:
 
         av_buffer_unref(&m_RgbFrame->buf[0]);
         SDL_UnlockTexture(m_Texture);
+        addCpuUploadTime(startTime);
 
         if (err < 0) {
             char string[AV_ERROR_MAX_STRING_SIZE];
@@ -597,7 +618,7 @@ ReadbackRetry:
 
 Exit:
     if (swFrame != nullptr) {
-        av_frame_free(&swFrame);
+        m_SwFrameMapper.releaseSwFrame(swFrame);
     }
 }
 
@@ -627,7 +648,7 @@ bool SdlRenderer::testRenderFrame(AVFrame* frame)
             return false;
         }
 
-        av_frame_free(&swFrame);
+        m_SwFrameMapper.releaseSwFrame(swFrame);
     }
     else if (!isPixelFormatSupported(m_VideoFormat, (AVPixelFormat)frame->format)) {
         SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
@@ -2,6 +2,7 @@
 
 #include "renderer.h"
 #include "swframemapper.h"
+#include "swframeuploader.h"
 
 #ifdef HAVE_CUDA
 #include "cuda.h"
@@ -29,6 +30,8 @@ private:
 
     static void ffNoopFree(void *opaque, uint8_t *data);
 
+    void addCpuUploadTime(uint64_t startTime);
+
     int m_VideoFormat;
     SDL_Renderer* m_Renderer;
     SDL_Texture* m_Texture;
@@ -38,9 +41,15 @@ private:
 
     // Used for CPU conversion of YUV to RGB if needed
     bool m_NeedsYuvToRgbConversion;
+    bool m_UseSwFrameUploader;
     SwsContext* m_SwsContext;
     AVFrame* m_RgbFrame;
 
+    // Used for CPU conversion and texture uploads that SDL can't do itself
+    SwFrameUploader m_SwFrameUploader;
+    uint64_t m_CpuUploadTime;
+    uint32_t m_CpuUploadFrames;
+
     SwFrameMapper m_SwFrameMapper;
 
 #ifdef HAVE_CUDA
@@ -1,11 +1,44 @@
 #include "swframemapper.h"
 
+#include <QtGlobal>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#if defined(Q_PROCESSOR_X86_64) || (defined(Q_PROCESSOR_X86) && (defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)))
+#include <emmintrin.h>
+#define HAVE_STREAMING_STORES
+#endif
+
+// Don't bother splitting up frames into slices smaller than this
+#define MIN_ROWS_PER_SLICE 32
+
+#define MAX_COPY_THREADS 4
+
 SwFrameMapper::SwFrameMapper(IFFmpegRenderer* renderer)
     : m_Renderer(renderer),
       m_VideoFormat(0),
       m_SwPixelFormat(AV_PIX_FMT_NONE),
-      m_MapFrame(false)
+      m_MapFrame(false),
+      m_OutputFrame(av_frame_alloc()),
+      m_WorkerPool(nullptr),
+      m_CopySrcFrame(nullptr),
+      m_CopyDstFrame(nullptr)
 {
+    SDL_zero(m_StagingFrames);
+}
+
+SwFrameMapper::~SwFrameMapper()
+{
+    delete m_WorkerPool;
+
+    for (int i = 0; i < k_StagingFrameCount; i++) {
+        av_frame_free(&m_StagingFrames[i]);
+    }
+
+    av_frame_free(&m_OutputFrame);
 }
 
 void SwFrameMapper::setVideoFormat(int videoFormat)
@@ -99,25 +132,86 @@ Exit:
     return true;
 }
 
-AVFrame* SwFrameMapper::getSwFrameFromHwFrame(AVFrame* hwFrame)
+AVPixelFormat SwFrameMapper::getSwPixelFormat(AVFrame* frame)
 {
-    int err;
+    if (frame->hw_frames_ctx == nullptr) {
+        return (AVPixelFormat)frame->format;
+    }
 
     // setVideoFormat() must have been called before our first frame
     SDL_assert(m_VideoFormat != 0);
 
     if (m_SwPixelFormat == AV_PIX_FMT_NONE) {
-        SDL_assert(hwFrame->hw_frames_ctx != nullptr);
-        if (!initializeReadBackFormat(hwFrame->hw_frames_ctx, hwFrame)) {
-            return nullptr;
+        if (!initializeReadBackFormat(frame->hw_frames_ctx, frame)) {
+            return AV_PIX_FMT_NONE;
+        }
+    }
+
+    return m_SwPixelFormat;
+}
+
+AVFrame* SwFrameMapper::getStagingFrame(AVBufferRef* hwFrameCtxRef)
+{
+    auto hwFrameCtx = (AVHWFramesContext*)hwFrameCtxRef->data;
+
+    for (int i = 0; i < k_StagingFrameCount; i++) {
+        AVFrame* stagingFrame = m_StagingFrames[i];
+
+        // Reallocate staging frames that no longer match the hwframes
+        if (stagingFrame != nullptr &&
+                (stagingFrame->format != m_SwPixelFormat ||
+                 stagingFrame->width != hwFrameCtx->width ||
+                 stagingFrame->height != hwFrameCtx->height)) {
+            av_frame_free(&m_StagingFrames[i]);
+        }
+
+        if (m_StagingFrames[i] == nullptr) {
+            stagingFrame = av_frame_alloc();
+            if (stagingFrame == nullptr) {
+                return nullptr;
+            }
+
+            // Match the size of the hwframes, like av_hwframe_transfer_data() does
+            // when it allocates the destination frame itself.
+            stagingFrame->format = m_SwPixelFormat;
+            stagingFrame->width = hwFrameCtx->width;
+            stagingFrame->height = hwFrameCtx->height;
+
+            int err = av_frame_get_buffer(stagingFrame, 0);
+            if (err < 0) {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                             "av_frame_get_buffer() failed: %d",
+                             err);
+                av_frame_free(&stagingFrame);
+                return nullptr;
+            }
+
+            m_StagingFrames[i] = stagingFrame;
+            return stagingFrame;
+        }
+
+        // Skip staging frames that are still referenced by a previous output frame
+        if (av_frame_is_writable(m_StagingFrames[i])) {
+            return m_StagingFrames[i];
         }
     }
 
-    AVFrame* swFrame = av_frame_alloc();
-    if (swFrame == nullptr) {
+    return nullptr;
+}
+
+AVFrame* SwFrameMapper::getSwFrameFromHwFrame(AVFrame* hwFrame)
+{
+    int err;
+
+    SDL_assert(hwFrame->hw_frames_ctx != nullptr);
+    if (getSwPixelFormat(hwFrame) == AV_PIX_FMT_NONE) {
         return nullptr;
     }
 
+    // The previous frame must have been released before we can reuse it
+    AVFrame* swFrame = m_OutputFrame;
+    SDL_assert(swFrame->buf[0] == nullptr);
+
     swFrame->format = m_SwPixelFormat;
 
     if (m_MapFrame) {
@@ -129,17 +223,33 @@ AVFrame* SwFrameMapper::getSwFrameFromHwFrame(AVFrame* hwFrame)
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "av_hwframe_map() failed: %d",
                          err);
-            av_frame_free(&swFrame);
+            av_frame_unref(swFrame);
             return nullptr;
         }
     }
     else {
-        err = av_hwframe_transfer_data(swFrame, hwFrame, 0);
+        AVFrame* stagingFrame = getStagingFrame(hwFrame->hw_frames_ctx);
+        if (stagingFrame != nullptr) {
+            err = av_hwframe_transfer_data(stagingFrame, hwFrame, 0);
+            if (err == 0) {
+                err = av_frame_ref(swFrame, stagingFrame);
+                if (err == 0) {
+                    // Crop the staging frame down to the size of this frame
+                    swFrame->width = hwFrame->width;
+                    swFrame->height = hwFrame->height;
+                }
+            }
+        }
+        else {
+            // Every staging frame is still in use, so let FFmpeg allocate one
+            err = av_hwframe_transfer_data(swFrame, hwFrame, 0);
+        }
+
         if (err < 0) {
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "av_hwframe_transfer_data() failed: %d",
                          err);
-            av_frame_free(&swFrame);
+            av_frame_unref(swFrame);
             return nullptr;
         }
 
@@ -151,3 +261,125 @@ AVFrame* SwFrameMapper::getSwFrameFromHwFrame(AVFrame* hwFrame)
 
     return swFrame;
 }
+
+void SwFrameMapper::releaseSwFrame(AVFrame* swFrame)
+{
+    SDL_assert(swFrame == m_OutputFrame);
+
+    // This drops our mapping or staging frame reference, but keeps the AVFrame
+    av_frame_unref(swFrame);
+}
+
+bool SwFrameMapper::copyFrame(AVFrame* frame, AVFrame* dstFrame)
+{
+    if (frame->hw_frames_ctx != nullptr) {
+        if (getSwPixelFormat(frame) == AV_PIX_FMT_NONE) {
+            return false;
+        }
+
+        SDL_assert(dstFrame->format == m_SwPixelFormat);
+
+        if (!m_MapFrame) {
+            // We'd have to read the frame back into a staging frame anyway,
+            // so read it back straight into the destination instead.
+            int err = av_hwframe_transfer_data(dstFrame, frame, 0);
+            if (err < 0) {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                             "av_hwframe_transfer_data() failed: %d",
+                             err);
+                return false;
+            }
+
+            return true;
+        }
+
+        AVFrame* swFrame = getSwFrameFromHwFrame(frame);
+        if (swFrame == nullptr) {
+            return false;
+        }
+
+        copyPlanes(swFrame, dstFrame);
+        releaseSwFrame(swFrame);
+    }
+    else {
+        SDL_assert(dstFrame->format == frame->format);
+        copyPlanes(frame, dstFrame);
+    }
+
+    return true;
+}
+
+static void copyRowStreaming(uint8_t* dst, const uint8_t* src, int length)
+{
+#ifdef HAVE_STREAMING_STORES
+    // Copy up to the first 16 byte boundary in the destination normally
+    int offset = SDL_min((int)(-(uintptr_t)dst & 15), length);
+    memcpy(dst, src, offset);
+
+    // Streaming stores skip the cache, so we don't evict useful data with
+    // a whole frame that only the display or GPU is going to read.
+    for (; offset + 64 <= length; offset += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + offset));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + offset + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(src + offset + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*)(src + offset + 48));
+        _mm_stream_si128((__m128i*)(dst + offset), a);
+        _mm_stream_si128((__m128i*)(dst + offset + 16), b);
+        _mm_stream_si128((__m128i*)(dst + offset + 32), c);
+        _mm_stream_si128((__m128i*)(dst + offset + 48), d);
+    }
+    for (; offset + 16 <= length; offset += 16) {
+        _mm_stream_si128((__m128i*)(dst + offset), _mm_loadu_si128((const __m128i*)(src + offset)));
+    }
+
+    memcpy(dst + offset, src + offset, length - offset);
+#else
+    memcpy(dst, src, length);
+#endif
+}
+
+void SwFrameMapper::copyPlanes(const AVFrame* srcFrame, AVFrame* dstFrame)
+{
+    if (m_WorkerPool == nullptr) {
+        m_WorkerPool = new SliceWorkerPool("SwFrameCopy", SDL_min(SDL_GetCPUCount(), MAX_COPY_THREADS));
+    }
+
+    m_CopySrcFrame = srcFrame;
+    m_CopyDstFrame = dstFrame;
+
+    int sliceCount = SDL_max(SDL_min(m_WorkerPool->getThreadCount() * 2, srcFrame->height / MIN_ROWS_PER_SLICE), 1);
+    m_WorkerPool->run(copyPlanesSlice, this, sliceCount);
+}
+
+void SwFrameMapper::copyPlanesSlice(void* context, int slice, int sliceCount)
+{
+    SwFrameMapper* me = reinterpret_cast<SwFrameMapper*>(context);
+    const AVFrame* src = me->m_CopySrcFrame;
+    AVFrame* dst = me->m_CopyDstFrame;
+    const AVPixFmtDescriptor* formatDesc = av_pix_fmt_desc_get((AVPixelFormat)src->format);
+    int planes = av_pix_fmt_count_planes((AVPixelFormat)src->format);
+
+    // Slices start on a multiple of the chroma subsampling height, so
+    // each chroma row belongs to exactly one slice.
+    int rowGroup = 1 << formatDesc->log2_chroma_h;
+    int rowGroups = AV_CEIL_RSHIFT(src->height, formatDesc->log2_chroma_h);
+    int startRow = (rowGroups * slice / sliceCount) * rowGroup;
+    int endRow = SDL_min((rowGroups * (slice + 1) / sliceCount) * rowGroup, src->height);
+
+    for (int i = 0; i < planes; i++) {
+        // Only chroma planes are subsampled, not luma or alpha
+        int shift = (i == 1 || i == 2) ? formatDesc->log2_chroma_h : 0;
+        int length = SDL_min(av_image_get_linesize((AVPixelFormat)src->format, src->width, i), dst->linesize[i]);
+
+        for (int row = startRow >> shift; row < AV_CEIL_RSHIFT(endRow, shift); row++) {
+            copyRowStreaming(dst->data[i] + (row * dst->linesize[i]),
+                             src->data[i] + (row * src->linesize[i]),
+                             length);
+        }
+    }
+
+#ifdef HAVE_STREAMING_STORES
+    // Make our streaming stores visible before the frame is handed off
+    _mm_sfence();
+#endif
+}
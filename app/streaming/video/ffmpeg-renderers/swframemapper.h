@@ -1,19 +1,49 @@
 #pragma once
 
 #include "renderer.h"
+#include "streaming/video/sliceworkerpool.h"
 
 class SwFrameMapper
 {
 public:
     explicit SwFrameMapper(IFFmpegRenderer* renderer);
+    ~SwFrameMapper();
     void setVideoFormat(int videoFormat);
+
+    // Returns the software pixel format that frames will be read back in,
+    // which is just the frame's own format if it's not a hwframe.
+    AVPixelFormat getSwPixelFormat(AVFrame* frame);
+
+    // The returned frame is owned by the SwFrameMapper and must be
+    // passed to releaseSwFrame() once the caller is done with it.
     AVFrame* getSwFrameFromHwFrame(AVFrame* hwFrame);
+    void releaseSwFrame(AVFrame* swFrame);
+
+    // Copies a hwframe or swframe into a caller-provided frame of the format
+    // returned by getSwPixelFormat(), such as one wrapping a DMA-BUF mapping.
+    // Writes to dstFrame bypass the CPU cache, so it should only be used for
+    // buffers that a device will read next.
+    bool copyFrame(AVFrame* frame, AVFrame* dstFrame);
 
 private:
     bool initializeReadBackFormat(AVBufferRef* hwFrameCtxRef, AVFrame* testFrame);
+    AVFrame* getStagingFrame(AVBufferRef* hwFrameCtxRef);
+    void copyPlanes(const AVFrame* srcFrame, AVFrame* dstFrame);
+    static void copyPlanesSlice(void* context, int slice, int sliceCount);
 
     IFFmpegRenderer* m_Renderer;
     int m_VideoFormat;
     enum AVPixelFormat m_SwPixelFormat;
     bool m_MapFrame;
+
+    // Read back frames are handed out in m_OutputFrame and reference the
+    // buffers of a staging frame, so neither needs a new allocation per frame.
+    static constexpr int k_StagingFrameCount = 2;
+    AVFrame* m_OutputFrame;
+    AVFrame* m_StagingFrames[k_StagingFrameCount];
+
+    // Used to copy planes in parallel
+    SliceWorkerPool* m_WorkerPool;
+    const AVFrame* m_CopySrcFrame;
+    AVFrame* m_CopyDstFrame;
 };
@@ -0,0 +1,420 @@
+#include "swframeuploader.h"
+
+#include <QtGlobal>
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+#if defined(Q_PROCESSOR_X86_64) || (defined(Q_PROCESSOR_X86) && (defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)))
+#include <immintrin.h>
+#define HAVE_SSE2_KERNEL
+#if defined(__GNUC__) || defined(__clang__)
+#define AVX2_KERNEL_ATTRIBUTE __attribute__((target("avx2")))
+#define HAVE_AVX2_KERNEL
+#elif defined(_MSC_VER)
+#define AVX2_KERNEL_ATTRIBUTE
+#define HAVE_AVX2_KERNEL
+#endif
+#elif defined(Q_PROCESSOR_ARM_64) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_NEON_KERNEL
+#endif
+
+// Don't bother splitting up frames into slices smaller than this
+#define MIN_ROWS_PER_SLICE 32
+
+// Match the thread count that we give swscale
+#define MAX_UPLOAD_THREADS 4
+
+// All kernels compute each term as (a * c) >> 16 where a is a sample scaled
+// up by 64 and c is a Q13 coefficient, leaving the result with 3 fractional
+// bits. This is what a 16-bit high multiply gives us, so the SIMD kernels
+// produce exactly the same pixels as the scalar one.
+static inline int mulHigh(int a, int c)
+{
+    return (a * c) >> 16;
+}
+
+static inline uint8_t clampPixel(int value)
+{
+    value = (value + 4) >> 3;
+    return (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static void convertRowToXrgbScalar(const uint8_t* yRow, const uint8_t* uRow, const uint8_t* vRow,
+                                   uint8_t* out, int start, int width, const XRGB_COEFFICIENTS* c)
+{
+    for (int x = start; x < width; x++) {
+        int y = mulHigh((yRow[x] - c->yOffset) * 64, c->yScale);
+        int u = (uRow[x] - 128) * 64;
+        int v = (vRow[x] - 128) * 64;
+
+        out[x * 4 + 0] = clampPixel(y + mulHigh(u, c->bU));
+        out[x * 4 + 1] = clampPixel(y - mulHigh(u, c->gU) - mulHigh(v, c->gV));
+        out[x * 4 + 2] = clampPixel(y + mulHigh(v, c->rV));
+        out[x * 4 + 3] = 0xFF;
+    }
+}
+
+#ifdef HAVE_SSE2_KERNEL
+
+// Interleaves 16 pixels worth of B, G, and R bytes into XRGB8888
+static inline void storeXrgbSse2(uint8_t* out, __m128i b, __m128i g, __m128i r)
+{
+    __m128i x = _mm_set1_epi8((char)0xFF);
+    __m128i bgLow = _mm_unpacklo_epi8(b, g);
+    __m128i bgHigh = _mm_unpackhi_epi8(b, g);
+    __m128i rxLow = _mm_unpacklo_epi8(r, x);
+    __m128i rxHigh = _mm_unpackhi_epi8(r, x);
+
+    _mm_storeu_si128((__m128i*)(out + 0), _mm_unpacklo_epi16(bgLow, rxLow));
+    _mm_storeu_si128((__m128i*)(out + 16), _mm_unpackhi_epi16(bgLow, rxLow));
+    _mm_storeu_si128((__m128i*)(out + 32), _mm_unpacklo_epi16(bgHigh, rxHigh));
+    _mm_storeu_si128((__m128i*)(out + 48), _mm_unpackhi_epi16(bgHigh, rxHigh));
+}
+
+// Converts 8 pixels that have been widened to 16 bits per sample
+static inline void convert8Sse2(__m128i y, __m128i u, __m128i v, const XRGB_COEFFICIENTS* c,
+                                __m128i* b, __m128i* g, __m128i* r)
+{
+    __m128i round = _mm_set1_epi16(4);
+
+    y = _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(y, _mm_set1_epi16(c->yOffset)), 6), _mm_set1_epi16(c->yScale));
+    u = _mm_slli_epi16(_mm_sub_epi16(u, _mm_set1_epi16(128)), 6);
+    v = _mm_slli_epi16(_mm_sub_epi16(v, _mm_set1_epi16(128)), 6);
+
+    *b = _mm_adds_epi16(y, _mm_mulhi_epi16(u, _mm_set1_epi16(c->bU)));
+    *g = _mm_subs_epi16(_mm_subs_epi16(y, _mm_mulhi_epi16(u, _mm_set1_epi16(c->gU))),
+                        _mm_mulhi_epi16(v, _mm_set1_epi16(c->gV)));
+    *r = _mm_adds_epi16(y, _mm_mulhi_epi16(v, _mm_set1_epi16(c->rV)));
+
+    *b = _mm_srai_epi16(_mm_adds_epi16(*b, round), 3);
+    *g = _mm_srai_epi16(_mm_adds_epi16(*g, round), 3);
+    *r = _mm_srai_epi16(_mm_adds_epi16(*r, round), 3);
+}
+
+static int convertRowToXrgbSse2(const uint8_t* yRow, const uint8_t* uRow, const uint8_t* vRow,
+                                uint8_t* out, int width, const XRGB_COEFFICIENTS* c)
+{
+    __m128i zero = _mm_setzero_si128();
+    int x;
+
+    for (x = 0; x + 16 <= width; x += 16) {
+        __m128i y = _mm_loadu_si128((const __m128i*)(yRow + x));
+        __m128i u = _mm_loadu_si128((const __m128i*)(uRow + x));
+        __m128i v = _mm_loadu_si128((const __m128i*)(vRow + x));
+        __m128i bLow, gLow, rLow, bHigh, gHigh, rHigh;
+
+        convert8Sse2(_mm_unpacklo_epi8(y, zero), _mm_unpacklo_epi8(u, zero), _mm_unpacklo_epi8(v, zero),
+                     c, &bLow, &gLow, &rLow);
+        convert8Sse2(_mm_unpackhi_epi8(y, zero), _mm_unpackhi_epi8(u, zero), _mm_unpackhi_epi8(v, zero),
+                     c, &bHigh, &gHigh, &rHigh);
+
+        storeXrgbSse2(out + x * 4,
+                      _mm_packus_epi16(bLow, bHigh),
+                      _mm_packus_epi16(gLow, gHigh),
+                      _mm_packus_epi16(rLow, rHigh));
+    }
+
+    return x;
+}
+
+#endif
+
+#ifdef HAVE_AVX2_KERNEL
+
+// Same as the SSE2 kernel, but all 16 pixels fit in a single set of registers
+AVX2_KERNEL_ATTRIBUTE
+static int convertRowToXrgbAvx2(const uint8_t* yRow, const uint8_t* uRow, const uint8_t* vRow,
+                                uint8_t* out, int width, const XRGB_COEFFICIENTS* c)
+{
+    __m256i yOffset = _mm256_set1_epi16(c->yOffset);
+    __m256i chromaOffset = _mm256_set1_epi16(128);
+    __m256i yScale = _mm256_set1_epi16(c->yScale);
+    __m256i rV = _mm256_set1_epi16(c->rV);
+    __m256i gU = _mm256_set1_epi16(c->gU);
+    __m256i gV = _mm256_set1_epi16(c->gV);
+    __m256i bU = _mm256_set1_epi16(c->bU);
+    __m256i round = _mm256_set1_epi16(4);
+    int x;
+
+    for (x = 0; x + 16 <= width; x += 16) {
+        __m256i y = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(yRow + x)));
+        __m256i u = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(uRow + x)));
+        __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(vRow + x)));
+
+        y = _mm256_mulhi_epi16(_mm256_slli_epi16(_mm256_sub_epi16(y, yOffset), 6), yScale);
+        u = _mm256_slli_epi16(_mm256_sub_epi16(u, chromaOffset), 6);
+        v = _mm256_slli_epi16(_mm256_sub_epi16(v, chromaOffset), 6);
+
+        __m256i b = _mm256_adds_epi16(y, _mm256_mulhi_epi16(u, bU));
+        __m256i g = _mm256_subs_epi16(_mm256_subs_epi16(y, _mm256_mulhi_epi16(u, gU)),
+                                      _mm256_mulhi_epi16(v, gV));
+        __m256i r = _mm256_adds_epi16(y, _mm256_mulhi_epi16(v, rV));
+
+        b = _mm256_srai_epi16(_mm256_adds_epi16(b, round), 3);
+        g = _mm256_srai_epi16(_mm256_adds_epi16(g, round), 3);
+        r = _mm256_srai_epi16(_mm256_adds_epi16(r, round), 3);
+
+        // Packing the two 128-bit halves against each other keeps the pixels in order
+        storeXrgbSse2(out + x * 4,
+                      _mm_packus_epi16(_mm256_castsi256_si128(b), _mm256_extracti128_si256(b, 1)),
+                      _mm_packus_epi16(_mm256_castsi256_si128(g), _mm256_extracti128_si256(g, 1)),
+                      _mm_packus_epi16(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1)));
+    }
+
+    return x;
+}
+
+#endif
+
+#ifdef HAVE_NEON_KERNEL
+
+// Converts 8 pixels that have been widened to 16 bits per sample. The
+// coefficients are halved because vqdmulhq_s16() doubles the product.
+static inline void convert8Neon(int16x8_t y, int16x8_t u, int16x8_t v, const XRGB_COEFFICIENTS* c,
+                                uint8x8_t* b, uint8x8_t* g, uint8x8_t* r)
+{
+    y = vqdmulhq_n_s16(vshlq_n_s16(vsubq_s16(y, vdupq_n_s16(c->yOffset)), 6), c->yScale / 2);
+    u = vshlq_n_s16(vsubq_s16(u, vdupq_n_s16(128)), 6);
+    v = vshlq_n_s16(vsubq_s16(v, vdupq_n_s16(128)), 6);
+
+    int16x8_t b16 = vqaddq_s16(y, vqdmulhq_n_s16(u, c->bU / 2));
+    int16x8_t g16 = vqsubq_s16(vqsubq_s16(y, vqdmulhq_n_s16(u, c->gU / 2)),
+                               vqdmulhq_n_s16(v, c->gV / 2));
+    int16x8_t r16 = vqaddq_s16(y, vqdmulhq_n_s16(v, c->rV / 2));
+
+    // Rounding shift and saturate to 0-255
+    *b = vqrshrun_n_s16(b16, 3);
+    *g = vqrshrun_n_s16(g16, 3);
+    *r = vqrshrun_n_s16(r16, 3);
+}
+
+static int convertRowToXrgbNeon(const uint8_t* yRow, const uint8_t* uRow, const uint8_t* vRow,
+                                uint8_t* out, int width, const XRGB_COEFFICIENTS* c)
+{
+    int x;
+
+    for (x = 0; x + 16 <= width; x += 16) {
+        uint8x16_t y = vld1q_u8(yRow + x);
+        uint8x16_t u = vld1q_u8(uRow + x);
+        uint8x16_t v = vld1q_u8(vRow + x);
+        uint8x8_t bLow, gLow, rLow, bHigh, gHigh, rHigh;
+        uint8x16x4_t bgrx;
+
+        convert8Neon(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y))),
+                     vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(u))),
+                     vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(v))),
+                     c, &bLow, &gLow, &rLow);
+        convert8Neon(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y))),
+                     vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(u))),
+                     vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(v))),
+                     c, &bHigh, &gHigh, &rHigh);
+
+        bgrx.val[0] = vcombine_u8(bLow, bHigh);
+        bgrx.val[1] = vcombine_u8(gLow, gHigh);
+        bgrx.val[2] = vcombine_u8(rLow, rHigh);
+        bgrx.val[3] = vdupq_n_u8(0xFF);
+        vst4q_u8(out + x * 4, bgrx);
+    }
+
+    return x;
+}
+
+#endif
+
+SwFrameUploader::SwFrameUploader() :
+    m_UseAvx2(false),
+    m_WorkerPool(nullptr),
+    m_Frame(nullptr),
+    m_Pixels(nullptr),
+    m_Pitch(0)
+{
+    SDL_zero(m_Coefficients);
+
+#ifdef HAVE_AVX2_KERNEL
+    m_UseAvx2 = SDL_HasAVX2();
+#endif
+}
+
+SwFrameUploader::~SwFrameUploader()
+{
+    delete m_WorkerPool;
+}
+
+bool SwFrameUploader::canConvertToXrgb(AVPixelFormat format)
+{
+    switch (format) {
+    case AV_PIX_FMT_YUV444P:
+    case AV_PIX_FMT_YUVJ444P:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+bool SwFrameUploader::initializeXrgbConversion(const AVFrame* frame, int colorspace, bool fullRange)
+{
+    double kr, kb;
+
+    if (!canConvertToXrgb((AVPixelFormat)frame->format)) {
+        return false;
+    }
+
+    switch (colorspace) {
+    case COLORSPACE_REC_709:
+        kr = 0.2126;
+        kb = 0.0722;
+        break;
+    case COLORSPACE_REC_2020:
+        kr = 0.2627;
+        kb = 0.0593;
+        break;
+    default:
+        SDL_assert(colorspace == COLORSPACE_REC_601);
+        kr = 0.299;
+        kb = 0.114;
+        break;
+    }
+
+    // Full range JPEG-style frames (and AV_PIX_FMT_YUVJ444P) use all 256 levels
+    fullRange = fullRange || frame->format == AV_PIX_FMT_YUVJ444P;
+
+    double kg = 1.0 - kr - kb;
+    double yScale = fullRange ? 1.0 : 255.0 / 219.0;
+    double chromaScale = fullRange ? 1.0 : 255.0 / 224.0;
+
+    // Round to even Q13 values (see XRGB_COEFFICIENTS)
+    auto toQ13 = [](double value) {
+        return (int16_t)(qRound(value * 8192.0 / 2.0) * 2);
+    };
+
+    m_Coefficients.yOffset = fullRange ? 0 : 16;
+    m_Coefficients.yScale = toQ13(yScale);
+    m_Coefficients.rV = toQ13(2.0 * (1.0 - kr) * chromaScale);
+    m_Coefficients.gU = toQ13(2.0 * kb * (1.0 - kb) / kg * chromaScale);
+    m_Coefficients.gV = toQ13(2.0 * kr * (1.0 - kr) / kg * chromaScale);
+    m_Coefficients.bU = toQ13(2.0 * (1.0 - kb) * chromaScale);
+
+    const char* kernel = "scalar";
+#if defined(HAVE_AVX2_KERNEL)
+    kernel = m_UseAvx2 ? "AVX2" : "SSE2";
+#elif defined(HAVE_SSE2_KERNEL)
+    kernel = "SSE2";
+#elif defined(HAVE_NEON_KERNEL)
+    kernel = "NEON";
+#endif
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using %s kernel for %s CPU color conversion",
+                kernel,
+                av_get_pix_fmt_name((AVPixelFormat)frame->format));
+    return true;
+}
+
+int SwFrameUploader::getSliceCount(const AVFrame* frame)
+{
+    if (m_WorkerPool == nullptr) {
+        m_WorkerPool = new SliceWorkerPool("SwFrameUpload", SDL_min(SDL_GetCPUCount(), MAX_UPLOAD_THREADS));
+    }
+
+    // Use a couple of slices per thread, so a thread that gets descheduled
+    // for a bit doesn't hold up the whole frame.
+    return SDL_max(SDL_min(m_WorkerPool->getThreadCount() * 2, frame->height / MIN_ROWS_PER_SLICE), 1);
+}
+
+void SwFrameUploader::getSliceRows(int height, int slice, int sliceCount, int* startRow, int* endRow)
+{
+    // Slices always start on an even row, so subsampled chroma rows are never split
+    int rowPairs = (height + 1) / 2;
+
+    *startRow = (rowPairs * slice / sliceCount) * 2;
+    *endRow = SDL_min((rowPairs * (slice + 1) / sliceCount) * 2, height);
+}
+
+void SwFrameUploader::convertToXrgb(const AVFrame* frame, uint8_t* pixels, int pitch)
+{
+    SDL_assert(canConvertToXrgb((AVPixelFormat)frame->format));
+
+    m_Frame = frame;
+    m_Pixels = pixels;
+    m_Pitch = pitch;
+
+    // This creates the worker pool on first use
+    int sliceCount = getSliceCount(frame);
+    m_WorkerPool->run(convertToXrgbSlice, this, sliceCount);
+}
+
+void SwFrameUploader::convertToXrgbSlice(void* context, int slice, int sliceCount)
+{
+    SwFrameUploader* me = reinterpret_cast<SwFrameUploader*>(context);
+    const AVFrame* frame = me->m_Frame;
+    int startRow, endRow;
+
+    getSliceRows(frame->height, slice, sliceCount, &startRow, &endRow);
+
+    for (int row = startRow; row < endRow; row++) {
+        const uint8_t* yRow = frame->data[0] + frame->linesize[0] * row;
+        const uint8_t* uRow = frame->data[1] + frame->linesize[1] * row;
+        const uint8_t* vRow = frame->data[2] + frame->linesize[2] * row;
+        uint8_t* out = me->m_Pixels + me->m_Pitch * row;
+        int x = 0;
+
+#if defined(HAVE_AVX2_KERNEL)
+        if (me->m_UseAvx2) {
+            x = convertRowToXrgbAvx2(yRow, uRow, vRow, out, frame->width, &me->m_Coefficients);
+        }
+        else {
+            x = convertRowToXrgbSse2(yRow, uRow, vRow, out, frame->width, &me->m_Coefficients);
+        }
+#elif defined(HAVE_SSE2_KERNEL)
+        x = convertRowToXrgbSse2(yRow, uRow, vRow, out, frame->width, &me->m_Coefficients);
+#elif defined(HAVE_NEON_KERNEL)
+        x = convertRowToXrgbNeon(yRow, uRow, vRow, out, frame->width, &me->m_Coefficients);
+#endif
+
+        // Finish off any pixels that don't fill a whole vector
+        convertRowToXrgbScalar(yRow, uRow, vRow, out, x, frame->width, &me->m_Coefficients);
+    }
+}
+
+void SwFrameUploader::copyNv12(const AVFrame* frame, uint8_t* pixels, int pitch)
+{
+    SDL_assert(frame->format == AV_PIX_FMT_NV12 || frame->format == AV_PIX_FMT_NV21);
+
+    m_Frame = frame;
+    m_Pixels = pixels;
+    m_Pitch = pitch;
+
+    // This creates the worker pool on first use
+    int sliceCount = getSliceCount(frame);
+    m_WorkerPool->run(copyNv12Slice, this, sliceCount);
+}
+
+void SwFrameUploader::copyNv12Slice(void* context, int slice, int sliceCount)
+{
+    SwFrameUploader* me = reinterpret_cast<SwFrameUploader*>(context);
+    const AVFrame* frame = me->m_Frame;
+    int startRow, endRow;
+
+    getSliceRows(frame->height, slice, sliceCount, &startRow, &endRow);
+
+    // Only copy the visible part of each row rather than all of the padding
+    int lumaWidth = SDL_min(frame->width, me->m_Pitch);
+    for (int row = startRow; row < endRow; row++) {
+        memcpy(me->m_Pixels + me->m_Pitch * row,
+               frame->data[0] + frame->linesize[0] * row,
+               lumaWidth);
+    }
+
+    // The interleaved chroma plane starts right after the luma plane
+    uint8_t* chroma = me->m_Pixels + me->m_Pitch * frame->height;
+    int chromaWidth = SDL_min((frame->width + 1) & ~1, me->m_Pitch);
+    for (int row = startRow / 2; row < (endRow + 1) / 2; row++) {
+        memcpy(chroma + me->m_Pitch * row,
+               frame->data[1] + frame->linesize[1] * row,
+               chromaWidth);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "renderer.h"
+#include "streaming/video/sliceworkerpool.h"
+
+typedef struct _XRGB_COEFFICIENTS {
+    // Q13 fixed point. These are always even so the NEON
+    // kernel can use a doubling multiply with half of them.
+    int16_t yOffset;
+    int16_t yScale;
+    int16_t rV;
+    int16_t gU;
+    int16_t gV;
+    int16_t bU;
+} XRGB_COEFFICIENTS, *PXRGB_COEFFICIENTS;
+
+// Copies and converts software frames into locked texture memory for
+// renderers whose textures can't take the frame's format directly.
+// Pitch adjustment and color conversion happen in a single pass over
+// the frame, split into row slices that run on a small worker pool.
+class SwFrameUploader
+{
+public:
+    SwFrameUploader();
+
+    ~SwFrameUploader();
+
+    static bool canConvertToXrgb(AVPixelFormat format);
+
+    // Sets up conversion for frames like this one. This must be called
+    // again whenever the colorspace or color range changes.
+    bool initializeXrgbConversion(const AVFrame* frame, int colorspace, bool fullRange);
+
+    // Converts a frame to XRGB8888 pixels
+    void convertToXrgb(const AVFrame* frame, uint8_t* pixels, int pitch);
+
+    // Copies an NV12 frame into NV12 texture memory with a different pitch
+    void copyNv12(const AVFrame* frame, uint8_t* pixels, int pitch);
+
+private:
+    static void convertToXrgbSlice(void* context, int slice, int sliceCount);
+
+    static void copyNv12Slice(void* context, int slice, int sliceCount);
+
+    static void getSliceRows(int height, int slice, int sliceCount, int* startRow, int* endRow);
+
+    int getSliceCount(const AVFrame* frame);
+
+    XRGB_COEFFICIENTS m_Coefficients;
+    bool m_UseAvx2;
+    SliceWorkerPool* m_WorkerPool;
+
+    // The current job, which is only read by slices while it runs
+    const AVFrame* m_Frame;
+    uint8_t* m_Pixels;
+    int m_Pitch;
+};
@@ -30,10 +30,6 @@ VAAPIRenderer::VAAPIRenderer(int decoderSelectionPass)
       m_EglImageFactory(this)
 #endif
 {
-#ifdef HAVE_EGL
-    SDL_zero(m_PrimeDescriptor);
-#endif
-
 #ifdef HAVE_LIBVA_DRM
     m_DrmFd = -1;
 #endif
@@ -1126,11 +1122,15 @@ VAAPIRenderer::exportEGLImages(AVFrame *frame, EGLDisplay dpy,
     AVVAAPIDeviceContext* vaDeviceContext = (AVVAAPIDeviceContext*)hwFrameCtx->device_ctx->hwctx;
     VASurfaceID surface_id = (VASurfaceID)(uintptr_t)frame->data[3];
 
+    // Each export gets its own descriptor, since the EGL renderer may have
+    // several frames in flight at once.
+    VADRMPRIMESurfaceDescriptor primeDescriptor = {};
+
     VAStatus st = vaExportSurfaceHandle(vaDeviceContext->display,
                                         surface_id,
                                         VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2,
                                         exportFlags,
-                                        &m_PrimeDescriptor);
+                                        &primeDescriptor);
     if (st != VA_STATUS_SUCCESS) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                      "vaExportSurfaceHandle failed: %d", st);
@@ -1141,33 +1141,30 @@ VAAPIRenderer::exportEGLImages(AVFrame *frame, EGLDisplay dpy,
     if (st != VA_STATUS_SUCCESS) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                      "vaSyncSurface() failed: %d", st);
-        goto fail;
+        count = -1;
+    }
+    else {
+        count = m_EglImageFactory.exportVAImages(frame, &primeDescriptor, dpy, images);
     }
 
-    count = m_EglImageFactory.exportVAImages(frame, &m_PrimeDescriptor, dpy, images);
-    if (count < 0) {
-        goto fail;
+    // The EGLImages hold their own references to the DMA-BUFs, so we can
+    // close these right away. This also keeps us from tying our FDs to the
+    // lifetime of EGLImages that the factory reuses across frames.
+    for (size_t i = 0; i < primeDescriptor.num_objects; ++i) {
+        close(primeDescriptor.objects[i].fd);
     }
 
     return count;
-
-fail:
-    for (size_t i = 0; i < m_PrimeDescriptor.num_objects; ++i) {
-        close(m_PrimeDescriptor.objects[i].fd);
-    }
-    m_PrimeDescriptor.num_layers = 0;
-    m_PrimeDescriptor.num_objects = 0;
-    return -1;
 }
 
 void
 VAAPIRenderer::freeEGLImages(EGLDisplay dpy, EGLImage images[EGL_MAX_PLANES]) {
     m_EglImageFactory.freeEGLImages(dpy, images);
-    for (size_t i = 0; i < m_PrimeDescriptor.num_objects; ++i) {
-        close(m_PrimeDescriptor.objects[i].fd);
-    }
-    m_PrimeDescriptor.num_layers = 0;
-    m_PrimeDescriptor.num_objects = 0;
+}
+
+void
+VAAPIRenderer::flushEGLImages(EGLDisplay dpy) {
+    m_EglImageFactory.flushEGLImages(dpy);
 }
 
 #endif
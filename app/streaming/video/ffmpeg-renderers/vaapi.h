@@ -74,6 +74,7 @@ public:
     virtual bool initializeEGL(EGLDisplay dpy, const EGLExtensions &ext) override;
     virtual ssize_t exportEGLImages(AVFrame *frame, EGLDisplay dpy, EGLImage images[EGL_MAX_PLANES]) override;
     virtual void freeEGLImages(EGLDisplay dpy, EGLImage[EGL_MAX_PLANES]) override;
+    virtual void flushEGLImages(EGLDisplay dpy) override;
 #endif
 
 #ifdef HAVE_DRM
@@ -122,7 +123,6 @@ private:
         Separate,
         Composed
     } m_EglExportType;
-    VADRMPRIMESurfaceDescriptor m_PrimeDescriptor;
     EglImageFactory m_EglImageFactory;
 #endif
 };
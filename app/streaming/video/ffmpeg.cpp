@@ -1,6 +1,7 @@
 #include <Limelight.h>
 #include "ffmpeg.h"
 #include "streaming/session.h"
+#include "streaming/streamutils.h"
 
 #include <h264_stream.h>
 
@@ -58,6 +59,10 @@ extern "C" {
 
 #define FAILED_DECODES_RESET_THRESHOLD 20
 
+// Decode units the submit thread can queue ahead of the codec thread
+// when decoding is pipelined
+#define MAX_PENDING_PACKETS 2
+
 // Note: This is NOT an exhaustive list of all decoders
 // that Moonlight could pick. It will pick any working
 // decoder that matches the codec ID and outputs one of
@@ -122,8 +127,11 @@ int FFmpegVideoDecoder::getDecoderCapabilities()
         capabilities = m_BackendRenderer->getDecoderCapabilities();
 
         if (!isHardwareAccelerated()) {
-            // Slice up to 4 times for parallel CPU decoding, once slice per core
-            int slices = qMin(MAX_SLICES, SDL_GetCPUCount());
+            // Request one slice per slice decoding thread. This must match what
+            // configureSoftwareDecodeThreading() picks for the streaming decoder.
+            int slices = getSoftwareDecodeSlices(m_VideoDecoderCtx->codec, m_VideoFormat,
+                                                 m_StreamWidth, m_StreamHeight, m_StreamFps,
+                                                 true);
             SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                         "Encoder configured for %d slices per frame",
                         slices);
@@ -221,7 +229,8 @@ FFmpegVideoDecoder::FFmpegVideoDecoder(bool testOnly)
     : m_Pkt(av_packet_alloc()),
       m_VideoDecoderCtx(nullptr),
       m_RequiredPixelFormat(AV_PIX_FMT_NONE),
-      m_DecodeBuffer(1024 * 1024, 0),
+      m_PacketBufferPool(nullptr),
+      m_PacketBufferPoolSize(0),
       m_HwDecodeCfg(nullptr),
       m_BackendRenderer(nullptr),
       m_FrontendRenderer(nullptr),
@@ -229,14 +238,22 @@ FFmpegVideoDecoder::FFmpegVideoDecoder(bool testOnly)
       m_Pacer(nullptr),
       m_FramesIn(0),
       m_FramesOut(0),
+      m_CountedFramePoolMisses(0),
       m_LastFrameNumber(0),
+      m_StreamWidth(0),
+      m_StreamHeight(0),
       m_StreamFps(0),
       m_VideoFormat(0),
       m_NeedsSpsFixup(false),
+      m_OutputRequiresInput(false),
       m_TestOnly(testOnly),
-      m_DecoderThread(nullptr)
+      m_PipelinedDecode(false),
+      m_SoftwareDecodeSlices(qMin(MAX_SLICES, SDL_GetCPUCount())),
+      m_DecoderThread(nullptr),
+      m_CodecThread(nullptr)
 {
     SDL_zero(m_ActiveWndVideoStats);
+    SDL_zero(m_ReceiveWndVideoStats);
     SDL_zero(m_LastWndVideoStats);
     SDL_zero(m_GlobalVideoStats);
 
@@ -257,6 +274,10 @@ FFmpegVideoDecoder::~FFmpegVideoDecoder()
     av_log_set_level(AV_LOG_INFO);
 
     av_packet_free(&m_Pkt);
+
+    // Any buffers still referenced by the decoder will be freed
+    // when their last reference is released.
+    av_buffer_pool_uninit(&m_PacketBufferPool);
 }
 
 IFFmpegRenderer* FFmpegVideoDecoder::getBackendRenderer()
@@ -268,20 +289,54 @@ void FFmpegVideoDecoder::reset()
 {
     // Terminate the decoder thread before doing anything else.
     // It might be touching things we're about to free.
-    if (m_DecoderThread != nullptr) {
+    if (m_DecoderThread != nullptr || m_CodecThread != nullptr) {
         SDL_AtomicSet(&m_DecoderThreadShouldQuit, 1);
         LiWakeWaitForVideoFrame();
-        SDL_WaitThread(m_DecoderThread, NULL);
+
+        // Wake the pipelined decoder threads if they're waiting on each other
+        m_DecoderLock.lock();
+        m_DecoderInputAvailable.wakeAll();
+        m_PendingPacketsNotFull.wakeAll();
+        m_DecoderLock.unlock();
+
+        if (m_DecoderThread != nullptr) {
+            SDL_WaitThread(m_DecoderThread, NULL);
+            m_DecoderThread = nullptr;
+        }
+        if (m_CodecThread != nullptr) {
+            SDL_WaitThread(m_CodecThread, NULL);
+            m_CodecThread = nullptr;
+        }
+
         SDL_AtomicSet(&m_DecoderThreadShouldQuit, 0);
-        m_DecoderThread = nullptr;
     }
 
     m_FramesIn = m_FramesOut = 0;
     m_FrameInfoQueue.clear();
+    while (!m_PendingPackets.isEmpty()) {
+        PENDING_PACKET pending = m_PendingPackets.dequeue();
+        av_packet_free(&pending.pkt);
+    }
 
     delete m_Pacer;
     m_Pacer = nullptr;
 
+    // All frames have been returned to the pool now that the decoder threads
+    // and Pacer are gone. Log how well it worked and free the idle frames.
+    if (m_FramePool.getAcquiredFrames() != 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Frame pool: %u frames acquired, %u pool misses",
+                    m_FramePool.getAcquiredFrames(),
+                    m_FramePool.getMissedFrames());
+    }
+    m_FramePool.clear();
+    m_CountedFramePoolMisses = 0;
+
+    // Learn from this stream's decode times before we free the codec
+    if (m_VideoDecoderCtx != nullptr) {
+        recordSoftwareDecodeCost();
+    }
+
     // This must be called after deleting Pacer because it
     // may be holding AVFrames to free in its destructor.
     // However, it must be called before deleting the IFFmpegRenderer
@@ -460,6 +515,250 @@ bool FFmpegVideoDecoder::createFrontendRenderer(PDECODER_PARAMETERS params, bool
     return true;
 }
 
+bool FFmpegVideoDecoder::getTestFrame(int videoFormat, AVPacket* pkt)
+{
+    switch (videoFormat) {
+    case VIDEO_FORMAT_H264:
+        pkt->data = (uint8_t*)k_H264TestFrame;
+        pkt->size = sizeof(k_H264TestFrame);
+        break;
+    case VIDEO_FORMAT_H265:
+        pkt->data = (uint8_t*)k_HEVCMainTestFrame;
+        pkt->size = sizeof(k_HEVCMainTestFrame);
+        break;
+    case VIDEO_FORMAT_H265_MAIN10:
+        pkt->data = (uint8_t*)k_HEVCMain10TestFrame;
+        pkt->size = sizeof(k_HEVCMain10TestFrame);
+        break;
+    case VIDEO_FORMAT_AV1_MAIN8:
+        pkt->data = (uint8_t*)k_AV1Main8TestFrame;
+        pkt->size = sizeof(k_AV1Main8TestFrame);
+        break;
+    case VIDEO_FORMAT_AV1_MAIN10:
+        pkt->data = (uint8_t*)k_AV1Main10TestFrame;
+        pkt->size = sizeof(k_AV1Main10TestFrame);
+        break;
+    case VIDEO_FORMAT_H264_HIGH8_444:
+        pkt->data = (uint8_t*)k_h264High_444TestFrame;
+        pkt->size = sizeof(k_h264High_444TestFrame);
+        break;
+    case VIDEO_FORMAT_H265_REXT8_444:
+        pkt->data = (uint8_t*)k_HEVCRExt8_444TestFrame;
+        pkt->size = sizeof(k_HEVCRExt8_444TestFrame);
+        break;
+    case VIDEO_FORMAT_H265_REXT10_444:
+        pkt->data = (uint8_t*)k_HEVCRExt10_444TestFrame;
+        pkt->size = sizeof(k_HEVCRExt10_444TestFrame);
+        break;
+    case VIDEO_FORMAT_AV1_HIGH8_444:
+        pkt->data = (uint8_t*)k_AV1High8_444TestFrame;
+        pkt->size = sizeof(k_AV1High8_444TestFrame);
+        break;
+    case VIDEO_FORMAT_AV1_HIGH10_444:
+        pkt->data = (uint8_t*)k_AV1High10_444TestFrame;
+        pkt->size = sizeof(k_AV1High10_444TestFrame);
+        break;
+    default:
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "No test frame for format: %x",
+                     videoFormat);
+        return false;
+    }
+
+    return true;
+}
+
+uint64_t FFmpegVideoDecoder::measureTestFrameDecodeTimeUs(const AVCodec* decoder, int videoFormat)
+{
+    AVCodecContext* context = avcodec_alloc_context3(decoder);
+    AVPacket* pkt = av_packet_alloc();
+    AVFrame* frame = av_frame_alloc();
+    uint64_t bestTimeUs = 0;
+
+    if (context != nullptr && pkt != nullptr && frame != nullptr && getTestFrame(videoFormat, pkt)) {
+        context->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        context->thread_count = 1;
+
+        if (avcodec_open2(context, decoder, nullptr) == 0) {
+            // Keep the fastest of a few runs to filter out cold caches and preemption
+            for (int i = 0; i < 3; i++) {
+                uint64_t startTimeUs = StreamUtils::getMonotonicTimeUs();
+                if (avcodec_send_packet(context, pkt) < 0 || avcodec_receive_frame(context, frame) < 0) {
+                    // The decoder needs more than one frame of input to produce output,
+                    // so we can't measure it this way.
+                    bestTimeUs = 0;
+                    break;
+                }
+
+                uint64_t decodeTimeUs = StreamUtils::getMonotonicTimeUs() - startTimeUs;
+                if (bestTimeUs == 0 || decodeTimeUs < bestTimeUs) {
+                    bestTimeUs = decodeTimeUs;
+                }
+
+                av_frame_unref(frame);
+            }
+        }
+    }
+
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    avcodec_free_context(&context);
+
+    return bestTimeUs;
+}
+
+// Slice counts negotiated with the host for each software decode configuration,
+// and the per-frame decode cost measured on real streams in each configuration.
+// The cost is an estimate of the single-threaded decode time in microseconds.
+static QMutex s_SoftwareDecodeLock;
+static QMap<QString, int> s_NegotiatedSlices;
+static QMap<QString, uint64_t> s_MeasuredDecodeCostUs;
+
+static QString getSoftwareDecodeKey(const AVCodec* decoder, int videoFormat, int width, int height, int frameRate)
+{
+    return QString("%1/%2/%3x%4x%5").arg(decoder->name).arg(videoFormat).arg(width).arg(height).arg(frameRate);
+}
+
+int FFmpegVideoDecoder::getSoftwareDecodeSlices(const AVCodec* decoder, int videoFormat, int width, int height, int frameRate,
+                                                bool negotiate)
+{
+    int cpuCount = SDL_GetCPUCount();
+    bool ok;
+
+    int slices = qEnvironmentVariableIntValue("SOFTWARE_DECODE_SLICES", &ok);
+    if (ok) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Using software decode slice count override: %d",
+                    slices);
+        return qBound(1, slices, MAX_ADAPTIVE_SLICES);
+    }
+
+    // By default, slice up to 4 times for parallel CPU decoding, once slice per core
+    slices = qMin(MAX_SLICES, cpuCount);
+    if (cpuCount <= MAX_SLICES) {
+        return slices;
+    }
+
+    // We can't pick a decode time target without knowing the frame rate
+    if (frameRate <= 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Using default software decode slice count for unknown frame rate: %d",
+                    frameRate);
+        return slices;
+    }
+
+    // The slice count is negotiated with the host by a test-only decoder, so the
+    // decoder that we create for streaming must come up with the same answer, even
+    // if we've learned more about the decode cost since then.
+    QString key = getSoftwareDecodeKey(decoder, videoFormat, width, height, frameRate);
+    QMutexLocker locker(&s_SoftwareDecodeLock);
+    if (!negotiate) {
+        auto it = s_NegotiatedSlices.constFind(key);
+        if (it != s_NegotiatedSlices.constEnd()) {
+            return it.value();
+        }
+    }
+
+    uint64_t decodeCostUs;
+    auto it = s_MeasuredDecodeCostUs.constFind(key);
+    if (it != s_MeasuredDecodeCostUs.constEnd()) {
+        // We've streamed this configuration before, so use what we measured then
+        decodeCostUs = it.value();
+    }
+    else {
+        // Otherwise, measure how long one core takes to decode our 720p test frame and
+        // scale that up to the stream resolution. The test frames are tiny and mostly
+        // blank, so real frames take much longer to decode. This is only a lower bound
+        // to start from until we've measured a real stream in this configuration.
+        decodeCostUs = measureTestFrameDecodeTimeUs(decoder, videoFormat) * width * height / (1280 * 720);
+    }
+
+    if (decodeCostUs != 0) {
+        // Use enough slices to decode each frame within half of the frame interval.
+        // Rendering the frame comes out of the same interval, and the other half
+        // leaves room for frames that are more complex than the average.
+        uint64_t targetDecodeTimeUs = 1000000 / 2 / frameRate;
+        int neededSlices = (int)((decodeCostUs + targetDecodeTimeUs - 1) / targetDecodeTimeUs);
+        slices = qBound(slices, neededSlices, qMin(MAX_ADAPTIVE_SLICES, cpuCount));
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Estimated single-threaded decode time: %.2f ms (%d slices needed)",
+                    decodeCostUs / 1000.0,
+                    neededSlices);
+    }
+    else {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Unable to measure software decode time");
+    }
+
+    s_NegotiatedSlices.insert(key, slices);
+    return slices;
+}
+
+void FFmpegVideoDecoder::recordSoftwareDecodeCost()
+{
+    // Frame threading decodes several frames at once, so the decode time of
+    // each frame doesn't tell us how much slicing would help. We also need
+    // enough frames for the average to mean something.
+    if (m_TestOnly || isHardwareAccelerated() ||
+            (m_VideoDecoderCtx->active_thread_type & FF_THREAD_FRAME) ||
+            m_StreamFps <= 0 || m_GlobalVideoStats.decodedFrames < (uint32_t)m_StreamFps * 10) {
+        return;
+    }
+
+    // Assume the slices decode perfectly in parallel. Anything less only makes
+    // the single-threaded estimate larger, which errs on the side of more slices.
+    uint64_t averageDecodeTimeUs = m_GlobalVideoStats.totalDecodeTimeUs / m_GlobalVideoStats.decodedFrames;
+    uint64_t decodeCostUs = averageDecodeTimeUs * m_VideoDecoderCtx->thread_count;
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Measured software decode time: %.2f ms with %d slice threads",
+                averageDecodeTimeUs / 1000.0,
+                m_VideoDecoderCtx->thread_count);
+
+    // This takes effect the next time a stream negotiates its slice count
+    QMutexLocker locker(&s_SoftwareDecodeLock);
+    s_MeasuredDecodeCostUs.insert(getSoftwareDecodeKey(m_VideoDecoderCtx->codec, m_VideoFormat,
+                                                       m_StreamWidth, m_StreamHeight, m_StreamFps),
+                                  decodeCostUs);
+}
+
+void FFmpegVideoDecoder::configureSoftwareDecodeThreading(const AVCodec* decoder, PDECODER_PARAMETERS params)
+{
+    int cpuCount = SDL_GetCPUCount();
+
+    // Test-only decoders don't need to decode quickly, so they don't need to measure anything
+    if (m_TestOnly) {
+        m_SoftwareDecodeSlices = qMin(MAX_SLICES, cpuCount);
+    }
+    else {
+        m_SoftwareDecodeSlices = getSoftwareDecodeSlices(decoder, params->videoFormat,
+                                                         params->width, params->height,
+                                                         params->frameRate, false);
+    }
+
+    m_VideoDecoderCtx->thread_type = FF_THREAD_SLICE;
+    m_VideoDecoderCtx->thread_count = m_SoftwareDecodeSlices;
+
+    // Frame threading adds a frame of latency for each additional thread, so
+    // we only use it if the user gives us a latency budget to spend on it.
+    int latencyBudgetMs = qEnvironmentVariableIntValue("FRAME_THREADING_LATENCY_MS");
+    if (latencyBudgetMs > 0 && !m_TestOnly) {
+        int frameThreads = qMin(cpuCount, 1 + latencyBudgetMs * params->frameRate / 1000);
+        if (frameThreads > 1) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Using %d frame threads (latency budget: %d ms)",
+                        frameThreads,
+                        latencyBudgetMs);
+            m_VideoDecoderCtx->thread_type |= FF_THREAD_FRAME;
+            m_VideoDecoderCtx->thread_count = frameThreads;
+
+            // FFmpeg won't use frame threading in low delay mode
+            m_VideoDecoderCtx->flags &= ~AV_CODEC_FLAG_LOW_DELAY;
+        }
+    }
+}
+
 bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVPixelFormat requiredFormat, PDECODER_PARAMETERS params, bool testFrame, bool useAlternateFrontend)
 {
     // In test-only mode, we should only see test frames
@@ -476,9 +775,10 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVP
 
     // Don't bother initializing Pacer if we're not actually going to render
     if (!testFrame) {
-        m_Pacer = new Pacer(m_FrontendRenderer, &m_ActiveWndVideoStats);
+        m_Pacer = new Pacer(m_FrontendRenderer, &m_ActiveWndVideoStats, &m_FramePool);
         if (!m_Pacer->initialize(params->window, params->frameRate,
-                                 params->enableFramePacing || (params->enableVsync && (m_FrontendRenderer->getRendererAttributes() & RENDERER_ATTRIBUTE_FORCE_PACING)))) {
+                                 params->enableFramePacing || (params->enableVsync && (m_FrontendRenderer->getRendererAttributes() & RENDERER_ATTRIBUTE_FORCE_PACING)),
+                                 params->frameDropPolicy)) {
             return false;
         }
     }
@@ -506,10 +806,9 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVP
     // runs out of output buffers.
     m_VideoDecoderCtx->err_recognition = AV_EF_EXPLODE;
 
-    // Enable slice multi-threading for software decoding
+    // Enable multi-threading for software decoding
     if (!isHardwareAccelerated()) {
-        m_VideoDecoderCtx->thread_type = FF_THREAD_SLICE;
-        m_VideoDecoderCtx->thread_count = qMin(MAX_SLICES, SDL_GetCPUCount());
+        configureSoftwareDecodeThreading(decoder, params);
     }
     else {
         // No threading for HW decode
@@ -551,51 +850,7 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVP
     // now to see if things will actually work when the video stream
     // comes in.
     if (testFrame) {
-        switch (params->videoFormat) {
-        case VIDEO_FORMAT_H264:
-            m_Pkt->data = (uint8_t*)k_H264TestFrame;
-            m_Pkt->size = sizeof(k_H264TestFrame);
-            break;
-        case VIDEO_FORMAT_H265:
-            m_Pkt->data = (uint8_t*)k_HEVCMainTestFrame;
-            m_Pkt->size = sizeof(k_HEVCMainTestFrame);
-            break;
-        case VIDEO_FORMAT_H265_MAIN10:
-            m_Pkt->data = (uint8_t*)k_HEVCMain10TestFrame;
-            m_Pkt->size = sizeof(k_HEVCMain10TestFrame);
-            break;
-        case VIDEO_FORMAT_AV1_MAIN8:
-            m_Pkt->data = (uint8_t*)k_AV1Main8TestFrame;
-            m_Pkt->size = sizeof(k_AV1Main8TestFrame);
-            break;
-        case VIDEO_FORMAT_AV1_MAIN10:
-            m_Pkt->data = (uint8_t*)k_AV1Main10TestFrame;
-            m_Pkt->size = sizeof(k_AV1Main10TestFrame);
-            break;
-        case VIDEO_FORMAT_H264_HIGH8_444:
-            m_Pkt->data = (uint8_t*)k_h264High_444TestFrame;
-            m_Pkt->size = sizeof(k_h264High_444TestFrame);
-            break;
-        case VIDEO_FORMAT_H265_REXT8_444:
-            m_Pkt->data = (uint8_t*)k_HEVCRExt8_444TestFrame;
-            m_Pkt->size = sizeof(k_HEVCRExt8_444TestFrame);
-            break;
-        case VIDEO_FORMAT_H265_REXT10_444:
-            m_Pkt->data = (uint8_t*)k_HEVCRExt10_444TestFrame;
-            m_Pkt->size = sizeof(k_HEVCRExt10_444TestFrame);
-            break;
-        case VIDEO_FORMAT_AV1_HIGH8_444:
-            m_Pkt->data = (uint8_t*)k_AV1High8_444TestFrame;
-            m_Pkt->size = sizeof(k_AV1High8_444TestFrame);
-            break;
-        case VIDEO_FORMAT_AV1_HIGH10_444:
-            m_Pkt->data = (uint8_t*)k_AV1High10_444TestFrame;
-            m_Pkt->size = sizeof(k_AV1High10_444TestFrame);
-            break;
-        default:
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "No test frame for format: %x",
-                         params->videoFormat);
+        if (!getTestFrame(params->videoFormat, m_Pkt)) {
             return false;
         }
 
@@ -654,6 +909,17 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVP
         av_frame_free(&frame);
     }
     else {
+        // FFmpeg's own decoders (including hwaccels) only produce output in response
+        // to avcodec_send_packet(), so EAGAIN from avcodec_receive_frame() means no
+        // frame can arrive until we submit more input. Wrappers around external
+        // hardware decoders (V4L2 M2M, MMAL, RKMPP, etc.) decode asynchronously and
+        // can produce output at any time, so those still have to be polled.
+        m_OutputRequiresInput = m_HwDecodeCfg != nullptr ||
+                (getAVCodecCapabilities(decoder) & AV_CODEC_CAP_HARDWARE) == 0;
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Decoder output mode: %s",
+                    m_OutputRequiresInput ? "blocking" : "polling");
+
         if ((params->videoFormat & VIDEO_FORMAT_MASK_H264) &&
                 !(m_BackendRenderer->getDecoderCapabilities() & CAPABILITY_REFERENCE_FRAME_INVALIDATION_AVC)) {
             SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
@@ -670,6 +936,32 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVP
         // Allow the renderer to perform final preparations for rendering
         m_FrontendRenderer->prepareToRender();
 
+        // Setting PIPELINED_DECODE=1 moves the decoder calls to a codec thread,
+        // so assembling the next decode unit can overlap decoding the last one.
+        // It's off by default.
+        m_PipelinedDecode = qEnvironmentVariableIntValue("PIPELINED_DECODE") != 0;
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Pipelined decoding: %s",
+                    m_PipelinedDecode ? "enabled" : "disabled");
+
+        // Size the frame pool to hold every frame that can be queued in the Pacer,
+        // plus one being rendered and one being decoded into. Frame-threaded
+        // decoders can also hold an additional frame per thread.
+        int framePoolCapacity = 2 * MAX_QUEUED_FRAMES + 2;
+        if (m_VideoDecoderCtx->active_thread_type & FF_THREAD_FRAME) {
+            framePoolCapacity += m_VideoDecoderCtx->thread_count;
+        }
+        m_FramePool.setCapacity(framePoolCapacity);
+
+        if (m_PipelinedDecode) {
+            m_CodecThread = SDL_CreateThread(FFmpegVideoDecoder::codecThreadProcThunk, "FFDecoderCodec", (void*)this);
+            if (m_CodecThread == nullptr) {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                             "Failed to create decoder codec thread: %s", SDL_GetError());
+                return false;
+            }
+        }
+
         // Only create the decoder thread when instantiating the decoder for real. It will use APIs from
         // moonlight-common-c that can only be legally called with an established connection.
         m_DecoderThread = SDL_CreateThread(FFmpegVideoDecoder::decoderThreadProcThunk, "FFDecoder", (void*)this);
@@ -703,10 +995,23 @@ void FFmpegVideoDecoder::addVideoStats(VIDEO_STATS& src, VIDEO_STATS& dst)
     dst.totalFrames += src.totalFrames;
     dst.networkDroppedFrames += src.networkDroppedFrames;
     dst.pacerDroppedFrames += src.pacerDroppedFrames;
-    dst.totalReassemblyTime += src.totalReassemblyTime;
-    dst.totalDecodeTime += src.totalDecodeTime;
-    dst.totalPacerTime += src.totalPacerTime;
-    dst.totalRenderTime += src.totalRenderTime;
+    dst.pacingQueueDroppedFrames += src.pacingQueueDroppedFrames;
+    dst.latchDroppedFrames += src.latchDroppedFrames;
+    dst.renderQueueDroppedFrames += src.renderQueueDroppedFrames;
+    dst.overflowDroppedFrames += src.overflowDroppedFrames;
+    dst.vrrPresentedFrames += src.vrrPresentedFrames;
+    dst.vrrRepeatedFrames += src.vrrRepeatedFrames;
+    dst.framePoolMissedFrames += src.framePoolMissedFrames;
+    dst.totalReassemblyTimeUs += src.totalReassemblyTimeUs;
+    dst.totalDecodeTimeUs += src.totalDecodeTimeUs;
+    dst.totalPacerTimeUs += src.totalPacerTimeUs;
+    dst.totalRenderTimeUs += src.totalRenderTimeUs;
+
+    dst.reassemblyLatency.add(src.reassemblyLatency);
+    dst.submitLatency.add(src.submitLatency);
+    dst.decodeLatency.add(src.decodeLatency);
+    dst.pacerLatency.add(src.pacerLatency);
+    dst.renderLatency.add(src.renderLatency);
 
     if (dst.minHostProcessingLatency == 0) {
         dst.minHostProcessingLatency = src.minHostProcessingLatency;
@@ -742,6 +1047,7 @@ void FFmpegVideoDecoder::addVideoStats(VIDEO_STATS& src, VIDEO_STATS& dst)
     dst.receivedFps = (float)dst.receivedFrames / ((float)(now - dst.measurementStartTimestamp) / 1000);
     dst.decodedFps = (float)dst.decodedFrames / ((float)(now - dst.measurementStartTimestamp) / 1000);
     dst.renderedFps = (float)dst.renderedFrames / ((float)(now - dst.measurementStartTimestamp) / 1000);
+    dst.vrrRefreshRate = (float)dst.vrrPresentedFrames / ((float)(now - dst.measurementStartTimestamp) / 1000);
 }
 
 void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output, int length)
@@ -836,6 +1142,21 @@ void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output, i
             }
 
             offset += ret;
+
+            if (!isHardwareAccelerated()) {
+                ret = snprintf(&output[offset],
+                               length - offset,
+                               "Software decoding: %d slices, %d %s threads\n",
+                               m_SoftwareDecodeSlices,
+                               m_VideoDecoderCtx->thread_count,
+                               (m_VideoDecoderCtx->active_thread_type & FF_THREAD_FRAME) ? "frame" : "slice");
+                if (ret < 0 || ret >= length - offset) {
+                    SDL_assert(false);
+                    return;
+                }
+
+                offset += ret;
+            }
         }
 
         ret = snprintf(&output[offset],
@@ -852,6 +1173,20 @@ void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output, i
         }
 
         offset += ret;
+
+        if (stats.vrrPresentedFrames != 0) {
+            ret = snprintf(&output[offset],
+                           length - offset,
+                           "Variable refresh rate: %.2f Hz (%.2f%% repeated frames)\n",
+                           stats.vrrRefreshRate,
+                           (float)stats.vrrRepeatedFrames / stats.vrrPresentedFrames * 100);
+            if (ret < 0 || ret >= length - offset) {
+                SDL_assert(false);
+                return;
+            }
+
+            offset += ret;
+        }
     }
 
     if (stats.framesWithHostProcessingLatency > 0) {
@@ -890,22 +1225,89 @@ void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output, i
                        (float)stats.networkDroppedFrames / stats.totalFrames * 100,
                        (float)stats.pacerDroppedFrames / stats.decodedFrames * 100,
                        rttString,
-                       (float)stats.totalDecodeTime / stats.decodedFrames,
-                       (float)stats.totalPacerTime / stats.renderedFrames,
-                       (float)stats.totalRenderTime / stats.renderedFrames);
+                       (double)stats.totalDecodeTimeUs / 1000.0 / stats.decodedFrames,
+                       (double)stats.totalPacerTimeUs / 1000.0 / stats.renderedFrames,
+                       (double)stats.totalRenderTimeUs / 1000.0 / stats.renderedFrames);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+
+        if (stats.pacerDroppedFrames != 0) {
+            ret = snprintf(&output[offset],
+                           length - offset,
+                           "Frame queue drops (pacing/latch/render/overflow): %u/%u/%u/%u\n",
+                           stats.pacingQueueDroppedFrames,
+                           stats.latchDroppedFrames,
+                           stats.renderQueueDroppedFrames,
+                           stats.overflowDroppedFrames);
+            if (ret < 0 || ret >= length - offset) {
+                SDL_assert(false);
+                return;
+            }
+
+            offset += ret;
+        }
+
+        if (stats.framePoolMissedFrames != 0) {
+            ret = snprintf(&output[offset],
+                           length - offset,
+                           "Frame pool misses: %u\n",
+                           stats.framePoolMissedFrames);
+            if (ret < 0 || ret >= length - offset) {
+                SDL_assert(false);
+                return;
+            }
+
+            offset += ret;
+        }
+
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Latency percentiles (p50/p95/p99/p99.9):\n");
         if (ret < 0 || ret >= length - offset) {
             SDL_assert(false);
             return;
         }
 
         offset += ret;
+
+        const struct {
+            const char* name;
+            const LatencyHistogram* histogram;
+        } stages[] = {
+            { "Reassembly", &stats.reassemblyLatency },
+            { "Decoder submit", &stats.submitLatency },
+            { "Decoding", &stats.decodeLatency },
+            { "Frame queue", &stats.pacerLatency },
+            { "Rendering", &stats.renderLatency },
+        };
+
+        for (const auto& stage : stages) {
+            ret = snprintf(&output[offset],
+                           length - offset,
+                           "  %s: %.2f/%.2f/%.2f/%.2f ms\n",
+                           stage.name,
+                           stage.histogram->getPercentile(50) / 1000.0f,
+                           stage.histogram->getPercentile(95) / 1000.0f,
+                           stage.histogram->getPercentile(99) / 1000.0f,
+                           stage.histogram->getPercentile(99.9) / 1000.0f);
+            if (ret < 0 || ret >= length - offset) {
+                SDL_assert(false);
+                return;
+            }
+
+            offset += ret;
+        }
     }
 }
 
 void FFmpegVideoDecoder::logVideoStats(VIDEO_STATS& stats, const char* title)
 {
     if (stats.renderedFps > 0 || stats.renderedFrames != 0) {
-        char videoStatsStr[512];
+        char videoStatsStr[2048];
         stringifyVideoStats(stats, videoStatsStr, sizeof(videoStatsStr));
 
         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
@@ -1476,6 +1878,11 @@ bool FFmpegVideoDecoder::tryInitializeNonHwAccelDecoder(PDECODER_PARAMETERS para
 
 bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
 {
+    // Test-only decoders are initialized with the test frame dimensions,
+    // so keep track of the stream dimensions separately.
+    m_StreamWidth = params->width;
+    m_StreamHeight = params->height;
+
     // Increase log level until the first frame is decoded
     av_log_set_level(AV_LOG_DEBUG);
 
@@ -1608,7 +2015,7 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
     return false;
 }
 
-void FFmpegVideoDecoder::writeBuffer(PLENTRY entry, int& offset)
+void FFmpegVideoDecoder::writeBuffer(PLENTRY entry, uint8_t* buffer, int& offset)
 {
     if (m_NeedsSpsFixup && entry->bufferType == BUFFER_TYPE_SPS) {
         h264_stream_t* stream = h264_new();
@@ -1631,18 +2038,18 @@ void FFmpegVideoDecoder::writeBuffer(PLENTRY entry, int& offset)
 
         // Copy the modified NALU data. This clobbers byte 0 and starts NALU data at byte 1.
         // Since it prepended one extra byte, subtract one from the returned length.
-        offset += write_nal_unit(stream, (uint8_t*)&m_DecodeBuffer.data()[initialOffset + nalStart - 1],
+        offset += write_nal_unit(stream, &buffer[initialOffset + nalStart - 1],
                                  MAX_SPS_EXTRA_SIZE + entry->length - nalStart) - 1;
 
         // Copy the NALU prefix over from the original SPS
-        memcpy(&m_DecodeBuffer.data()[initialOffset], entry->data, nalStart);
+        memcpy(&buffer[initialOffset], entry->data, nalStart);
         offset += nalStart;
 
         h264_free(stream);
     }
     else {
         // Write the buffer as-is
-        memcpy(&m_DecodeBuffer.data()[offset],
+        memcpy(&buffer[offset],
                entry->data,
                entry->length);
         offset += entry->length;
@@ -1655,8 +2062,204 @@ int FFmpegVideoDecoder::decoderThreadProcThunk(void *context)
     return 0;
 }
 
+int FFmpegVideoDecoder::codecThreadProcThunk(void *context)
+{
+    ((FFmpegVideoDecoder*)context)->codecThreadProc();
+    return 0;
+}
+
+// Submits a packet on the thread that owns the codec context
+int FFmpegVideoDecoder::sendPacket(AVPacket* pkt, FRAME_INFO* info)
+{
+    // This includes any time spent waiting for the codec thread
+    info->queueDelayUs = (LiGetMillis() - info->du.enqueueTimeMs) * 1000;
+    info->submitTimeUs = StreamUtils::getMonotonicTimeUs();
+    int err = avcodec_send_packet(m_VideoDecoderCtx, pkt);
+    uint64_t submitLatencyUs = StreamUtils::getMonotonicTimeUs() - info->submitTimeUs;
+
+    if (err == AVERROR(EAGAIN) && m_PipelinedDecode) {
+        // The codec thread will receive output and try again
+        return err;
+    }
+
+    if (err < 0) {
+        char errorstring[512];
+        av_strerror(err, errorstring, sizeof(errorstring));
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "avcodec_send_packet() failed: %s (frame %d)",
+                    errorstring,
+                    info->du.frameNumber);
+    }
+
+    m_DecoderLock.lock();
+
+    m_ReceiveWndVideoStats.submitLatency.record(submitLatencyUs);
+
+    if (err < 0) {
+        // If we've failed a bunch of decodes in a row, the decoder/renderer is
+        // clearly unhealthy, so let's generate a synthetic reset event to trigger
+        // the event loop to destroy and recreate the decoder.
+        if (++m_ConsecutiveFailedDecodes == FAILED_DECODES_RESET_THRESHOLD) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Resetting decoder due to consistent failure");
+
+            SDL_Event event;
+            event.type = SDL_RENDER_DEVICE_RESET;
+            SDL_PushEvent(&event);
+
+            // Don't consume any additional data
+            SDL_AtomicSet(&m_DecoderThreadShouldQuit, 1);
+        }
+    }
+    else {
+        m_FrameInfoQueue.enqueue(*info);
+        m_FramesIn++;
+    }
+
+    m_DecoderLock.unlock();
+
+    return err;
+}
+
+int FFmpegVideoDecoder::receiveFrame(AVFrame* frame, FRAME_INFO* info, bool* infoValid)
+{
+    int err = avcodec_receive_frame(m_VideoDecoderCtx, frame);
+    if (err == 0) {
+        m_DecoderLock.lock();
+
+        SDL_assert(m_FrameInfoQueue.size() == m_FramesIn - m_FramesOut);
+        m_FramesOut++;
+
+        *infoValid = !m_FrameInfoQueue.isEmpty();
+        if (*infoValid) {
+            *info = m_FrameInfoQueue.dequeue();
+        }
+
+        // Reset failed decodes count if we reached this far
+        m_ConsecutiveFailedDecodes = 0;
+
+        m_DecoderLock.unlock();
+    }
+
+    return err;
+}
+
+void FFmpegVideoDecoder::handleDecodedFrame(AVFrame* frame, FRAME_INFO* info)
+{
+    // Attach HDR metadata to the frame if it's not already present. We will defer to
+    // any metadata contained in the bitstream itself since that is guaranteed to be
+    // correctly synchronized to each frame, unlike our async HDR metadata message.
+    SS_HDR_METADATA hdrMetadata;
+    if (LiGetHdrMetadata(&hdrMetadata)) {
+        if (av_frame_get_side_data(frame, AV_FRAME_DATA_MASTERING_DISPLAY_METADATA) == nullptr) {
+            auto mdm = av_mastering_display_metadata_create_side_data(frame);
+
+            mdm->display_primaries[0][0] = av_make_q(hdrMetadata.displayPrimaries[0].x, 50000);
+            mdm->display_primaries[0][1] = av_make_q(hdrMetadata.displayPrimaries[0].y, 50000);
+            mdm->display_primaries[1][0] = av_make_q(hdrMetadata.displayPrimaries[1].x, 50000);
+            mdm->display_primaries[1][1] = av_make_q(hdrMetadata.displayPrimaries[1].y, 50000);
+            mdm->display_primaries[2][0] = av_make_q(hdrMetadata.displayPrimaries[2].x, 50000);
+            mdm->display_primaries[2][1] = av_make_q(hdrMetadata.displayPrimaries[2].y, 50000);
+
+            mdm->white_point[0] = av_make_q(hdrMetadata.whitePoint.x, 50000);
+            mdm->white_point[1] = av_make_q(hdrMetadata.whitePoint.y, 50000);
+
+            mdm->min_luminance = av_make_q(hdrMetadata.minDisplayLuminance, 10000);
+            mdm->max_luminance = av_make_q(hdrMetadata.maxDisplayLuminance, 1);
+
+            mdm->has_luminance = hdrMetadata.maxDisplayLuminance != 0 ? 1 : 0;
+            mdm->has_primaries = hdrMetadata.displayPrimaries[0].x != 0 ? 1 : 0;
+        }
+
+        if ((hdrMetadata.maxContentLightLevel != 0 || hdrMetadata.maxFrameAverageLightLevel != 0) &&
+                av_frame_get_side_data(frame, AV_FRAME_DATA_CONTENT_LIGHT_LEVEL) == nullptr) {
+            auto clm = av_content_light_metadata_create_side_data(frame);
+
+            clm->MaxCLL = hdrMetadata.maxContentLightLevel;
+            clm->MaxFALL = hdrMetadata.maxFrameAverageLightLevel;
+        }
+    }
+
+    // Restore default log level after a successful decode
+    av_log_set_level(AV_LOG_INFO);
+
+    uint64_t decodeEndTimeUs = StreamUtils::getMonotonicTimeUs();
+
+    m_DecoderLock.lock();
+
+    if (info != nullptr) {
+        // Count time in avcodec_send_packet() and avcodec_receive_frame()
+        // as time spent decoding. Also count time spent in the decode unit
+        // queue because that's directly caused by decoder latency.
+        uint64_t decodeTimeUs = info->queueDelayUs + (decodeEndTimeUs - info->submitTimeUs);
+        m_ReceiveWndVideoStats.totalDecodeTimeUs += decodeTimeUs;
+        m_ReceiveWndVideoStats.decodeLatency.record(decodeTimeUs);
+
+        // Store the presentation time
+        frame->pts = info->du.presentationTimeMs;
+    }
+
+    m_ReceiveWndVideoStats.decodedFrames++;
+
+    m_DecoderLock.unlock();
+
+    // Queue the frame for rendering (or render now if pacer is disabled)
+    m_Pacer->submitFrame(frame);
+}
+
+void FFmpegVideoDecoder::handleReceiveError(int err)
+{
+    char errorstring[512];
+
+    m_DecoderLock.lock();
+
+    // FIXME: Should we pop an entry off m_FrameInfoQueue here?
+
+    av_strerror(err, errorstring, sizeof(errorstring));
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                "avcodec_receive_frame() failed: %s (frame %d)",
+                errorstring,
+                !m_FrameInfoQueue.isEmpty() ? m_FrameInfoQueue.head().du.frameNumber : -1);
+
+    if (++m_ConsecutiveFailedDecodes == FAILED_DECODES_RESET_THRESHOLD) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Resetting decoder due to consistent failure");
+
+        SDL_Event event;
+        event.type = SDL_RENDER_DEVICE_RESET;
+        SDL_PushEvent(&event);
+
+        // Don't consume any additional data
+        SDL_AtomicSet(&m_DecoderThreadShouldQuit, 1);
+    }
+
+    m_DecoderLock.unlock();
+
+    // Just in case the error resulted in the loss of the frame,
+    // request an IDR frame to reset our decoder state.
+    LiRequestIdrFrame();
+}
+
 void FFmpegVideoDecoder::decoderThreadProc()
 {
+    if (m_PipelinedDecode) {
+        // In pipelined mode, this thread only assembles decode units into
+        // packets. The codec thread submits them and receives the frames.
+        while (!SDL_AtomicGet(&m_DecoderThreadShouldQuit)) {
+            VIDEO_FRAME_HANDLE handle;
+            PDECODE_UNIT du;
+
+            if (!LiWaitForNextVideoFrame(&handle, &du)) {
+                // This might be a signal from the main thread to exit
+                continue;
+            }
+
+            LiCompleteVideoFrame(handle, submitDecodeUnit(du));
+        }
+
+        return;
+    }
+
     while (!SDL_AtomicGet(&m_DecoderThreadShouldQuit)) {
         if (m_FramesIn == m_FramesOut) {
             VIDEO_FRAME_HANDLE handle;
@@ -1677,7 +2280,7 @@ void FFmpegVideoDecoder::decoderThreadProc()
 
             // We have output frames to receive. Let's poll until we get one,
             // and submit new input data if/when we get it.
-            AVFrame* frame = av_frame_alloc();
+            AVFrame* frame = m_FramePool.acquire();
             if (!frame) {
                 // Failed to allocate a frame but we did submit,
                 // so we can return DR_OK
@@ -1688,71 +2291,12 @@ void FFmpegVideoDecoder::decoderThreadProc()
 
             int err;
             do {
-                err = avcodec_receive_frame(m_VideoDecoderCtx, frame);
-                if (err == 0) {
-                    SDL_assert(m_FrameInfoQueue.size() == m_FramesIn - m_FramesOut);
-                    m_FramesOut++;
-
-                    // Attach HDR metadata to the frame if it's not already present. We will defer to
-                    // any metadata contained in the bitstream itself since that is guaranteed to be
-                    // correctly synchronized to each frame, unlike our async HDR metadata message.
-                    SS_HDR_METADATA hdrMetadata;
-                    if (LiGetHdrMetadata(&hdrMetadata)) {
-                        if (av_frame_get_side_data(frame, AV_FRAME_DATA_MASTERING_DISPLAY_METADATA) == nullptr) {
-                            auto mdm = av_mastering_display_metadata_create_side_data(frame);
-
-                            mdm->display_primaries[0][0] = av_make_q(hdrMetadata.displayPrimaries[0].x, 50000);
-                            mdm->display_primaries[0][1] = av_make_q(hdrMetadata.displayPrimaries[0].y, 50000);
-                            mdm->display_primaries[1][0] = av_make_q(hdrMetadata.displayPrimaries[1].x, 50000);
-                            mdm->display_primaries[1][1] = av_make_q(hdrMetadata.displayPrimaries[1].y, 50000);
-                            mdm->display_primaries[2][0] = av_make_q(hdrMetadata.displayPrimaries[2].x, 50000);
-                            mdm->display_primaries[2][1] = av_make_q(hdrMetadata.displayPrimaries[2].y, 50000);
-
-                            mdm->white_point[0] = av_make_q(hdrMetadata.whitePoint.x, 50000);
-                            mdm->white_point[1] = av_make_q(hdrMetadata.whitePoint.y, 50000);
-
-                            mdm->min_luminance = av_make_q(hdrMetadata.minDisplayLuminance, 10000);
-                            mdm->max_luminance = av_make_q(hdrMetadata.maxDisplayLuminance, 1);
-
-                            mdm->has_luminance = hdrMetadata.maxDisplayLuminance != 0 ? 1 : 0;
-                            mdm->has_primaries = hdrMetadata.displayPrimaries[0].x != 0 ? 1 : 0;
-                        }
-
-                        if ((hdrMetadata.maxContentLightLevel != 0 || hdrMetadata.maxFrameAverageLightLevel != 0) &&
-                                av_frame_get_side_data(frame, AV_FRAME_DATA_CONTENT_LIGHT_LEVEL) == nullptr) {
-                            auto clm = av_content_light_metadata_create_side_data(frame);
-
-                            clm->MaxCLL = hdrMetadata.maxContentLightLevel;
-                            clm->MaxFALL = hdrMetadata.maxFrameAverageLightLevel;
-                        }
-                    }
-
-                    // Reset failed decodes count if we reached this far
-                    m_ConsecutiveFailedDecodes = 0;
-
-                    // Restore default log level after a successful decode
-                    av_log_set_level(AV_LOG_INFO);
-
-                    // Capture a frame timestamp to measuring pacing delay
-                    frame->pkt_dts = SDL_GetTicks();
+                FRAME_INFO info;
+                bool infoValid;
 
-                    if (!m_FrameInfoQueue.isEmpty()) {
-                        // Data buffers in the DU are not valid here!
-                        DECODE_UNIT du = m_FrameInfoQueue.dequeue();
-
-                        // Count time in avcodec_send_packet() and avcodec_receive_frame()
-                        // as time spent decoding. Also count time spent in the decode unit
-                        // queue because that's directly caused by decoder latency.
-                        m_ActiveWndVideoStats.totalDecodeTime += LiGetMillis() - du.enqueueTimeMs;
-
-                        // Store the presentation time
-                        frame->pts = du.presentationTimeMs;
-                    }
-
-                    m_ActiveWndVideoStats.decodedFrames++;
-
-                    // Queue the frame for rendering (or render now if pacer is disabled)
-                    m_Pacer->submitFrame(frame);
+                err = receiveFrame(frame, &info, &infoValid);
+                if (err == 0) {
+                    handleDecodedFrame(frame, infoValid ? &info : nullptr);
                 }
                 else if (err == AVERROR(EAGAIN)) {
                     VIDEO_FRAME_HANDLE handle;
@@ -1760,50 +2304,119 @@ void FFmpegVideoDecoder::decoderThreadProc()
 
                     // No output data, so let's try to submit more input data,
                     // while we're waiting for this to frame to come back.
-                    if (LiPollNextVideoFrame(&handle, &du)) {
+                    if (m_OutputRequiresInput) {
+                        // The decoder can't produce output without more input, so
+                        // just block until the next frame arrives from the host.
+                        // LiWakeWaitForVideoFrame() will interrupt this wait on
+                        // shutdown, which is handled by the loop condition.
+                        if (LiWaitForNextVideoFrame(&handle, &du)) {
+                            // FIXME: Handle EAGAIN on avcodec_send_packet() properly?
+                            LiCompleteVideoFrame(handle, submitDecodeUnit(du));
+                        }
+                    }
+                    else if (LiPollNextVideoFrame(&handle, &du)) {
                         // FIXME: Handle EAGAIN on avcodec_send_packet() properly?
                         LiCompleteVideoFrame(handle, submitDecodeUnit(du));
                     }
                     else {
-                        // No output data or input data. Let's wait a little bit.
+                        // No output data or input data from an asynchronous decoder.
+                        // Let's wait a little bit.
                         SDL_Delay(2);
                     }
                 }
                 else {
-                    char errorstring[512];
+                    handleReceiveError(err);
+                }
+            } while (err == AVERROR(EAGAIN) && !SDL_AtomicGet(&m_DecoderThreadShouldQuit));
 
-                    // FIXME: Should we pop an entry off m_FrameInfoQueue here?
+            if (err != 0) {
+                // Return the frame if we failed to submit it
+                m_FramePool.release(frame);
+            }
+        }
+    }
+}
 
-                    av_strerror(err, errorstring, sizeof(errorstring));
-                    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
-                                "avcodec_receive_frame() failed: %s (frame %d)",
-                                errorstring,
-                                !m_FrameInfoQueue.isEmpty() ? m_FrameInfoQueue.head().frameNumber : -1);
+void FFmpegVideoDecoder::codecThreadProc()
+{
+    AVFrame* frame = nullptr;
+    PENDING_PACKET pending = {};
 
-                    if (++m_ConsecutiveFailedDecodes == FAILED_DECODES_RESET_THRESHOLD) {
-                        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                                     "Resetting decoder due to consistent failure");
+    while (!SDL_AtomicGet(&m_DecoderThreadShouldQuit)) {
+        // Submit queued input first, so the decoder is never left waiting for it
+        if (pending.pkt == nullptr) {
+            m_DecoderLock.lock();
+            if (!m_PendingPackets.isEmpty()) {
+                pending = m_PendingPackets.dequeue();
+                m_PendingPacketsNotFull.wakeAll();
+            }
+            m_DecoderLock.unlock();
+        }
 
-                        SDL_Event event;
-                        event.type = SDL_RENDER_DEVICE_RESET;
-                        SDL_PushEvent(&event);
+        bool inputStalled = false;
+        if (pending.pkt != nullptr) {
+            int err = sendPacket(pending.pkt, &pending.info);
+            if (err == AVERROR(EAGAIN)) {
+                // The decoder won't take more input until we receive some output
+                inputStalled = true;
+            }
+            else {
+                if (err < 0) {
+                    LiRequestIdrFrame();
+                }
+                av_packet_free(&pending.pkt);
+            }
+        }
 
-                        // Don't consume any additional data
-                        SDL_AtomicSet(&m_DecoderThreadShouldQuit, 1);
-                    }
+        // No frames can come out of the decoder unless we've put some in
+        if (m_FramesIn != m_FramesOut) {
+            if (frame == nullptr) {
+                frame = m_FramePool.acquire();
+                if (!frame) {
+                    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                                "Failed to allocate frame");
 
-                    // Just in case the error resulted in the loss of the frame,
-                    // request an IDR frame to reset our decoder state.
-                    LiRequestIdrFrame();
+                    // Don't spin while we're out of memory. Wait for the Pacer
+                    // to release a frame back to the pool, but wake up now and
+                    // then to check whether we've been asked to quit.
+                    m_FramePool.waitForIdleFrame(100);
+                    continue;
                 }
-            } while (err == AVERROR(EAGAIN) && !SDL_AtomicGet(&m_DecoderThreadShouldQuit));
+            }
 
-            if (err != 0) {
-                // Free the frame if we failed to submit it
-                av_frame_free(&frame);
+            FRAME_INFO info;
+            bool infoValid;
+
+            int err = receiveFrame(frame, &info, &infoValid);
+            if (err == 0) {
+                // The Pacer owns the frame now
+                handleDecodedFrame(frame, infoValid ? &info : nullptr);
+                frame = nullptr;
+                continue;
+            }
+            else if (err != AVERROR(EAGAIN)) {
+                handleReceiveError(err);
+                continue;
+            }
+        }
+
+        // There's no output yet, so wait for more input. Asynchronous decoders
+        // can produce output without it, so those must still be polled.
+        bool pollForOutput = inputStalled || (!m_OutputRequiresInput && m_FramesIn != m_FramesOut);
+        m_DecoderLock.lock();
+        if (!SDL_AtomicGet(&m_DecoderThreadShouldQuit) && (inputStalled || m_PendingPackets.isEmpty())) {
+            if (pollForOutput) {
+                m_DecoderInputAvailable.wait(&m_DecoderLock, 1);
+            }
+            else {
+                m_DecoderInputAvailable.wait(&m_DecoderLock);
             }
         }
+        m_DecoderLock.unlock();
     }
+
+    av_packet_free(&pending.pkt);
+    m_FramePool.release(frame);
 }
 
 int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
@@ -1814,7 +2427,10 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
     SDL_assert(!m_TestOnly);
 
     // If this is the first frame, reject anything that's not an IDR frame
-    if (m_FramesIn == 0 && du->frameType != FRAME_TYPE_IDR) {
+    m_DecoderLock.lock();
+    bool firstFrame = m_FramesIn == 0 && m_PendingPackets.isEmpty();
+    m_DecoderLock.unlock();
+    if (firstFrame && du->frameType != FRAME_TYPE_IDR) {
         return DR_NEED_IDR;
     }
 
@@ -1831,15 +2447,32 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
 
     // Flip stats windows roughly every second
     if (SDL_TICKS_PASSED(SDL_GetTicks(), m_ActiveWndVideoStats.measurementStartTimestamp + 1000)) {
+        // Pick up what was decoded during this window
+        m_DecoderLock.lock();
+        m_ActiveWndVideoStats.decodedFrames += m_ReceiveWndVideoStats.decodedFrames;
+        m_ActiveWndVideoStats.totalDecodeTimeUs += m_ReceiveWndVideoStats.totalDecodeTimeUs;
+        m_ActiveWndVideoStats.decodeLatency.add(m_ReceiveWndVideoStats.decodeLatency);
+        m_ActiveWndVideoStats.submitLatency.add(m_ReceiveWndVideoStats.submitLatency);
+        SDL_zero(m_ReceiveWndVideoStats);
+        m_DecoderLock.unlock();
+
+        uint32_t framePoolMisses = m_FramePool.getMissedFrames();
+        m_ActiveWndVideoStats.framePoolMissedFrames = framePoolMisses - m_CountedFramePoolMisses;
+        m_CountedFramePoolMisses = framePoolMisses;
+
         // Update overlay stats if it's enabled
         if (Session::get()->getOverlayManager().isOverlayEnabled(Overlay::OverlayDebug)) {
             VIDEO_STATS lastTwoWndStats = {};
             addVideoStats(m_LastWndVideoStats, lastTwoWndStats);
             addVideoStats(m_ActiveWndVideoStats, lastTwoWndStats);
 
-            stringifyVideoStats(lastTwoWndStats,
-                                Session::get()->getOverlayManager().getOverlayText(Overlay::OverlayDebug),
-                                Session::get()->getOverlayManager().getOverlayMaxTextLength());
+            char* overlayText = Session::get()->getOverlayManager().getOverlayText(Overlay::OverlayDebug);
+            int overlayTextLength = Session::get()->getOverlayManager().getOverlayMaxTextLength();
+            stringifyVideoStats(lastTwoWndStats, overlayText, overlayTextLength);
+
+            int offset = (int)strlen(overlayText);
+            Session::get()->stringifyOverlayAudioStats(&overlayText[offset], overlayTextLength - offset);
+
             Session::get()->getOverlayManager().setOverlayTextUpdated(Overlay::OverlayDebug);
         }
 
@@ -1873,16 +2506,45 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
         requiredBufferSize += MAX_SPS_EXTRA_SIZE;
     }
 
-    // Ensure the decoder buffer is large enough
-    m_DecodeBuffer.reserve(requiredBufferSize + AV_INPUT_BUFFER_PADDING_SIZE);
+    requiredBufferSize += AV_INPUT_BUFFER_PADDING_SIZE;
+
+    // Ensure the packet buffer pool is large enough. We grow in 1 MB steps to
+    // avoid recreating the pool for every slightly larger frame. Buffers from
+    // the old pool that are still held by the decoder stay valid until released.
+    if (m_PacketBufferPool == nullptr || (size_t)requiredBufferSize > m_PacketBufferPoolSize) {
+        av_buffer_pool_uninit(&m_PacketBufferPool);
+
+        m_PacketBufferPoolSize = FFALIGN(requiredBufferSize, 1024 * 1024);
+        m_PacketBufferPool = av_buffer_pool_init(m_PacketBufferPoolSize, nullptr);
+        if (m_PacketBufferPool == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Failed to allocate packet buffer pool");
+            m_PacketBufferPoolSize = 0;
+            return DR_NEED_IDR;
+        }
+    }
+
+    // Assemble the frame into a refcounted buffer. Since the packet is refcounted,
+    // avcodec_send_packet() can take a reference to it rather than making its own
+    // copy of the frame data like it does for plain packets.
+    AVBufferRef* packetBuffer = av_buffer_pool_get(m_PacketBufferPool);
+    if (packetBuffer == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to allocate packet buffer");
+        return DR_NEED_IDR;
+    }
 
     int offset = 0;
     while (entry != nullptr) {
-        writeBuffer(entry, offset);
+        writeBuffer(entry, packetBuffer->data, offset);
         entry = entry->next;
     }
 
-    m_Pkt->data = reinterpret_cast<uint8_t*>(m_DecodeBuffer.data());
+    // Pool buffers are recycled, so we must zero the padding ourselves
+    memset(&packetBuffer->data[offset], 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    m_Pkt->buf = packetBuffer;
+    m_Pkt->data = packetBuffer->data;
     m_Pkt->size = offset;
 
     if (du->frameType == FRAME_TYPE_IDR) {
@@ -1892,39 +2554,47 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
         m_Pkt->flags = 0;
     }
 
-    m_ActiveWndVideoStats.totalReassemblyTime += du->enqueueTimeMs - du->receiveTimeMs;
+    // Decode unit timestamps come from moonlight-common-c in milliseconds
+    uint64_t reassemblyTimeUs = (du->enqueueTimeMs - du->receiveTimeMs) * 1000;
+    m_ActiveWndVideoStats.totalReassemblyTimeUs += reassemblyTimeUs;
+    m_ActiveWndVideoStats.reassemblyLatency.record(reassemblyTimeUs);
 
-    err = avcodec_send_packet(m_VideoDecoderCtx, m_Pkt);
-    if (err < 0) {
-        char errorstring[512];
-        av_strerror(err, errorstring, sizeof(errorstring));
-        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
-                    "avcodec_send_packet() failed: %s (frame %d)",
-                    errorstring,
-                    du->frameNumber);
+    FRAME_INFO info;
+    info.du = *du;
 
-        // If we've failed a bunch of decodes in a row, the decoder/renderer is
-        // clearly unhealthy, so let's generate a synthetic reset event to trigger
-        // the event loop to destroy and recreate the decoder.
-        if (++m_ConsecutiveFailedDecodes == FAILED_DECODES_RESET_THRESHOLD) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "Resetting decoder due to consistent failure");
-
-            SDL_Event event;
-            event.type = SDL_RENDER_DEVICE_RESET;
-            SDL_PushEvent(&event);
+    if (m_PipelinedDecode) {
+        PENDING_PACKET pending;
+        pending.pkt = av_packet_alloc();
+        if (pending.pkt == nullptr) {
+            av_buffer_unref(&m_Pkt->buf);
+            return DR_NEED_IDR;
+        }
+        av_packet_move_ref(pending.pkt, m_Pkt);
+        pending.info = info;
 
-            // Don't consume any additional data
-            SDL_AtomicSet(&m_DecoderThreadShouldQuit, 1);
+        // Hand the packet to the codec thread, unless it's fallen too far behind
+        m_DecoderLock.lock();
+        while (!SDL_AtomicGet(&m_DecoderThreadShouldQuit) && m_PendingPackets.size() >= MAX_PENDING_PACKETS) {
+            m_PendingPacketsNotFull.wait(&m_DecoderLock);
+        }
+        if (SDL_AtomicGet(&m_DecoderThreadShouldQuit)) {
+            m_DecoderLock.unlock();
+            av_packet_free(&pending.pkt);
+            return DR_OK;
         }
+        m_PendingPackets.enqueue(pending);
+        m_DecoderInputAvailable.wakeAll();
+        m_DecoderLock.unlock();
 
-        return DR_NEED_IDR;
+        return DR_OK;
     }
 
-    m_FrameInfoQueue.enqueue(*du);
+    err = sendPacket(m_Pkt, &info);
+
+    // The decoder holds its own reference to the packet data if it needs it
+    av_buffer_unref(&m_Pkt->buf);
 
-    m_FramesIn++;
-    return DR_OK;
+    return err < 0 ? DR_NEED_IDR : DR_OK;
 }
 
 void FFmpegVideoDecoder::renderFrameOnMainThread()
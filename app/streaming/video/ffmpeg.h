@@ -2,9 +2,12 @@
 
 #include <functional>
 #include <QQueue>
+#include <QMutex>
+#include <QWaitCondition>
 #include <set>
 
 #include "decoder.h"
+#include "framepool.h"
 #include "ffmpeg-renderers/renderer.h"
 #include "ffmpeg-renderers/pacer/pacer.h"
 
@@ -32,12 +35,47 @@ public:
     virtual IFFmpegRenderer* getBackendRenderer();
 
 private:
+    typedef struct _FRAME_INFO {
+        // Data buffers in this DU are not valid
+        DECODE_UNIT du;
+
+        // Time between reassembly and avcodec_send_packet(). This uses
+        // moonlight-common-c's millisecond clock, so it's stored as a
+        // duration rather than a timestamp.
+        uint64_t queueDelayUs;
+
+        // StreamUtils::getMonotonicTimeUs() before avcodec_send_packet()
+        uint64_t submitTimeUs;
+    } FRAME_INFO;
+
+    // A decode unit waiting to be submitted by the codec thread
+    typedef struct _PENDING_PACKET {
+        AVPacket* pkt;
+        FRAME_INFO info;
+    } PENDING_PACKET;
+
     bool completeInitialization(const AVCodec* decoder,
                                 enum AVPixelFormat requiredFormat,
                                 PDECODER_PARAMETERS params,
                                 bool testFrame,
                                 bool useAlternateFrontend);
 
+    static
+    bool getTestFrame(int videoFormat, AVPacket* pkt);
+
+    static
+    uint64_t measureTestFrameDecodeTimeUs(const AVCodec* decoder, int videoFormat);
+
+    // Negotiating picks the slice count to request from the host. Otherwise,
+    // this returns the slice count that was last negotiated.
+    static
+    int getSoftwareDecodeSlices(const AVCodec* decoder, int videoFormat, int width, int height, int frameRate,
+                                bool negotiate);
+
+    void recordSoftwareDecodeCost();
+
+    void configureSoftwareDecodeThreading(const AVCodec* decoder, PDECODER_PARAMETERS params);
+
     void stringifyVideoStats(VIDEO_STATS& stats, char* output, int length);
 
     void logVideoStats(VIDEO_STATS& stats, const char* title);
@@ -80,7 +118,7 @@ private:
 
     void reset();
 
-    void writeBuffer(PLENTRY entry, int& offset);
+    void writeBuffer(PLENTRY entry, uint8_t* buffer, int& offset);
 
     static
     enum AVPixelFormat ffGetFormat(AVCodecContext* context,
@@ -90,16 +128,35 @@ private:
 
     static int decoderThreadProcThunk(void* context);
 
+    void codecThreadProc();
+
+    static int codecThreadProcThunk(void* context);
+
+    int sendPacket(AVPacket* pkt, FRAME_INFO* info);
+
+    int receiveFrame(AVFrame* frame, FRAME_INFO* info, bool* infoValid);
+
+    void handleDecodedFrame(AVFrame* frame, FRAME_INFO* info);
+
+    void handleReceiveError(int err);
+
     AVPacket* m_Pkt;
     AVCodecContext* m_VideoDecoderCtx;
     enum AVPixelFormat m_RequiredPixelFormat;
-    QByteArray m_DecodeBuffer;
+    AVBufferPool* m_PacketBufferPool;
+    size_t m_PacketBufferPoolSize;
     const AVCodecHWConfig* m_HwDecodeCfg;
     IFFmpegRenderer* m_BackendRenderer;
     IFFmpegRenderer* m_FrontendRenderer;
     int m_ConsecutiveFailedDecodes;
     Pacer* m_Pacer;
+    FramePool m_FramePool;
     VIDEO_STATS m_ActiveWndVideoStats;
+
+    // Stats from the decoder calls, which run on the codec thread when
+    // decoding is pipelined. The submit thread owns m_ActiveWndVideoStats, so
+    // it merges these in under m_DecoderLock when it rolls the stats window.
+    VIDEO_STATS m_ReceiveWndVideoStats;
     VIDEO_STATS m_LastWndVideoStats;
     VIDEO_STATS m_GlobalVideoStats;
     std::set<IFFmpegRenderer::RendererType> m_FailedRenderers;
@@ -107,16 +164,34 @@ private:
     int m_FramesIn;
     int m_FramesOut;
 
+    // Frame pool misses already counted in a stats window
+    uint32_t m_CountedFramePoolMisses;
+
     int m_LastFrameNumber;
+    int m_StreamWidth;
+    int m_StreamHeight;
     int m_StreamFps;
     int m_VideoFormat;
     bool m_NeedsSpsFixup;
+    bool m_OutputRequiresInput;
     bool m_TestOnly;
+    bool m_PipelinedDecode;
+    int m_SoftwareDecodeSlices;
     SDL_Thread* m_DecoderThread;
+    SDL_Thread* m_CodecThread;
     SDL_atomic_t m_DecoderThreadShouldQuit;
 
-    // Data buffers in the queued DU are not valid
-    QQueue<DECODE_UNIT> m_FrameInfoQueue;
+    // Protects m_FrameInfoQueue, m_PendingPackets, m_FramesIn/m_FramesOut,
+    // m_ConsecutiveFailedDecodes, and m_ReceiveWndVideoStats. It's never held
+    // while decoding, so the submit thread doesn't wait behind the decoder.
+    // When decoding is pipelined, only the codec thread uses the codec context
+    // since libavcodec doesn't allow two threads to use it at once. The submit
+    // thread assembles decode units into packets and queues them for it.
+    QMutex m_DecoderLock;
+    QWaitCondition m_DecoderInputAvailable;
+    QWaitCondition m_PendingPacketsNotFull;
+    QQueue<FRAME_INFO> m_FrameInfoQueue;
+    QQueue<PENDING_PACKET> m_PendingPackets;
 
     static const uint8_t k_H264TestFrame[];
     static const uint8_t k_HEVCMainTestFrame[];
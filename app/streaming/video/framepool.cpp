@@ -0,0 +1,115 @@
+#include "framepool.h"
+
+FramePool::FramePool() :
+    m_Capacity(0),
+    m_AcquiredFrames(0),
+    m_MissedFrames(0)
+{
+
+}
+
+FramePool::~FramePool()
+{
+    clear();
+}
+
+void FramePool::setCapacity(int capacity)
+{
+    m_Lock.lock();
+
+    m_Capacity = capacity;
+
+    // Reserve space up front so release() never needs to allocate
+    m_IdleFrames.reserve(capacity);
+
+    while (m_IdleFrames.size() > m_Capacity) {
+        AVFrame* frame = m_IdleFrames.takeLast();
+        av_frame_free(&frame);
+    }
+
+    m_Lock.unlock();
+}
+
+AVFrame* FramePool::acquire()
+{
+    AVFrame* frame = nullptr;
+
+    m_Lock.lock();
+    m_AcquiredFrames++;
+    if (!m_IdleFrames.isEmpty()) {
+        frame = m_IdleFrames.takeLast();
+    }
+    else {
+        m_MissedFrames++;
+    }
+    m_Lock.unlock();
+
+    if (frame == nullptr) {
+        frame = av_frame_alloc();
+    }
+
+    return frame;
+}
+
+void FramePool::release(AVFrame* frame)
+{
+    if (frame == nullptr) {
+        return;
+    }
+
+    // Release the frame's buffers outside of the lock. This resets
+    // all fields to their defaults, just like a newly allocated frame.
+    av_frame_unref(frame);
+
+    m_Lock.lock();
+    if (m_IdleFrames.size() < m_Capacity) {
+        m_IdleFrames.append(frame);
+        m_FrameReleased.wakeAll();
+        frame = nullptr;
+    }
+    m_Lock.unlock();
+
+    // Free the frame if the pool is full
+    av_frame_free(&frame);
+}
+
+bool FramePool::waitForIdleFrame(int timeoutMs)
+{
+    m_Lock.lock();
+    if (m_IdleFrames.isEmpty()) {
+        m_FrameReleased.wait(&m_Lock, timeoutMs);
+    }
+    bool frameAvailable = !m_IdleFrames.isEmpty();
+    m_Lock.unlock();
+
+    return frameAvailable;
+}
+
+void FramePool::clear()
+{
+    m_Lock.lock();
+    for (AVFrame* frame : m_IdleFrames) {
+        av_frame_free(&frame);
+    }
+    m_IdleFrames.clear();
+    m_AcquiredFrames = m_MissedFrames = 0;
+    m_Lock.unlock();
+}
+
+uint32_t FramePool::getAcquiredFrames()
+{
+    m_Lock.lock();
+    uint32_t acquiredFrames = m_AcquiredFrames;
+    m_Lock.unlock();
+
+    return acquiredFrames;
+}
+
+uint32_t FramePool::getMissedFrames()
+{
+    m_Lock.lock();
+    uint32_t missedFrames = m_MissedFrames;
+    m_Lock.unlock();
+
+    return missedFrames;
+}
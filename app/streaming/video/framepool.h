@@ -0,0 +1,56 @@
+#pragma once
+
+#include "SDL_compat.h"
+
+#include <QMutex>
+#include <QVector>
+#include <QWaitCondition>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Recycles AVFrame structures between the decoder and the Pacer to avoid
+// allocator churn on every decoded frame. Frames may be released from any
+// thread. Released frames are unreferenced immediately, so their underlying
+// buffers go back to the decoder's surface pool right away, and only the
+// AVFrame shell is retained for reuse.
+class FramePool
+{
+public:
+    FramePool();
+
+    ~FramePool();
+
+    // Sets the maximum number of idle frames retained by the pool
+    void setCapacity(int capacity);
+
+    // Returns a blank frame, allocating a new one if the pool is empty
+    AVFrame* acquire();
+
+    // Returns a frame to the pool. The frame may be nullptr.
+    void release(AVFrame* frame);
+
+    // Blocks until the pool has an idle frame or the timeout expires.
+    // This lets a caller whose acquire() failed wait for a frame to be
+    // released rather than retrying in a loop. Returns true if an idle
+    // frame is available.
+    bool waitForIdleFrame(int timeoutMs);
+
+    // Frees all idle frames and resets the counters
+    void clear();
+
+    // Counts since the last clear(). These may be called from any thread.
+    uint32_t getAcquiredFrames();
+
+    // Acquires that had to allocate a new frame
+    uint32_t getMissedFrames();
+
+private:
+    QMutex m_Lock;
+    QVector<AVFrame*> m_IdleFrames;
+    QWaitCondition m_FrameReleased;
+    int m_Capacity;
+    uint32_t m_AcquiredFrames;
+    uint32_t m_MissedFrames;
+};
@@ -0,0 +1,294 @@
+#include "glyphatlas.h"
+
+// Glyphs are packed left to right into rows that are one font height tall
+#define ATLAS_WIDTH 1024
+#define ATLAS_ROWS 16
+
+using namespace Overlay;
+
+GlyphAtlas::GlyphAtlas(TTF_Font* font, SDL_Color color) :
+    m_Font(font),
+    m_Color(color),
+    m_FontHeight(TTF_FontHeight(font)),
+    m_LineSkip(TTF_FontLineSkip(font)),
+    m_ShelfX(0),
+    m_ShelfY(0),
+    m_Canvas(nullptr)
+{
+    SDL_zero(m_Glyphs);
+
+    m_Atlas = SDL_CreateRGBSurfaceWithFormat(0, ATLAS_WIDTH, m_FontHeight * ATLAS_ROWS,
+                                             32, SDL_PIXELFORMAT_ARGB8888);
+    if (m_Atlas == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_CreateRGBSurfaceWithFormat() failed: %s",
+                     SDL_GetError());
+        return;
+    }
+
+    // Copy glyph pixels as-is rather than blending them onto the canvas.
+    // Blending onto transparent pixels would darken the glyph edges.
+    SDL_SetSurfaceBlendMode(m_Atlas, SDL_BLENDMODE_NONE);
+
+    // Rasterize printable ASCII up front, since that's nearly all overlay text
+    for (int ch = ' '; ch <= '~'; ch++) {
+        cacheGlyph((unsigned char)ch);
+    }
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+    reset();
+
+    if (m_Atlas != nullptr) {
+        SDL_FreeSurface(m_Atlas);
+    }
+}
+
+void GlyphAtlas::reset()
+{
+    if (m_Canvas != nullptr) {
+        SDL_FreeSurface(m_Canvas);
+        m_Canvas = nullptr;
+    }
+
+    m_CanvasLines.clear();
+}
+
+bool GlyphAtlas::cacheGlyph(unsigned char ch)
+{
+    if (m_Glyphs[ch].cached) {
+        return true;
+    }
+
+    if (m_Atlas == nullptr) {
+        return false;
+    }
+
+    m_Glyphs[ch].cached = true;
+
+    // TTF_RenderText_*() treat text as Latin-1, so each byte is one glyph
+    if (TTF_GlyphMetrics(m_Font, ch, nullptr, nullptr, nullptr, nullptr, &m_Glyphs[ch].advance) != 0) {
+        m_Glyphs[ch].advance = 0;
+    }
+
+    SDL_Surface* glyph = TTF_RenderGlyph_Blended(m_Font, ch, m_Color);
+    if (glyph == nullptr) {
+        // Some glyphs (like control characters) have nothing to draw
+        return true;
+    }
+
+    int width = SDL_min(glyph->w, ATLAS_WIDTH);
+    int height = SDL_min(glyph->h, m_FontHeight);
+
+    // Start a new row if this glyph doesn't fit on the current one
+    if (m_ShelfX + width > ATLAS_WIDTH) {
+        m_ShelfX = 0;
+        m_ShelfY += m_FontHeight;
+    }
+
+    if (m_ShelfY + height > m_Atlas->h) {
+        // Leave a blank space for this glyph rather than trying again every time
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Overlay glyph atlas is full. Unable to cache glyph: %u",
+                    ch);
+        SDL_FreeSurface(glyph);
+        return true;
+    }
+
+    m_Glyphs[ch].atlasRect = { m_ShelfX, m_ShelfY, width, height };
+
+    SDL_Rect srcRect = { 0, 0, width, height };
+    SDL_Rect dstRect = m_Glyphs[ch].atlasRect;
+    SDL_SetSurfaceBlendMode(glyph, SDL_BLENDMODE_NONE);
+    SDL_BlitSurface(glyph, &srcRect, m_Atlas, &dstRect);
+    SDL_FreeSurface(glyph);
+
+    m_ShelfX += width;
+    return true;
+}
+
+int GlyphAtlas::getKerning(unsigned char previous, unsigned char ch)
+{
+    // TTF kerns each pair of glyphs when rendering a string, so we must too
+#ifdef SDL_TTF_VERSION_ATLEAST
+#if SDL_TTF_VERSION_ATLEAST(2, 0, 18)
+    return TTF_GetFontKerningSizeGlyphs32(m_Font, previous, ch);
+#else
+    return TTF_GetFontKerningSizeGlyphs(m_Font, previous, ch);
+#endif
+#else
+    return TTF_GetFontKerningSizeGlyphs(m_Font, previous, ch);
+#endif
+}
+
+int GlyphAtlas::getGlyphAdvance(const char* text, int lineStart, int index)
+{
+    unsigned char ch = (unsigned char)text[index];
+    int advance = cacheGlyph(ch) ? m_Glyphs[ch].advance : 0;
+
+    if (index > lineStart) {
+        advance += getKerning((unsigned char)text[index - 1], ch);
+    }
+
+    return advance;
+}
+
+int GlyphAtlas::getLineWidth(const char* text, int length)
+{
+    int width = 0;
+
+    for (int i = 0; i < length; i++) {
+        width += getGlyphAdvance(text, 0, i);
+    }
+
+    return width;
+}
+
+void GlyphAtlas::layoutText(const char* text, int wrapLength, QVector<Line>* lines)
+{
+    // Break the text into lines at newlines, and at the last space before
+    // any line that would otherwise be wider than wrapLength.
+    int lineStart = 0;
+    int lineWidth = 0;
+    int lastSpace = -1;
+    int widthBeforeSpace = 0;
+    for (int i = 0; ; i++) {
+        unsigned char ch = (unsigned char)text[i];
+
+        if (ch == '\0' || ch == '\n') {
+            // Don't leave an empty line at the bottom of the overlay
+            if (ch == '\n' || i > lineStart) {
+                lines->append({ QByteArray(text + lineStart, i - lineStart), lineWidth });
+            }
+
+            if (ch == '\0') {
+                break;
+            }
+
+            lineStart = i + 1;
+            lineWidth = 0;
+            lastSpace = -1;
+            continue;
+        }
+
+        int advance = getGlyphAdvance(text, lineStart, i);
+
+        if (lineWidth + advance > wrapLength && i > lineStart) {
+            if (lastSpace >= 0) {
+                // Wrap at the last space, which is dropped
+                lines->append({ QByteArray(text + lineStart, lastSpace - lineStart), widthBeforeSpace });
+                lineStart = lastSpace + 1;
+                lastSpace = -1;
+            }
+            else {
+                // No space to wrap at, so break the word here
+                lines->append({ QByteArray(text + lineStart, i - lineStart), lineWidth });
+                lineStart = i;
+            }
+
+            // Measure whatever is left now that it starts a line
+            lineWidth = getLineWidth(text + lineStart, i - lineStart);
+            advance = getGlyphAdvance(text, lineStart, i);
+        }
+
+        if (ch == ' ') {
+            lastSpace = i;
+            widthBeforeSpace = lineWidth;
+        }
+
+        lineWidth += advance;
+    }
+}
+
+SDL_Surface* GlyphAtlas::renderText(const char* text, int wrapLength, SDL_Rect* dirtyRect)
+{
+    QVector<Line> lines;
+    int width = 0;
+
+    SDL_zerop(dirtyRect);
+
+    layoutText(text, wrapLength, &lines);
+    for (const Line& line : lines) {
+        width = SDL_max(width, line.width);
+    }
+
+    // Like TTF, we don't create surfaces for text with nothing to draw
+    if (lines.isEmpty() || width == 0) {
+        reset();
+        return nullptr;
+    }
+
+    int height = m_LineSkip * (lines.size() - 1) + m_FontHeight;
+    if (m_Canvas == nullptr || m_Canvas->w != width || m_Canvas->h != height) {
+        // Nothing on the old canvas can be reused at a different size
+        reset();
+
+        // New surfaces are zeroed, so anything we don't draw is transparent
+        m_Canvas = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+        if (m_Canvas == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "SDL_CreateRGBSurfaceWithFormat() failed: %s",
+                         SDL_GetError());
+            return nullptr;
+        }
+    }
+
+    for (int i = 0; i < lines.size(); i++) {
+        const QByteArray& line = lines[i].text;
+
+        // Find the first glyph that differs from what's on the canvas
+        int first = 0;
+        if (i < m_CanvasLines.size()) {
+            const QByteArray& oldLine = m_CanvasLines[i].text;
+            while (first < line.size() && first < oldLine.size() && line[first] == oldLine[first]) {
+                first++;
+            }
+
+            if (first == line.size() && first == oldLine.size()) {
+                continue;
+            }
+        }
+
+        // Glyphs before the first change stay where they are, since
+        // kerning only depends on the glyph before each one. Clear the
+        // rest of the line, which may have been longer last time.
+        int x = getLineWidth(line.constData(), first);
+        SDL_Rect lineRect = { x, i * m_LineSkip, m_Canvas->w - x, m_FontHeight };
+        SDL_FillRect(m_Canvas, &lineRect, 0);
+
+        for (int j = first; j < line.size(); j++) {
+            unsigned char ch = (unsigned char)line[j];
+
+            if (j > 0) {
+                x += getKerning((unsigned char)line[j - 1], ch);
+            }
+
+            if (m_Glyphs[ch].atlasRect.w != 0) {
+                SDL_Rect glyphRect = { x, lineRect.y, 0, 0 };
+                SDL_BlitSurface(m_Atlas, &m_Glyphs[ch].atlasRect, m_Canvas, &glyphRect);
+            }
+
+            x += m_Glyphs[ch].advance;
+        }
+
+        if (SDL_RectEmpty(dirtyRect)) {
+            *dirtyRect = lineRect;
+        }
+        else {
+            SDL_UnionRect(dirtyRect, &lineRect, dirtyRect);
+        }
+    }
+
+    m_CanvasLines = lines;
+
+    // The caller owns the copy, so the canvas stays intact for next time
+    SDL_Surface* surface = SDL_DuplicateSurface(m_Canvas);
+    if (surface == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_DuplicateSurface() failed: %s",
+                     SDL_GetError());
+    }
+
+    return surface;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <QByteArray>
+#include <QVector>
+
+#include "SDL_compat.h"
+#include <SDL_ttf.h>
+
+namespace Overlay {
+
+// Caches rasterized glyphs for a single font and color in one atlas
+// surface, and composes overlay text from them onto a canvas that is kept
+// between updates. Each glyph is only rasterized and colored once, and an
+// update only redraws each line from its first changed glyph onward.
+class GlyphAtlas
+{
+public:
+    GlyphAtlas(TTF_Font* font, SDL_Color color);
+
+    ~GlyphAtlas();
+
+    // Draws text onto the canvas, wrapping lines like
+    // TTF_RenderText_Blended_Wrapped(), and returns a copy of the canvas
+    // that the caller must free. The area that differs from the previous
+    // copy is stored in dirtyRect, which is empty if nothing changed.
+    // Returns nullptr if there is nothing to draw.
+    SDL_Surface* renderText(const char* text, int wrapLength, SDL_Rect* dirtyRect);
+
+    // Discards the canvas, so the next copy is dirty in its entirety
+    void reset();
+
+private:
+    struct Line {
+        QByteArray text;
+        int width;
+    };
+
+    bool cacheGlyph(unsigned char ch);
+
+    int getKerning(unsigned char previous, unsigned char ch);
+
+    // Includes the kerning against the previous glyph on the same line
+    int getGlyphAdvance(const char* text, int lineStart, int index);
+
+    int getLineWidth(const char* text, int length);
+
+    void layoutText(const char* text, int wrapLength, QVector<Line>* lines);
+
+    TTF_Font* m_Font;
+    SDL_Color m_Color;
+    int m_FontHeight;
+    int m_LineSkip;
+
+    SDL_Surface* m_Atlas;
+    int m_ShelfX;
+    int m_ShelfY;
+
+    SDL_Surface* m_Canvas;
+    QVector<Line> m_CanvasLines;
+
+    struct {
+        bool cached;
+        int advance;
+        SDL_Rect atlasRect;
+    } m_Glyphs[256];
+};
+
+}
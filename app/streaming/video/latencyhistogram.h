@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+
+// Log-linear latency histogram with 16 sub-buckets per power of two, so each
+// recorded value is within ~3% of its bucket's midpoint. Values are in
+// microseconds and anything above ~16 seconds is clamped into the last bucket.
+//
+// This is a plain fixed-size struct with no allocations, so it can be embedded
+// in VIDEO_STATS and copied, zeroed, and summed along with the other window
+// stats. Like the other VIDEO_STATS counters, each histogram must only be
+// recorded into from a single thread.
+#define LATENCY_HISTOGRAM_SUB_BUCKET_BITS 4
+#define LATENCY_HISTOGRAM_SUB_BUCKETS (1 << LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+#define LATENCY_HISTOGRAM_MAX_VALUE_BITS 24
+#define LATENCY_HISTOGRAM_BUCKETS ((LATENCY_HISTOGRAM_MAX_VALUE_BITS - LATENCY_HISTOGRAM_SUB_BUCKET_BITS + 1) * LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+struct LatencyHistogram
+{
+    uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+    uint32_t count;
+
+    void record(uint64_t valueUs)
+    {
+        buckets[getBucketIndex(valueUs)]++;
+        count++;
+    }
+
+    void add(const LatencyHistogram& other)
+    {
+        for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+            buckets[i] += other.buckets[i];
+        }
+        count += other.count;
+    }
+
+    // Returns the approximate value at the given percentile (0-100) or 0 if empty
+    uint32_t getPercentile(double percentile) const
+    {
+        if (count == 0) {
+            return 0;
+        }
+
+        // Find the first bucket where the cumulative count reaches the target rank
+        uint64_t targetRank = (uint64_t)(percentile / 100.0 * count + 0.5);
+        if (targetRank == 0) {
+            targetRank = 1;
+        }
+        else if (targetRank > count) {
+            targetRank = count;
+        }
+
+        uint64_t cumulativeCount = 0;
+        for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+            cumulativeCount += buckets[i];
+            if (cumulativeCount >= targetRank) {
+                return getBucketMidpoint(i);
+            }
+        }
+
+        return getBucketMidpoint(LATENCY_HISTOGRAM_BUCKETS - 1);
+    }
+
+private:
+    static int getBucketIndex(uint64_t rawValue)
+    {
+        uint32_t value = rawValue >= (1U << LATENCY_HISTOGRAM_MAX_VALUE_BITS) ?
+                             (1U << LATENCY_HISTOGRAM_MAX_VALUE_BITS) - 1 : (uint32_t)rawValue;
+
+        // Values in the first two octaves get exact buckets
+        if (value < 2 * LATENCY_HISTOGRAM_SUB_BUCKETS) {
+            return (int)value;
+        }
+
+        int msb = 31;
+        while (!(value & (1U << msb))) {
+            msb--;
+        }
+
+        // Keep the top bits of the value as the sub-bucket index
+        int shift = msb - LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+        return shift * LATENCY_HISTOGRAM_SUB_BUCKETS + (int)(value >> shift);
+    }
+
+    static uint32_t getBucketMidpoint(int index)
+    {
+        if (index < 2 * LATENCY_HISTOGRAM_SUB_BUCKETS) {
+            return (uint32_t)index;
+        }
+
+        int shift = index / LATENCY_HISTOGRAM_SUB_BUCKETS - 1;
+        uint32_t subBucket = (uint32_t)(index % LATENCY_HISTOGRAM_SUB_BUCKETS) + LATENCY_HISTOGRAM_SUB_BUCKETS;
+        return (subBucket << shift) + ((1U << shift) >> 1);
+    }
+};
@@ -37,6 +37,7 @@ OverlayManager::~OverlayManager()
         if (m_Overlays[i].surface != nullptr) {
             SDL_FreeSurface(m_Overlays[i].surface);
         }
+        delete m_Overlays[i].glyphAtlas;
         if (m_Overlays[i].font != nullptr) {
             TTF_CloseFont(m_Overlays[i].font);
         }
@@ -80,10 +81,27 @@ int OverlayManager::getOverlayFontSize(OverlayType type)
 }
 
 SDL_Surface* OverlayManager::getUpdatedOverlaySurface(OverlayType type)
+{
+    return getUpdatedOverlaySurface(type, nullptr);
+}
+
+SDL_Surface* OverlayManager::getUpdatedOverlaySurface(OverlayType type, SDL_Rect* dirtyRect)
 {
     // If a new surface is available, return it. If not, return nullptr.
     // Caller must free the surface on success.
-    return (SDL_Surface*)SDL_AtomicSetPtr((void**)&m_Overlays[type].surface, nullptr);
+    //
+    // dirtyRect receives the area that changed since the last surface the
+    // caller took. Everything outside it matches that surface, as long as
+    // both surfaces are the same size.
+    SDL_AtomicLock(&m_Overlays[type].surfaceLock);
+    SDL_Surface* surface = m_Overlays[type].surface;
+    m_Overlays[type].surface = nullptr;
+    if (dirtyRect != nullptr) {
+        *dirtyRect = m_Overlays[type].dirtyRect;
+    }
+    SDL_AtomicUnlock(&m_Overlays[type].surfaceLock);
+
+    return surface;
 }
 
 void OverlayManager::setOverlayTextUpdated(OverlayType type)
@@ -147,24 +165,44 @@ void OverlayManager::notifyOverlayUpdated(OverlayType type)
             // Can't proceed without a font
             return;
         }
+
+        // Glyphs are cached per overlay, since each has its own font size and color
+        m_Overlays[type].glyphAtlas = new GlyphAtlas(m_Overlays[type].font, m_Overlays[type].color);
     }
 
-    SDL_Surface* oldSurface = (SDL_Surface*)SDL_AtomicSetPtr((void**)&m_Overlays[type].surface, nullptr);
+    SDL_Surface* surface = nullptr;
+    SDL_Rect dirtyRect = {};
+
+    if (m_Overlays[type].enabled) {
+        // Only the glyphs that changed since the last update are redrawn
+        surface = m_Overlays[type].glyphAtlas->renderText(m_Overlays[type].text, 1024, &dirtyRect);
+    }
+    else {
+        // The renderer won't have kept anything while the overlay is disabled
+        m_Overlays[type].glyphAtlas->reset();
+    }
+
+    SDL_AtomicLock(&m_Overlays[type].surfaceLock);
+    SDL_Surface* oldSurface = m_Overlays[type].surface;
+    if (oldSurface != nullptr && surface != nullptr) {
+        // The renderer never took the old surface, so whatever changed
+        // in it still needs to be uploaded along with our changes.
+        if (oldSurface->w == surface->w && oldSurface->h == surface->h) {
+            SDL_UnionRect(&dirtyRect, &m_Overlays[type].dirtyRect, &dirtyRect);
+        }
+        else {
+            dirtyRect = { 0, 0, surface->w, surface->h };
+        }
+    }
+    m_Overlays[type].surface = surface;
+    m_Overlays[type].dirtyRect = dirtyRect;
+    SDL_AtomicUnlock(&m_Overlays[type].surfaceLock);
 
     // Free the old surface
     if (oldSurface != nullptr) {
         SDL_FreeSurface(oldSurface);
     }
 
-    if (m_Overlays[type].enabled) {
-        // The _Wrapped variant is required for line breaks to work
-        SDL_Surface* surface = TTF_RenderText_Blended_Wrapped(m_Overlays[type].font,
-                                                              m_Overlays[type].text,
-                                                              m_Overlays[type].color,
-                                                              1024);
-        SDL_AtomicSetPtr((void**)&m_Overlays[type].surface, surface);
-    }
-
     // Notify the renderer
     m_Renderer->notifyOverlayUpdated(type);
 }
@@ -5,6 +5,8 @@
 #include "SDL_compat.h"
 #include <SDL_ttf.h>
 
+#include "glyphatlas.h"
+
 namespace Overlay {
 
 enum OverlayType {
@@ -37,6 +39,7 @@ public:
     SDL_Color getOverlayColor(OverlayType type);
     int getOverlayFontSize(OverlayType type);
     SDL_Surface* getUpdatedOverlaySurface(OverlayType type);
+    SDL_Surface* getUpdatedOverlaySurface(OverlayType type, SDL_Rect* dirtyRect);
 
     void setOverlayRenderer(IOverlayRenderer* renderer);
 
@@ -47,10 +50,15 @@ private:
         bool enabled;
         int fontSize;
         SDL_Color color;
-        char text[512];
+        char text[2048];
 
         TTF_Font* font;
+        GlyphAtlas* glyphAtlas;
+
+        // Guards surface and dirtyRect, which are handed off together
+        SDL_SpinLock surfaceLock;
         SDL_Surface* surface;
+        SDL_Rect dirtyRect;
     } m_Overlays[OverlayMax];
     IOverlayRenderer* m_Renderer;
     QByteArray m_FontData;
@@ -0,0 +1,132 @@
+#include "sliceworkerpool.h"
+
+SliceWorkerPool::SliceWorkerPool(const char* name, int threadCount) :
+    m_Stopping(false),
+    m_Generation(0),
+    m_Function(nullptr),
+    m_Context(nullptr),
+    m_SliceCount(0),
+    m_ActiveWorkers(0)
+{
+    SDL_AtomicSet(&m_NextSlice, 0);
+    SDL_AtomicSet(&m_RemainingSlices, 0);
+
+    for (int i = 1; i < threadCount; i++) {
+        SDL_Thread* thread = SDL_CreateThread(SliceWorkerPool::workerThreadProc, name, this);
+        if (thread == nullptr) {
+            // We can still do the work with fewer threads
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Unable to create slice worker thread: %s",
+                        SDL_GetError());
+            break;
+        }
+
+        m_Threads.append(thread);
+    }
+}
+
+SliceWorkerPool::~SliceWorkerPool()
+{
+    m_Lock.lock();
+    m_Stopping = true;
+    m_WorkAvailable.wakeAll();
+    m_Lock.unlock();
+
+    for (SDL_Thread* thread : m_Threads) {
+        SDL_WaitThread(thread, nullptr);
+    }
+}
+
+int SliceWorkerPool::getThreadCount()
+{
+    return m_Threads.size() + 1;
+}
+
+void SliceWorkerPool::run(SliceFunction function, void* context, int sliceCount)
+{
+    // Don't bother waking the workers if there's nothing to split up
+    if (m_Threads.isEmpty() || sliceCount <= 1) {
+        for (int i = 0; i < sliceCount; i++) {
+            function(context, i, sliceCount);
+        }
+        return;
+    }
+
+    m_Lock.lock();
+
+    // A worker that woke up late for the last job may still be looking
+    // for slices of it, so wait for it before replacing the job.
+    while (m_ActiveWorkers != 0) {
+        m_WorkDone.wait(&m_Lock);
+    }
+
+    m_Function = function;
+    m_Context = context;
+    m_SliceCount = sliceCount;
+    SDL_AtomicSet(&m_NextSlice, 0);
+    SDL_AtomicSet(&m_RemainingSlices, sliceCount);
+    m_Generation++;
+    m_WorkAvailable.wakeAll();
+    m_Lock.unlock();
+
+    processSlices(function, context, sliceCount);
+
+    // Wait for the workers to finish their slices and let go of this job
+    // before the caller can reuse anything that the job references.
+    m_Lock.lock();
+    while (SDL_AtomicGet(&m_RemainingSlices) != 0 || m_ActiveWorkers != 0) {
+        m_WorkDone.wait(&m_Lock);
+    }
+    m_Lock.unlock();
+}
+
+void SliceWorkerPool::processSlices(SliceFunction function, void* context, int sliceCount)
+{
+    for (;;) {
+        int slice = SDL_AtomicAdd(&m_NextSlice, 1);
+        if (slice >= sliceCount) {
+            break;
+        }
+
+        function(context, slice, sliceCount);
+        SDL_AtomicAdd(&m_RemainingSlices, -1);
+    }
+}
+
+int SliceWorkerPool::workerThreadProc(void* context)
+{
+    SliceWorkerPool* me = reinterpret_cast<SliceWorkerPool*>(context);
+    uint32_t lastGeneration = 0;
+
+    // Our callers are on the render path, so don't let us get starved
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+
+    me->m_Lock.lock();
+    for (;;) {
+        while (!me->m_Stopping && me->m_Generation == lastGeneration) {
+            me->m_WorkAvailable.wait(&me->m_Lock);
+        }
+
+        if (me->m_Stopping) {
+            break;
+        }
+
+        // We may have woken up after the caller already finished this job,
+        // in which case there will be no slices left for us.
+        lastGeneration = me->m_Generation;
+        SliceFunction function = me->m_Function;
+        void* jobContext = me->m_Context;
+        int sliceCount = me->m_SliceCount;
+        me->m_ActiveWorkers++;
+        me->m_Lock.unlock();
+
+        me->processSlices(function, jobContext, sliceCount);
+
+        me->m_Lock.lock();
+        me->m_ActiveWorkers--;
+        me->m_WorkDone.wakeAll();
+    }
+    me->m_Lock.unlock();
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "SDL_compat.h"
+
+#include <QMutex>
+#include <QVector>
+#include <QWaitCondition>
+
+// Splits CPU-bound per-frame work (like color conversion or plane copies)
+// into slices that are processed in parallel by a small set of persistent
+// worker threads. The calling thread processes slices too, and run() only
+// returns once every slice is done, so callers can treat it like a plain
+// function call. A pool must only be used by one thread at a time.
+class SliceWorkerPool
+{
+public:
+    typedef void (*SliceFunction)(void* context, int slice, int sliceCount);
+
+    // threadCount includes the calling thread, so 1 creates no workers
+    SliceWorkerPool(const char* name, int threadCount);
+
+    ~SliceWorkerPool();
+
+    // Returns the number of threads that process slices, including the caller
+    int getThreadCount();
+
+    void run(SliceFunction function, void* context, int sliceCount);
+
+private:
+    static int workerThreadProc(void* context);
+
+    void processSlices(SliceFunction function, void* context, int sliceCount);
+
+    QVector<SDL_Thread*> m_Threads;
+    QMutex m_Lock;
+    QWaitCondition m_WorkAvailable;
+    QWaitCondition m_WorkDone;
+    bool m_Stopping;
+
+    // The current job. These are protected by m_Lock, and they're only
+    // changed once all workers have stopped working on the previous job.
+    uint32_t m_Generation;
+    SliceFunction m_Function;
+    void* m_Context;
+    int m_SliceCount;
+    int m_ActiveWorkers;
+
+    SDL_atomic_t m_NextSlice;
+    SDL_atomic_t m_RemainingSlices;
+};
@@ -16,6 +16,12 @@ win32:!winrt {
     app.depends += soundio
 }
 
+# Unit tests and benchmarks are only built when requested
+# with "qmake CONFIG+=tests". Run the tests with "make check".
+tests {
+    SUBDIRS += tests
+}
+
 # Support debug and release builds from command line for CI
 CONFIG += debug_and_release
 
@@ -0,0 +1,439 @@
+#include "benchmarks.h"
+#include "streaming/streamutils.h"
+
+#include <SDL.h>
+
+#include <QMutex>
+#include <QQueue>
+#include <QVector>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+}
+
+// Measures how long each decode unit takes to come out of a real FFmpeg
+// decoder after it arrives, with the decoder thread either blocking for
+// input or polling for it every 2 ms while the decoder has frames in flight.
+// The decoder thread runs the same send/receive loop as the non-pipelined
+// FFmpegVideoDecoder::decoderThreadProc(). Only moonlight-common-c's decode
+// unit queue is replaced by a stand-in, since the benchmark has no host.
+//
+// The test stream is encoded up front with whichever of these encoders
+// this FFmpeg build has, in order of preference.
+static const AVCodecID k_Codecs[] = {
+    AV_CODEC_ID_H264,
+    AV_CODEC_ID_HEVC,
+    AV_CODEC_ID_MPEG4,
+};
+
+#define STREAM_WIDTH 1280
+#define STREAM_HEIGHT 720
+#define STREAM_BITRATE 20000000
+
+// Decode units arrive from the host at a steady 120 FPS
+#define DECODE_UNITS 360
+#define DECODE_UNIT_INTERVAL_US 8333
+
+// The decoder thread's poll interval while it has no input
+#define POLL_INTERVAL_MS 2
+
+// FFmpegVideoDecoder only decodes ahead like this when the user gives it
+// a latency budget with FRAME_THREADING_LATENCY_MS
+#define FRAME_THREADS 3
+
+// Stand-in for moonlight-common-c's decode unit queue, which is a locked
+// queue with an event that LiWaitForNextVideoFrame() blocks on and that
+// LiPollNextVideoFrame() just checks.
+class DecodeUnitQueue
+{
+public:
+    DecodeUnitQueue() :
+        m_Stopped(false)
+    {
+
+    }
+
+    void submit(int index)
+    {
+        m_Lock.lock();
+        m_Queue.enqueue(index);
+        m_Lock.unlock();
+
+        m_NotEmpty.wakeOne();
+    }
+
+    // Like LiPollNextVideoFrame()
+    bool poll(int* index)
+    {
+        bool ret = false;
+
+        m_Lock.lock();
+        if (!m_Queue.isEmpty()) {
+            *index = m_Queue.dequeue();
+            ret = true;
+        }
+        m_Lock.unlock();
+
+        return ret;
+    }
+
+    // Like LiWaitForNextVideoFrame(). Returns false once stopped.
+    bool wait(int* index)
+    {
+        bool ret = false;
+
+        m_Lock.lock();
+        while (!m_Stopped && m_Queue.isEmpty()) {
+            m_NotEmpty.wait(&m_Lock);
+        }
+        if (!m_Queue.isEmpty()) {
+            *index = m_Queue.dequeue();
+            ret = true;
+        }
+        m_Lock.unlock();
+
+        return ret;
+    }
+
+    // Like LiWakeWaitForVideoFrame()
+    void stop()
+    {
+        m_Lock.lock();
+        m_Stopped = true;
+        m_Lock.unlock();
+
+        m_NotEmpty.wakeAll();
+    }
+
+    bool isStopped()
+    {
+        QMutexLocker locker(&m_Lock);
+        return m_Stopped;
+    }
+
+private:
+    QMutex m_Lock;
+    QWaitCondition m_NotEmpty;
+    QQueue<int> m_Queue;
+    bool m_Stopped;
+};
+
+struct DecoderWaitContext
+{
+    DecodeUnitQueue queue;
+    AVCodecContext* decoder;
+    const QVector<AVPacket*>* packets;
+    QVector<uint64_t> arrivalUs;
+    bool outputRequiresInput;
+    int framesIn;
+    int framesOut;
+    bool failed;
+    LatencyHistogram latency;
+    uint32_t wakeups;
+};
+
+static void fillTestFrame(AVFrame* frame, int index)
+{
+    // Scrolling gradients with some noise, so every frame has real motion
+    // and residual to decode rather than being a skipped copy of the last
+    for (int plane = 0; plane < 3; plane++) {
+        int planeWidth = plane == 0 ? frame->width : frame->width / 2;
+        int planeHeight = plane == 0 ? frame->height : frame->height / 2;
+        for (int y = 0; y < planeHeight; y++) {
+            uint8_t* row = frame->data[plane] + frame->linesize[plane] * y;
+            for (int x = 0; x < planeWidth; x++) {
+                row[x] = (uint8_t)(x + y * (plane + 1) + index * 4 + (rand() & 15));
+            }
+        }
+    }
+}
+
+static AVCodecContext* openEncoder(AVCodecID codecId)
+{
+    void* iterator = nullptr;
+    const AVCodec* encoder;
+
+    while ((encoder = av_codec_iterate(&iterator)) != nullptr) {
+        // Hardware encoders need a device we don't set up
+        if (encoder->id != codecId || !av_codec_is_encoder(encoder) ||
+                (encoder->capabilities & AV_CODEC_CAP_HARDWARE)) {
+            continue;
+        }
+
+        AVCodecContext* context = avcodec_alloc_context3(encoder);
+        if (context == nullptr) {
+            continue;
+        }
+
+        // Encode like a streaming host: one IDR frame and no B-frames
+        context->width = STREAM_WIDTH;
+        context->height = STREAM_HEIGHT;
+        context->pix_fmt = AV_PIX_FMT_YUV420P;
+        context->time_base = { 1, 1000000 / DECODE_UNIT_INTERVAL_US };
+        context->framerate = { 1000000 / DECODE_UNIT_INTERVAL_US, 1 };
+        context->bit_rate = STREAM_BITRATE;
+        context->gop_size = DECODE_UNITS;
+        context->max_b_frames = 0;
+
+        // Only some encoders have these options
+        av_opt_set(context->priv_data, "preset", "ultrafast", 0);
+        av_opt_set(context->priv_data, "tune", "zerolatency", 0);
+
+        if (avcodec_open2(context, encoder, nullptr) == 0) {
+            printf("  Test stream: %d frames of %dx%d encoded with %s\n",
+                   DECODE_UNITS, STREAM_WIDTH, STREAM_HEIGHT, encoder->name);
+            return context;
+        }
+
+        avcodec_free_context(&context);
+    }
+
+    return nullptr;
+}
+
+static bool encodeTestStream(AVCodecContext* encoder, QVector<AVPacket*>* packets)
+{
+    AVFrame* frame = av_frame_alloc();
+    if (frame == nullptr) {
+        return false;
+    }
+
+    frame->format = encoder->pix_fmt;
+    frame->width = encoder->width;
+    frame->height = encoder->height;
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        av_frame_free(&frame);
+        return false;
+    }
+
+    srand(1234);
+    for (int i = 0; i <= DECODE_UNITS; i++) {
+        int err;
+
+        // The last pass flushes the encoder
+        if (i < DECODE_UNITS) {
+            if (av_frame_make_writable(frame) < 0) {
+                break;
+            }
+            fillTestFrame(frame, i);
+            frame->pts = i;
+            err = avcodec_send_frame(encoder, frame);
+        }
+        else {
+            err = avcodec_send_frame(encoder, nullptr);
+        }
+
+        if (err < 0) {
+            break;
+        }
+
+        for (;;) {
+            AVPacket* packet = av_packet_alloc();
+            if (packet == nullptr || avcodec_receive_packet(encoder, packet) < 0) {
+                av_packet_free(&packet);
+                break;
+            }
+            packets->append(packet);
+        }
+    }
+
+    av_frame_free(&frame);
+    return packets->size() == DECODE_UNITS;
+}
+
+static void submitDecodeUnit(DecoderWaitContext* ctx, int index)
+{
+    AVPacket* packet = (*ctx->packets)[index];
+
+    // Lets us match each frame back to the decode unit it came from
+    packet->pts = index;
+
+    if (avcodec_send_packet(ctx->decoder, packet) == 0) {
+        ctx->framesIn++;
+    }
+}
+
+// FFmpegVideoDecoder::decoderThreadProc() without the pipelined mode,
+// frame pool, or stats beyond the arrival to output latency
+static int decoderThread(void* context)
+{
+    DecoderWaitContext* ctx = (DecoderWaitContext*)context;
+    AVFrame* frame = av_frame_alloc();
+    int index;
+
+    while (frame != nullptr && !ctx->failed && !ctx->queue.isStopped()) {
+        if (ctx->framesIn == ctx->framesOut) {
+            // Waiting for input. All output frames have been received.
+            if (!ctx->queue.wait(&index)) {
+                continue;
+            }
+
+            submitDecodeUnit(ctx, index);
+        }
+
+        if (ctx->framesIn != ctx->framesOut) {
+            int err;
+            do {
+                err = avcodec_receive_frame(ctx->decoder, frame);
+                if (err == 0) {
+                    uint64_t nowUs = StreamUtils::getMonotonicTimeUs();
+
+                    ctx->framesOut++;
+                    if (frame->pts >= 0 && frame->pts < ctx->arrivalUs.size()) {
+                        ctx->latency.record(nowUs - ctx->arrivalUs[frame->pts]);
+                    }
+                    av_frame_unref(frame);
+                }
+                else if (err == AVERROR(EAGAIN)) {
+                    ctx->wakeups++;
+
+                    if (ctx->outputRequiresInput) {
+                        if (ctx->queue.wait(&index)) {
+                            submitDecodeUnit(ctx, index);
+                        }
+                    }
+                    else if (ctx->queue.poll(&index)) {
+                        submitDecodeUnit(ctx, index);
+                    }
+                    else {
+                        SDL_Delay(POLL_INTERVAL_MS);
+                    }
+                }
+                else {
+                    ctx->failed = true;
+                }
+            } while (err == AVERROR(EAGAIN) && !ctx->queue.isStopped());
+        }
+    }
+
+    av_frame_free(&frame);
+    return 0;
+}
+
+static bool benchmarkDecoderWait(const char* name, const AVCodec* codec,
+                                 const QVector<AVPacket*>& packets,
+                                 bool frameThreading, bool outputRequiresInput)
+{
+    AVCodecContext* decoder = avcodec_alloc_context3(codec);
+    if (decoder == nullptr) {
+        return false;
+    }
+
+    // Same settings FFmpegVideoDecoder uses for software decoding
+    decoder->flags |= AV_CODEC_FLAG_OUTPUT_CORRUPT;
+    decoder->flags2 |= AV_CODEC_FLAG2_SHOW_ALL;
+    decoder->width = STREAM_WIDTH;
+    decoder->height = STREAM_HEIGHT;
+    if (frameThreading) {
+        // FFmpeg won't use frame threading in low delay mode
+        decoder->thread_type = FF_THREAD_SLICE | FF_THREAD_FRAME;
+        decoder->thread_count = FRAME_THREADS;
+    }
+    else {
+        decoder->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        decoder->thread_type = FF_THREAD_SLICE;
+        decoder->thread_count = std::min(SDL_GetCPUCount(), 4);
+    }
+
+    if (avcodec_open2(decoder, codec, nullptr) < 0) {
+        avcodec_free_context(&decoder);
+        return false;
+    }
+
+    DecoderWaitContext* ctx = new DecoderWaitContext();
+    ctx->decoder = decoder;
+    ctx->packets = &packets;
+    ctx->arrivalUs.fill(0, packets.size());
+    ctx->outputRequiresInput = outputRequiresInput;
+    ctx->framesIn = ctx->framesOut = 0;
+    ctx->failed = false;
+    ctx->wakeups = 0;
+    SDL_zero(ctx->latency);
+
+    SDL_Thread* thread = SDL_CreateThread(decoderThread, "BenchDecoder", ctx);
+    if (thread == nullptr) {
+        avcodec_free_context(&decoder);
+        delete ctx;
+        return false;
+    }
+
+    uint64_t startUs = StreamUtils::getMonotonicTimeUs() + 10000;
+    for (int i = 0; i < packets.size(); i++) {
+        sleepUntilUs(startUs + (uint64_t)i * DECODE_UNIT_INTERVAL_US);
+
+        // The queue's lock publishes this to the decoder thread
+        ctx->arrivalUs[i] = StreamUtils::getMonotonicTimeUs();
+        ctx->queue.submit(i);
+    }
+
+    // Give the decoder time to finish the last one. Frames still held
+    // for frame threading never come out, since no input follows them.
+    sleepUntilUs(startUs + (uint64_t)(packets.size() + 1) * DECODE_UNIT_INTERVAL_US);
+    ctx->queue.stop();
+    SDL_WaitThread(thread, nullptr);
+
+    if (frameThreading && !(decoder->active_thread_type & FF_THREAD_FRAME)) {
+        printf("  %-28s (decoder isn't using frame threads)\n", name);
+    }
+    else if (ctx->failed) {
+        printf("  %-28s (decoding failed)\n", name);
+    }
+    else {
+        printLatencyPercentiles(name, ctx->latency);
+        printf("  %-28s %.1f EAGAIN wakeups per frame\n", "",
+               ctx->latency.count > 0 ? (double)ctx->wakeups / ctx->latency.count : 0.0);
+    }
+
+    avcodec_free_context(&decoder);
+    delete ctx;
+    return true;
+}
+
+bool benchmarkDecoderWait()
+{
+    AVCodecContext* encoder = nullptr;
+    const AVCodec* decoder = nullptr;
+    for (AVCodecID codecId : k_Codecs) {
+        decoder = avcodec_find_decoder(codecId);
+        if (decoder != nullptr) {
+            encoder = openEncoder(codecId);
+            if (encoder != nullptr) {
+                break;
+            }
+        }
+    }
+
+    if (encoder == nullptr) {
+        return false;
+    }
+
+    QVector<AVPacket*> packets;
+    bool encoded = encodeTestStream(encoder, &packets);
+    avcodec_free_context(&encoder);
+
+    bool ret = false;
+    if (encoded) {
+        printf(" Decode unit arrival to output from %s (one unit every %d us):\n",
+               decoder->name, DECODE_UNIT_INTERVAL_US);
+
+        // Without frame threading, every frame comes out of its own
+        // avcodec_send_packet(), so the decoder thread always blocks
+        // in the outer wait and both modes should match.
+        ret = benchmarkDecoderWait("slice threads, blocking", decoder, packets, false, true) &&
+              benchmarkDecoderWait("slice threads, polling", decoder, packets, false, false) &&
+              benchmarkDecoderWait("frame threads, blocking", decoder, packets, true, true) &&
+              benchmarkDecoderWait("frame threads, polling", decoder, packets, true, false);
+    }
+
+    for (AVPacket* packet : packets) {
+        av_packet_free(&packet);
+    }
+
+    return ret;
+}
@@ -0,0 +1,231 @@
+#include "benchmarks.h"
+#include "streaming/streamutils.h"
+#include "streaming/video/ffmpeg-renderers/pacer/framering.h"
+
+#include <QQueue>
+
+// Same depth as the Pacer's queues
+#define QUEUE_CAPACITY 4
+
+// Frames handed from a producer to a blocked consumer, like the decoder
+// thread feeding the Pacer's V-sync thread
+#define HANDOFF_FRAMES 5000
+#define HANDOFF_INTERVAL_US 500
+
+// Enqueue and dequeue pairs on a single thread, which is the cost the
+// decoder and render threads pay on every frame when nobody is waiting
+#define UNCONTENDED_OPERATIONS 5000000
+
+// Enough frames that the producer never reuses one the consumer is reading
+#define FRAME_COUNT 64
+
+// The Pacer's queues before they became lock-free rings: a QQueue and a
+// condition variable guarded by one QMutex.
+class MutexFrameQueue
+{
+public:
+    MutexFrameQueue() :
+        m_Interrupted(false)
+    {
+
+    }
+
+    bool enqueue(AVFrame* frame)
+    {
+        m_Lock.lock();
+        if (m_Queue.size() == QUEUE_CAPACITY) {
+            m_Lock.unlock();
+            return false;
+        }
+        m_Queue.enqueue(frame);
+        m_Lock.unlock();
+
+        m_NotEmpty.wakeOne();
+        return true;
+    }
+
+    AVFrame* dequeue()
+    {
+        AVFrame* frame = nullptr;
+
+        m_Lock.lock();
+        if (!m_Queue.isEmpty()) {
+            frame = m_Queue.dequeue();
+        }
+        m_Lock.unlock();
+
+        return frame;
+    }
+
+    AVFrame* waitAndDequeue()
+    {
+        AVFrame* frame = nullptr;
+
+        m_Lock.lock();
+        while (!m_Interrupted && m_Queue.isEmpty()) {
+            m_NotEmpty.wait(&m_Lock);
+        }
+        if (!m_Queue.isEmpty()) {
+            frame = m_Queue.dequeue();
+        }
+        m_Lock.unlock();
+
+        return frame;
+    }
+
+    void interrupt()
+    {
+        m_Lock.lock();
+        m_Interrupted = true;
+        m_Lock.unlock();
+
+        m_NotEmpty.wakeAll();
+    }
+
+private:
+    QMutex m_Lock;
+    QWaitCondition m_NotEmpty;
+    QQueue<AVFrame*> m_Queue;
+    bool m_Interrupted;
+};
+
+class RingFrameQueue
+{
+public:
+    bool enqueue(AVFrame* frame)
+    {
+        return m_Ring.enqueue(frame);
+    }
+
+    AVFrame* dequeue()
+    {
+        return m_Ring.dequeue();
+    }
+
+    AVFrame* waitAndDequeue()
+    {
+        // The wait can return early on a spurious wakeup, so only give up
+        // without a frame once we've been interrupted
+        for (;;) {
+            AVFrame* frame = m_Ring.dequeue();
+            if (frame != nullptr || m_Ring.isInterrupted()) {
+                return frame;
+            }
+
+            m_Ring.waitForFrame(-1);
+        }
+    }
+
+    void interrupt()
+    {
+        m_Ring.interrupt();
+    }
+
+private:
+    FrameRing<QUEUE_CAPACITY> m_Ring;
+};
+
+template <typename Queue>
+struct HandoffContext
+{
+    Queue queue;
+    LatencyHistogram latency;
+};
+
+template <typename Queue>
+static int handoffConsumerThread(void* context)
+{
+    HandoffContext<Queue>* ctx = (HandoffContext<Queue>*)context;
+
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+
+    AVFrame* frame;
+    while ((frame = ctx->queue.waitAndDequeue()) != nullptr) {
+        // The producer stored the time it enqueued the frame in pkt_dts
+        ctx->latency.record(StreamUtils::getMonotonicTimeUs() - frame->pkt_dts);
+    }
+
+    return 0;
+}
+
+template <typename Queue>
+static void benchmarkHandoff(const char* name, AVFrame** frames)
+{
+    HandoffContext<Queue>* ctx = new HandoffContext<Queue>();
+    SDL_zero(ctx->latency);
+
+    SDL_Thread* consumer = SDL_CreateThread(handoffConsumerThread<Queue>, "BenchConsumer", ctx);
+
+    int overflows = 0;
+    uint64_t startUs = StreamUtils::getMonotonicTimeUs() + 10000;
+    for (int i = 0; i < HANDOFF_FRAMES; i++) {
+        sleepUntilUs(startUs + (uint64_t)i * HANDOFF_INTERVAL_US);
+
+        AVFrame* frame = frames[i % FRAME_COUNT];
+        frame->pkt_dts = (int64_t)StreamUtils::getMonotonicTimeUs();
+        if (!ctx->queue.enqueue(frame)) {
+            overflows++;
+        }
+    }
+
+    // Let the consumer drain what's left before we stop it
+    SDL_Delay(10);
+    ctx->queue.interrupt();
+    SDL_WaitThread(consumer, nullptr);
+
+    // Leave nothing behind for the ring's destructor to complain about
+    while (ctx->queue.dequeue() != nullptr);
+
+    printLatencyPercentiles(name, ctx->latency);
+    if (overflows > 0) {
+        printf("  %-28s %d frames overflowed the queue\n", "", overflows);
+    }
+
+    delete ctx;
+}
+
+template <typename Queue>
+static void benchmarkUncontended(const char* name, AVFrame** frames)
+{
+    Queue* queue = new Queue();
+
+    uint64_t startUs = StreamUtils::getMonotonicTimeUs();
+    for (int i = 0; i < UNCONTENDED_OPERATIONS; i++) {
+        queue->enqueue(frames[i % FRAME_COUNT]);
+        queue->dequeue();
+    }
+    uint64_t elapsedUs = StreamUtils::getMonotonicTimeUs() - startUs;
+
+    printTimePerOperation(name, elapsedUs, UNCONTENDED_OPERATIONS * 2ULL);
+
+    delete queue;
+}
+
+bool benchmarkFrameQueues()
+{
+    AVFrame* frames[FRAME_COUNT];
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        frames[i] = av_frame_alloc();
+        if (frames[i] == nullptr) {
+            while (--i >= 0) {
+                av_frame_free(&frames[i]);
+            }
+            return false;
+        }
+    }
+
+    printf(" Enqueue-to-dequeue latency with a blocked consumer (%d frames, one every %d us):\n",
+           HANDOFF_FRAMES, HANDOFF_INTERVAL_US);
+    benchmarkHandoff<RingFrameQueue>("lock-free ring", frames);
+    benchmarkHandoff<MutexFrameQueue>("mutex queue", frames);
+
+    printf(" Uncontended enqueue and dequeue on one thread:\n");
+    benchmarkUncontended<RingFrameQueue>("lock-free ring", frames);
+    benchmarkUncontended<MutexFrameQueue>("mutex queue", frames);
+
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        av_frame_free(&frames[i]);
+    }
+
+    return true;
+}
@@ -0,0 +1,239 @@
+#include "benchmarks.h"
+#include "streaming/streamutils.h"
+#include "streaming/video/ffmpeg-renderers/swframeuploader.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+extern "C" {
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+
+#define WARMUP_ITERATIONS 5
+
+// Texture rows are usually padded differently than frame rows, which is
+// what keeps SdlRenderer from copying whole planes with one memcpy().
+#define TEXTURE_PITCH_PADDING 64
+
+static const struct {
+    int width;
+    int height;
+    int iterations;
+} k_Resolutions[] = {
+    { 1920, 1080, 120 },
+    { 3840, 2160, 30 },
+};
+
+static AVFrame* allocateTestFrame(AVPixelFormat format, int width, int height)
+{
+    AVFrame* frame = av_frame_alloc();
+    if (frame == nullptr) {
+        return nullptr;
+    }
+
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    // Gradients with some noise, so nothing compresses into a trivial case
+    srand(1234);
+    for (int plane = 0; plane < AV_NUM_DATA_POINTERS && frame->data[plane] != nullptr; plane++) {
+        int planeHeight = (format == AV_PIX_FMT_NV12 && plane > 0) ? height / 2 : height;
+        for (int y = 0; y < planeHeight; y++) {
+            uint8_t* row = frame->data[plane] + frame->linesize[plane] * y;
+            for (int x = 0; x < frame->linesize[plane]; x++) {
+                row[x] = (uint8_t)(x + y * (plane + 1) + (rand() & 15));
+            }
+        }
+    }
+
+    return frame;
+}
+
+// Sets up swscale the same way SdlRenderer does
+static SwsContext* createSwsContext(const AVFrame* src, const AVFrame* dst)
+{
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+    SwsContext* context = sws_alloc_context();
+    if (context == nullptr) {
+        return nullptr;
+    }
+
+    AVDictionary *options { nullptr };
+    av_dict_set_int(&options, "srcw", src->width, 0);
+    av_dict_set_int(&options, "srch", src->height, 0);
+    av_dict_set_int(&options, "src_format", src->format, 0);
+    av_dict_set_int(&options, "dstw", dst->width, 0);
+    av_dict_set_int(&options, "dsth", dst->height, 0);
+    av_dict_set_int(&options, "dst_format", dst->format, 0);
+    av_dict_set_int(&options, "threads", std::min(SDL_GetCPUCount(), 4), 0);
+
+    int err = av_opt_set_dict(context, &options);
+    av_dict_free(&options);
+    if (err < 0 || sws_init_context(context, nullptr, nullptr) < 0) {
+        sws_freeContext(context);
+        return nullptr;
+    }
+
+    return context;
+#else
+    return sws_getContext(src->width, src->height, (AVPixelFormat)src->format,
+                          dst->width, dst->height, (AVPixelFormat)dst->format,
+                          0, nullptr, nullptr, nullptr);
+#endif
+}
+
+static bool convertWithSwscale(SwsContext* context, AVFrame* dst, const AVFrame* src)
+{
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+    return sws_scale_frame(context, dst, src) >= 0;
+#else
+    return sws_scale(context, src->data, src->linesize, 0, src->height,
+                     dst->data, dst->linesize) >= 0;
+#endif
+}
+
+// SdlRenderer's NV12 lock fallback before SwFrameUploader
+static void copyNv12Rows(const AVFrame* frame, uint8_t* pixels, int pitch)
+{
+    int lumaWidth = SDL_min(frame->linesize[0], pitch);
+    for (int i = 0; i < frame->height; i++) {
+        memcpy(pixels + pitch * i, frame->data[0] + frame->linesize[0] * i, lumaWidth);
+    }
+
+    int chromaWidth = SDL_min(frame->linesize[1], pitch);
+    for (int i = 0; i < frame->height / 2; i++) {
+        memcpy(pixels + pitch * (frame->height + i), frame->data[1] + frame->linesize[1] * i, chromaWidth);
+    }
+}
+
+// Times each iteration of the upload and prints the per-frame distribution
+template <typename Upload>
+static void timeUpload(const char* name, int iterations, Upload upload)
+{
+    LatencyHistogram frameTime;
+    SDL_zero(frameTime);
+
+    for (int i = 0; i < WARMUP_ITERATIONS; i++) {
+        upload();
+    }
+
+    for (int i = 0; i < iterations; i++) {
+        uint64_t startUs = StreamUtils::getMonotonicTimeUs();
+        upload();
+        frameTime.record(StreamUtils::getMonotonicTimeUs() - startUs);
+    }
+
+    printLatencyPercentiles(name, frameTime);
+}
+
+// Largest difference in any color channel between two XRGB8888 images
+static int getMaxChannelDifference(const uint8_t* a, const uint8_t* b, int pitchA, int pitchB,
+                                   int width, int height)
+{
+    int maxDifference = 0;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            for (int channel = 0; channel < 3; channel++) {
+                maxDifference = SDL_max(maxDifference,
+                                        abs(a[pitchA * y + x * 4 + channel] - b[pitchB * y + x * 4 + channel]));
+            }
+        }
+    }
+
+    return maxDifference;
+}
+
+static bool benchmarkXrgbConversion(int width, int height, int iterations)
+{
+    AVFrame* src = allocateTestFrame(AV_PIX_FMT_YUV444P, width, height);
+    AVFrame* dst = av_frame_alloc();
+    if (src == nullptr || dst == nullptr) {
+        av_frame_free(&src);
+        av_frame_free(&dst);
+        return false;
+    }
+
+    // SdlRenderer asks swscale for BGR0, which is XRGB8888 in memory. Each
+    // converter gets its own output so we can compare them afterwards.
+    dst->format = AV_PIX_FMT_BGR0;
+    dst->width = width;
+    dst->height = height;
+    SwsContext* swsContext = createSwsContext(src, dst);
+
+    int pitch = width * 4;
+    uint8_t* pixels = (uint8_t*)av_malloc(pitch * height);
+
+    // We don't set a colorspace for swscale, so it uses its Rec 601 default
+    SwFrameUploader uploader;
+    bool ok = swsContext != nullptr && pixels != nullptr &&
+              av_frame_get_buffer(dst, 0) >= 0 &&
+              uploader.initializeXrgbConversion(src, COLORSPACE_REC_601, false);
+
+    if (ok) {
+        printf(" YUV 4:4:4 to XRGB8888 at %dx%d (%d iterations):\n", width, height, iterations);
+
+        timeUpload("SwFrameUploader", iterations, [&]() {
+            uploader.convertToXrgb(src, pixels, pitch);
+        });
+        timeUpload("swscale", iterations, [&]() {
+            ok = convertWithSwscale(swsContext, dst, src) && ok;
+        });
+
+        if (ok) {
+            printf("  %-28s max channel difference: %d\n", "",
+                   getMaxChannelDifference(pixels, dst->data[0], pitch, dst->linesize[0], width, height));
+        }
+    }
+
+    av_free(pixels);
+    sws_freeContext(swsContext);
+    av_frame_free(&dst);
+    av_frame_free(&src);
+    return ok;
+}
+
+static bool benchmarkNv12Copy(int width, int height, int iterations)
+{
+    AVFrame* src = allocateTestFrame(AV_PIX_FMT_NV12, width, height);
+    int pitch = width + TEXTURE_PITCH_PADDING;
+    uint8_t* pixels = (uint8_t*)av_malloc(pitch * (height + height / 2));
+    if (src == nullptr || pixels == nullptr) {
+        av_frame_free(&src);
+        av_free(pixels);
+        return false;
+    }
+
+    printf(" NV12 copy into a texture with a different pitch at %dx%d (%d iterations):\n",
+           width, height, iterations);
+
+    SwFrameUploader uploader;
+    timeUpload("SwFrameUploader", iterations, [&]() {
+        uploader.copyNv12(src, pixels, pitch);
+    });
+    timeUpload("single-threaded row copy", iterations, [&]() {
+        copyNv12Rows(src, pixels, pitch);
+    });
+
+    av_free(pixels);
+    av_frame_free(&src);
+    return true;
+}
+
+bool benchmarkFrameUpload()
+{
+    for (const auto& resolution : k_Resolutions) {
+        if (!benchmarkXrgbConversion(resolution.width, resolution.height, resolution.iterations) ||
+                !benchmarkNv12Copy(resolution.width, resolution.height, resolution.iterations)) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "streaming/video/latencyhistogram.h"
+
+#include <stdint.h>
+
+// Each benchmark prints its own results. It returns false if it
+// couldn't run on this machine.
+typedef bool (*BenchmarkFunction)();
+
+bool benchmarkDecoderWait();
+
+bool benchmarkFrameQueues();
+
+bool benchmarkFrameUpload();
+
+// Sleeps until the given time on the StreamUtils monotonic clock
+void sleepUntilUs(uint64_t timeUs);
+
+// Prints one line of latency percentiles in microseconds
+void printLatencyPercentiles(const char* name, const LatencyHistogram& histogram);
+
+// Prints one line with the average time per operation
+void printTimePerOperation(const char* name, uint64_t elapsedUs, uint64_t operations);
@@ -0,0 +1,26 @@
+include(../tests.pri)
+
+TARGET = benchmarks
+
+SOURCES += \
+    main.cpp \
+    bench_decoderwait.cpp \
+    bench_framequeue.cpp \
+    bench_frameupload.cpp \
+    $$APP_DIR/streaming/streamutils.cpp \
+    $$APP_DIR/streaming/video/sliceworkerpool.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/swframeuploader.cpp
+
+HEADERS += \
+    benchmarks.h
+
+# The frame upload benchmark compares against swscale
+win32 {
+    LIBS += -lswscale
+}
+macx:!disable-prebuilts {
+    LIBS += -lswscale.8
+}
+unix:if(!macx|disable-prebuilts) {
+    PKGCONFIG += libswscale
+}
@@ -0,0 +1,78 @@
+#include "benchmarks.h"
+#include "streaming/streamutils.h"
+
+#include <SDL.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+static const struct {
+    const char* name;
+    const char* description;
+    BenchmarkFunction function;
+} k_Benchmarks[] = {
+    { "decoderwait", "Decoder thread input wait: blocking vs. polling with a real FFmpeg decoder", benchmarkDecoderWait },
+    { "framequeue", "Pacer frame queue: lock-free ring vs. mutex-guarded queue", benchmarkFrameQueues },
+    { "frameupload", "Software frame upload: SwFrameUploader vs. swscale and row copies", benchmarkFrameUpload },
+};
+
+void sleepUntilUs(uint64_t timeUs)
+{
+    uint64_t nowUs = StreamUtils::getMonotonicTimeUs();
+    if (nowUs < timeUs) {
+        // SDL_Delay() only has millisecond precision
+        std::this_thread::sleep_for(std::chrono::microseconds(timeUs - nowUs));
+    }
+}
+
+void printLatencyPercentiles(const char* name, const LatencyHistogram& histogram)
+{
+    printf("  %-28s p50/p90/p99/p99.9: %u/%u/%u/%u us (%u samples)\n",
+           name,
+           histogram.getPercentile(50),
+           histogram.getPercentile(90),
+           histogram.getPercentile(99),
+           histogram.getPercentile(99.9),
+           histogram.count);
+    fflush(stdout);
+}
+
+void printTimePerOperation(const char* name, uint64_t elapsedUs, uint64_t operations)
+{
+    printf("  %-28s %.1f ns/op (%llu ops in %.2f s)\n",
+           name,
+           operations > 0 ? elapsedUs * 1000.0 / operations : 0.0,
+           (unsigned long long)operations,
+           elapsedUs / 1000000.0);
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[])
+{
+    SDL_SetMainReady();
+
+    // Run every benchmark unless some are named on the command line
+    for (const auto& benchmark : k_Benchmarks) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], benchmark.name) == 0) {
+                selected = true;
+            }
+        }
+
+        if (!selected) {
+            continue;
+        }
+
+        printf("%s: %s\n", benchmark.name, benchmark.description);
+        fflush(stdout);
+
+        if (!benchmark.function()) {
+            printf("  (not supported on this machine)\n");
+        }
+    }
+
+    return 0;
+}
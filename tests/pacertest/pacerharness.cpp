@@ -0,0 +1,501 @@
+#include "pacerharness.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+// Let queued frames drain after the last one arrives
+#define DRAIN_TIME_US 100000
+
+namespace {
+
+// A display with a perfectly regular V-sync starting at time 0
+class VsyncTimeline
+{
+public:
+    VsyncTimeline(double periodUs) :
+        m_PeriodUs(periodUs)
+    {
+
+    }
+
+    uint64_t getVsyncTimeUs(int64_t index) const
+    {
+        return (uint64_t)llround(index * m_PeriodUs);
+    }
+
+    // Index of the first V-sync after the given time
+    int64_t getNextVsyncIndex(uint64_t timeUs) const
+    {
+        int64_t index = (int64_t)(timeUs / m_PeriodUs) + 1;
+
+        // Correct for rounding in getVsyncTimeUs()
+        while (index > 0 && getVsyncTimeUs(index - 1) > timeUs) {
+            index--;
+        }
+        while (getVsyncTimeUs(index) <= timeUs) {
+            index++;
+        }
+
+        return index;
+    }
+
+private:
+    double m_PeriodUs;
+};
+
+// Virtual time for a single run. Waiting moves time forward immediately and
+// submits any frames from the trace that arrive in the meantime, exactly as
+// the decoder would have while the Pacer was blocked.
+class PacerSimulation : public IPacerClock
+{
+public:
+    PacerSimulation(const FrameTrace& trace, FramePool* framePool) :
+        m_Trace(trace),
+        m_FramePool(framePool),
+        m_Pacer(nullptr),
+        m_NowUs(0),
+        m_NextFrameIndex(0)
+    {
+
+    }
+
+    void setPacer(Pacer* pacer)
+    {
+        m_Pacer = pacer;
+    }
+
+    virtual uint64_t getTimeUs() override
+    {
+        return m_NowUs;
+    }
+
+    virtual void delay(int ms) override
+    {
+        advanceTo(m_NowUs + ms * 1000ULL);
+    }
+
+    virtual bool waitForFrame(FrameRing<MAX_QUEUED_FRAMES>& queue, int timeoutMs) override
+    {
+        while (queue.isEmpty()) {
+            if (m_NextFrameIndex == m_Trace.getFrameCount()) {
+                // Nothing else is coming. An unbounded wait returns right
+                // away rather than hanging the run.
+                if (timeoutMs >= 0) {
+                    m_NowUs += timeoutMs * 1000ULL;
+                }
+                return false;
+            }
+
+            uint64_t arrivalTimeUs = m_Trace.getArrivalTimeUs(m_NextFrameIndex);
+            if (timeoutMs >= 0 && arrivalTimeUs > m_NowUs + timeoutMs * 1000ULL) {
+                m_NowUs += timeoutMs * 1000ULL;
+                return false;
+            }
+
+            submitNextFrame();
+        }
+
+        return true;
+    }
+
+    // Submits every frame that arrives up to the given time
+    void advanceTo(uint64_t timeUs)
+    {
+        while (m_NextFrameIndex < m_Trace.getFrameCount() &&
+               m_Trace.getArrivalTimeUs(m_NextFrameIndex) <= timeUs) {
+            submitNextFrame();
+        }
+
+        m_NowUs = SDL_max(m_NowUs, timeUs);
+    }
+
+    // Times that frames were actually submitted, which are later than they
+    // arrived in the trace if the Pacer was busy at the time
+    const std::vector<uint64_t>& getSubmitTimesUs() const
+    {
+        return m_SubmitTimesUs;
+    }
+
+private:
+    void submitNextFrame()
+    {
+        m_NowUs = SDL_max(m_NowUs, m_Trace.getArrivalTimeUs(m_NextFrameIndex));
+
+        AVFrame* frame = m_FramePool->acquire();
+        frame->pts = m_NextFrameIndex++;
+        m_SubmitTimesUs.push_back(m_NowUs);
+        m_Pacer->submitFrame(frame);
+    }
+
+    const FrameTrace& m_Trace;
+    FramePool* m_FramePool;
+    Pacer* m_Pacer;
+    uint64_t m_NowUs;
+    int m_NextFrameIndex;
+    std::vector<uint64_t> m_SubmitTimesUs;
+};
+
+// The simulation calls handleVsync() itself, so this only gives the
+// Pacer a V-sync source to pace against.
+class SimulatedVsyncSource : public IVsyncSource
+{
+public:
+    virtual bool initialize(SDL_Window*, int) override
+    {
+        return true;
+    }
+
+    virtual bool isAsync() override
+    {
+        return true;
+    }
+};
+
+// Renderer that draws nothing but takes a fixed time to do it, and records
+// which V-sync each frame would have been scanned out at. Like a FIFO
+// swapchain with a single back buffer, it presents at the first V-sync after
+// the render that isn't already taken, and it can't start the next render
+// until that V-sync.
+class NullRenderer : public IFFmpegRenderer
+{
+public:
+    NullRenderer(PacerSimulation* simulation, const VsyncTimeline* timeline, int renderTimeUs) :
+        IFFmpegRenderer(RendererType::Unknown),
+        m_Simulation(simulation),
+        m_Timeline(timeline),
+        m_RenderTimeUs(renderTimeUs),
+        m_LastVsyncIndex(-1)
+    {
+
+    }
+
+    virtual bool initialize(PDECODER_PARAMETERS) override
+    {
+        return true;
+    }
+
+    virtual bool prepareDecoderContext(AVCodecContext*, AVDictionary**) override
+    {
+        return true;
+    }
+
+    virtual void renderFrame(AVFrame* frame) override
+    {
+        // Wait for our back buffer to be scanned out
+        if (m_LastVsyncIndex >= 0) {
+            m_Simulation->advanceTo(m_Timeline->getVsyncTimeUs(m_LastVsyncIndex));
+        }
+
+        PRESENT_RECORD record;
+        record.frameIndex = frame->pts;
+        record.submitTimeUs = m_Simulation->getSubmitTimesUs()[frame->pts];
+        record.renderTimeUs = m_Simulation->getTimeUs();
+
+        m_Simulation->advanceTo(record.renderTimeUs + m_RenderTimeUs);
+
+        m_LastVsyncIndex = SDL_max(m_Timeline->getNextVsyncIndex(m_Simulation->getTimeUs()),
+                                   m_LastVsyncIndex + 1);
+        record.vsyncIndex = m_LastVsyncIndex;
+        m_Presents.push_back(record);
+    }
+
+    const std::vector<PRESENT_RECORD>& getPresents() const
+    {
+        return m_Presents;
+    }
+
+private:
+    PacerSimulation* m_Simulation;
+    const VsyncTimeline* m_Timeline;
+    int m_RenderTimeUs;
+    int64_t m_LastVsyncIndex;
+    std::vector<PRESENT_RECORD> m_Presents;
+};
+
+}
+
+FrameTrace::FrameTrace(double fps) :
+    m_Fps(fps)
+{
+
+}
+
+FrameTrace FrameTrace::steady(double fps, int durationMs, int phaseUs)
+{
+    FrameTrace trace(fps);
+    int frameCount = (int)(durationMs * fps / 1000);
+
+    for (int i = 0; i < frameCount; i++) {
+        trace.m_ArrivalTimesUs.push_back((uint64_t)llround(phaseUs + i * 1000000.0 / fps));
+    }
+
+    return trace;
+}
+
+FrameTrace FrameTrace::jittery(double fps, int durationMs, int phaseUs, int jitterUs, unsigned int seed)
+{
+    FrameTrace trace = steady(fps, durationMs, phaseUs);
+
+    // The standard library's distributions differ between implementations,
+    // but mt19937 itself doesn't, so this gives the same trace everywhere.
+    std::mt19937 rng(seed);
+
+    int64_t lastArrivalUs = 0;
+    for (uint64_t& arrivalUs : trace.m_ArrivalTimesUs) {
+        int jitter = (int)(rng() % (2 * jitterUs + 1)) - jitterUs;
+        lastArrivalUs = SDL_max((int64_t)arrivalUs + jitter, lastArrivalUs);
+        arrivalUs = (uint64_t)lastArrivalUs;
+    }
+
+    return trace;
+}
+
+FrameTrace FrameTrace::stalled(double fps, int durationMs, int phaseUs, int stallStartMs, int stallMs)
+{
+    FrameTrace trace = steady(fps, durationMs, phaseUs);
+    uint64_t stallStartUs = stallStartMs * 1000ULL;
+    uint64_t stallEndUs = stallStartUs + stallMs * 1000ULL;
+
+    for (uint64_t& arrivalUs : trace.m_ArrivalTimesUs) {
+        if (arrivalUs >= stallStartUs && arrivalUs < stallEndUs) {
+            arrivalUs = stallEndUs;
+        }
+    }
+
+    return trace;
+}
+
+bool FrameTrace::load(const char* path, int phaseUs, FrameTrace* trace)
+{
+    FILE* file = fopen(path, "r");
+    if (file == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to open frame trace %s: %s",
+                     path, strerror(errno));
+        return false;
+    }
+
+    FrameTrace loadedTrace(0);
+    bool ok = true;
+    int lineNumber = 0;
+    char line[256];
+    while (ok && fgets(line, sizeof(line), file) != nullptr) {
+        lineNumber++;
+
+        char* value = line + strspn(line, " \t");
+        if (*value == '#' || *value == '\r' || *value == '\n' || *value == '\0') {
+            continue;
+        }
+
+        char* end;
+        if (loadedTrace.m_Fps == 0) {
+            ok = strncmp(value, "fps", 3) == 0;
+            if (ok) {
+                loadedTrace.m_Fps = strtod(value + 3, &end);
+                ok = end != value + 3 && loadedTrace.m_Fps > 0;
+            }
+        }
+        else {
+            uint64_t arrivalUs = strtoull(value, &end, 10);
+            ok = end != value &&
+                    (loadedTrace.m_ArrivalTimesUs.empty() || arrivalUs >= loadedTrace.m_ArrivalTimesUs.back());
+            loadedTrace.m_ArrivalTimesUs.push_back(arrivalUs);
+        }
+
+        ok = ok && (*end == '\0' || strspn(end, " \t\r\n") == strlen(end));
+    }
+
+    fclose(file);
+
+    if (!ok) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Invalid frame trace %s at line %d",
+                     path, lineNumber);
+        return false;
+    }
+    else if (loadedTrace.m_ArrivalTimesUs.empty()) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Frame trace %s has no frames",
+                     path);
+        return false;
+    }
+
+    uint64_t firstArrivalUs = loadedTrace.m_ArrivalTimesUs.front();
+    for (uint64_t& arrivalUs : loadedTrace.m_ArrivalTimesUs) {
+        arrivalUs = arrivalUs - firstArrivalUs + phaseUs;
+    }
+
+    *trace = loadedTrace;
+    return true;
+}
+
+bool FrameTrace::save(const char* path) const
+{
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) {
+        return false;
+    }
+
+    fprintf(file, "# Frame arrival times in microseconds\n");
+    fprintf(file, "fps %g\n", m_Fps);
+    for (uint64_t arrivalUs : m_ArrivalTimesUs) {
+        fprintf(file, "%llu\n", (unsigned long long)arrivalUs);
+    }
+
+    return fclose(file) == 0;
+}
+
+int FrameTrace::getFrameCount() const
+{
+    return (int)m_ArrivalTimesUs.size();
+}
+
+uint64_t FrameTrace::getArrivalTimeUs(int frameIndex) const
+{
+    return m_ArrivalTimesUs[frameIndex];
+}
+
+uint64_t FrameTrace::getDurationUs() const
+{
+    return m_ArrivalTimesUs.empty() ? 0 : m_ArrivalTimesUs.back();
+}
+
+double FrameTrace::getFps() const
+{
+    return m_Fps;
+}
+
+double PacerRunResult::getDropRate() const
+{
+    return submittedFrames > 0 ? (double)stats.pacerDroppedFrames / submittedFrames : 0;
+}
+
+uint64_t PacerRunResult::getQueueDelayPercentileUs(double percentile) const
+{
+    if (presents.empty()) {
+        return 0;
+    }
+
+    std::vector<uint64_t> delaysUs;
+    for (const PRESENT_RECORD& present : presents) {
+        delaysUs.push_back(present.renderTimeUs - present.submitTimeUs);
+    }
+    std::sort(delaysUs.begin(), delaysUs.end());
+
+    size_t rank = (size_t)ceil(percentile / 100 * delaysUs.size());
+    return delaysUs[SDL_max(rank, (size_t)1) - 1];
+}
+
+double PacerRunResult::getJudderMs() const
+{
+    if (presents.size() < 2) {
+        return 0;
+    }
+
+    double totalSquaredErrorMs = 0;
+    for (size_t i = 1; i < presents.size(); i++) {
+        double onScreenMs = (presents[i].vsyncIndex - presents[i - 1].vsyncIndex) * vsyncPeriodUs / 1000;
+        double streamTimeMs = (presents[i].frameIndex - presents[i - 1].frameIndex) * 1000 / fps;
+        totalSquaredErrorMs += (onScreenMs - streamTimeMs) * (onScreenMs - streamTimeMs);
+    }
+
+    return sqrt(totalSquaredErrorMs / (presents.size() - 1));
+}
+
+int PacerRunResult::getRepeatedVsyncs() const
+{
+    int repeatedVsyncs = 0;
+
+    for (size_t i = 1; i < presents.size(); i++) {
+        repeatedVsyncs += (int)(presents[i].vsyncIndex - presents[i - 1].vsyncIndex - 1);
+    }
+
+    return repeatedVsyncs;
+}
+
+void PacerRunResult::print(const char* name) const
+{
+    printf("%-45s drops: %5.1f%% (%u pacing, %u latch, %u render, %u overflow) | "
+           "queue delay p50/p90/p99: %.1f/%.1f/%.1f ms | judder: %.2f ms (%d repeats)\n",
+           name,
+           getDropRate() * 100,
+           stats.pacingQueueDroppedFrames,
+           stats.latchDroppedFrames,
+           stats.renderQueueDroppedFrames,
+           stats.overflowDroppedFrames,
+           getQueueDelayPercentileUs(50) / 1000.0,
+           getQueueDelayPercentileUs(90) / 1000.0,
+           getQueueDelayPercentileUs(99) / 1000.0,
+           getJudderMs(),
+           getRepeatedVsyncs());
+    fflush(stdout);
+}
+
+PacerRunResult runPacerTrace(const FrameTrace& trace, double displayHz,
+                             StreamingPreferences::FrameDropPolicy policy,
+                             int renderTimeUs)
+{
+    PacerRunResult result;
+    result.submittedFrames = trace.getFrameCount();
+    result.fps = trace.getFps();
+    result.vsyncPeriodUs = 1000000.0 / displayHz;
+    SDL_zero(result.stats);
+
+    // Enough frames for both queues plus the ones in flight
+    FramePool framePool;
+    framePool.setCapacity(MAX_QUEUED_FRAMES * 2 + 2);
+
+    VsyncTimeline timeline(result.vsyncPeriodUs);
+    PacerSimulation simulation(trace, &framePool);
+    NullRenderer renderer(&simulation, &timeline, renderTimeUs);
+
+    {
+        Pacer pacer(&renderer, &result.stats, &framePool, &simulation);
+        simulation.setPacer(&pacer);
+        if (!pacer.initialize(new SimulatedVsyncSource(), (int)lround(displayHz),
+                              (int)lround(trace.getFps()), policy)) {
+            result.submittedFrames = 0;
+            return result;
+        }
+
+        int64_t vsyncIndex = 0;
+        while (timeline.getVsyncTimeUs(vsyncIndex) <= trace.getDurationUs() + DRAIN_TIME_US) {
+            uint64_t vsyncTimeUs = timeline.getVsyncTimeUs(vsyncIndex);
+            simulation.advanceTo(vsyncTimeUs);
+
+            // Latch a frame for the next V-sync and render it right away,
+            // like the render thread would.
+            pacer.handleVsync((int)(timeline.getVsyncTimeUs(vsyncIndex + 1) - vsyncTimeUs));
+            pacer.renderOnMainThread();
+
+            // If that ran past any V-syncs, they're missed rather than caught up on
+            do {
+                vsyncIndex++;
+            } while (timeline.getVsyncTimeUs(vsyncIndex) < simulation.getTimeUs());
+        }
+
+        // Free the Pacer's frames before the pool goes away
+    }
+
+    result.presents = renderer.getPresents();
+    return result;
+}
+
+const char* getFrameDropPolicyName(StreamingPreferences::FrameDropPolicy policy)
+{
+    switch (policy) {
+    case StreamingPreferences::FDP_LOWEST_LATENCY:
+        return "lowest latency";
+    case StreamingPreferences::FDP_SMOOTHEST:
+        return "smoothest";
+    case StreamingPreferences::FDP_BALANCED:
+        return "balanced";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "streaming/video/ffmpeg-renderers/pacer/pacer.h"
+
+#include <vector>
+
+// Times that frames arrive from the decoder, relative to the first V-sync
+class FrameTrace
+{
+public:
+    // Frames arrive evenly at the given rate, offset from V-sync by the phase
+    static FrameTrace steady(double fps, int durationMs, int phaseUs);
+
+    // Like steady(), but each arrival is moved by up to jitterUs either way
+    // without reordering frames. The same seed always gives the same trace.
+    static FrameTrace jittery(double fps, int durationMs, int phaseUs, int jitterUs, unsigned int seed);
+
+    // Like steady(), but no frames arrive for stallMs starting at stallStartMs,
+    // then all of the delayed frames arrive at once.
+    static FrameTrace stalled(double fps, int durationMs, int phaseUs, int stallStartMs, int stallMs);
+
+    // Reads a trace file. Blank lines and lines starting with '#' are
+    // ignored. The first line must be "fps <stream frame rate>", followed by
+    // the arrival time of each frame in microseconds, one per line and in
+    // order. Arrival times may use any epoch, since they're shifted so that
+    // the first frame arrives at phaseUs.
+    static bool load(const char* path, int phaseUs, FrameTrace* trace);
+
+    // Writes the trace in the format that load() reads
+    bool save(const char* path) const;
+
+    int getFrameCount() const;
+
+    uint64_t getArrivalTimeUs(int frameIndex) const;
+
+    uint64_t getDurationUs() const;
+
+    double getFps() const;
+
+private:
+    FrameTrace(double fps);
+
+    double m_Fps;
+    std::vector<uint64_t> m_ArrivalTimesUs;
+};
+
+typedef struct _PRESENT_RECORD {
+    int64_t frameIndex;
+    uint64_t submitTimeUs;
+    uint64_t renderTimeUs;
+    int64_t vsyncIndex;
+} PRESENT_RECORD, *PPRESENT_RECORD;
+
+class PacerRunResult
+{
+public:
+    // Fraction of submitted frames that the Pacer dropped
+    double getDropRate() const;
+
+    // Time from submitFrame() until the frame was rendered, using the
+    // nearest-rank method so the result is always a measured delay
+    uint64_t getQueueDelayPercentileUs(double percentile) const;
+
+    // RMS difference in milliseconds between how long each frame stayed on
+    // screen and how much stream time it covered. A perfectly paced stream
+    // has none, even if it drops frames at a regular cadence.
+    double getJudderMs() const;
+
+    // V-syncs that repeated the previous frame
+    int getRepeatedVsyncs() const;
+
+    // Prints a one line summary of the run
+    void print(const char* name) const;
+
+    int submittedFrames;
+    double fps;
+    double vsyncPeriodUs;
+    VIDEO_STATS stats;
+    std::vector<PRESENT_RECORD> presents;
+};
+
+// Plays the frame trace into a Pacer in virtual time. V-syncs land exactly on
+// a display running at displayHz, starting at time 0, and each render takes
+// renderTimeUs. Nothing depends on the host's clock or scheduler, so a given
+// trace always produces the same result.
+PacerRunResult runPacerTrace(const FrameTrace& trace, double displayHz,
+                             StreamingPreferences::FrameDropPolicy policy,
+                             int renderTimeUs);
+
+const char* getFrameDropPolicyName(StreamingPreferences::FrameDropPolicy policy);
@@ -0,0 +1,27 @@
+include(../tests.pri)
+
+QT += testlib
+
+TARGET = pacertest
+
+# Adds a "make check" target that runs the tests
+CONFIG += testcase
+
+SOURCES += \
+    pacerharness.cpp \
+    tst_pacer.cpp \
+    $$APP_DIR/streaming/streamutils.cpp \
+    $$APP_DIR/streaming/video/framepool.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/pacer/pacer.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/pacer/framedroppolicy.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/pacer/softwarevsyncsource.cpp
+
+HEADERS += \
+    pacerharness.h
+
+win32 {
+    # The Pacer uses DxVsyncSource on Windows
+    SOURCES += $$APP_DIR/streaming/video/ffmpeg-renderers/pacer/dxvsyncsource.cpp
+    HEADERS += $$APP_DIR/streaming/video/ffmpeg-renderers/pacer/dxvsyncsource.h
+    LIBS += gdi32.lib user32.lib
+}
@@ -0,0 +1,357 @@
+#include <QtTest>
+
+#include "pacerharness.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// These replay frame arrival traces through the Pacer in virtual time, so
+// every run of a trace makes exactly the same decisions and the expected
+// drops, repeats and delays can be checked exactly. Unless a test says
+// otherwise, the display's V-syncs are at multiples of its period, frames
+// arrive 8 ms after a V-sync, and each render takes 1 ms. The Pacer learns
+// that render time within the first second, after which it latches frames
+// at the last whole millisecond before V-sync minus 2 ms.
+
+#define RENDER_TIME_US 1000
+
+static const StreamingPreferences::FrameDropPolicy k_Policies[] = {
+    StreamingPreferences::FDP_LOWEST_LATENCY,
+    StreamingPreferences::FDP_BALANCED,
+    StreamingPreferences::FDP_SMOOTHEST,
+};
+
+static PacerRunResult runAndPrint(const char* traceName, const FrameTrace& trace, double displayHz,
+                                  StreamingPreferences::FrameDropPolicy policy)
+{
+    PacerRunResult result = runPacerTrace(trace, displayHz, policy, RENDER_TIME_US);
+
+    std::string name = std::string(traceName) + " (" + getFrameDropPolicyName(policy) + ")";
+    result.print(name.c_str());
+
+    return result;
+}
+
+// Every frame is either shown once, in order, or counted as a drop
+static bool isConsistent(const PacerRunResult& result, const FrameTrace& trace)
+{
+    if (result.submittedFrames != trace.getFrameCount() ||
+            result.presents.size() + result.stats.pacerDroppedFrames != (size_t)result.submittedFrames) {
+        return false;
+    }
+
+    for (size_t i = 1; i < result.presents.size(); i++) {
+        if (result.presents[i].frameIndex <= result.presents[i - 1].frameIndex ||
+                result.presents[i].vsyncIndex <= result.presents[i - 1].vsyncIndex) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int getQueueDelayUs(const PacerRunResult& result, double percentile)
+{
+    return (int)result.getQueueDelayPercentileUs(percentile);
+}
+
+class TestPacer : public QObject
+{
+    Q_OBJECT
+
+private:
+    void addPolicyColumn()
+    {
+        QTest::addColumn<StreamingPreferences::FrameDropPolicy>("policy");
+        for (StreamingPreferences::FrameDropPolicy policy : k_Policies) {
+            QTest::newRow(getFrameDropPolicyName(policy)) << policy;
+        }
+    }
+
+private slots:
+    void initTestCase()
+    {
+        SDL_SetMainReady();
+
+        // Keep the Pacer's own logging out of the test output
+        SDL_LogSetAllPriority(SDL_LOG_PRIORITY_WARN);
+    }
+
+    void steadyStream_data()
+    {
+        addPolicyColumn();
+    }
+
+    // A steady stream at the refresh rate isn't dropped or delayed
+    void steadyStream()
+    {
+        QFETCH(StreamingPreferences::FrameDropPolicy, policy);
+
+        FrameTrace trace = FrameTrace::steady(60, 3000, 8000);
+        PacerRunResult result = runAndPrint("60 FPS on 60 Hz", trace, 60, policy);
+        QVERIFY(isConsistent(result, trace));
+
+        // Each frame is shown at the V-sync after it arrives
+        QCOMPARE((int)result.presents.size(), 180);
+        for (size_t i = 0; i < result.presents.size(); i++) {
+            QCOMPARE((qint64)result.presents[i].frameIndex, (qint64)i);
+            QCOMPARE((qint64)result.presents[i].vsyncIndex, (qint64)i + 1);
+        }
+        QVERIFY(qAbs(result.getJudderMs()) < 1e-9);
+
+        if (policy == StreamingPreferences::FDP_LOWEST_LATENCY) {
+            // Held until the deadline in case a newer frame arrives. That's
+            // at 13 ms with the initial 3 ms slack, and 14 ms once the Pacer
+            // has learned how fast the renderer is.
+            QCOMPARE(getQueueDelayUs(result, 0), 5000);
+            QCOMPARE(getQueueDelayUs(result, 50), 6000);
+            QCOMPARE(getQueueDelayUs(result, 100), 6000);
+        }
+        else {
+            // Latched as soon as it arrives
+            QCOMPARE(getQueueDelayUs(result, 100), 0);
+        }
+    }
+
+    // A stream at twice the refresh rate drops every other frame
+    void doubleRateStream()
+    {
+        // Frames arrive 4 ms and 12.3 ms after each V-sync
+        FrameTrace trace = FrameTrace::steady(120, 3000, 4000);
+
+        // Latching the newest frame shows the second frame of each pair, which
+        // is both fresher and evenly spaced.
+        PacerRunResult lowestLatency = runAndPrint("120 FPS on 60 Hz", trace, 60,
+                                                   StreamingPreferences::FDP_LOWEST_LATENCY);
+        QVERIFY(isConsistent(lowestLatency, trace));
+        QCOMPARE(lowestLatency.stats.latchDroppedFrames, 180u);
+        QCOMPARE(lowestLatency.stats.pacingQueueDroppedFrames, 0u);
+        for (const PRESENT_RECORD& present : lowestLatency.presents) {
+            QCOMPARE((int)(present.frameIndex % 2), 1);
+        }
+        QVERIFY(qAbs(lowestLatency.getJudderMs()) < 1e-9);
+        QCOMPARE(getQueueDelayUs(lowestLatency, 50), 1667);
+
+        // Balanced and Smoothest take the oldest frame, so a queue builds up
+        // until it reaches the lenient target of 3 frames and the excess is
+        // dropped at each V-sync. Balanced drops to its strict target of 1 once
+        // the queue has stayed above it for 500 ms, then shows each second frame
+        // at the V-sync after it arrives. Smoothest keeps 2 frames queued.
+        PacerRunResult balanced = runAndPrint("120 FPS on 60 Hz", trace, 60,
+                                              StreamingPreferences::FDP_BALANCED);
+        QVERIFY(isConsistent(balanced, trace));
+        QCOMPARE(balanced.stats.latchDroppedFrames, 0u);
+        QCOMPARE(balanced.stats.pacingQueueDroppedFrames, 179u);
+        QCOMPARE(getQueueDelayUs(balanced, 90), 21000);
+        QCOMPARE(getQueueDelayUs(balanced, 50), 4333);
+
+        PacerRunResult smoothest = runAndPrint("120 FPS on 60 Hz", trace, 60,
+                                               StreamingPreferences::FDP_SMOOTHEST);
+        QVERIFY(isConsistent(smoothest, trace));
+        QCOMPARE(smoothest.stats.latchDroppedFrames, 0u);
+        QCOMPARE(smoothest.stats.pacingQueueDroppedFrames, 178u);
+        QCOMPARE(getQueueDelayUs(smoothest, 50), 21000);
+    }
+
+    void slowStream_data()
+    {
+        addPolicyColumn();
+    }
+
+    // A 59.94 FPS stream on a 60 Hz display only repeats frames
+    void slowStream()
+    {
+        QFETCH(StreamingPreferences::FrameDropPolicy, policy);
+
+        // Each frame arrives 16.7 us later relative to V-sync than the one
+        // before. The first one misses its deadline after 6.6 s, and another one
+        // does every 16.7 s after that.
+        FrameTrace trace = FrameTrace::steady(59.94, 60000, 8000);
+        PacerRunResult result = runAndPrint("59.94 FPS on 60 Hz", trace, 60, policy);
+        QVERIFY(isConsistent(result, trace));
+
+        QCOMPARE(result.stats.pacerDroppedFrames, 0u);
+        QCOMPARE(result.getRepeatedVsyncs(), 4);
+    }
+
+    // A 60 FPS stream on a 59.94 Hz display drops a frame every 16.7 seconds
+    void fastStream()
+    {
+        // Each frame arrives 16.7 us earlier relative to V-sync than the one
+        // before. The first one arrives before the previous deadline after 10 s,
+        // and another one does every 16.7 s after that.
+        FrameTrace trace = FrameTrace::steady(60, 60000, 8000);
+
+        PacerRunResult lowestLatency = runAndPrint("60 FPS on 59.94 Hz", trace, 59.94,
+                                                   StreamingPreferences::FDP_LOWEST_LATENCY);
+        QVERIFY(isConsistent(lowestLatency, trace));
+        QCOMPARE(lowestLatency.stats.latchDroppedFrames, 3u);
+        QCOMPARE(lowestLatency.getRepeatedVsyncs(), 0);
+
+        PacerRunResult balanced = runAndPrint("60 FPS on 59.94 Hz", trace, 59.94,
+                                              StreamingPreferences::FDP_BALANCED);
+        QVERIFY(isConsistent(balanced, trace));
+        QCOMPARE(balanced.stats.pacingQueueDroppedFrames, 3u);
+        QCOMPARE(balanced.getRepeatedVsyncs(), 0);
+
+        // Smoothest lets the queue grow to 2 frames before it drops any, so
+        // the first two extra frames just add latency.
+        PacerRunResult smoothest = runAndPrint("60 FPS on 59.94 Hz", trace, 59.94,
+                                               StreamingPreferences::FDP_SMOOTHEST);
+        QVERIFY(isConsistent(smoothest, trace));
+        QCOMPARE(smoothest.stats.pacingQueueDroppedFrames, 1u);
+        QCOMPARE(smoothest.getRepeatedVsyncs(), 0);
+        QCOMPARE(getQueueDelayUs(smoothest, 100), 35360);
+    }
+
+    // Network jitter is absorbed by the queueing policies
+    void networkJitter()
+    {
+        // Frames stay in order but land anywhere in their V-sync period,
+        // so some miss the latch deadline and arrive with the next one.
+        FrameTrace trace = FrameTrace::jittery(60, 3000, 8000, 8000, 1234);
+
+        // Lowest Latency shows nothing new at the V-sync each late frame
+        // misses, then drops it in favor of the next one.
+        PacerRunResult lowestLatency = runAndPrint("60 FPS on 60 Hz with jitter", trace, 60,
+                                                   StreamingPreferences::FDP_LOWEST_LATENCY);
+        QVERIFY(isConsistent(lowestLatency, trace));
+        QCOMPARE(lowestLatency.stats.latchDroppedFrames, 22u);
+        QCOMPARE(lowestLatency.getRepeatedVsyncs(), 22);
+
+        // The queueing policies show the first late frame a V-sync late, which
+        // leaves a frame queued that covers for every later one.
+        for (StreamingPreferences::FrameDropPolicy policy : { StreamingPreferences::FDP_BALANCED,
+                                                               StreamingPreferences::FDP_SMOOTHEST }) {
+            PacerRunResult result = runAndPrint("60 FPS on 60 Hz with jitter", trace, 60, policy);
+            QVERIFY2(isConsistent(result, trace), getFrameDropPolicyName(policy));
+
+            QVERIFY2(result.stats.pacerDroppedFrames == 0, getFrameDropPolicyName(policy));
+            QVERIFY2(result.getRepeatedVsyncs() == 1, getFrameDropPolicyName(policy));
+            QVERIFY2(result.getJudderMs() < lowestLatency.getJudderMs(), getFrameDropPolicyName(policy));
+        }
+    }
+
+    // Each drop policy recovers from a burst differently
+    void burstRecovery()
+    {
+        // The network stalls for 40 ms, then delivers the two delayed frames
+        // along with the next one. That leaves a standing queue unless the
+        // Pacer drops the extra frames.
+        FrameTrace trace = FrameTrace::stalled(60, 3000, 8000, 500, 40);
+
+        // Lowest Latency shows nothing new for the two V-syncs of the stall,
+        // then drops the delayed frames and carries on as if nothing happened.
+        PacerRunResult lowestLatency = runAndPrint("60 FPS on 60 Hz with a burst", trace, 60,
+                                                   StreamingPreferences::FDP_LOWEST_LATENCY);
+        QVERIFY(isConsistent(lowestLatency, trace));
+        QCOMPARE(lowestLatency.stats.latchDroppedFrames, 2u);
+        QCOMPARE(lowestLatency.getRepeatedVsyncs(), 2);
+        QVERIFY(qAbs(lowestLatency.getJudderMs()) < 1e-9);
+        QCOMPARE(getQueueDelayUs(lowestLatency, 100), 6000);
+
+        // Balanced shows the burst in order, then catches up to a single queued
+        // frame once the queue has stayed long for half a second. That frame
+        // waits for the next V-sync, which costs 8.7 ms over the 0 ms before.
+        PacerRunResult balanced = runAndPrint("60 FPS on 60 Hz with a burst", trace, 60,
+                                              StreamingPreferences::FDP_BALANCED);
+        QVERIFY(isConsistent(balanced, trace));
+        QVERIFY(!balanced.presents.empty());
+        QCOMPARE(balanced.stats.latchDroppedFrames, 0u);
+        QCOMPARE(balanced.stats.pacingQueueDroppedFrames, 1u);
+        QCOMPARE((int)(balanced.presents.front().renderTimeUs - balanced.presents.front().submitTimeUs), 0);
+        QCOMPARE((int)(balanced.presents.back().renderTimeUs - balanced.presents.back().submitTimeUs), 8667);
+
+        // Smoothest never drops a queue this short, so the burst's latency stays
+        PacerRunResult smoothest = runAndPrint("60 FPS on 60 Hz with a burst", trace, 60,
+                                               StreamingPreferences::FDP_SMOOTHEST);
+        QVERIFY(isConsistent(smoothest, trace));
+        QVERIFY(!smoothest.presents.empty());
+        QCOMPARE(smoothest.stats.pacerDroppedFrames, 0u);
+        QCOMPARE((int)(smoothest.presents.back().renderTimeUs - smoothest.presents.back().submitTimeUs), 25334);
+    }
+
+    // A saved trace loads back as the same arrival times, and
+    // replaying it gives the same result every time
+    void savedTraceReplay()
+    {
+        const char* path = "pacertest-trace.txt";
+        FrameTrace generated = FrameTrace::jittery(60, 1000, 8000, 8000, 5678);
+        QVERIFY(generated.save(path));
+
+        // Times in a trace file have an arbitrary epoch, so they're moved to the phase
+        FrameTrace loaded = FrameTrace::steady(60, 0, 0);
+        bool ok = FrameTrace::load(path, 1000, &loaded);
+        remove(path);
+        QVERIFY(ok);
+
+        QCOMPARE(loaded.getFrameCount(), generated.getFrameCount());
+        QCOMPARE(loaded.getFps(), 60.0);
+        for (int i = 0; i < loaded.getFrameCount(); i++) {
+            QCOMPARE((quint64)loaded.getArrivalTimeUs(i),
+                     (quint64)(generated.getArrivalTimeUs(i) - generated.getArrivalTimeUs(0) + 1000));
+        }
+
+        // Unlike a real-time replay, the same trace gives the same result every time
+        PacerRunResult first = runPacerTrace(loaded, 60, StreamingPreferences::FDP_BALANCED, RENDER_TIME_US);
+        PacerRunResult second = runPacerTrace(loaded, 60, StreamingPreferences::FDP_BALANCED, RENDER_TIME_US);
+        QCOMPARE((int)first.presents.size(), (int)second.presents.size());
+        for (size_t i = 0; i < first.presents.size(); i++) {
+            QCOMPARE((qint64)first.presents[i].frameIndex, (qint64)second.presents[i].frameIndex);
+            QCOMPARE((quint64)first.presents[i].renderTimeUs, (quint64)second.presents[i].renderTimeUs);
+            QCOMPARE((qint64)first.presents[i].vsyncIndex, (qint64)second.presents[i].vsyncIndex);
+        }
+    }
+
+    void malformedTrace_data()
+    {
+        QTest::addColumn<QByteArray>("contents");
+
+        QTest::newRow("no frame rate") << QByteArray("1000\n2000\n");
+        QTest::newRow("out of order") << QByteArray("fps 60\n2000\n1000\n");
+        QTest::newRow("trailing garbage") << QByteArray("fps 60\n1000\n2000ms\n");
+        QTest::newRow("no frames") << QByteArray("# Nothing but a comment\n");
+    }
+
+    void malformedTrace()
+    {
+        QFETCH(QByteArray, contents);
+
+        const char* path = "pacertest-bad-trace.txt";
+        FILE* file = fopen(path, "w");
+        QVERIFY(file != nullptr);
+        fputs(contents.constData(), file);
+        fclose(file);
+
+        FrameTrace trace = FrameTrace::steady(60, 0, 0);
+        bool ok = FrameTrace::load(path, 0, &trace);
+        remove(path);
+        QVERIFY(!ok);
+    }
+
+    // Replays a trace file written in the format that FrameTrace::load() reads
+    // against each drop policy, such as:
+    // PACER_REPLAY_TRACE=trace.txt PACER_REPLAY_HZ=120 pacertest replayTrace
+    void replayTrace()
+    {
+        const char* path = getenv("PACER_REPLAY_TRACE");
+        if (path == nullptr) {
+            QSKIP("PACER_REPLAY_TRACE is not set");
+        }
+
+        const char* displayHz = getenv("PACER_REPLAY_HZ");
+
+        FrameTrace trace = FrameTrace::steady(60, 0, 0);
+        QVERIFY(FrameTrace::load(path, 8000, &trace));
+
+        for (StreamingPreferences::FrameDropPolicy policy : k_Policies) {
+            PacerRunResult result = runAndPrint(path, trace, displayHz != nullptr ? atof(displayHz) : 60, policy);
+            QVERIFY2(isConsistent(result, trace), getFrameDropPolicyName(policy));
+        }
+    }
+};
+
+QTEST_APPLESS_MAIN(TestPacer)
+
+#include "tst_pacer.moc"
@@ -0,0 +1,59 @@
+# Common settings for the unit tests and benchmarks. These build the app
+# sources they exercise directly rather than linking against the app.
+# The video headers pull in StreamingPreferences, which includes QQmlEngine
+QT = core qml
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+include(../globaldefs.pri)
+
+TEMPLATE = app
+
+APP_DIR = $$PWD/../app
+
+INCLUDEPATH += \
+    $$APP_DIR \
+    $$PWD/../moonlight-common-c/moonlight-common-c/src
+
+# SDL must not replace our main() with its own
+DEFINES += SDL_MAIN_HANDLED
+
+win32 {
+    contains(QT_ARCH, i386) {
+        LIBS += -L$$PWD/../libs/windows/lib/x86
+        INCLUDEPATH += $$PWD/../libs/windows/include/x86
+    }
+    contains(QT_ARCH, x86_64) {
+        LIBS += -L$$PWD/../libs/windows/lib/x64
+        INCLUDEPATH += $$PWD/../libs/windows/include/x64
+    }
+    contains(QT_ARCH, arm64) {
+        LIBS += -L$$PWD/../libs/windows/lib/arm64
+        INCLUDEPATH += $$PWD/../libs/windows/include/arm64
+    }
+
+    INCLUDEPATH += $$PWD/../libs/windows/include
+    LIBS += -lSDL2 -lSDL2_ttf -lavcodec -lavutil
+
+    # Work around a conflict with math.h inclusion between SDL and Qt 6
+    DEFINES += _USE_MATH_DEFINES
+}
+macx:!disable-prebuilts {
+    INCLUDEPATH += $$PWD/../libs/mac/include
+    INCLUDEPATH += $$PWD/../libs/mac/Frameworks/SDL2.framework/Versions/A/Headers
+    INCLUDEPATH += $$PWD/../libs/mac/Frameworks/SDL2_ttf.framework/Versions/A/Headers
+    LIBS += -L$$PWD/../libs/mac/lib -F$$PWD/../libs/mac/Frameworks
+    LIBS += -lavcodec.61 -lavutil.59 -framework SDL2 -framework SDL2_ttf
+    QMAKE_RPATHDIR += $$PWD/../libs/mac/lib $$PWD/../libs/mac/Frameworks
+
+    # QMake doesn't handle framework-style includes correctly on its own
+    QMAKE_CXXFLAGS += -F$$PWD/../libs/mac/Frameworks
+}
+macx {
+    # For the display APIs in streamutils.cpp
+    LIBS += -framework ApplicationServices
+}
+unix:if(!macx|disable-prebuilts) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += sdl2 SDL2_ttf libavcodec libavutil
+}